@@ -22,7 +22,14 @@
  */
 /*******************************************************************************/
 #include <stdio.h>
+#include <math.h>
 #include "simlib.h"
+#include "statistics.h"
+#include "rare_event.h"
+#include "likelihood_ratio.h"
+#include "standard_clock.h"
+#include "result_cache.h"
+#include "adaptive_grid.h"
 
 /* ===== NEW: toggle service-time model =====
  * 0 => M/D/1 (deterministic service time = SERVICE_TIME)
@@ -46,6 +53,58 @@
 /* NEW */
 #define MAX_QUEUE_SIZE 50  
 
+/* ===== NEW: rare event estimation of the rejection probability =====
+ * 0 => ordinary simulation runs (below)
+ * 1 => importance sampling and multilevel splitting (M/M/1/K only)
+ */
+#define RARE_EVENT_MODE 0
+#define RARE_EVENT_CYCLES 100000    /* regeneration cycles for importance sampling */
+#define SPLITTING_LEVEL_STEP 0      /* customers between splitting levels (0: automatic) */
+#define SPLITTING_EFFORT 100000     /* trajectories started per level */
+
+/* ===== NEW: likelihood ratio reweighting =====
+ * 0 => ordinary simulation runs (below)
+ * 1 => simulate once at each rate and reweight the sample path to the nearby
+ *      arrival rates and mean service times below. Points whose relative
+ *      effective sample size drops below LR_MIN_RELATIVE_ESS are simulated
+ *      directly instead.
+ */
+#define LR_REWEIGHT_MODE 0
+#define LR_ARRIVAL_RATE_OFFSETS -0.01, -0.005, 0.005, 0.01
+#define LR_SERVICE_TIME_OFFSETS -1.0, 1.0   /* M/M/1 only */
+#define LR_MIN_RELATIVE_ESS 0.1
+
+/* ===== NEW: standard clock =====
+ * 0 => ordinary simulation runs (below)
+ * 1 => all arrival rates are simulated together in one uniformized pass per
+ *      seed, driven by a common stream of epochs (M/M/1/K only)
+ */
+#define STANDARD_CLOCK_MODE 0
+#define STANDARD_CLOCK_EPOCHS 1e8
+
+/* ===== NEW: result cache =====
+ * 0 => every run is simulated
+ * 1 => the results of each (rate, seed) run are kept in RESULT_CACHE_DIR,
+ *      keyed by the build of this program and all the run's inputs, and
+ *      reused when the program is run again. An interrupted sweep resumes
+ *      where it stopped, and adding a rate only simulates the new runs.
+ */
+#define RESULT_CACHE_MODE 0
+#define RESULT_CACHE_DIR "result_cache"
+
+/* ===== NEW: adaptive grid refinement =====
+ * 0 => ordinary simulation runs (below)
+ * 1 => the mean delay curve is refined over the arrival rates from the first
+ *      to the last of the rate list, starting from ADAPTIVE_GRID_INITIAL_POINTS
+ *      rates, adding rates where it is steep and seeds where it is noisy
+ *      until its relative error is within ADAPTIVE_GRID_TOLERANCE or
+ *      ADAPTIVE_GRID_BUDGET runs are spent (see adaptive_grid.h)
+ */
+#define ADAPTIVE_GRID_MODE 0
+#define ADAPTIVE_GRID_INITIAL_POINTS 5
+#define ADAPTIVE_GRID_BUDGET 200       /* runs */
+#define ADAPTIVE_GRID_TOLERANCE 0.02
+
 /*******************************************************************************/
 
 typedef struct {
@@ -58,21 +117,104 @@ typedef struct {
   double clock_time;
   double rejection_probability;
   long int rejected_customers;
+  double probability_full;       /* time average P(N = K), equal to the
+                                    rejection probability by PASTA */
+  Running_Stat delays;           /* of the customers served */
+  double mean_interarrival_time; /* sample means of the inputs, used as */
+  double mean_service_time;      /* control variates */
+  /* NEW: IPA sensitivities with respect to the service rate (mu) and the
+     arrival rate (lambda). */
+  double d_mean_delay_d_mu;
+  double d_mean_delay_d_lambda;
+  double d_mean_number_d_mu;
+  double d_mean_number_d_lambda;
 } Results;
 
 /* ===== NEW: helper to draw a service time according to the selected model ===== */
-static inline double draw_service_time(void) {
+static inline double draw_service_time(double service_time) {
 #if SERVICE_DIST_MM1
-  /* M/M/1: exponential with mean = SERVICE_TIME */
-  return exponential_generator((double) SERVICE_TIME);
+  /* M/M/1: exponential with mean = service_time */
+  return exponential_generator(service_time);
 #else
   /* M/D/1: deterministic service time */
-  return (double) SERVICE_TIME;
+  return service_time;
 #endif
 }
 
-/* Run one simulation for a given arrival rate, seed, and verbosity. */
-static Results run_one(double arrival_rate, unsigned seed, int verbose)
+/* ===== NEW: live metrics =====
+ * With SIMLIB_METRICS set, each run publishes its counts, its delay and its
+ * progress on the metrics page of the process (see metrics.h), every
+ * BLIP_RATE customers served. The loop below does not go through the event
+ * list, so the simulation_run only holds the page, and the events and the
+ * simulation time are published here too.
+ */
+typedef enum {
+  RUN_METRICS_ARRIVALS,
+  RUN_METRICS_SERVED,
+  RUN_METRICS_REJECTED
+} Run_Metrics_Counter;
+
+typedef enum {
+  RUN_METRICS_DELAY
+} Run_Metrics_Estimate;
+
+static Simulation_Run_Ptr run_metrics_start(double arrival_rate,
+                                            double service_time)
+{
+  Simulation_Run_Ptr simulation_run;
+  char label[128];  /* cut to METRICS_LABEL_SIZE on the page */
+
+  if (getenv("SIMLIB_METRICS") == NULL) return NULL;
+  simulation_run = simulation_run_new();
+  if (simulation_run->metrics == NULL) {
+    simulation_run_free_memory(simulation_run);
+    return NULL;
+  }
+
+  sprintf(label, "M/%s/1/%d, arrival rate %g, service %g",
+          SERVICE_DIST_MM1 ? "M" : "D", MAX_QUEUE_SIZE + 1, arrival_rate,
+          service_time);
+  simulation_run_metrics_label(simulation_run, label);
+  simulation_run_metrics_counter(simulation_run, "arrivals");
+  simulation_run_metrics_counter(simulation_run, "customers served");
+  simulation_run_metrics_counter(simulation_run, "rejected customers");
+  simulation_run_metrics_estimate(simulation_run, "delay");
+  return simulation_run;
+}
+
+static void run_metrics_publish(Simulation_Run_Ptr simulation_run,
+                                double clock, long int total_arrived,
+                                long int total_served,
+                                long int rejected_customers,
+                                const Running_Stat *delays)
+{
+  if (simulation_run == NULL) return;
+
+  METRICS_STORE(simulation_run->metrics->events,
+                (long long) (total_arrived + total_served));
+  METRICS_STORE(simulation_run->metrics->simulation_time, clock);
+  SIMULATION_RUN_METRICS_PROGRESS(simulation_run,
+                                  total_served / NUMBER_TO_SERVE);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, RUN_METRICS_ARRIVALS,
+                                 total_arrived);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, RUN_METRICS_SERVED,
+                                 total_served);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, RUN_METRICS_REJECTED,
+                                 rejected_customers);
+
+  /* The running statistic gives the sums back from the mean and m2. */
+  SIMULATION_RUN_METRICS_ESTIMATE(simulation_run, RUN_METRICS_DELAY,
+                                  delays->count, delays->count * delays->mean,
+                                  delays->m2 + delays->count * delays->mean *
+                                  delays->mean);
+}
+
+/* Run one simulation for a given arrival rate, mean service time, seed, and
+ * verbosity. If lr is not NULL the likelihood ratios of the sample path are
+ * accumulated over regeneration cycles, each starting with an arrival to an
+ * empty system, for reweighting to nearby parameter points. */
+static Results run_one(double arrival_rate, double service_time, unsigned seed,
+                       int verbose, Likelihood_Ratio_Ptr lr)
 {
   Results r;
 
@@ -93,21 +235,71 @@ static Results run_one(double arrival_rate, unsigned seed, int verbose)
   long int rejected_customers = 0;
 
   double total_busy_time = 0;
-  double integral_of_n = 0;
-  double last_event_time = 0;
 
+  /* Time average number in system and its distribution P(N = n). There is
+     no simulation_run here, so the times are passed explicitly. */
+  Time_Weighted_Stat_Ptr number_in_system_stat = time_weighted_stat_new(NULL);
+
+  /* Sums of the sampled inputs (for the control variates). */
+  double sum_of_interarrival_times = 0;
+  double sum_of_service_times = 0;
+  long int service_times_drawn = 0;
+  double interarrival_time;
+
+  /* ===== NEW: infinitesimal perturbation analysis =====
+   * The derivatives of each event time with respect to the mean service time
+   * (theta) and the arrival rate (lambda) are carried along the sample path.
+   * Arrival times scale as 1/lambda, so dA/dlambda = -A/lambda, and service
+   * times scale with theta, so dS/dtheta = S/theta. A service starts either
+   * at the customer's arrival or at the previous departure, and inherits
+   * that time's derivative. The FIFO arrival times of the customers in the
+   * system are kept in a small ring buffer. Note that with a finite buffer,
+   * perturbations can change which customers are rejected, so the estimates
+   * are only unbiased when rejections are rare. */
+  double arrival_times[MAX_QUEUE_SIZE + 1];
+  int oldest_arrival = 0;
+  double d_departure_d_theta = 0, d_departure_d_lambda = 0;
+  double sum_d_delay_d_theta = 0, sum_d_delay_d_lambda = 0;
+  double arrival_time, delay;
+  Running_Stat delays;
+
+  /* Regeneration cycle bookkeeping for the likelihood ratios. */
+  double cycle_start_time = 0, cycle_start_integral = 0;
+  long int cycle_start_served = 0;
+  double cycle_values[3];
+
+  Simulation_Run_Ptr metrics_run;
+
+  running_stat_reset(&delays);
   random_generator_initialize(seed);
+  metrics_run = run_metrics_start(arrival_rate, service_time);
 
   while (total_served < NUMBER_TO_SERVE) {
 
     if (number_in_system == 0 || next_arrival_time < next_departure_time) {
       /* Arrival */
       clock = next_arrival_time;
-      next_arrival_time = clock + exponential_generator((double) (1.0/arrival_rate));
 
-      /* Stats update */
-      integral_of_n += number_in_system * (clock - last_event_time);
-      last_event_time = clock;
+      /* An arrival to an empty system ends a regeneration cycle. Its totals
+         are the time integral of the number in system (i.e., the sum of the
+         delays), the number served and the cycle length. */
+      if (lr != NULL && number_in_system == 0) {
+        if (total_arrived > 0) {
+          time_weighted_stat_advance(number_in_system_stat, clock);
+          cycle_values[0] = number_in_system_stat->integral - cycle_start_integral;
+          cycle_values[1] = (double) (total_served - cycle_start_served);
+          cycle_values[2] = clock - cycle_start_time;
+          likelihood_ratio_end_cycle(lr, cycle_values);
+        }
+        cycle_start_time = clock;
+        cycle_start_integral = number_in_system_stat->integral;
+        cycle_start_served = total_served;
+      }
+
+      interarrival_time = exponential_generator((double) (1.0/arrival_rate));
+      sum_of_interarrival_times += interarrival_time;
+      next_arrival_time = clock + interarrival_time;
+      if (lr != NULL) likelihood_ratio_interarrival(lr, interarrival_time);
 
       // Check if queue is full (number_in_system includes customer in service)
       if (number_in_system >= MAX_QUEUE_SIZE + 1) {
@@ -116,13 +308,23 @@ static Results run_one(double arrival_rate, unsigned seed, int verbose)
         total_arrived++;
         // Do NOT increment number_in_system, do NOT start service
       } else {
+        arrival_times[(oldest_arrival + number_in_system) % (MAX_QUEUE_SIZE + 1)] = clock;
         number_in_system++;
         total_arrived++;
+        time_weighted_stat_set_at(number_in_system_stat, clock, number_in_system);
 
         /* If the system was idle, start service immediately. */
         if (number_in_system == 1) {
-          current_service_time = draw_service_time();
+          current_service_time = draw_service_time(service_time);
+          sum_of_service_times += current_service_time;
+          service_times_drawn++;
           next_departure_time = clock + current_service_time;
+          if (lr != NULL && SERVICE_DIST_MM1)
+            likelihood_ratio_service(lr, current_service_time);
+
+          /* IPA: the service starts at this arrival. */
+          d_departure_d_theta = current_service_time/service_time;
+          d_departure_d_lambda = -clock/arrival_rate;
         }
       }
 
@@ -130,43 +332,356 @@ static Results run_one(double arrival_rate, unsigned seed, int verbose)
       /* Departure */
       clock = next_departure_time;
 
-      /* Stats update */
-      integral_of_n += number_in_system * (clock - last_event_time);
-      last_event_time = clock;
-
       number_in_system--;
+      time_weighted_stat_set_at(number_in_system_stat, clock, number_in_system);
       total_served++;
 
+      /* IPA: delay = departure time - arrival time of the oldest customer. */
+      arrival_time = arrival_times[oldest_arrival];
+      oldest_arrival = (oldest_arrival + 1) % (MAX_QUEUE_SIZE + 1);
+      sum_d_delay_d_theta += d_departure_d_theta;
+      sum_d_delay_d_lambda += d_departure_d_lambda + arrival_time/arrival_rate;
+      running_stat_add(&delays, clock - arrival_time);
+
       /* ===== CHANGED: busy time is the actual service duration ===== */
       total_busy_time += current_service_time;
 
       if (number_in_system > 0) {
         /* Start next job immediately, draw a fresh service time */
-        current_service_time = draw_service_time();               /* NEW */
+        current_service_time = draw_service_time(service_time);   /* NEW */
+        sum_of_service_times += current_service_time;
+        service_times_drawn++;
         next_departure_time = clock + current_service_time;       /* CHANGED */
+        if (lr != NULL && SERVICE_DIST_MM1)
+          likelihood_ratio_service(lr, current_service_time);
+
+        /* IPA: the service starts at the departure just processed. */
+        d_departure_d_theta += current_service_time/service_time;
       } else {
         /* Idle */
         current_service_time = 0.0;                               /* NEW (optional) */
       }
 
-      if (verbose && total_served % BLIP_RATE == 0)
-        printf("Customers served = %ld (Total arrived = %ld)\r", total_served, total_arrived);
+      if (total_served % BLIP_RATE == 0) {
+        if (verbose)
+          printf("Customers served = %ld (Total arrived = %ld)\r", total_served, total_arrived);
+        run_metrics_publish(metrics_run, clock, total_arrived, total_served,
+                            rejected_customers, &delays);
+      }
     }
   }
 
+  if (metrics_run != NULL) {
+    run_metrics_publish(metrics_run, clock, total_arrived, total_served,
+                        rejected_customers, &delays);
+    simulation_run_free_memory(metrics_run);
+  }
+
   /* Results */
+  time_weighted_stat_advance(number_in_system_stat, clock);
   r.utilization = total_busy_time/clock;
   r.fraction_served = (double) total_served/total_arrived;
-  r.mean_number_in_system = integral_of_n/clock;
-  r.mean_delay = integral_of_n/total_served; /* Little’s law-based estimator of total time in system */
+  r.mean_number_in_system = time_weighted_stat_mean(number_in_system_stat);
+  r.mean_delay = number_in_system_stat->integral/total_served; /* Little’s law-based estimator of total time in system */
   r.total_served = total_served;
   r.total_arrived = total_arrived;
   r.clock_time = clock;
   r.rejection_probability = (double) rejected_customers / (double) total_arrived;
   r.rejected_customers = rejected_customers;
+  r.probability_full = time_weighted_stat_probability(number_in_system_stat,
+                                                      MAX_QUEUE_SIZE + 1);
+  r.mean_interarrival_time = sum_of_interarrival_times/total_arrived;
+  r.mean_service_time = sum_of_service_times/service_times_drawn;
+  r.delays = delays;
+
+  /* IPA results. Since mu = 1/theta, d/dmu = -theta^2 d/dtheta. The mean
+     number in system follows from Little's law, L = lambda W. */
+  delay = r.mean_delay;
+  r.d_mean_delay_d_mu = -service_time * service_time * sum_d_delay_d_theta/total_served;
+  r.d_mean_delay_d_lambda = sum_d_delay_d_lambda/total_served;
+  r.d_mean_number_d_mu = arrival_rate * r.d_mean_delay_d_mu;
+  r.d_mean_number_d_lambda = delay + arrival_rate * r.d_mean_delay_d_lambda;
+
+  time_weighted_stat_free(number_in_system_stat);
   return r;
 }
 
+/* The Results fields kept in the result cache, in order. */
+#define RESULTS_CACHED 21
+
+static void results_to_values(const Results *r, double *v)
+{
+  double fields[RESULTS_CACHED] = {
+    r->utilization, r->fraction_served, r->mean_number_in_system,
+    r->mean_delay, (double) r->total_served, (double) r->total_arrived,
+    r->clock_time, r->rejection_probability, (double) r->rejected_customers,
+    r->probability_full, (double) r->delays.count, r->delays.mean,
+    r->delays.m2, r->delays.min, r->delays.max, r->mean_interarrival_time,
+    r->mean_service_time, r->d_mean_delay_d_mu, r->d_mean_delay_d_lambda,
+    r->d_mean_number_d_mu, r->d_mean_number_d_lambda
+  };
+  int i;
+
+  for (i = 0; i < RESULTS_CACHED; i++) v[i] = fields[i];
+}
+
+static void values_to_results(const double *v, Results *r)
+{
+  r->utilization = v[0];
+  r->fraction_served = v[1];
+  r->mean_number_in_system = v[2];
+  r->mean_delay = v[3];
+  r->total_served = (long int) v[4];
+  r->total_arrived = (long int) v[5];
+  r->clock_time = v[6];
+  r->rejection_probability = v[7];
+  r->rejected_customers = (long int) v[8];
+  r->probability_full = v[9];
+  r->delays.count = (long int) v[10];
+  r->delays.mean = v[11];
+  r->delays.m2 = v[12];
+  r->delays.min = v[13];
+  r->delays.max = v[14];
+  r->mean_interarrival_time = v[15];
+  r->mean_service_time = v[16];
+  r->d_mean_delay_d_mu = v[17];
+  r->d_mean_delay_d_lambda = v[18];
+  r->d_mean_number_d_mu = v[19];
+  r->d_mean_number_d_lambda = v[20];
+}
+
+/* Run one simulation quietly, or reuse its results from the cache if it is
+ * not NULL. The key holds every input that changes the results. */
+static Results cached_run_one(Result_Cache_Ptr cache, double arrival_rate,
+                              double service_time, unsigned seed)
+{
+  Results r;
+  double v[RESULTS_CACHED];
+
+  if (cache == NULL)
+    return run_one(arrival_rate, service_time, seed, 0, NULL);
+
+  result_cache_start_key(cache);
+  result_cache_add_key(cache, "service_dist_mm1", SERVICE_DIST_MM1);
+  result_cache_add_key(cache, "max_queue_size", MAX_QUEUE_SIZE);
+  result_cache_add_key(cache, "arrival_rate", arrival_rate);
+  result_cache_add_key(cache, "service_time", service_time);
+  result_cache_add_key(cache, "seed", seed);
+  result_cache_add_key(cache, "number_to_serve", NUMBER_TO_SERVE);
+
+  if (result_cache_load(cache, v, RESULTS_CACHED)) {
+    values_to_results(v, &r);
+    return r;
+  }
+
+  r = run_one(arrival_rate, service_time, seed, 0, NULL);
+  results_to_values(&r, v);
+  result_cache_store(cache, v, RESULTS_CACHED);
+  return r;
+}
+
+/* ===== NEW: rejection probabilities that are far too rare to observe in an
+ * ordinary run. Each rate is estimated by importance sampling and by
+ * splitting and compared against the exact M/M/1/K value. ===== */
+#if RARE_EVENT_MODE && SERVICE_DIST_MM1
+static void rare_event_rejection_probabilities(const double *rates, int nrates)
+{
+  int i;
+  Birth_Death_Queue queue;
+  Rare_Event_Estimate is, split;
+
+  printf("arrival_rate\texact\tis_estimate\tis_relative_error\tis_transitions\tsplitting_estimate\tsplitting_relative_error\tsplitting_transitions\n");
+
+  for (i = 0; i < nrates; i++) {
+    queue.arrival_rate = rates[i];
+    queue.service_rate = 1.0/SERVICE_TIME;
+    queue.servers = 1;
+    queue.capacity = MAX_QUEUE_SIZE + 1;
+
+    random_generator_initialize(RANDOM_SEED);
+    rare_event_importance_sampling(&queue, RARE_EVENT_CYCLES, &is);
+    random_generator_initialize(RANDOM_SEED);
+    rare_event_splitting(&queue, SPLITTING_LEVEL_STEP, SPLITTING_EFFORT, &split);
+
+    printf("%.5f\t%.6e\t%.6e\t%.4f\t%ld\t%.6e\t%.4f\t%ld\n",
+           rates[i], rare_event_exact_blocking(&queue),
+           is.probability, is.relative_error, is.transitions,
+           split.probability, split.relative_error, split.transitions);
+  }
+}
+#endif
+
+/* ===== NEW: simulate once at each rate and reweight the sample path to the
+ * nearby parameter points. Each estimate is printed with its confidence
+ * interval and relative effective sample size. Points where the latter has
+ * collapsed are simulated directly instead. ===== */
+#if LR_REWEIGHT_MODE
+static void likelihood_ratio_reweighted_sweep(const double *rates, int nrates,
+                                              unsigned seed)
+{
+  const double rate_offsets[] = {LR_ARRIVAL_RATE_OFFSETS};
+  const double service_offsets[] = {LR_SERVICE_TIME_OFFSETS};
+  const int NRATE_OFFSETS = (int)(sizeof(rate_offsets)/sizeof(rate_offsets[0]));
+  const int NSERVICE_OFFSETS = SERVICE_DIST_MM1 ?
+    (int)(sizeof(service_offsets)/sizeof(service_offsets[0])) : 0;
+  int i, j, n;
+  Likelihood_Ratio_Ptr lr;
+  Likelihood_Ratio_Target_Ptr target;
+  Likelihood_Ratio_Estimate delay, number;
+  Results r;
+
+  printf("base_arrival_rate\tarrival_rate\tservice_time\tsource\tmean_delay\tmean_delay_half_width\tmean_number_in_system\tmean_number_half_width\trelative_ess\n");
+
+  for (i = 0; i < nrates; i++) {
+    lr = likelihood_ratio_new(rates[i], SERVICE_TIME, 3);
+
+    likelihood_ratio_add_target(lr, rates[i], SERVICE_TIME);
+    for (j = 0; j < NRATE_OFFSETS; j++)
+      if (rates[i] + rate_offsets[j] > 0)
+        likelihood_ratio_add_target(lr, rates[i] + rate_offsets[j], SERVICE_TIME);
+    for (j = 0; j < NSERVICE_OFFSETS; j++)
+      if (SERVICE_TIME + service_offsets[j] > 0)
+        likelihood_ratio_add_target(lr, rates[i], SERVICE_TIME + service_offsets[j]);
+
+    run_one(rates[i], SERVICE_TIME, seed, 0, lr);
+
+    for (n = 0; n < lr->number_of_targets; n++) {
+      target = lr->targets + n;
+      likelihood_ratio_estimate(lr, n, 0, 1, &delay);
+      likelihood_ratio_estimate(lr, n, 0, 2, &number);
+
+      if (delay.relative_ess >= LR_MIN_RELATIVE_ESS) {
+        printf("%.5f\t%.5f\t%.5f\treweighted\t%.10f\t%.10f\t%.10f\t%.10f\t%.6f\n",
+               rates[i], target->arrival_rate, target->service_time,
+               delay.mean, delay.half_width, number.mean, number.half_width,
+               delay.relative_ess);
+      } else {
+        r = run_one(target->arrival_rate, target->service_time, seed, 0, NULL);
+        printf("%.5f\t%.5f\t%.5f\tsimulated\t%.10f\t\t%.10f\t\t%.6f\n",
+               rates[i], target->arrival_rate, target->service_time,
+               r.mean_delay, r.mean_number_in_system, delay.relative_ess);
+      }
+    }
+    likelihood_ratio_free(lr);
+    fflush(stdout);
+    fprintf(stderr, "Completed base arrival_rate=%.5f\n", rates[i]);
+  }
+}
+#endif
+
+/* ===== NEW: one standard clock pass per seed covers every arrival rate. The
+ * rates share the epochs and marks, i.e., common random numbers. ===== */
+#if STANDARD_CLOCK_MODE && SERVICE_DIST_MM1
+static void standard_clock_sweep(const double *rates, int nrates,
+                                 const unsigned *seeds, int nseeds)
+{
+  int i, s;
+  Standard_Clock_Ptr sc;
+  Standard_Clock_Results r;
+
+  printf("arrival_rate\tseed\tutilization\tmean_number_in_system\tmean_delay\trejection_probability\n");
+
+  for (s = 0; s < nseeds; s++) {
+    sc = standard_clock_new();
+    for (i = 0; i < nrates; i++)
+      standard_clock_add_variant(sc, rates[i], 1.0/SERVICE_TIME, 1,
+                                 MAX_QUEUE_SIZE + 1);
+
+    random_generator_initialize(seeds[s]);
+    standard_clock_run(sc, (long int) STANDARD_CLOCK_EPOCHS);
+
+    for (i = 0; i < nrates; i++) {
+      standard_clock_results(sc, i, &r);
+      printf("%.5f\t%u\t%.10f\t%.10f\t%.10f\t%.10f\n", rates[i], seeds[s],
+             r.utilization, r.mean_number_in_system, r.mean_delay,
+             r.blocking_probability);
+    }
+    standard_clock_free(sc);
+    fprintf(stderr, "Completed seed=%u\n", seeds[s]);
+  }
+}
+#endif
+
+/* ===== NEW: refine the mean delay curve where it is steep or noisy. Run k
+ * of every rate uses the k-th seed (offsets of them past the end of the
+ * list), so neighbouring rates share their random numbers. ===== */
+#if ADAPTIVE_GRID_MODE
+typedef struct {
+  Result_Cache_Ptr cache;
+  const unsigned *seeds;
+  int nseeds;
+} Adaptive_Grid_Runs;
+
+static double adaptive_grid_mean_delay(double arrival_rate, int replication,
+                                       void *argument)
+{
+  Adaptive_Grid_Runs *runs = (Adaptive_Grid_Runs *) argument;
+  unsigned seed = runs->seeds[replication % runs->nseeds] +
+    replication / runs->nseeds;
+
+  return cached_run_one(runs->cache, arrival_rate, SERVICE_TIME, seed).mean_delay;
+}
+
+static void adaptive_grid_sweep(double low, double high,
+                                const unsigned *seeds, int nseeds)
+{
+  int i;
+  Adaptive_Grid_Runs runs;
+  Adaptive_Grid_Ptr grid;
+  Adaptive_Grid_Point_Ptr p;
+
+  runs.cache = NULL;
+#if RESULT_CACHE_MODE
+  runs.cache = result_cache_new(RESULT_CACHE_DIR, "lab1_single_server_queue");
+#endif
+  runs.seeds = seeds;
+  runs.nseeds = nseeds;
+
+  grid = adaptive_grid_new(low, high, ADAPTIVE_GRID_INITIAL_POINTS,
+                           ADAPTIVE_GRID_BUDGET, ADAPTIVE_GRID_TOLERANCE);
+  adaptive_grid_run(grid, adaptive_grid_mean_delay, &runs);
+
+  printf("arrival_rate\truns\tmean_delay\thalf_width\tcurvature\tinterpolation_error\n");
+  for (i = 0; i < grid->number_of_points; i++) {
+    p = grid->points + i;
+    printf("%.5f\t%ld\t%.10f\t%.10f\t%.10f\t", p->x, p->stat.count,
+           p->stat.mean, running_stat_half_width(&p->stat, grid->confidence),
+           p->curvature);
+    if (i < grid->number_of_points - 1)
+      printf("%.6f", adaptive_grid_interpolation_error(grid, i));
+    printf("\n");
+  }
+  fprintf(stderr, "Adaptive grid %s: %d rates, %d bisections, %ld runs of %ld\n",
+          grid->status == ADAPTIVE_GRID_CONVERGED ? "converged" : "spent its budget",
+          grid->number_of_points, grid->bisections, grid->replications,
+          grid->budget);
+
+  adaptive_grid_free(grid);
+  if (runs.cache != NULL) result_cache_free(runs.cache);
+}
+#endif
+
+/* Print the 95% confidence interval over the seeds of each output, with the
+ * range of the per-seed values and, for the delay, the spread and range of
+ * the delays of all customers served. */
+static void print_replication_summary(double rate, Replication_Aggregator_Ptr agg)
+{
+  int i;
+  Running_Stat_Ptr r, o;
+
+  for (i = 0; i < agg->number_of_outputs; i++) {
+    r = agg->replications + i;
+    o = agg->observations + i;
+    printf("CI\t%.5f\t%ld_seeds\t%s\t%.10f\t+/-\t%.10f\tmin\t%.10f\tmax\t%.10f",
+           rate, r->count, agg->names[i], r->mean,
+           running_stat_half_width(r, 0.95), r->min, r->max);
+    if (o->count > 0)
+      printf("\tcustomers\t%ld\tsd\t%.10f\tmin\t%.10f\tmax\t%.10f",
+             o->count, sqrt(running_stat_variance(o)), o->min, o->max);
+    printf("\n");
+  }
+}
+
 int main()
 {
   setvbuf(stdout, NULL, _IONBF, 0);
@@ -174,11 +689,39 @@ int main()
   const double rates[] = {0.01, 0.03, 0.05, 0.07, 0.08, 0.09, 0.098};
   const int NRATES = (int)(sizeof(rates)/sizeof(rates[0]));
 
+#if RARE_EVENT_MODE
+#if SERVICE_DIST_MM1
+  rare_event_rejection_probabilities(rates, NRATES);
+#else
+  printf("Rare event estimation needs exponential service (SERVICE_DIST_MM1 1).\n");
+#endif
+  return 0;
+#endif
+
   const unsigned seeds[10] = {
     400430923u, 400474322u, 89101112u, 424242u, 8675309u,
     1357911u, 24681012u, 31415926u, 27182818u, 16180339u
   };
 
+#if LR_REWEIGHT_MODE
+  likelihood_ratio_reweighted_sweep(rates, NRATES, seeds[0]);
+  return 0;
+#endif
+
+#if STANDARD_CLOCK_MODE
+#if SERVICE_DIST_MM1
+  standard_clock_sweep(rates, NRATES, seeds, 10);
+#else
+  printf("The standard clock needs exponential service (SERVICE_DIST_MM1 1).\n");
+#endif
+  return 0;
+#endif
+
+#if ADAPTIVE_GRID_MODE
+  adaptive_grid_sweep(rates[0], rates[NRATES - 1], seeds, 10);
+  return 0;
+#endif
+
   /* Print header and a tag telling which model this build is */
 #if SERVICE_DIST_MM1
   printf("# model=M/M/1\n");
@@ -186,30 +729,79 @@ int main()
   printf("# model=M/D/1\n");
 #endif
   // printf("arrival_rate,seed,utilization,fraction_served,mean_number_in_system,mean_delay,total_served,total_arrived,clock_time,rejection_probability,rejected_customers\n");
-  printf("arrival_rate\tseed\tutilization\tfraction_served\tmean_number_in_system\tmean_delay\ttotal_served\ttotal_arrived\tclock_time\trejection_probability\trejected_customers\n");
+  printf("arrival_rate\tseed\tutilization\tfraction_served\tmean_number_in_system\tmean_delay\ttotal_served\ttotal_arrived\tclock_time\trejection_probability\trejected_customers\td_mean_delay_d_mu\td_mean_delay_d_lambda\td_mean_number_d_mu\td_mean_number_d_lambda\tprobability_full\n");
   int i, s;
+
+  /* Per rate summaries over the seeds. */
+  Replication_Aggregator_Ptr agg = replication_aggregator_new();
+  int agg_delay = replication_aggregator_add_output(agg, "customer_delay");
+  int agg_number = replication_aggregator_add_output(agg, "mean_number_in_system");
+  int agg_utilization = replication_aggregator_add_output(agg, "utilization");
+  int agg_rejection = replication_aggregator_add_output(agg, "rejection_probability");
+
+  Result_Cache_Ptr cache = NULL;
+#if RESULT_CACHE_MODE
+  cache = result_cache_new(RESULT_CACHE_DIR, "lab1_single_server_queue");
+#endif
+
   for (i = 0; i < NRATES; i++) {
     double rate = rates[i];
     double sum_mean_delay = 0.0;
 
+    replication_aggregator_reset(agg);
+
+    /* Control variates: the sampled mean interarrival time and, for M/M/1,
+       the sampled mean service time. Their true means are known. */
+    double control_means[2] = {1.0/rate, (double) SERVICE_TIME};
+    double controls[2];
+    Control_Variate_Ptr delay_cv = control_variate_new(SERVICE_DIST_MM1 ? 2 : 1,
+                                                       control_means);
+    Control_Variate_Estimate cv_estimate;
+
     for (s = 0; s < 10; s++) {
-      Results r = run_one(rate, seeds[s], 0 /* verbose */);
+      Results r = cached_run_one(cache, rate, SERVICE_TIME, seeds[s]);
       sum_mean_delay += r.mean_delay;
 
+      controls[0] = r.mean_interarrival_time;
+      controls[1] = r.mean_service_time;
+      control_variate_add(delay_cv, r.mean_delay, controls);
+
+      replication_aggregator_add_run(agg, agg_delay, &r.delays);
+      replication_aggregator_add(agg, agg_number, r.mean_number_in_system);
+      replication_aggregator_add(agg, agg_utilization, r.utilization);
+      replication_aggregator_add(agg, agg_rejection, r.rejection_probability);
+
       // printf("%.5f,%u,%.10f,%.10f,%.10f,%.10f,%ld,%ld,%.10f\n",
-      printf("%.5f\t%u\t%.10f\t%.10f\t%.10f\t%.10f\t%ld\t%ld\t%.10f\t%.10f\t%ld\n",
+      printf("%.5f\t%u\t%.10f\t%.10f\t%.10f\t%.10f\t%ld\t%ld\t%.10f\t%.10f\t%ld\t%.10f\t%.10f\t%.10f\t%.10f\t%.10f\n",
              rate, seeds[s], r.utilization, r.fraction_served,
              r.mean_number_in_system, r.mean_delay,
              r.total_served, r.total_arrived, r.clock_time,
-             r.rejection_probability, r.rejected_customers);
+             r.rejection_probability, r.rejected_customers,
+             r.d_mean_delay_d_mu, r.d_mean_delay_d_lambda,
+             r.d_mean_number_d_mu, r.d_mean_number_d_lambda,
+             r.probability_full);
       fflush(stdout);
     }
 
     double avg_mean_delay = sum_mean_delay / 10.0;
     printf("AVG\t%.5f\t%d_seeds\tavg_mean_delay\t%.10f\n", rate, 10, avg_mean_delay);
+    print_replication_summary(rate, agg);
+
+    /* Regression adjusted mean delay with 95% confidence intervals. */
+    control_variate_estimate(delay_cv, 0.95, &cv_estimate);
+    printf("CV\t%.5f\t%d_seeds\tcrude_mean_delay\t%.10f\t+/-\t%.10f\tcv_mean_delay\t%.10f\t+/-\t%.10f\n",
+           rate, 10, cv_estimate.crude_mean, cv_estimate.crude_half_width,
+           cv_estimate.mean, cv_estimate.half_width);
+    control_variate_free(delay_cv);
     fflush(stdout);
     fprintf(stderr, "Completed arrival_rate=%.5f\n", rate);
   }
+  replication_aggregator_free(agg);
+  if (cache != NULL) {
+    fprintf(stderr, "Result cache: %ld runs reused, %ld simulated\n",
+            cache->hits, cache->misses);
+    result_cache_free(cache);
+  }
   return 0;
 }
 
@@ -0,0 +1,118 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _LIKELIHOOD_RATIO_H_
+#define _LIKELIHOOD_RATIO_H_
+
+/******************************************************************************/
+
+/*
+ * Likelihood ratio reweighting of one sample path to nearby parameter points.
+ *
+ * The run is simulated at a base Poisson arrival rate and exponential mean
+ * service time. For each target (arrival rate, mean service time) the
+ * likelihood ratio of every interarrival and service time drawn is
+ * accumulated over a regeneration cycle (e.g., from an arrival to an empty
+ * system up to the next one). At the end of each cycle the model passes a
+ * few cycle totals (e.g., sum of delays, number served). Estimates at a
+ * target are then ratios of likelihood-weighted cycle totals. Weighting
+ * whole cycles instead of the whole run keeps the weights from degenerating.
+ *
+ * The effective sample size (ESS) of the cycle weights is the diagnostic: when
+ * it collapses, the target is too far from the base and should be simulated
+ * directly.
+ */
+
+#define LR_MAX_TARGETS 16
+#define LR_MAX_VALUES 4
+
+typedef struct _likelihood_ratio_target_
+{
+  double arrival_rate;
+  double service_time;
+  double log_weight;   /* of the current cycle */
+  double sum_w;
+  double sum_w2;
+  double sum_wv[LR_MAX_VALUES];
+  double sum_wv_wv[LR_MAX_VALUES][LR_MAX_VALUES];
+} Likelihood_Ratio_Target, * Likelihood_Ratio_Target_Ptr;
+
+typedef struct _likelihood_ratio_
+{
+  double base_arrival_rate;
+  double base_service_time;
+  int number_of_values;
+  int number_of_targets;
+  long int cycles;
+  Likelihood_Ratio_Target targets[LR_MAX_TARGETS];
+} Likelihood_Ratio, * Likelihood_Ratio_Ptr;
+
+typedef struct _likelihood_ratio_estimate_
+{
+  double mean;
+  double half_width;      /* 95% confidence interval half width */
+  double ess;             /* effective number of cycles */
+  double relative_ess;    /* ess/cycles, 1 at the base point */
+} Likelihood_Ratio_Estimate, * Likelihood_Ratio_Estimate_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Likelihood_Ratio_Ptr
+likelihood_ratio_new(double, double, int);
+
+int
+likelihood_ratio_add_target(Likelihood_Ratio_Ptr, double, double);
+
+void
+likelihood_ratio_interarrival(Likelihood_Ratio_Ptr, double);
+
+void
+likelihood_ratio_no_arrival(Likelihood_Ratio_Ptr, double);
+
+void
+likelihood_ratio_service(Likelihood_Ratio_Ptr, double);
+
+void
+likelihood_ratio_end_cycle(Likelihood_Ratio_Ptr, const double *);
+
+void
+likelihood_ratio_start_cycle(Likelihood_Ratio_Ptr);
+
+void
+likelihood_ratio_estimate(Likelihood_Ratio_Ptr, int, int, int,
+			  Likelihood_Ratio_Estimate_Ptr);
+
+void
+likelihood_ratio_free(Likelihood_Ratio_Ptr);
+
+/******************************************************************************/
+
+#endif /* likelihood_ratio.h */
+
@@ -0,0 +1,423 @@
+/*
+ *
+ * Simulation of Single Server Queueing System
+ *
+ * Copyright (C) 2014 Terence D. Todd Hamilton, Ontario, CANADA,
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include "simlib.h"
+#include "rare_event.h"
+
+/*******************************************************************************/
+
+/*
+ * The conditional probability aimed for between splitting levels when they
+ * are placed automatically. Around 0.2 minimizes the relative variance of
+ * fixed effort splitting for a given number of trajectories per level.
+ */
+
+#define SPLITTING_LEVEL_PROBABILITY 0.2
+
+/* The 97.5% t quantile for RARE_EVENT_PLAIN_BATCHES - 1 degrees of freedom. */
+#define PLAIN_BATCHES_T 2.093
+
+/*******************************************************************************/
+
+/*
+ * Running sums for a sample mean and variance.
+ */
+
+typedef struct {
+  long int n;
+  double sum;
+  double sum_of_squares;
+} Sample_Sums;
+
+static double
+departure_rate(Birth_Death_Queue_Ptr, int);
+
+static long int
+plain_cycle_arrivals(Birth_Death_Queue_Ptr, long int *);
+
+static long int
+rejections_until_empty(Birth_Death_Queue_Ptr, long int *);
+
+static int
+stable(Birth_Death_Queue_Ptr);
+
+static void
+sample_sums_add(Sample_Sums *, double);
+
+static double
+sample_sums_relative_variance(Sample_Sums *);
+
+/*******************************************************************************/
+
+static double
+departure_rate(Birth_Death_Queue_Ptr queue, int number_in_system)
+{
+  int busy = number_in_system < queue->servers ?
+    number_in_system : queue->servers;
+
+  return busy * queue->service_rate;
+}
+
+/*
+ * Rejections are only rare, and cycles short, below the total service rate.
+ */
+
+static int
+stable(Birth_Death_Queue_Ptr queue)
+{
+  return queue->arrival_rate < queue->servers * queue->service_rate;
+}
+
+static void
+sample_sums_add(Sample_Sums * sums, double x)
+{
+  sums->n++;
+  sums->sum += x;
+  sums->sum_of_squares += x*x;
+}
+
+/*
+ * Relative variance of the sample mean, i.e., Var(mean)/mean^2.
+ */
+
+static double
+sample_sums_relative_variance(Sample_Sums * sums)
+{
+  double mean, variance;
+
+  if (sums->n < 2 || sums->sum == 0.0) return 0.0;
+
+  mean = sums->sum/sums->n;
+  variance = (sums->sum_of_squares - sums->n * mean * mean)/(sums->n - 1);
+  if (variance < 0.0) variance = 0.0;
+  return variance/sums->n/(mean*mean);
+}
+
+/*******************************************************************************/
+
+/*
+ * The exact blocking probability from the birth-death balance equations. It
+ * is worked out in logs since it can be far below the smallest double.
+ */
+
+double
+rare_event_exact_blocking(Birth_Death_Queue_Ptr queue)
+{
+  int n;
+  double log_weight = 0.0, log_max = 0.0, sum = 0.0;
+  double * log_weights;
+
+  log_weights = (double *) xcalloc(queue->capacity + 1, sizeof(double));
+
+  for (n=1; n<=queue->capacity; n++) {
+    log_weight += log(queue->arrival_rate/departure_rate(queue, n));
+    log_weights[n] = log_weight;
+    if (log_weight > log_max) log_max = log_weight;
+  }
+
+  for (n=0; n<=queue->capacity; n++) sum += exp(log_weights[n] - log_max);
+
+  log_weight = log_weights[queue->capacity] - log_max - log(sum);
+  xfree((void *) log_weights);
+  return exp(log_weight);
+}
+
+/*******************************************************************************/
+
+/*
+ * Simulate one ordinary regeneration cycle, starting with an arrival to an
+ * empty system, and return the number of arrivals in it. Only the embedded
+ * jump chain is needed since counts do not depend on the holding times.
+ * Returns -1 if the cycle runs past RARE_EVENT_MAX_CYCLE_TRANSITIONS.
+ */
+
+static long int
+plain_cycle_arrivals(Birth_Death_Queue_Ptr queue, long int * transitions)
+{
+  int n = 1;
+  long int arrivals = 1, steps = 0;
+  double lambda = queue->arrival_rate, mu;
+
+  while (n > 0) {
+    if (++steps > RARE_EVENT_MAX_CYCLE_TRANSITIONS) return -1;
+    mu = departure_rate(queue, n);
+    (*transitions)++;
+    if (uniform_generator() < lambda/(lambda + mu)) {
+      arrivals++;
+      if (n < queue->capacity) n++;
+    } else {
+      n--;
+    }
+  }
+  return arrivals;
+}
+
+/*
+ * Starting from a full system, count the rejected arrivals until the system
+ * next empties. Returns -1 if that takes more than
+ * RARE_EVENT_MAX_CYCLE_TRANSITIONS.
+ */
+
+static long int
+rejections_until_empty(Birth_Death_Queue_Ptr queue, long int * transitions)
+{
+  int n = queue->capacity;
+  long int rejections = 0, steps = 0;
+  double lambda = queue->arrival_rate, mu;
+
+  while (n > 0) {
+    if (++steps > RARE_EVENT_MAX_CYCLE_TRANSITIONS) return -1;
+    mu = departure_rate(queue, n);
+    (*transitions)++;
+    if (uniform_generator() < lambda/(lambda + mu)) {
+      if (n < queue->capacity) n++;
+      else rejections++;
+    } else {
+      n--;
+    }
+  }
+  return rejections;
+}
+
+/*******************************************************************************/
+
+/*
+ * Importance sampling. Until the system first fills, the arrival and
+ * departure rates in each state are exponentially twisted by swapping them
+ * whenever arrivals are the slower of the two. This pushes the chain towards
+ * the rare full state. The total event rate is unchanged by the swap so the
+ * holding time terms cancel out of the likelihood ratio, leaving only the
+ * ratio of the jump probabilities. Once the system is full the original
+ * rates are restored, so the rejections that follow are weighted by the
+ * likelihood ratio accumulated on the way up. For M/M/1/K this is the swap of
+ * lambda and mu, which has bounded relative error as K grows. An unstable
+ * queue is simulated plainly instead (see rare_event.h).
+ */
+
+void
+rare_event_importance_sampling(Birth_Death_Queue_Ptr queue, long int cycles,
+			       Rare_Event_Estimate_Ptr estimate)
+{
+  long int i, count;
+  int n, twisted;
+  double lambda, mu, p, p_twisted, likelihood_ratio;
+  Sample_Sums numerator = {0, 0.0, 0.0}, denominator = {0, 0.0, 0.0};
+
+  if (!stable(queue)) {
+    rare_event_plain(queue, RARE_EVENT_PLAIN_TRANSITIONS, estimate);
+    return;
+  }
+
+  estimate->transitions = 0;
+
+  for (i=0; i<cycles; i++) {
+
+    /* The denominator, E[arrivals per cycle], under the original rates. */
+    if ((count = plain_cycle_arrivals(queue, &estimate->transitions)) < 0) {
+      rare_event_plain(queue, RARE_EVENT_PLAIN_TRANSITIONS, estimate);
+      return;
+    }
+    sample_sums_add(&denominator, (double) count);
+
+    /* The numerator, E[rejections per cycle], under the twisted rates. */
+    n = 1;
+    twisted = (n < queue->capacity);
+    likelihood_ratio = 1.0;
+    lambda = queue->arrival_rate;
+
+    while (twisted && n > 0) {
+      mu = departure_rate(queue, n);
+      p = lambda/(lambda + mu);
+      p_twisted = (lambda < mu) ? mu/(lambda + mu) : p;
+      estimate->transitions++;
+
+      if (uniform_generator() < p_twisted) {
+	likelihood_ratio *= p/p_twisted;
+	if (++n == queue->capacity) twisted = 0;
+      } else {
+	likelihood_ratio *= (1.0 - p)/(1.0 - p_twisted);
+	n--;
+      }
+    }
+
+    if (n == queue->capacity) {
+      if ((count = rejections_until_empty(queue, &estimate->transitions)) < 0) {
+	rare_event_plain(queue, RARE_EVENT_PLAIN_TRANSITIONS, estimate);
+	return;
+      }
+      sample_sums_add(&numerator, likelihood_ratio * count);
+    } else {
+      sample_sums_add(&numerator, 0.0);
+    }
+  }
+
+  estimate->probability = (numerator.sum/numerator.n) /
+    (denominator.sum/denominator.n);
+  estimate->relative_error = 1.96 *
+    sqrt(sample_sums_relative_variance(&numerator) +
+	 sample_sums_relative_variance(&denominator));
+  estimate->half_width = estimate->probability * estimate->relative_error;
+}
+
+/*******************************************************************************/
+
+/*
+ * Multilevel splitting on the number in system, with fixed effort per
+ * level. Levels are placed every level_step customers from 1 up to the
+ * capacity. With level_step below 1 they are placed so that each is reached
+ * from the one before with probability about SPLITTING_LEVEL_PROBABILITY:
+ * well above the servers, going up k customers before emptying has
+ * probability about rho^k, rho = arrival_rate/(servers*service_rate). Steps
+ * too long for the effort leave few successes per level and a large
+ * relative error. Since the chain can only move one step at a time, every
+ * trajectory enters a level in exactly the level state, so each conditional
+ * probability of reaching the next level before emptying is estimated by
+ * restarting effort trajectories from there. Their product is the
+ * probability of filling the system within a cycle, which is then multiplied
+ * by the expected rejections once full. An unstable queue is simulated
+ * plainly instead (see rare_event.h).
+ */
+
+void
+rare_event_splitting(Birth_Death_Queue_Ptr queue, int level_step,
+		     long int effort, Rare_Event_Estimate_Ptr estimate)
+{
+  long int i, successes, count;
+  int n, level, next_level;
+  double lambda = queue->arrival_rate, mu, rho;
+  double fill_probability = 1.0, relative_variance = 0.0, p;
+  Sample_Sums rejections = {0, 0.0, 0.0}, denominator = {0, 0.0, 0.0};
+
+  if (!stable(queue)) {
+    rare_event_plain(queue, RARE_EVENT_PLAIN_TRANSITIONS, estimate);
+    return;
+  }
+
+  if (level_step < 1) {
+    rho = lambda/(queue->servers * queue->service_rate);
+    level_step = (int) (log(SPLITTING_LEVEL_PROBABILITY)/log(rho));
+    if (level_step < 1) level_step = 1;
+  }
+  estimate->transitions = 0;
+
+  for (level = 1; level < queue->capacity; level = next_level) {
+
+    next_level = level + level_step;
+    if (next_level > queue->capacity) next_level = queue->capacity;
+
+    successes = 0;
+    for (i=0; i<effort; i++) {
+      n = level;
+      while (n > 0 && n < next_level) {
+	mu = departure_rate(queue, n);
+	estimate->transitions++;
+	if (uniform_generator() < lambda/(lambda + mu)) n++;
+	else n--;
+      }
+      if (n == next_level) successes++;
+    }
+
+    if (successes == 0) {
+      printf("Warning: Splitting level %d was never reached from level %d. "
+	     "Increase the effort or reduce the level step.\n",
+	     next_level, level);
+      fill_probability = 0.0;
+      break;
+    }
+
+    p = (double) successes/effort;
+    fill_probability *= p;
+    relative_variance += (1.0 - p)/(effort * p);
+  }
+
+  for (i=0; i<effort; i++) {
+    if ((count = rejections_until_empty(queue, &estimate->transitions)) < 0) {
+      rare_event_plain(queue, RARE_EVENT_PLAIN_TRANSITIONS, estimate);
+      return;
+    }
+    sample_sums_add(&rejections, (double) count);
+    if ((count = plain_cycle_arrivals(queue, &estimate->transitions)) < 0) {
+      rare_event_plain(queue, RARE_EVENT_PLAIN_TRANSITIONS, estimate);
+      return;
+    }
+    sample_sums_add(&denominator, (double) count);
+  }
+
+  relative_variance += sample_sums_relative_variance(&rejections) +
+    sample_sums_relative_variance(&denominator);
+
+  estimate->probability = fill_probability * (rejections.sum/rejections.n) /
+    (denominator.sum/denominator.n);
+  estimate->relative_error = 1.96 * sqrt(relative_variance);
+  estimate->half_width = estimate->probability * estimate->relative_error;
+}
+
+/*******************************************************************************/
+
+/*
+ * Plain simulation of the jump chain, for when rejections are not rare. It
+ * starts empty and runs a warm up batch and then RARE_EVENT_PLAIN_BATCHES
+ * batches, dividing the transitions between them, and estimates the
+ * fraction of arrivals rejected by batch means. Arrivals come at the same
+ * rate in every state, so this fraction in the jump chain is the
+ * rejection probability.
+ */
+
+void
+rare_event_plain(Birth_Death_Queue_Ptr queue, long int transitions,
+		 Rare_Event_Estimate_Ptr estimate)
+{
+  long int i, batch_length, arrivals, rejections;
+  int n = 0, batch;
+  double lambda = queue->arrival_rate, mu;
+  Sample_Sums batches = {0, 0.0, 0.0};
+
+  batch_length = transitions/(RARE_EVENT_PLAIN_BATCHES + 1);
+  estimate->transitions = 0;
+
+  for (batch=0; batch<=RARE_EVENT_PLAIN_BATCHES; batch++) {
+    arrivals = rejections = 0;
+    for (i=0; i<batch_length; i++) {
+      mu = departure_rate(queue, n);
+      if (uniform_generator() < lambda/(lambda + mu)) {
+	arrivals++;
+	if (n < queue->capacity) n++;
+	else rejections++;
+      } else {
+	n--;
+      }
+    }
+    estimate->transitions += batch_length;
+    if (batch > 0)
+      sample_sums_add(&batches, arrivals > 0 ?
+		      (double) rejections/arrivals : 0.0);
+  }
+
+  estimate->probability = batches.sum/batches.n;
+  estimate->relative_error = PLAIN_BATCHES_T *
+    sqrt(sample_sums_relative_variance(&batches));
+  estimate->half_width = estimate->probability * estimate->relative_error;
+}
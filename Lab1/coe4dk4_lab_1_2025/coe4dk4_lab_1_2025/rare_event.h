@@ -0,0 +1,95 @@
+/*
+ *
+ * Simulation of Single Server Queueing System
+ *
+ * Copyright (C) 2014 Terence D. Todd Hamilton, Ontario, CANADA,
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*******************************************************************************/
+
+#ifndef _RARE_EVENT_H_
+#define _RARE_EVENT_H_
+
+/*******************************************************************************/
+
+/*
+ * Rare event estimation of the rejection (blocking) probability of a Markovian
+ * M/M/c/K queue. This covers Lab 1's M/M/1/K system (servers = 1, capacity =
+ * MAX_QUEUE_SIZE + 1) as well as Erlang B loss systems (capacity = servers).
+ *
+ * Both estimators are regenerative. A cycle starts with an arrival to an empty
+ * system. The rejection probability is
+ *
+ *   E[rejections per cycle] / E[arrivals per cycle]
+ *
+ * where the denominator is not rare and is estimated by plain simulation. The
+ * rare numerator is estimated either by importance sampling or by multilevel
+ * splitting on the number in system.
+ *
+ * Rejections are only rare when the queue is stable. Once the arrival rate
+ * reaches servers*service_rate, a cycle has to come back down from a nearly
+ * full system and its length grows geometrically with the capacity, so both
+ * estimators fall back to a plain simulation of RARE_EVENT_PLAIN_TRANSITIONS
+ * state changes, which is accurate there. They also fall back if any cycle
+ * runs past RARE_EVENT_MAX_CYCLE_TRANSITIONS.
+ */
+
+#define RARE_EVENT_PLAIN_TRANSITIONS 20000000
+#define RARE_EVENT_PLAIN_BATCHES 20
+#define RARE_EVENT_MAX_CYCLE_TRANSITIONS 1000000
+
+typedef struct _birth_death_queue_
+{
+  double arrival_rate;
+  double service_rate; /* per server */
+  int servers;
+  int capacity;        /* maximum number in system, including those in service */
+} Birth_Death_Queue, * Birth_Death_Queue_Ptr;
+
+typedef struct _rare_event_estimate_
+{
+  double probability;
+  double half_width;     /* 95% confidence interval half width */
+  double relative_error; /* half_width/probability */
+  long int transitions;  /* total simulated state changes (the cost) */
+} Rare_Event_Estimate, * Rare_Event_Estimate_Ptr;
+
+/*******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+double
+rare_event_exact_blocking(Birth_Death_Queue_Ptr);
+
+void
+rare_event_importance_sampling(Birth_Death_Queue_Ptr, long int,
+			       Rare_Event_Estimate_Ptr);
+
+void
+rare_event_splitting(Birth_Death_Queue_Ptr, int, long int,
+		     Rare_Event_Estimate_Ptr);
+
+void
+rare_event_plain(Birth_Death_Queue_Ptr, long int, Rare_Event_Estimate_Ptr);
+
+/*******************************************************************************/
+
+#endif /* rare_event.h */
+
@@ -0,0 +1,106 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _RESULT_CACHE_H_
+#define _RESULT_CACHE_H_
+
+/******************************************************************************/
+
+/*
+ * An on-disk cache of the results of simulation runs.
+ *
+ * A run is identified by a key made of the model name, a hash of the running
+ * executable, and the name and value of every input the caller adds (the
+ * parameters, the seed, the run length). Rebuilding the program with any
+ * change therefore starts a fresh set of entries. The results are stored as
+ * an array of doubles in one small file per run, named after a 64-bit FNV-1a
+ * hash of the key. The file also holds the full key text, which is checked
+ * on loading, so a hash collision is only a cache miss.
+ *
+ * Each entry is written to a temporary file and renamed into place, so an
+ * interrupted program or several processes storing at once never leave a
+ * partial entry (at worst a hidden .tmp file, which is never read).
+ * Rerunning an interrupted experiment then only repeats the runs that had
+ * not finished.
+ *
+ * The entries of the model and build can also be listed, e.g., to fit a
+ * metamodel to all the runs done so far; the inputs of each are read back
+ * from its key by name.
+ */
+
+#define RESULT_CACHE_MAX_KEY 1024
+#define RESULT_CACHE_MAX_VALUES 64
+
+typedef void (* Result_Cache_Entry_Function)(const char *, const double *, int,
+					      void *);
+
+typedef struct _result_cache_
+{
+  char directory[256];
+  char model[64];
+  unsigned long long build_hash;
+
+  char key[RESULT_CACHE_MAX_KEY];  /* text of the current key */
+  unsigned long long hash;         /* and its hash */
+
+  long int hits;
+  long int misses;
+} Result_Cache, * Result_Cache_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Result_Cache_Ptr
+result_cache_new(const char *, const char *);
+
+void
+result_cache_start_key(Result_Cache_Ptr);
+
+void
+result_cache_add_key(Result_Cache_Ptr, const char *, double);
+
+int
+result_cache_load(Result_Cache_Ptr, double *, int);
+
+void
+result_cache_store(Result_Cache_Ptr, const double *, int);
+
+long int
+result_cache_scan(Result_Cache_Ptr, Result_Cache_Entry_Function, void *);
+
+int
+result_cache_key_value(const char *, const char *, double *);
+
+void
+result_cache_free(Result_Cache_Ptr);
+
+/******************************************************************************/
+
+#endif /* result_cache.h */
+
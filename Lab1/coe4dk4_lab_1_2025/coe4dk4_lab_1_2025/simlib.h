@@ -29,6 +29,8 @@
 
 #include <stdlib.h>
 
+#include "metrics.h"
+
 /******************************************************************************/
 
 /*
@@ -41,12 +43,19 @@ struct _clock_;
 struct _event_;
 struct _event_container_;
 struct _event_list_;
+struct _time_weighted_stat_;
+struct _profile_;
+struct _trace_;
+struct _trace_record_;
 
 /*
  * Define some convenient typedefs to use when writing simulation_runs.
  *
  * The simulation_run consists of an event list, clock and a pointer for
- * passing user data between various functions.
+ * passing user data between various functions. The profile is NULL unless
+ * profiling is on (see below), the metrics page unless the run is
+ * publishing live metrics (see metrics.h), and the trace unless the run is
+ * being traced (see below).
  */
 
 typedef struct _simulation_run_
@@ -54,6 +63,9 @@ typedef struct _simulation_run_
   struct _eventlist_ * eventlist;
   struct _clock_ * clock;
   void * data;
+  struct _profile_ * profile;
+  struct _metrics_page_ * metrics;
+  struct _trace_ * trace;
 } Simulation_Run, * Simulation_Run_Ptr;
 
 typedef struct _clock_
@@ -92,6 +104,254 @@ typedef struct _eventlist_
 
 /******************************************************************************/
 
+/*
+ * Allocation statistics.
+ *
+ * All memory goes through xmalloc, xcalloc and xfree, which put a small
+ * header in front of each block with its size and kind, and keep the
+ * number of allocations, frees and live bytes of each kind, and the peaks
+ * of the live bytes. simlib's own objects (event containers, queue
+ * containers, ...) are kinds of their own, named with xmalloc_named. Other
+ * blocks are told apart by their size (the element size for xcalloc),
+ * which in practice means by type. A block not from xmalloc, or freed
+ * twice, is an error in xfree. The bytes counted leave out the headers.
+ * All this is on only with SIMLIB_PROFILE or SIMLIB_PERF set when the
+ * process makes its first allocation; otherwise xmalloc and xfree are plain
+ * malloc and free.
+ */
+
+#define ALLOCATION_MAX_KINDS 64
+
+typedef struct _allocation_kind_
+{
+  const char * name;    /* NULL for blocks told apart by size */
+  unsigned size;
+  long int allocations;
+  long int frees;
+  size_t live_bytes;
+  size_t peak_bytes;
+} Allocation_Kind, * Allocation_Kind_Ptr;
+
+typedef struct _allocation_stats_
+{
+  long int allocations;
+  long int frees;
+  size_t live_bytes;
+  size_t peak_bytes;
+  int number_of_kinds;  /* the last one takes all kinds past the table */
+  Allocation_Kind kinds[ALLOCATION_MAX_KINDS];
+} Allocation_Stats, * Allocation_Stats_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Profiling of a simulation_run, to see where its run time goes. It is
+ * always compiled in and costs a pointer test per event when off. It is
+ * turned on for every run by setting the environment variable
+ * SIMLIB_PROFILE, or for one run by simulation_run_start_profile, and the
+ * profile is printed to stderr when the run is freed (or on request).
+ *
+ * Each event type (event function) has its count, and the time of every
+ * PROFILE_SAMPLE_PERIOD-th execution of its handler, read from the CPU
+ * time stamp counter where there is one, which estimates its total time.
+ * Scheduling, descheduling and the random number generators are timed the
+ * same way, so that the time of the handlers themselves can be told apart
+ * from that of the event list and of the random numbers. The size of the
+ * event list at each event, and the number of containers passed over to
+ * insert each new event, are kept as histograms in powers of two
+ * (bin 0 for 0, bin k for 2^(k-1) up to 2^k - 1).
+ *
+ * With SIMLIB_PERF set as well (Linux only), the sampled calls also read the
+ * hardware performance counters through perf_event_open: cycles,
+ * instructions, L1 data cache read misses, last level cache misses and
+ * branch misses, in user mode. They are kept per engine phase (schedule,
+ * taking the next event off the list, and dispatching it to its handler)
+ * and per event type, and printed with the profile. Counters that the CPU
+ * or the kernel does not offer (e.g., in most virtual machines) are left
+ * out. The phases are measured one at a time: a schedule from within a
+ * measured handler is only counted in the handler's numbers.
+ *
+ * The profile also has the allocations and frees of each kind during the
+ * run and the peak of its live bytes (see above), the peak size of the
+ * event list, and the peak length of each FIFO queue created since the
+ * profile started.
+ */
+
+#define PROFILE_MAX_EVENT_TYPES 64
+#define PROFILE_SAMPLE_PERIOD 16
+#define PROFILE_BINS 24
+#define PROFILE_TOP_QUEUES 8
+#define PROFILE_COUNTERS 5
+
+/* Hardware counter totals over the sampled calls of a phase. */
+typedef struct _profile_counters_
+{
+  long int samples;
+  unsigned long long values[PROFILE_COUNTERS];
+} Profile_Counters, * Profile_Counters_Ptr;
+
+typedef struct _profile_event_type_
+{
+  void (* function)(struct _simulation_run_*, void *);
+  const char * description;
+  long int count;
+  long int samples;
+  unsigned long long ticks;  /* of the sampled executions */
+  Profile_Counters counters;
+} Profile_Event_Type, * Profile_Event_Type_Ptr;
+
+typedef struct _profile_
+{
+  int number_of_event_types;
+  Profile_Event_Type event_types[PROFILE_MAX_EVENT_TYPES];
+  long int events;
+
+  long int schedules;
+  long int schedule_samples;
+  unsigned long long schedule_ticks;
+  long int deschedules;
+  long int deschedule_samples;
+  unsigned long long deschedule_ticks;
+  long int pop_samples;
+  unsigned long long pop_ticks;
+  long int random_draws;
+  long int random_samples;
+  unsigned long long random_ticks;
+  int random_depth;       /* of nested generator calls */
+
+  long int list_size[PROFILE_BINS];        /* at each event */
+  long int insertion_depth[PROFILE_BINS];  /* containers passed over */
+  double list_size_sum;
+  double insertion_depth_sum;
+  double deschedule_depth_sum;
+  int max_list_size;     /* at any time */
+
+  unsigned long long tick_overhead;  /* of reading the counter */
+  unsigned long long start_ticks;
+  double start_seconds;
+
+  int counter_fd;         /* of the perf_event_open group, or -1 */
+  int counter_fds[PROFILE_COUNTERS];
+  int counter_slot[PROFILE_COUNTERS];  /* in a group read, or -1 */
+  int number_of_counters;
+  int measuring;          /* a phase is being counted */
+  unsigned long long counter_overhead[PROFILE_COUNTERS];
+  Profile_Counters schedule_counters;
+  Profile_Counters pop_counters;
+
+  long int allocations[ALLOCATION_MAX_KINDS];  /* of each kind at the start */
+  long int frees[ALLOCATION_MAX_KINDS];
+  long int first_queue;   /* number of the first FIFO queue of the run */
+  long int number_of_queues;  /* of the run, freed or not */
+  long int top_queues[PROFILE_TOP_QUEUES];  /* the longest peaks, longest first */
+  int top_queue_sizes[PROFILE_TOP_QUEUES];
+  int number_of_top_queues;
+} Profile, * Profile_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Publishing live metrics (see metrics.h).
+ *
+ * simulation_run_new gives the run the metrics page of the process when
+ * SIMLIB_METRICS is set, and the run then publishes its events and
+ * simulation time as it goes. Only the newest run of a process publishes.
+ * The model adds its counters and estimates to the run by name, which gives
+ * their indices (-1 when the run is not publishing), and then publishes
+ * them with the macros below. These are only relaxed atomic stores, cheap
+ * enough to do at every update.
+ */
+
+#define SIMULATION_RUN_METRICS_COUNTER(simulation_run, index, number) \
+  do { \
+    if ((simulation_run)->metrics != NULL) \
+      METRICS_STORE((simulation_run)->metrics->counters[index].value, \
+		    (long long) (number)); \
+  } while (0)
+
+#define SIMULATION_RUN_METRICS_ESTIMATE(simulation_run, index, n, total, \
+					total_squares) \
+  do { \
+    if ((simulation_run)->metrics != NULL) { \
+      Metrics_Estimate_Ptr metrics_estimate_ = \
+	(simulation_run)->metrics->estimates + (index); \
+      METRICS_STORE(metrics_estimate_->count, (long long) (n)); \
+      METRICS_STORE(metrics_estimate_->sum, (double) (total)); \
+      METRICS_STORE(metrics_estimate_->sum_squares, (double) (total_squares)); \
+    } \
+  } while (0)
+
+#define SIMULATION_RUN_METRICS_PROGRESS(simulation_run, fraction) \
+  do { \
+    if ((simulation_run)->metrics != NULL) \
+      METRICS_STORE((simulation_run)->metrics->progress, (double) (fraction)); \
+  } while (0)
+
+/******************************************************************************/
+
+/*
+ * Binary event tracing (see trace.h for the file format).
+ *
+ * With SIMLIB_TRACE set to a file name, every run records each schedule,
+ * execution and deschedule of an event as a Trace_Record in its own ring in
+ * memory. A thread of the process writes the rings out to the file as they
+ * fill, so the run only waits if it gets a whole ring ahead. A %p in the
+ * name is replaced by the process id; a process that finds the file still
+ * being written by another (e.g., a sweep worker) appends its id to the
+ * name. The records are decoded, or exported to a timeline viewer, by
+ * tools/simtrace.
+ *
+ * SIMLIB_TRACE_SAMPLE=n records only one executed event in n, along with
+ * the schedules and deschedules made by its handler.
+ *
+ * SIMLIB_TRACE_WINDOW=n captures a window around a trigger instead of the
+ * whole run: the ring is overwritten until the trigger, and then the n
+ * records before it and the n after it are written, with a TRACE_TRIGGER
+ * record between them. The trigger is the first event at or after the
+ * simulation time SIMLIB_TRACE_TRIGGER, or a call of
+ * simulation_run_trace_trigger by the model (e.g., when a delay is out of
+ * bounds). The window is at most half of the ring. Without a window, a
+ * trigger only adds its record.
+ *
+ * Without threads (Windows) the rings are written out by the run itself.
+ */
+
+#define TRACE_RING_SIZE 65536   /* records, a power of two */
+#define TRACE_SEGMENT 4096      /* records written out at a time */
+#define TRACE_MAX_TYPES 256
+#define TRACE_CACHED_TYPES 16
+
+typedef enum {TRACE_STREAMING, TRACE_ARMED, TRACE_CAPTURING, TRACE_STOPPED}
+  Trace_State;
+
+typedef struct _trace_
+{
+  struct _trace_record_ * records;  /* the ring */
+  unsigned long long head;  /* records made */
+  unsigned long long tail;  /* records written out */
+  unsigned long long stop;  /* head at the end of the window */
+  unsigned run;
+  int state;              /* a Trace_State */
+  int busy;               /* being written out */
+
+  long int sample;        /* record one executed event in this many */
+  long int countdown;
+  int sampled;            /* the current event is recorded */
+
+  long int window;
+  double trigger_time;
+
+  /* The last types seen, to find them without the lock. */
+  int number_of_cached_types;
+  void (* cached_functions[TRACE_CACHED_TYPES])(struct _simulation_run_*,
+						void *);
+  unsigned cached_types[TRACE_CACHED_TYPES];
+
+  struct _trace_ * next;  /* the traces of the process */
+} Trace, * Trace_Ptr;
+
+/******************************************************************************/
+
 /*
  * FIFO queue object keeps the queue size and contains pointers to containers
  * at the front and back of the queue. The queue container objects are kept on
@@ -106,6 +366,11 @@ typedef struct _fifoqueue_
   struct _queue_container_ * front_ptr;
   struct _queue_container_ * back_ptr;
   int size;
+  struct _time_weighted_stat_ * stat;
+  int max_size;
+  long int number;        /* in order of creation, from 1 */
+  struct _fifoqueue_ * next_queue;      /* all live queues, for profiles */
+  struct _fifoqueue_ * previous_queue;
 } Fifoqueue, * Fifoqueue_Ptr;
 
 typedef struct _queue_container_
@@ -126,18 +391,59 @@ typedef struct _server_
 {
   Server_State state;
   void * customer_in_service;
+  struct _time_weighted_stat_ * stat;
 } Server, * Server_Ptr;
 
 /******************************************************************************/
 
+/*
+ * Time weighted statistics of an integer level, e.g., the number in a queue
+ * or the number of busy servers. Besides the time integral (for the time
+ * average), the total time spent at each level is kept in a dense array,
+ * which gives the time average distribution P(N = n).
+ *
+ * A statistic created with a simulation_run reads the time from its clock.
+ * One created with a NULL simulation_run is given the time explicitly.
+ *
+ * A statistic can be attached to FIFO queues and servers. It is then changed
+ * by +1/-1 as objects are put and taken, so that a single statistic attached
+ * to several of them counts their total, e.g., the busy servers in a pool, or
+ * a queue and its server for the number in system.
+ */
+
+typedef struct _time_weighted_stat_
+{
+  Clock_Ptr clock;
+  double start_time;
+  double last_time;
+  int value;
+  int max_value;
+  double integral;
+  int number_of_levels;
+  double * time_at_level;
+} Time_Weighted_Stat, * Time_Weighted_Stat_Ptr;
+
+/******************************************************************************/
+
 /*
  * Random Number Generation
  *
- * The generator uses the library function rand() which must return an int
- * within the range 1 to RAND_MAX.  Note: RAND_MAX is defined for this purpose
- * in ANSI C.)
+ * uniform_generator uses simlib's own copy of the C library's random()
+ * generator (the same numbers as rand() on glibc), whose state can be read
+ * and set, e.g., for checkpoints.
  */
 
+#define RANDOM_STATE_DEGREE 31
+#define RANDOM_STATE_SEPARATION 3
+#define RANDOM_GENERATOR_MAX 2147483647
+
+typedef struct _random_state_
+{
+  unsigned table[RANDOM_STATE_DEGREE];
+  int front;
+  int rear;
+} Random_State, * Random_State_Ptr;
+
 /*
  * _rand_stream_ permits having multiple rand() streams at once. Multiple
  * Rand_Stream objects can be created and accessed via rand_stream_get.
@@ -178,12 +484,42 @@ simulation_run_set_data(Simulation_Run_Ptr, void*);
 /* Create an alias for simulation_run_set_data. */
 #define simulation_run_attach_data simulation_run_set_data
 
+void
+simulation_run_start_profile(Simulation_Run_Ptr);
+
+void
+simulation_run_print_profile(Simulation_Run_Ptr);
+
+int
+simulation_run_metrics_counter(Simulation_Run_Ptr, const char *);
+
+int
+simulation_run_metrics_estimate(Simulation_Run_Ptr, const char *);
+
+void
+simulation_run_metrics_label(Simulation_Run_Ptr, const char *);
+
+void
+simulation_run_metrics_close(void);
+
+void
+simulation_run_trace_trigger(Simulation_Run_Ptr);
+
+void
+simulation_run_trace_close(void);
+
 long int
 simulation_run_schedule_event(Simulation_Run_Ptr, Event, double);
 
 void *
 simulation_run_deschedule_event(Simulation_Run_Ptr, long int);
 
+long int
+simulation_run_get_next_event_id(void);
+
+void
+simulation_run_set_next_event_id(long int);
+
 Fifoqueue_Ptr
 fifoqueue_new(void);
 
@@ -196,6 +532,9 @@ fifoqueue_get(Fifoqueue_Ptr);
 int
 fifoqueue_size(Fifoqueue_Ptr);
 
+int
+fifoqueue_max_size(Fifoqueue_Ptr);
+
 void *
 fifoqueue_see_front(Fifoqueue_Ptr);
 
@@ -211,6 +550,45 @@ server_get(Server_Ptr);
 Server_State
 server_state(Server_Ptr);
 
+void
+fifoqueue_attach_stat(Fifoqueue_Ptr, Time_Weighted_Stat_Ptr);
+
+void
+server_attach_stat(Server_Ptr, Time_Weighted_Stat_Ptr);
+
+Time_Weighted_Stat_Ptr
+time_weighted_stat_new(Simulation_Run_Ptr);
+
+void
+time_weighted_stat_set(Time_Weighted_Stat_Ptr, int);
+
+void
+time_weighted_stat_change(Time_Weighted_Stat_Ptr, int);
+
+void
+time_weighted_stat_set_at(Time_Weighted_Stat_Ptr, double, int);
+
+void
+time_weighted_stat_advance(Time_Weighted_Stat_Ptr, double);
+
+void
+time_weighted_stat_reset(Time_Weighted_Stat_Ptr);
+
+double
+time_weighted_stat_elapsed(Time_Weighted_Stat_Ptr);
+
+double
+time_weighted_stat_mean(Time_Weighted_Stat_Ptr);
+
+double
+time_weighted_stat_probability(Time_Weighted_Stat_Ptr, int);
+
+double
+time_weighted_stat_tail(Time_Weighted_Stat_Ptr, int);
+
+void
+time_weighted_stat_free(Time_Weighted_Stat_Ptr);
+
 double
 exponential_generator(double);
 
@@ -220,6 +598,15 @@ uniform_generator(void);
 void
 random_generator_initialize(unsigned);
 
+unsigned
+random_generator_get(void);
+
+void
+random_generator_get_state(Random_State_Ptr);
+
+void
+random_generator_set_state(Random_State_Ptr);
+
 Rand_Stream_Ptr
 rand_stream_new(unsigned);
 
@@ -241,9 +628,15 @@ xmalloc(unsigned);
 void *
 xcalloc(unsigned, unsigned);
 
+void *
+xmalloc_named(unsigned, const char *);
+
 void
 xfree(void*);
 
+Allocation_Stats_Ptr
+xmalloc_stats(void);
+
 void
 simulation_run_free_memory(Simulation_Run_Ptr);
 
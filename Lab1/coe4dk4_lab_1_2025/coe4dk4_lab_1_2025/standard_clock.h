@@ -0,0 +1,114 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _STANDARD_CLOCK_H_
+#define _STANDARD_CLOCK_H_
+
+/******************************************************************************/
+
+/*
+ * Standard clock simulation of many M/M/c/K parameter variants at once.
+ *
+ * Every variant is uniformized at the same rate, the largest total event rate
+ * lambda + c mu of all the variants. A single stream of event epochs, spaced
+ * by exponential times at that rate, then drives all of them. At each epoch
+ * one uniform mark U is drawn and each variant decides, from its own state
+ * alone, whether the epoch is one of its arrivals (U < lambda), one of its
+ * departures (U < lambda + min(n, c) mu), or a fictitious self-transition.
+ * Each variant only holds its own number in system and its statistics, so a
+ * whole dimensioning grid costs one pass over the epochs, and the variants
+ * share common random numbers.
+ *
+ * The capacity is the maximum number in system, including those in service.
+ * Use STANDARD_CLOCK_INFINITE for an infinite queue (Erlang C) or a capacity
+ * equal to the number of servers for a loss system (Erlang B).
+ */
+
+#define STANDARD_CLOCK_INFINITE 0
+
+typedef struct _standard_clock_variant_
+{
+  double arrival_rate;
+  double service_rate;     /* per server */
+  int servers;
+  int capacity;
+
+  int number_in_system;
+
+  long int arrivals;
+  long int blocked;        /* arrivals that found the system full */
+  long int waited;         /* admitted arrivals that found all servers busy */
+  double integral_of_n;    /* time integrals of the number in system, */
+  double integral_of_queue;/* the number waiting */
+  double integral_of_busy; /* and the number of busy servers */
+} Standard_Clock_Variant, * Standard_Clock_Variant_Ptr;
+
+typedef struct _standard_clock_
+{
+  double uniformization_rate;
+  double time;
+  long int epochs;
+  int number_of_variants;
+  int allocated_variants;
+  Standard_Clock_Variant_Ptr variants;
+} Standard_Clock, * Standard_Clock_Ptr;
+
+typedef struct _standard_clock_results_
+{
+  double blocking_probability;
+  double wait_probability;       /* of an arrival, blocked ones included */
+  double mean_number_in_system;
+  double mean_delay;             /* time in system of admitted arrivals */
+  double mean_waiting_time;      /* over all admitted arrivals */
+  double mean_waiting_time_of_waiting; /* over those that had to wait */
+  double utilization;            /* per server */
+} Standard_Clock_Results, * Standard_Clock_Results_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Standard_Clock_Ptr
+standard_clock_new(void);
+
+int
+standard_clock_add_variant(Standard_Clock_Ptr, double, double, int, int);
+
+void
+standard_clock_run(Standard_Clock_Ptr, long int);
+
+void
+standard_clock_results(Standard_Clock_Ptr, int, Standard_Clock_Results_Ptr);
+
+void
+standard_clock_free(Standard_Clock_Ptr);
+
+/******************************************************************************/
+
+#endif /* standard_clock.h */
+
@@ -0,0 +1,257 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "statistics.h"
+#include "adaptive_grid.h"
+
+/******************************************************************************/
+
+/*
+ * Refine the curve over [low, high] from initial_points points with a
+ * budget of replications, until its relative error is within tolerance. The
+ * other settings can be changed before running.
+ */
+
+Adaptive_Grid_Ptr
+adaptive_grid_new(double low, double high, int initial_points, long int budget,
+		  double tolerance)
+{
+  Adaptive_Grid_Ptr grid;
+
+  if (!(low < high) || tolerance <= 0.0) {
+    printf("Error: Bad adaptive grid range [%g, %g].\n", low, high);
+    exit(1);
+  }
+
+  grid = (Adaptive_Grid_Ptr) xcalloc(1, sizeof(Adaptive_Grid));
+  grid->low = low;
+  grid->high = high;
+  grid->initial_points = initial_points;
+  grid->budget = budget;
+  grid->tolerance = tolerance;
+  grid->confidence = 0.95;
+  grid->min_replications = 3;
+  grid->max_replications = 1000;
+  grid->min_spacing = (high - low) / 1024;
+  return grid;
+}
+
+/*
+ * The size of the response around a point, to which its errors are
+ * relative.
+ */
+
+static double
+adaptive_grid_scale(double y)
+{
+  return (y != 0.0) ? fabs(y) : 1.0;
+}
+
+/*
+ * The relative error of interpolating linearly across the interval from
+ * point i to point i+1.
+ */
+
+double
+adaptive_grid_interpolation_error(Adaptive_Grid_Ptr grid, int i)
+{
+  Adaptive_Grid_Point_Ptr a = grid->points + i, b = a + 1;
+  double h = b->x - a->x;
+  double curvature = fmax(fabs(a->curvature), fabs(b->curvature));
+
+  return curvature * h * h / 8 /
+    adaptive_grid_scale(fmax(fabs(a->stat.mean), fabs(b->stat.mean)));
+}
+
+/*
+ * The relative half width of the mean of point i.
+ */
+
+double
+adaptive_grid_noise(Adaptive_Grid_Ptr grid, int i)
+{
+  Adaptive_Grid_Point_Ptr p = grid->points + i;
+
+  return running_stat_half_width(&p->stat, grid->confidence) /
+    adaptive_grid_scale(p->stat.mean);
+}
+
+/*
+ * The second divided differences of the means, carried over to the ends.
+ */
+
+static void
+adaptive_grid_update_curvature(Adaptive_Grid_Ptr grid)
+{
+  Adaptive_Grid_Point_Ptr p = grid->points;
+  int n = grid->number_of_points, i;
+  double left, right;
+
+  for (i=1; i<n-1; i++) {
+    left = (p[i].stat.mean - p[i-1].stat.mean) / (p[i].x - p[i-1].x);
+    right = (p[i+1].stat.mean - p[i].stat.mean) / (p[i+1].x - p[i].x);
+    p[i].curvature = 2 * (right - left) / (p[i+1].x - p[i-1].x);
+  }
+  p[0].curvature = p[1].curvature;
+  p[n-1].curvature = p[n-2].curvature;
+}
+
+static void
+adaptive_grid_replicate(Adaptive_Grid_Ptr grid, Adaptive_Grid_Point_Ptr p,
+			long int n, Adaptive_Grid_Function function,
+			void * argument)
+{
+  while (n-- > 0) {
+    running_stat_add(&p->stat, (*function)(p->x, (int) p->stat.count, argument));
+    grid->replications++;
+  }
+}
+
+/*
+ * Insert a point at x before point i and replicate it min_replications
+ * times.
+ */
+
+static void
+adaptive_grid_insert(Adaptive_Grid_Ptr grid, int i, double x,
+		     Adaptive_Grid_Function function, void * argument)
+{
+  Adaptive_Grid_Point_Ptr p = grid->points + i;
+
+  memmove(p + 1, p, (grid->number_of_points - i) * sizeof(Adaptive_Grid_Point));
+  grid->number_of_points++;
+
+  p->x = x;
+  p->curvature = 0.0;
+  running_stat_reset(&p->stat);
+  adaptive_grid_replicate(grid, p, grid->min_replications, function, argument);
+}
+
+/*
+ * Run the refinement. The points and their statistics are left in the grid.
+ */
+
+void
+adaptive_grid_run(Adaptive_Grid_Ptr grid, Adaptive_Grid_Function function,
+		  void * argument)
+{
+  Adaptive_Grid_Point_Ptr p;
+  double error, worst_error, noise, worst_noise;
+  long int more;
+  int i, worst_interval, worst_point;
+
+  if (grid->initial_points < 3) grid->initial_points = 3;
+  if (grid->min_replications < 2) grid->min_replications = 2;
+
+  /* No more points than the budget can pay for. */
+  grid->max_points = grid->initial_points +
+    grid->budget / grid->min_replications + 1;
+  if (grid->points != NULL) xfree((void *) grid->points);
+  grid->points = (Adaptive_Grid_Point_Ptr)
+    xcalloc(grid->max_points, sizeof(Adaptive_Grid_Point));
+
+  grid->number_of_points = 0;
+  grid->bisections = 0;
+  grid->replications = 0;
+
+  for (i=0; i<grid->initial_points; i++)
+    adaptive_grid_insert(grid, i, grid->low + i * (grid->high - grid->low) /
+			 (grid->initial_points - 1), function, argument);
+
+  for (;;) {
+    adaptive_grid_update_curvature(grid);
+
+    /* The worst interval that can still be bisected. */
+    worst_interval = -1;
+    worst_error = 0.0;
+    for (i=0; i<grid->number_of_points-1; i++) {
+      p = grid->points + i;
+      if ((p + 1)->x - p->x < 2 * grid->min_spacing) continue;
+      error = adaptive_grid_interpolation_error(grid, i);
+      if (error > worst_error) {
+	worst_error = error;
+	worst_interval = i;
+      }
+    }
+
+    /* The noisiest point that can still be replicated. */
+    worst_point = -1;
+    worst_noise = 0.0;
+    for (i=0; i<grid->number_of_points; i++) {
+      if (grid->points[i].stat.count >= grid->max_replications) continue;
+      noise = adaptive_grid_noise(grid, i);
+      if (noise > worst_noise) {
+	worst_noise = noise;
+	worst_point = i;
+      }
+    }
+
+    if (worst_error <= grid->tolerance && worst_noise <= grid->tolerance) {
+      grid->status = ADAPTIVE_GRID_CONVERGED;
+      return;
+    }
+
+    if (worst_error > worst_noise &&
+	grid->budget - grid->replications >= grid->min_replications &&
+	grid->number_of_points < grid->max_points) {
+      p = grid->points + worst_interval;
+      adaptive_grid_insert(grid, worst_interval + 1,
+			   0.5 * (p->x + (p + 1)->x), function, argument);
+      grid->bisections++;
+      continue;
+    }
+
+    if (worst_noise > grid->tolerance) {
+      p = grid->points + worst_point;
+      more = p->stat.count;
+      if (more > grid->max_replications - p->stat.count)
+	more = grid->max_replications - p->stat.count;
+      if (more > grid->budget - grid->replications)
+	more = grid->budget - grid->replications;
+      if (more > 0) {
+	adaptive_grid_replicate(grid, p, more, function, argument);
+	continue;
+      }
+    }
+
+    grid->status = ADAPTIVE_GRID_BUDGET_SPENT;
+    return;
+  }
+}
+
+void
+adaptive_grid_free(Adaptive_Grid_Ptr grid)
+{
+  if (grid->points != NULL) xfree((void *) grid->points);
+  xfree((void *) grid);
+}
+
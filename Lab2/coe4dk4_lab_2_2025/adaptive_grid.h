@@ -0,0 +1,125 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _ADAPTIVE_GRID_H_
+#define _ADAPTIVE_GRID_H_
+
+/******************************************************************************/
+
+#include "statistics.h"
+
+/******************************************************************************/
+
+/*
+ * Adaptive grid refinement of a noisy response curve.
+ *
+ * A response, e.g., the mean delay of a queue against its arrival rate, is
+ * flat over most of its range and steep near saturation. A uniform grid
+ * wastes runs on the flat part and undersamples the knee. Here the curve is
+ * started on a coarse uniform grid of initial_points points with
+ * min_replications each, and then refined one step at a time, within a
+ * budget of replications in total:
+ *
+ *  - the error of interpolating linearly across an interval of width h is
+ *    about |y''| h^2 / 8, with y'' estimated by the second divided
+ *    difference at the ends of the interval;
+ *
+ *  - the noise of a point is the half width of the confidence interval of
+ *    its mean.
+ *
+ * Both are taken relative to the size of the local mean (absolute where the
+ * mean is zero). Each step works on the larger of the two: the worst
+ * interval is bisected, or the noisiest point gets as many replications
+ * again (at most max_replications). The curvature is only trusted once the
+ * points around it are quiet, since the noise is dealt with first whenever
+ * it is larger. The refinement stops when both are below tolerance
+ * (converged), or when the budget is spent. Intervals narrower than twice
+ * min_spacing are not bisected.
+ *
+ * function(x, replication, argument) returns one replication of the
+ * response at x. Replication k of every point should use the same random
+ * seed (common random numbers), so that the differences between neighbours,
+ * and hence the curvature, are not swamped by the noise.
+ */
+
+typedef double (* Adaptive_Grid_Function)(double, int, void *);
+
+typedef enum {ADAPTIVE_GRID_CONVERGED, ADAPTIVE_GRID_BUDGET_SPENT}
+  Adaptive_Grid_Status;
+
+typedef struct _adaptive_grid_point_
+{
+  double x;
+  Running_Stat stat;      /* of the replications */
+  double curvature;       /* second divided difference (y'') */
+} Adaptive_Grid_Point, * Adaptive_Grid_Point_Ptr;
+
+typedef struct _adaptive_grid_
+{
+  double low;
+  double high;
+  int initial_points;     /* at least 3 */
+  long int budget;        /* replications in total */
+  double tolerance;       /* relative */
+  double confidence;
+  long int min_replications;  /* at least 2 */
+  long int max_replications;  /* per point */
+  double min_spacing;
+
+  int number_of_points;   /* in increasing x */
+  int max_points;
+  Adaptive_Grid_Point_Ptr points;
+
+  Adaptive_Grid_Status status;
+  int bisections;
+  long int replications;  /* in total */
+} Adaptive_Grid, * Adaptive_Grid_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Adaptive_Grid_Ptr
+adaptive_grid_new(double, double, int, long int, double);
+
+void
+adaptive_grid_run(Adaptive_Grid_Ptr, Adaptive_Grid_Function, void *);
+
+double
+adaptive_grid_interpolation_error(Adaptive_Grid_Ptr, int);
+
+double
+adaptive_grid_noise(Adaptive_Grid_Ptr, int);
+
+void
+adaptive_grid_free(Adaptive_Grid_Ptr);
+
+/******************************************************************************/
+
+#endif /* adaptive_grid.h */
+
@@ -0,0 +1,275 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "simlib.h"
+#include "branch.h"
+
+/******************************************************************************/
+
+/*
+ * Create the branches of a run into the given number of children, each
+ * returning number_of_values values.
+ */
+
+Branch_Ptr
+branch_new(int number_of_children, int number_of_values)
+{
+  Branch_Ptr branch;
+  int i;
+
+  branch = (Branch_Ptr) xcalloc(1, sizeof(Branch));
+  branch->number_of_children = number_of_children;
+  branch->number_of_values = number_of_values;
+  branch->values = (double *) xcalloc(number_of_children * number_of_values,
+				      sizeof(double));
+  for (i=0; i<number_of_children * number_of_values; i++)
+    branch->values[i] = NAN;
+
+#ifdef _WIN32
+  branch->workers = 1;
+#else
+  branch->workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (branch->workers < 1) branch->workers = 1;
+#endif
+
+  return branch;
+}
+
+/*
+ * Set the variable to the value in the given child (or in all of them if
+ * child is -1) before it continues.
+ */
+
+void
+branch_add_override(Branch_Ptr branch, int child, double * variable,
+		    double value)
+{
+  Branch_Override_Ptr override;
+
+  if (branch->number_of_overrides >= BRANCH_MAX_OVERRIDES) {
+    printf("Error: Too many branch overrides.\n");
+    exit(1);
+  }
+  override = branch->overrides + branch->number_of_overrides++;
+  override->child = child;
+  override->variable = variable;
+  override->value = value;
+}
+
+/*
+ * The seed of a substream: a 32-bit FNV-1a hash of the generator state at
+ * the branch point and the substream number.
+ */
+
+static unsigned
+branch_seed(Random_State_Ptr state, int stream)
+{
+  const unsigned char * p;
+  unsigned hash = 2166136261U;
+  size_t i;
+
+  p = (const unsigned char *) state->table;
+  for (i=0; i<sizeof(state->table); i++) hash = (hash ^ p[i]) * 16777619U;
+  p = (const unsigned char *) &stream;
+  for (i=0; i<sizeof(stream); i++) hash = (hash ^ p[i]) * 16777619U;
+
+  return hash;
+}
+
+/******************************************************************************/
+
+#ifndef _WIN32
+
+static int
+branch_read_fully(int fd, void * buffer, size_t size)
+{
+  char * p = (char *) buffer;
+  ssize_t n;
+
+  while (size > 0) {
+    n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    p += n;
+    size -= n;
+  }
+  return 1;
+}
+
+static int
+branch_write_fully(int fd, const void * buffer, size_t size)
+{
+  const char * p = (const char *) buffer;
+  ssize_t n;
+
+  while (size > 0) {
+    n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    p += n;
+    size -= n;
+  }
+  return 1;
+}
+
+/*
+ * Continue the run in a child. This never returns.
+ */
+
+static void
+branch_child(Branch_Ptr branch, Simulation_Run_Ptr simulation_run,
+	     Branch_Function function, void * argument, int child,
+	     Random_State_Ptr state, int fd)
+{
+  Branch_Override_Ptr override;
+  double * values;
+  int i;
+
+  if (freopen("/dev/null", "w", stdout) == NULL) _exit(1);
+
+  /*
+   * The metrics page and the trace are the parent's, still publishing and
+   * recording its own run.
+   */
+  simulation_run->metrics = NULL;
+  simulation_run->trace = NULL;
+
+  for (i=0; i<branch->number_of_overrides; i++) {
+    override = branch->overrides + i;
+    if (override->child < 0 || override->child == child)
+      *override->variable = override->value;
+  }
+
+  random_generator_initialize(branch_seed(state,
+		      branch->common_random_numbers ? 0 : child));
+
+  values = branch->values + child * branch->number_of_values;
+  (*function)(simulation_run, child, values, argument);
+
+  if (!branch_write_fully(fd, values,
+			  branch->number_of_values * sizeof(double)))
+    _exit(1);
+  _exit(0);
+}
+
+/*
+ * Wait for a child and read its values.
+ */
+
+static int
+branch_collect(Branch_Ptr branch, int child, int fd, pid_t pid)
+{
+  double * values = branch->values + child * branch->number_of_values;
+  int i, status, ok;
+
+  ok = branch_read_fully(fd, values, branch->number_of_values * sizeof(double));
+  close(fd);
+  waitpid(pid, &status, 0);
+
+  if (!ok) {
+    for (i=0; i<branch->number_of_values; i++) values[i] = NAN;
+    fprintf(stderr, "Error: Branch %d failed.\n", child);
+  }
+  return ok;
+}
+
+#endif /* _WIN32 */
+
+/*
+ * Branch the run at its current state. Each child i calls the function
+ * with its number and its values to set. Returns the number of children
+ * that failed.
+ */
+
+int
+branch_run(Branch_Ptr branch, Simulation_Run_Ptr simulation_run,
+	   Branch_Function function, void * argument)
+{
+#ifdef _WIN32
+  printf("Error: Branching a run needs fork().\n");
+  exit(1);
+#else
+  Random_State state;
+  int * fds;
+  pid_t * pids;
+  int child, oldest, fd[2], failed = 0;
+
+  random_generator_get_state(&state);
+
+  fds = (int *) xcalloc(branch->number_of_children, sizeof(int));
+  pids = (pid_t *) xcalloc(branch->number_of_children, sizeof(pid_t));
+
+  /* A child that dies is noticed on its pipe instead. */
+  signal(SIGPIPE, SIG_IGN);
+  fflush(NULL);
+
+  /* Keep up to workers children running, collecting the oldest first. */
+  for (child=0, oldest=0; oldest<branch->number_of_children; ) {
+    if (child < branch->number_of_children &&
+	child - oldest < branch->workers) {
+      if (pipe(fd) != 0 || (pids[child] = fork()) < 0) {
+	printf("Error: Could not start branch %d.\n", child);
+	exit(1);
+      }
+      if (pids[child] == 0) {
+	close(fd[0]);
+	branch_child(branch, simulation_run, function, argument, child,
+		     &state, fd[1]);
+      }
+      close(fd[1]);
+      fds[child++] = fd[0];
+    } else {
+      if (!branch_collect(branch, oldest, fds[oldest], pids[oldest])) failed++;
+      oldest++;
+    }
+  }
+
+  xfree((void *) pids);
+  xfree((void *) fds);
+
+  return failed;
+#endif
+}
+
+void
+branch_free(Branch_Ptr branch)
+{
+  xfree((void *) branch->values);
+  xfree((void *) branch);
+}
+
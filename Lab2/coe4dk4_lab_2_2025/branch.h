@@ -0,0 +1,102 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _BRANCH_H_
+#define _BRANCH_H_
+
+/******************************************************************************/
+
+#include "simlib.h"
+
+/******************************************************************************/
+
+/*
+ * What-if branches of a simulation run.
+ *
+ * A run is brought to some state, e.g., the end of a warm-up, and then split
+ * into a number of children, each continuing from that state under its own
+ * parameter overrides. Each child is a fork() of the calling process, so the
+ * state is shared copy-on-write and the warm-up is paid only once; the
+ * calling process and its run are left as they were.
+ *
+ * Before calling the branch function, a child sets its overrides and
+ * reseeds the random generator with its own substream, derived from the
+ * generator state at the branch point and the child number. With
+ * common_random_numbers set, all children use the same substream instead,
+ * so that differences between them come from the overrides rather than the
+ * noise. The branch function continues the run and sets the child's values,
+ * which are sent back to the caller. A child that fails leaves NaN values.
+ *
+ * Up to workers children run at once (the number of CPUs by default).
+ * Without fork (Windows) runs cannot be branched.
+ */
+
+#define BRANCH_MAX_OVERRIDES 64
+
+typedef void (* Branch_Function)(Simulation_Run_Ptr, int, double *, void *);
+
+typedef struct _branch_override_
+{
+  int child;
+  double * variable;
+  double value;
+} Branch_Override, * Branch_Override_Ptr;
+
+typedef struct _branch_
+{
+  int number_of_children;
+  int number_of_values;   /* per child */
+  double * values;        /* [child * number_of_values + value] */
+
+  int number_of_overrides;
+  Branch_Override overrides[BRANCH_MAX_OVERRIDES];
+
+  int common_random_numbers;
+  int workers;
+} Branch, * Branch_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Branch_Ptr
+branch_new(int, int);
+
+void
+branch_add_override(Branch_Ptr, int, double *, double);
+
+int
+branch_run(Branch_Ptr, Simulation_Run_Ptr, Branch_Function, void *);
+
+void
+branch_free(Branch_Ptr);
+
+/******************************************************************************/
+
+#endif /* branch.h */
+
@@ -0,0 +1,667 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "simlib.h"
+#include "checkpoint.h"
+
+/******************************************************************************/
+
+#define CHECKPOINT_MAGIC "SIMLIBC1"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static unsigned long long
+checkpoint_hash(unsigned long long hash, const void * data, size_t size)
+{
+  const unsigned char * p = (const unsigned char *) data;
+
+  while (size-- > 0) {
+    hash ^= *p++;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+/*
+ * A hash of everything registered, written at the start of the file so that
+ * a checkpoint is only restored into a run of the same shape.
+ */
+
+static unsigned long long
+checkpoint_signature(Checkpoint_Ptr checkpoint)
+{
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  int i, j;
+
+  for (i=0; i<checkpoint->number_of_types; i++) {
+    Checkpoint_Type_Ptr type = checkpoint->types + i;
+
+    hash = checkpoint_hash(hash, &type->size, sizeof(type->size));
+    for (j=0; j<type->number_of_pointers; j++)
+      hash = checkpoint_hash(hash, type->pointer_offsets + j,
+			     sizeof(type->pointer_offsets[j]));
+  }
+  for (i=0; i<checkpoint->number_of_events; i++) {
+    hash = checkpoint_hash(hash, checkpoint->events[i].description,
+			   strlen(checkpoint->events[i].description) + 1);
+    hash = checkpoint_hash(hash, &checkpoint->events[i].type,
+			   sizeof(checkpoint->events[i].type));
+  }
+  for (i=0; i<checkpoint->number_of_items; i++) {
+    hash = checkpoint_hash(hash, &checkpoint->items[i].kind,
+			   sizeof(checkpoint->items[i].kind));
+    hash = checkpoint_hash(hash, &checkpoint->items[i].size,
+			   sizeof(checkpoint->items[i].size));
+    hash = checkpoint_hash(hash, &checkpoint->items[i].type,
+			   sizeof(checkpoint->items[i].type));
+  }
+  return hash;
+}
+
+/******************************************************************************/
+
+/*
+ * Registration.
+ */
+
+Checkpoint_Ptr
+checkpoint_new(Simulation_Run_Ptr simulation_run)
+{
+  Checkpoint_Ptr checkpoint;
+
+  checkpoint = (Checkpoint_Ptr) xcalloc(1, sizeof(Checkpoint));
+  checkpoint->simulation_run = simulation_run;
+  return checkpoint;
+}
+
+/*
+ * Add a customer type of the given size. Returns its type number.
+ */
+
+int
+checkpoint_add_type(Checkpoint_Ptr checkpoint, unsigned size)
+{
+  if (checkpoint->number_of_types >= CHECKPOINT_MAX_TYPES) {
+    printf("Error: Too many checkpoint types.\n");
+    exit(1);
+  }
+  checkpoint->types[checkpoint->number_of_types].size = size;
+  return checkpoint->number_of_types++;
+}
+
+/*
+ * Declare a field of a customer type, at the given offset, that points to a
+ * registered queue, server or statistic (or is NULL).
+ */
+
+void
+checkpoint_add_type_pointer(Checkpoint_Ptr checkpoint, int type,
+			    unsigned offset)
+{
+  Checkpoint_Type_Ptr t = checkpoint->types + type;
+
+  if (t->number_of_pointers >= CHECKPOINT_MAX_POINTERS ||
+      offset + sizeof(void *) > t->size) {
+    printf("Error: Bad checkpoint pointer field at offset %u.\n", offset);
+    exit(1);
+  }
+  t->pointer_offsets[t->number_of_pointers++] = offset;
+}
+
+void
+checkpoint_add_event(Checkpoint_Ptr checkpoint, const char * description,
+		     void (*function)(Simulation_Run_Ptr, void *), int type)
+{
+  Checkpoint_Event_Ptr event;
+
+  if (checkpoint->number_of_events >= CHECKPOINT_MAX_EVENTS) {
+    printf("Error: Too many checkpoint event types.\n");
+    exit(1);
+  }
+  event = checkpoint->events + checkpoint->number_of_events++;
+  event->description = description;
+  event->function = function;
+  event->type = type;
+}
+
+static void
+checkpoint_add_item(Checkpoint_Ptr checkpoint, Checkpoint_Item_Kind kind,
+		    void * address, unsigned size, int type)
+{
+  Checkpoint_Item_Ptr item;
+
+  if (checkpoint->number_of_items >= CHECKPOINT_MAX_ITEMS) {
+    printf("Error: Too many checkpoint items.\n");
+    exit(1);
+  }
+  item = checkpoint->items + checkpoint->number_of_items++;
+  item->kind = kind;
+  item->address = address;
+  item->size = size;
+  item->type = type;
+}
+
+void
+checkpoint_add_fifoqueue(Checkpoint_Ptr checkpoint, Fifoqueue_Ptr queue,
+			 int type)
+{
+  checkpoint_add_item(checkpoint, CHECKPOINT_FIFOQUEUE, queue, 0, type);
+}
+
+void
+checkpoint_add_server(Checkpoint_Ptr checkpoint, Server_Ptr server, int type)
+{
+  checkpoint_add_item(checkpoint, CHECKPOINT_SERVER, server, 0, type);
+}
+
+void
+checkpoint_add_stat(Checkpoint_Ptr checkpoint, Time_Weighted_Stat_Ptr stat)
+{
+  checkpoint_add_item(checkpoint, CHECKPOINT_STAT, stat, 0,
+		      CHECKPOINT_OBJECT);
+}
+
+void
+checkpoint_add_values(Checkpoint_Ptr checkpoint, void * address,
+		      unsigned size)
+{
+  checkpoint_add_item(checkpoint, CHECKPOINT_VALUES, address, size,
+		      CHECKPOINT_OBJECT);
+}
+
+/******************************************************************************/
+
+/*
+ * The translation between pointers and indices.
+ */
+
+static long int
+checkpoint_slot(Checkpoint_Ptr checkpoint, void * pointer)
+{
+  unsigned long long h = (unsigned long long) (size_t) pointer;
+
+  h = (h >> 4) * 0x9E3779B97F4A7C15ULL;
+  return (long int) (h >> 20) & (checkpoint->table_size - 1);
+}
+
+/*
+ * Return the index of a known object, or -1.
+ */
+
+static long int
+checkpoint_find_object(Checkpoint_Ptr checkpoint, void * pointer)
+{
+  long int slot;
+
+  if (checkpoint->table_size == 0) return -1;
+
+  slot = checkpoint_slot(checkpoint, pointer);
+  while (checkpoint->table[slot] >= 0) {
+    if (checkpoint->objects[checkpoint->table[slot]] == pointer)
+      return checkpoint->table[slot];
+    slot = (slot + 1) & (checkpoint->table_size - 1);
+  }
+  return -1;
+}
+
+static void
+checkpoint_rehash(Checkpoint_Ptr checkpoint, long int table_size)
+{
+  long int i, slot;
+
+  if (checkpoint->table != NULL) xfree(checkpoint->table);
+  checkpoint->table_size = table_size;
+  checkpoint->table = (long int *) xmalloc(table_size * sizeof(long int));
+  for (i=0; i<table_size; i++) checkpoint->table[i] = -1;
+
+  for (i=0; i<checkpoint->number_of_objects; i++) {
+    slot = checkpoint_slot(checkpoint, checkpoint->objects[i]);
+    while (checkpoint->table[slot] >= 0)
+      slot = (slot + 1) & (table_size - 1);
+    checkpoint->table[slot] = i;
+  }
+}
+
+/*
+ * Number a new object. The hash table is only kept while saving.
+ */
+
+static long int
+checkpoint_add_object(Checkpoint_Ptr checkpoint, void * pointer, int saving)
+{
+  long int i, slot;
+  void ** objects;
+
+  if (checkpoint->number_of_objects == checkpoint->objects_size) {
+    checkpoint->objects_size = 2 * checkpoint->objects_size + 64;
+    objects = (void **) xmalloc(checkpoint->objects_size * sizeof(void *));
+    for (i=0; i<checkpoint->number_of_objects; i++)
+      objects[i] = checkpoint->objects[i];
+    if (checkpoint->objects != NULL) xfree(checkpoint->objects);
+    checkpoint->objects = objects;
+  }
+  checkpoint->objects[checkpoint->number_of_objects] = pointer;
+
+  if (saving) {
+    /* The slots are masked, so the table size is a power of two. */
+    if (2 * (checkpoint->number_of_objects + 1) > checkpoint->table_size) {
+      for (i = 64; i < 2 * checkpoint->objects_size; i *= 2);
+      checkpoint_rehash(checkpoint, i);
+    }
+    slot = checkpoint_slot(checkpoint, pointer);
+    while (checkpoint->table[slot] >= 0)
+      slot = (slot + 1) & (checkpoint->table_size - 1);
+    checkpoint->table[slot] = checkpoint->number_of_objects;
+  }
+  return checkpoint->number_of_objects++;
+}
+
+/*
+ * Number the registered queues, servers and statistics, which come first.
+ */
+
+static void
+checkpoint_start(Checkpoint_Ptr checkpoint, FILE * file, int saving)
+{
+  int i;
+
+  checkpoint->file = file;
+  checkpoint->number_of_objects = 0;
+  for (i=0; i<checkpoint->number_of_items; i++)
+    if (checkpoint->items[i].kind != CHECKPOINT_VALUES)
+      checkpoint_add_object(checkpoint, checkpoint->items[i].address, saving);
+}
+
+static void
+checkpoint_finish(Checkpoint_Ptr checkpoint)
+{
+  if (checkpoint->objects != NULL) xfree(checkpoint->objects);
+  if (checkpoint->table != NULL) xfree(checkpoint->table);
+  checkpoint->objects = NULL;
+  checkpoint->table = NULL;
+  checkpoint->objects_size = 0;
+  checkpoint->table_size = 0;
+  checkpoint->number_of_objects = 0;
+  checkpoint->file = NULL;
+}
+
+/******************************************************************************/
+
+/*
+ * Saving.
+ */
+
+static void
+checkpoint_write(Checkpoint_Ptr checkpoint, const void * data, size_t size)
+{
+  if (size > 0 && fwrite(data, size, 1, checkpoint->file) != 1) {
+    printf("Error: Could not write the checkpoint.\n");
+    exit(1);
+  }
+}
+
+/*
+ * Write a pointer as an index. A customer of the given type met for the
+ * first time is numbered and written in full after its index.
+ */
+
+static void
+checkpoint_write_reference(Checkpoint_Ptr checkpoint, void * pointer,
+			   int type)
+{
+  Checkpoint_Type_Ptr t;
+  long int index = -1;
+  void * field;
+  int i;
+
+  if (pointer != NULL) index = checkpoint_find_object(checkpoint, pointer);
+
+  if (pointer == NULL || index >= 0) {
+    checkpoint_write(checkpoint, &index, sizeof(index));
+    return;
+  }
+
+  if (type == CHECKPOINT_OBJECT) {
+    printf("Error: Checkpoint of a pointer to an unregistered object.\n");
+    exit(1);
+  }
+
+  t = checkpoint->types + type;
+  index = checkpoint_add_object(checkpoint, pointer, 1);
+  checkpoint_write(checkpoint, &index, sizeof(index));
+  checkpoint_write(checkpoint, pointer, t->size);
+
+  for (i=0; i<t->number_of_pointers; i++) {
+    memcpy(&field, (char *) pointer + t->pointer_offsets[i], sizeof(field));
+    checkpoint_write_reference(checkpoint, field, CHECKPOINT_OBJECT);
+  }
+}
+
+static int
+checkpoint_find_event(Checkpoint_Ptr checkpoint, Event event)
+{
+  int i;
+
+  for (i=0; i<checkpoint->number_of_events; i++)
+    if (checkpoint->events[i].function == event.function &&
+	strcmp(checkpoint->events[i].description, event.description) == 0)
+      return i;
+
+  printf("Error: Checkpoint of an unregistered event \"%s\".\n",
+	 event.description);
+  exit(1);
+}
+
+/*
+ * Save the run to the named file.
+ */
+
+void
+checkpoint_save(Checkpoint_Ptr checkpoint, const char * filename)
+{
+  char temporary[512];
+  unsigned long long signature;
+  Random_State random_state;
+  Event_Container_Ptr container;
+  Queue_Container_Ptr queue_container;
+  Checkpoint_Item_Ptr item;
+  Fifoqueue_Ptr queue;
+  Server_Ptr server;
+  Time_Weighted_Stat_Ptr stat;
+  Simulation_Run_Ptr simulation_run = checkpoint->simulation_run;
+  double time;
+  long int next_event_id, size;
+  int i, event_type, state;
+  FILE * file;
+
+  sprintf(temporary, "%.400s.%d.tmp", filename, (int) getpid());
+  if ((file = fopen(temporary, "wb")) == NULL) {
+    printf("Error: Could not write the checkpoint file %s.\n", temporary);
+    exit(1);
+  }
+  checkpoint_start(checkpoint, file, 1);
+
+  signature = checkpoint_signature(checkpoint);
+  time = simulation_run_get_time(simulation_run);
+  next_event_id = simulation_run_get_next_event_id();
+  random_generator_get_state(&random_state);
+
+  checkpoint_write(checkpoint, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC));
+  checkpoint_write(checkpoint, &signature, sizeof(signature));
+  checkpoint_write(checkpoint, &time, sizeof(time));
+  checkpoint_write(checkpoint, &next_event_id, sizeof(next_event_id));
+  checkpoint_write(checkpoint, &random_state, sizeof(random_state));
+
+  for (i=0; i<checkpoint->number_of_items; i++) {
+    item = checkpoint->items + i;
+
+    switch (item->kind) {
+    case CHECKPOINT_VALUES:
+      checkpoint_write(checkpoint, item->address, item->size);
+      break;
+
+    case CHECKPOINT_FIFOQUEUE:
+      queue = (Fifoqueue_Ptr) item->address;
+      size = queue->size;
+      checkpoint_write(checkpoint, &size, sizeof(size));
+      for (queue_container = queue->front_ptr; queue_container != NULL;
+	   queue_container = queue_container->next_ptr)
+	checkpoint_write_reference(checkpoint, queue_container->content_ptr,
+				   item->type);
+      break;
+
+    case CHECKPOINT_SERVER:
+      server = (Server_Ptr) item->address;
+      state = (int) server->state;
+      checkpoint_write(checkpoint, &state, sizeof(state));
+      checkpoint_write_reference(checkpoint, server->customer_in_service,
+				 item->type);
+      break;
+
+    case CHECKPOINT_STAT:
+      stat = (Time_Weighted_Stat_Ptr) item->address;
+      checkpoint_write(checkpoint, &stat->start_time, sizeof(double));
+      checkpoint_write(checkpoint, &stat->last_time, sizeof(double));
+      checkpoint_write(checkpoint, &stat->value, sizeof(int));
+      checkpoint_write(checkpoint, &stat->max_value, sizeof(int));
+      checkpoint_write(checkpoint, &stat->integral, sizeof(double));
+      checkpoint_write(checkpoint, &stat->number_of_levels, sizeof(int));
+      checkpoint_write(checkpoint, stat->time_at_level,
+		       stat->number_of_levels * sizeof(double));
+      break;
+    }
+  }
+
+  /* The event list, in order. */
+  size = simulation_run->eventlist->size;
+  checkpoint_write(checkpoint, &size, sizeof(size));
+  for (container = simulation_run->eventlist->front_ptr; container != NULL;
+       container = container->next_container) {
+    event_type = checkpoint_find_event(checkpoint, container->event);
+    checkpoint_write(checkpoint, &event_type, sizeof(event_type));
+    checkpoint_write(checkpoint, &container->occurrence_time, sizeof(double));
+    checkpoint_write(checkpoint, &container->event_id, sizeof(long int));
+    checkpoint_write_reference(checkpoint, container->event.attachment,
+			       checkpoint->events[event_type].type);
+  }
+
+  checkpoint_finish(checkpoint);
+
+#ifdef _WIN32
+  remove(filename);
+#endif
+  if (fclose(file) != 0 || rename(temporary, filename) != 0) {
+    printf("Error: Could not store the checkpoint file %s.\n", filename);
+    exit(1);
+  }
+}
+
+/******************************************************************************/
+
+/*
+ * Restoring.
+ */
+
+static void
+checkpoint_read(Checkpoint_Ptr checkpoint, void * data, size_t size)
+{
+  if (size > 0 && fread(data, size, 1, checkpoint->file) != 1) {
+    printf("Error: The checkpoint file is truncated.\n");
+    exit(1);
+  }
+}
+
+static void *
+checkpoint_read_reference(Checkpoint_Ptr checkpoint, int type)
+{
+  Checkpoint_Type_Ptr t;
+  long int index;
+  void * pointer, * field;
+  int i;
+
+  checkpoint_read(checkpoint, &index, sizeof(index));
+
+  if (index < 0) return NULL;
+  if (index < checkpoint->number_of_objects)
+    return checkpoint->objects[index];
+
+  if (index > checkpoint->number_of_objects || type == CHECKPOINT_OBJECT) {
+    printf("Error: The checkpoint file is corrupt.\n");
+    exit(1);
+  }
+
+  t = checkpoint->types + type;
+  pointer = xmalloc(t->size);
+  checkpoint_read(checkpoint, pointer, t->size);
+  checkpoint_add_object(checkpoint, pointer, 0);
+
+  for (i=0; i<t->number_of_pointers; i++) {
+    field = checkpoint_read_reference(checkpoint, CHECKPOINT_OBJECT);
+    memcpy((char *) pointer + t->pointer_offsets[i], &field, sizeof(field));
+  }
+  return pointer;
+}
+
+/*
+ * Restore the named file into the run. Returns 0, leaving the run alone, if
+ * the file does not exist, and 1 once restored.
+ */
+
+int
+checkpoint_restore(Checkpoint_Ptr checkpoint, const char * filename)
+{
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  unsigned long long signature;
+  Random_State random_state;
+  Checkpoint_Item_Ptr item;
+  Fifoqueue_Ptr queue;
+  Time_Weighted_Stat_Ptr stat, queue_stat;
+  Server_Ptr server;
+  Event event;
+  Simulation_Run_Ptr simulation_run = checkpoint->simulation_run;
+  double time, event_time;
+  long int next_event_id, event_id, size, j;
+  int i, event_type, state, number_of_levels;
+  FILE * file;
+
+  if ((file = fopen(filename, "rb")) == NULL) return 0;
+
+  if (simulation_run->eventlist->size != 0) {
+    printf("Error: Checkpoint restored into a run with events scheduled.\n");
+    exit(1);
+  }
+
+  checkpoint_start(checkpoint, file, 0);
+
+  checkpoint_read(checkpoint, magic, strlen(CHECKPOINT_MAGIC));
+  checkpoint_read(checkpoint, &signature, sizeof(signature));
+  if (memcmp(magic, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)) != 0 ||
+      signature != checkpoint_signature(checkpoint)) {
+    printf("Error: %s is not a checkpoint of this model.\n", filename);
+    exit(1);
+  }
+
+  checkpoint_read(checkpoint, &time, sizeof(time));
+  checkpoint_read(checkpoint, &next_event_id, sizeof(next_event_id));
+  checkpoint_read(checkpoint, &random_state, sizeof(random_state));
+
+  simulation_run->clock->time = time;
+  random_generator_set_state(&random_state);
+
+  for (i=0; i<checkpoint->number_of_items; i++) {
+    item = checkpoint->items + i;
+
+    switch (item->kind) {
+    case CHECKPOINT_VALUES:
+      checkpoint_read(checkpoint, item->address, item->size);
+      break;
+
+    case CHECKPOINT_FIFOQUEUE:
+      /* Refill the queue without counting in its statistic. */
+      queue = (Fifoqueue_Ptr) item->address;
+      queue_stat = queue->stat;
+      queue->stat = NULL;
+      checkpoint_read(checkpoint, &size, sizeof(size));
+      for (j=0; j<size; j++)
+	fifoqueue_put(queue, checkpoint_read_reference(checkpoint, item->type));
+      queue->stat = queue_stat;
+      break;
+
+    case CHECKPOINT_SERVER:
+      server = (Server_Ptr) item->address;
+      checkpoint_read(checkpoint, &state, sizeof(state));
+      server->state = (Server_State) state;
+      server->customer_in_service =
+	checkpoint_read_reference(checkpoint, item->type);
+      break;
+
+    case CHECKPOINT_STAT:
+      stat = (Time_Weighted_Stat_Ptr) item->address;
+      checkpoint_read(checkpoint, &stat->start_time, sizeof(double));
+      checkpoint_read(checkpoint, &stat->last_time, sizeof(double));
+      checkpoint_read(checkpoint, &stat->value, sizeof(int));
+      checkpoint_read(checkpoint, &stat->max_value, sizeof(int));
+      checkpoint_read(checkpoint, &stat->integral, sizeof(double));
+      checkpoint_read(checkpoint, &number_of_levels, sizeof(int));
+      xfree(stat->time_at_level);
+      stat->number_of_levels = number_of_levels;
+      stat->time_at_level = (double *) xcalloc(number_of_levels,
+					       sizeof(double));
+      checkpoint_read(checkpoint, stat->time_at_level,
+		      number_of_levels * sizeof(double));
+      break;
+    }
+  }
+
+  /*
+   * Rebuild the event list. Each event is scheduled with its own id, and
+   * since equal times go after those already there, in the saved order.
+   */
+  checkpoint_read(checkpoint, &size, sizeof(size));
+  for (j=0; j<size; j++) {
+    checkpoint_read(checkpoint, &event_type, sizeof(event_type));
+    checkpoint_read(checkpoint, &event_time, sizeof(event_time));
+    checkpoint_read(checkpoint, &event_id, sizeof(event_id));
+    if (event_type < 0 || event_type >= checkpoint->number_of_events) {
+      printf("Error: The checkpoint file is corrupt.\n");
+      exit(1);
+    }
+    event.description = checkpoint->events[event_type].description;
+    event.function = checkpoint->events[event_type].function;
+    event.attachment =
+      checkpoint_read_reference(checkpoint,
+				checkpoint->events[event_type].type);
+
+    simulation_run_set_next_event_id(event_id);
+    simulation_run_schedule_event(simulation_run, event, event_time);
+  }
+  simulation_run_set_next_event_id(next_event_id);
+
+  checkpoint_finish(checkpoint);
+  fclose(file);
+  return 1;
+}
+
+/******************************************************************************/
+
+void
+checkpoint_free(Checkpoint_Ptr checkpoint)
+{
+  checkpoint_finish(checkpoint);
+  xfree((void *) checkpoint);
+}
+
@@ -0,0 +1,180 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include "simlib.h"
+
+/******************************************************************************/
+
+/*
+ * Checkpoints of a simulation run.
+ *
+ * A checkpoint saves the clock, the event list, the random generator, and the
+ * model state that was registered with it to a compact binary file, and
+ * restores them into a freshly built run. A run that was stopped can then
+ * resume, or a warmed-up state can be saved once and used as the start of
+ * many runs.
+ *
+ * The model registers, in the same order before saving and before restoring:
+ *
+ *   - its customer types (checkpoint_add_type), plain structures copied
+ *     byte for byte. Fields pointing to registered queues, servers or
+ *     statistics are declared with checkpoint_add_type_pointer and saved
+ *     as indices.
+ *   - its event types (checkpoint_add_event), by description and function,
+ *     with the type of the attachment: a customer type, or
+ *     CHECKPOINT_OBJECT when the attachment is a registered queue, server
+ *     or statistic (or NULL).
+ *   - its queues and servers, with the customer type they hold, and its
+ *     time weighted statistics.
+ *   - its plain values (counters, sums, Running_Stat structures, the
+ *     counts of histograms and so on) with checkpoint_add_values.
+ *
+ * Pointers are written as indices: the registered objects are numbered in
+ * the order they were added, and each customer is numbered when first met
+ * and written in full only then, so one referenced from both a queue and an
+ * event is restored as one object. On restoring, the queues, servers and
+ * statistics must be the empty ones of a newly built run, with no events
+ * scheduled; the customers are allocated with xmalloc.
+ *
+ * The file starts with a description of what was registered and is only
+ * restored into a run that registered the same. It holds the raw bytes of
+ * the values, so it is read back by the same build on the same machine.
+ * Saving writes a temporary file and renames it into place, so a run killed
+ * while saving keeps its previous checkpoint.
+ */
+
+#define CHECKPOINT_MAX_ITEMS 64
+#define CHECKPOINT_MAX_TYPES 16
+#define CHECKPOINT_MAX_EVENTS 32
+#define CHECKPOINT_MAX_POINTERS 4
+
+/* The attachment type of events whose attachment is a registered object. */
+#define CHECKPOINT_OBJECT (-1)
+
+/* Register one variable as plain values. */
+#define CHECKPOINT_ADD_VALUE(checkpoint, variable) \
+  checkpoint_add_values((checkpoint), &(variable), sizeof(variable))
+
+typedef enum {CHECKPOINT_VALUES, CHECKPOINT_FIFOQUEUE, CHECKPOINT_SERVER,
+	      CHECKPOINT_STAT} Checkpoint_Item_Kind;
+
+typedef struct _checkpoint_item_
+{
+  Checkpoint_Item_Kind kind;
+  void * address;
+  unsigned size;  /* of the values */
+  int type;       /* of the customers in a queue or server */
+} Checkpoint_Item, * Checkpoint_Item_Ptr;
+
+typedef struct _checkpoint_type_
+{
+  unsigned size;
+  int number_of_pointers;
+  unsigned pointer_offsets[CHECKPOINT_MAX_POINTERS];
+} Checkpoint_Type, * Checkpoint_Type_Ptr;
+
+typedef struct _checkpoint_event_
+{
+  const char * description;
+  void (*function)(Simulation_Run_Ptr, void *);
+  int type;  /* of the attachment */
+} Checkpoint_Event, * Checkpoint_Event_Ptr;
+
+typedef struct _checkpoint_
+{
+  Simulation_Run_Ptr simulation_run;
+
+  int number_of_items;
+  Checkpoint_Item items[CHECKPOINT_MAX_ITEMS];
+  int number_of_types;
+  Checkpoint_Type types[CHECKPOINT_MAX_TYPES];
+  int number_of_events;
+  Checkpoint_Event events[CHECKPOINT_MAX_EVENTS];
+
+  /*
+   * The translation between pointers and indices while saving or
+   * restoring: the objects by index, and an open addressing hash table of
+   * indices by pointer (saving only).
+   */
+  void ** objects;
+  long int number_of_objects;
+  long int objects_size;
+  long int * table;
+  long int table_size;
+
+  FILE * file;
+} Checkpoint, * Checkpoint_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Checkpoint_Ptr
+checkpoint_new(Simulation_Run_Ptr);
+
+int
+checkpoint_add_type(Checkpoint_Ptr, unsigned);
+
+void
+checkpoint_add_type_pointer(Checkpoint_Ptr, int, unsigned);
+
+void
+checkpoint_add_event(Checkpoint_Ptr, const char *,
+		     void (*)(Simulation_Run_Ptr, void *), int);
+
+void
+checkpoint_add_fifoqueue(Checkpoint_Ptr, Fifoqueue_Ptr, int);
+
+void
+checkpoint_add_server(Checkpoint_Ptr, Server_Ptr, int);
+
+void
+checkpoint_add_stat(Checkpoint_Ptr, Time_Weighted_Stat_Ptr);
+
+void
+checkpoint_add_values(Checkpoint_Ptr, void *, unsigned);
+
+void
+checkpoint_save(Checkpoint_Ptr, const char *);
+
+int
+checkpoint_restore(Checkpoint_Ptr, const char *);
+
+void
+checkpoint_free(Checkpoint_Ptr);
+
+/******************************************************************************/
+
+#endif /* checkpoint.h */
+
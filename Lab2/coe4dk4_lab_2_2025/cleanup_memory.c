@@ -103,6 +103,8 @@ cleanup_memory_part7 (Simulation_Run_Ptr simulation_run)
     xfree(server_get(data->link));
   xfree(data->link);
 
+  time_weighted_stat_free(data->number_in_system);
+
   simulation_run_free_memory(simulation_run);
 }
 
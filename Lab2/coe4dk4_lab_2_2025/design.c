@@ -0,0 +1,156 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simlib.h"
+#include "design.h"
+
+/******************************************************************************/
+
+/*
+ * A small generator of its own (splitmix64), so that making a design does
+ * not disturb the simulation's random numbers.
+ */
+
+static double
+design_uniform(unsigned long long * state)
+{
+  unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * A Latin hypercube of n points in d dimensions, written to
+ * points[i * d + j].
+ */
+
+void
+design_latin_hypercube(int n, int d, unsigned seed, double * points)
+{
+  unsigned long long state = seed;
+  int * stratum;
+  int i, j, k, swap;
+
+  stratum = (int *) xcalloc(n, sizeof(int));
+
+  for (j=0; j<d; j++) {
+    /* A random permutation of the strata (Fisher-Yates). */
+    for (i=0; i<n; i++) stratum[i] = i;
+    for (i=n-1; i>0; i--) {
+      k = (int) (design_uniform(&state) * (i + 1));
+      swap = stratum[i];
+      stratum[i] = stratum[k];
+      stratum[k] = swap;
+    }
+    for (i=0; i<n; i++)
+      points[i * d + j] = (stratum[i] + design_uniform(&state)) / n;
+  }
+
+  xfree((void *) stratum);
+}
+
+/******************************************************************************/
+
+/*
+ * Joe and Kuo's primitive polynomials (degree s, inner coefficients a) and
+ * initial direction numbers m for dimensions 2 to 16. The first dimension is
+ * the van der Corput sequence.
+ */
+
+static const struct {
+  int s;
+  int a;
+  int m[6];
+} design_sobol_table[DESIGN_MAX_DIMENSIONS - 1] = {
+  {1, 0, {1}},
+  {2, 1, {1, 3}},
+  {3, 1, {1, 3, 1}},
+  {3, 2, {1, 1, 1}},
+  {4, 1, {1, 1, 3, 3}},
+  {4, 4, {1, 3, 5, 13}},
+  {5, 2, {1, 1, 5, 5, 17}},
+  {5, 4, {1, 1, 5, 5, 5}},
+  {5, 7, {1, 1, 7, 11, 19}},
+  {5, 11, {1, 1, 5, 1, 1}},
+  {5, 13, {1, 1, 1, 3, 11}},
+  {5, 14, {1, 3, 5, 5, 31}},
+  {6, 1, {1, 3, 3, 9, 7, 49}},
+  {6, 13, {1, 1, 1, 15, 21, 21}},
+  {6, 16, {1, 3, 1, 13, 27, 49}}
+};
+
+/*
+ * The first n points of the Sobol sequence in d dimensions, written to
+ * points[i * d + j].
+ */
+
+void
+design_sobol(int n, int d, double * points)
+{
+  unsigned direction[DESIGN_MAX_DIMENSIONS][32], x[DESIGN_MAX_DIMENSIONS];
+  int i, j, k, l, s, a, c;
+
+  if (d < 1 || d > DESIGN_MAX_DIMENSIONS) {
+    printf("Error: A Sobol design cannot have %d dimensions.\n", d);
+    exit(1);
+  }
+
+  /* The direction numbers v_k = m_k / 2^k, as 32-bit fractions. */
+  for (k=0; k<32; k++) direction[0][k] = 1U << (31 - k);
+  for (j=1; j<d; j++) {
+    s = design_sobol_table[j-1].s;
+    a = design_sobol_table[j-1].a;
+    for (k=0; k<32; k++) {
+      if (k < s) {
+	direction[j][k] = (unsigned) design_sobol_table[j-1].m[k] << (31 - k);
+      } else {
+	direction[j][k] = direction[j][k-s] ^ (direction[j][k-s] >> s);
+	for (l=1; l<s; l++)
+	  if ((a >> (s - 1 - l)) & 1)
+	    direction[j][k] ^= direction[j][k-l];
+      }
+    }
+  }
+
+  /* Gray code order: point i differs from point i-1 in the direction of
+     the lowest zero bit of i-1. */
+  for (j=0; j<d; j++) x[j] = 0;
+  for (i=0; i<n; i++) {
+    if (i > 0) {
+      for (c=0; (i - 1) >> c & 1; c++);
+      for (j=0; j<d; j++) x[j] ^= direction[j][c];
+    }
+    for (j=0; j<d; j++)
+      points[i * d + j] = x[j] * (1.0 / 4294967296.0);
+  }
+}
+
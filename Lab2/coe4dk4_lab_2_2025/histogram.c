@@ -0,0 +1,258 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "histogram.h"
+
+/******************************************************************************/
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HALF_SUB_BUCKETS (SUB_BUCKETS/2)
+
+static int
+bucket_index(double);
+
+static void
+bucket_range(int, double *, double *);
+
+/******************************************************************************/
+
+/*
+ * Return the bucket of a value given in resolution units. Everything is done
+ * in floating point, with frexp giving the power of two range, so that no 64
+ * bit integers are needed.
+ */
+
+static int
+bucket_index(double units)
+{
+  int exponent, shift, sub_bucket;
+
+  if (units < SUB_BUCKETS) return (units > 0.0) ? (int) units : 0;
+
+  frexp(units, &exponent);              /* 2^(exponent-1) <= units < 2^exponent */
+  shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+  sub_bucket = (int) ldexp(units, -shift);  /* in [HALF_SUB_BUCKETS, SUB_BUCKETS) */
+  if (sub_bucket >= SUB_BUCKETS) {
+    shift++;
+    sub_bucket = (int) ldexp(units, -shift);
+  }
+  return SUB_BUCKETS + (shift-1) * HALF_SUB_BUCKETS + sub_bucket - HALF_SUB_BUCKETS;
+}
+
+/*
+ * The range [low, low + width) of a bucket, in resolution units.
+ */
+
+static void
+bucket_range(int index, double * low, double * width)
+{
+  int shift;
+
+  if (index < SUB_BUCKETS) {
+    *low = (double) index;
+    *width = 1.0;
+    return;
+  }
+
+  index -= SUB_BUCKETS;
+  shift = index/HALF_SUB_BUCKETS + 1;
+  *low = ldexp((double) (index % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS), shift);
+  *width = ldexp(1.0, shift);
+}
+
+/******************************************************************************/
+
+/*
+ * Create a histogram for values from 0 up to highest_value, resolved to
+ * within resolution (or the relative error, whichever is larger).
+ */
+
+Histogram_Ptr
+histogram_new(double resolution, double highest_value)
+{
+  Histogram_Ptr histogram;
+
+  if (resolution <= 0.0 || highest_value <= resolution) {
+    printf("Error: Bad histogram range (resolution = %g, highest value = %g).\n",
+	   resolution, highest_value);
+    exit(1);
+  }
+
+  histogram = (Histogram_Ptr) xmalloc(sizeof(Histogram));
+  histogram->resolution = resolution;
+  histogram->highest_value = highest_value;
+  histogram->number_of_buckets = bucket_index(highest_value/resolution) + 1;
+  histogram->counts = (long int *) xcalloc(histogram->number_of_buckets,
+					   sizeof(long int));
+  histogram_reset(histogram);
+  return histogram;
+}
+
+void
+histogram_reset(Histogram_Ptr histogram)
+{
+  int i;
+
+  for (i=0; i<histogram->number_of_buckets; i++) histogram->counts[i] = 0;
+  histogram->total_count = 0;
+  histogram->overflow_count = 0;
+  histogram->min = 0.0;
+  histogram->max = 0.0;
+  histogram->sum = 0.0;
+}
+
+void
+histogram_record(Histogram_Ptr histogram, double value)
+{
+  int index;
+
+  if (histogram->total_count == 0 || value < histogram->min)
+    histogram->min = value;
+  if (histogram->total_count == 0 || value > histogram->max)
+    histogram->max = value;
+  histogram->total_count++;
+  histogram->sum += value;
+
+  if (value > histogram->highest_value) {
+    histogram->overflow_count++;
+    index = histogram->number_of_buckets - 1;
+  } else {
+    index = bucket_index(value/histogram->resolution);
+  }
+  histogram->counts[index]++;
+}
+
+/*
+ * Add the counts of source into destination. Both must have been created
+ * with the same resolution and highest value.
+ */
+
+void
+histogram_merge(Histogram_Ptr destination, Histogram_Ptr source)
+{
+  int i;
+
+  if (destination->resolution != source->resolution ||
+      destination->number_of_buckets != source->number_of_buckets) {
+    printf("Error: Histograms with different layouts cannot be merged.\n");
+    exit(1);
+  }
+
+  if (source->total_count == 0) return;
+
+  if (destination->total_count == 0 || source->min < destination->min)
+    destination->min = source->min;
+  if (destination->total_count == 0 || source->max > destination->max)
+    destination->max = source->max;
+
+  for (i=0; i<destination->number_of_buckets; i++)
+    destination->counts[i] += source->counts[i];
+  destination->total_count += source->total_count;
+  destination->overflow_count += source->overflow_count;
+  destination->sum += source->sum;
+}
+
+/******************************************************************************/
+
+/*
+ * Return the q quantile (e.g., 0.99), as the middle of the bucket that holds
+ * it, kept within the observed minimum and maximum. The bucket at zero gives
+ * zero, since that is where e.g. the delays of packets that did not wait go.
+ */
+
+double
+histogram_quantile(Histogram_Ptr histogram, double q)
+{
+  int i;
+  long int rank, cumulative = 0;
+  double low, width, value;
+
+  if (histogram->total_count == 0) return 0.0;
+  if (q <= 0.0) return histogram->min;
+  if (q >= 1.0) return histogram->max;
+
+  rank = (long int) ceil(q * histogram->total_count);
+  if (rank < 1) rank = 1;
+
+  for (i=0; i<histogram->number_of_buckets; i++) {
+    cumulative += histogram->counts[i];
+    if (cumulative >= rank) break;
+  }
+  if (i == histogram->number_of_buckets) i--;
+
+  bucket_range(i, &low, &width);
+  value = (i == 0) ? 0.0 : (low + 0.5 * width) * histogram->resolution;
+
+  if (value < histogram->min) value = histogram->min;
+  if (value > histogram->max) value = histogram->max;
+  return value;
+}
+
+/*
+ * Return the fraction of the values greater than threshold (e.g., a delay
+ * bound). The bucket that holds the threshold is split in proportion.
+ */
+
+double
+histogram_exceedance(Histogram_Ptr histogram, double threshold)
+{
+  int i, index;
+  double low, width, count;
+
+  if (histogram->total_count == 0 || threshold >= histogram->max) return 0.0;
+  if (threshold < histogram->min) return 1.0;
+  if (threshold > histogram->highest_value)
+    return (double) histogram->overflow_count/histogram->total_count;
+
+  index = bucket_index(threshold/histogram->resolution);
+  bucket_range(index, &low, &width);
+  count = histogram->counts[index] *
+    (low + width - threshold/histogram->resolution)/width;
+
+  for (i=index+1; i<histogram->number_of_buckets; i++)
+    count += histogram->counts[i];
+
+  return count/histogram->total_count;
+}
+
+double
+histogram_mean(Histogram_Ptr histogram)
+{
+  if (histogram->total_count == 0) return 0.0;
+  return histogram->sum/histogram->total_count;
+}
+
+void
+histogram_free(Histogram_Ptr histogram)
+{
+  xfree((void *) histogram->counts);
+  xfree((void *) histogram);
+}
+
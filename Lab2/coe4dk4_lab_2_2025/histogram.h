@@ -0,0 +1,96 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+/******************************************************************************/
+
+/*
+ * Log-linear (HDR style) histograms for delay percentiles.
+ *
+ * A value is counted in units of the given resolution. Below
+ * 2^HISTOGRAM_SUB_BUCKET_BITS units every unit has its own bucket. Above that,
+ * each power of two range is split into 2^(HISTOGRAM_SUB_BUCKET_BITS-1) equal
+ * buckets, so the relative error of any bucket is at most
+ * 2^-(HISTOGRAM_SUB_BUCKET_BITS-1). The memory is fixed when the histogram is
+ * created from the resolution and the highest value to be tracked, recording
+ * is O(1), and two histograms with the same layout can be merged (e.g., over
+ * replications, or over threads that each have their own).
+ *
+ * Values above the highest trackable value are counted in the top bucket and
+ * in the overflow count. The exact minimum, maximum and sum are kept as well.
+ */
+
+#define HISTOGRAM_SUB_BUCKET_BITS 8
+
+typedef struct _histogram_
+{
+  double resolution;       /* value of one unit */
+  double highest_value;
+  int number_of_buckets;
+  long int * counts;
+  long int total_count;
+  long int overflow_count;
+  double min;
+  double max;
+  double sum;
+} Histogram, * Histogram_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Histogram_Ptr
+histogram_new(double, double);
+
+void
+histogram_reset(Histogram_Ptr);
+
+void
+histogram_record(Histogram_Ptr, double);
+
+void
+histogram_merge(Histogram_Ptr, Histogram_Ptr);
+
+double
+histogram_quantile(Histogram_Ptr, double);
+
+double
+histogram_exceedance(Histogram_Ptr, double);
+
+double
+histogram_mean(Histogram_Ptr);
+
+void
+histogram_free(Histogram_Ptr);
+
+/******************************************************************************/
+
+#endif /* histogram.h */
+
@@ -0,0 +1,222 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "likelihood_ratio.h"
+
+/******************************************************************************/
+
+/*
+ * Create a reweighting object for a run made at the given base arrival rate
+ * and mean service time. number_of_values is the number of cycle totals the
+ * model will pass to likelihood_ratio_end_cycle.
+ */
+
+Likelihood_Ratio_Ptr
+likelihood_ratio_new(double base_arrival_rate, double base_service_time,
+		     int number_of_values)
+{
+  Likelihood_Ratio_Ptr lr;
+
+  if (number_of_values < 1 || number_of_values > LR_MAX_VALUES) {
+    printf("Error: Between 1 and %d cycle values are supported.\n",
+	   LR_MAX_VALUES);
+    exit(1);
+  }
+
+  lr = (Likelihood_Ratio_Ptr) xcalloc(1, sizeof(Likelihood_Ratio));
+  lr->base_arrival_rate = base_arrival_rate;
+  lr->base_service_time = base_service_time;
+  lr->number_of_values = number_of_values;
+  lr->number_of_targets = 0;
+  lr->cycles = 0;
+  return lr;
+}
+
+/*
+ * Add a target parameter point. Returns its index.
+ */
+
+int
+likelihood_ratio_add_target(Likelihood_Ratio_Ptr lr, double arrival_rate,
+			    double service_time)
+{
+  Likelihood_Ratio_Target_Ptr target;
+
+  if (lr->number_of_targets == LR_MAX_TARGETS) {
+    printf("Error: At most %d reweighting targets are supported.\n",
+	   LR_MAX_TARGETS);
+    exit(1);
+  }
+
+  target = lr->targets + lr->number_of_targets;
+  target->arrival_rate = arrival_rate;
+  target->service_time = service_time;
+  target->log_weight = 0.0;
+  return lr->number_of_targets++;
+}
+
+/*
+ * Record an interarrival time drawn at the base rate. Its likelihood ratio is
+ * (lambda/lambda0) exp(-(lambda - lambda0) x).
+ */
+
+void
+likelihood_ratio_interarrival(Likelihood_Ratio_Ptr lr, double x)
+{
+  int i;
+  double lambda0 = lr->base_arrival_rate, lambda;
+
+  for (i=0; i<lr->number_of_targets; i++) {
+    lambda = lr->targets[i].arrival_rate;
+    if (lambda != lambda0)
+      lr->targets[i].log_weight += log(lambda/lambda0) - (lambda - lambda0) * x;
+  }
+}
+
+/*
+ * Record that no arrival occurred for a time t, i.e., an interarrival time
+ * still running when a cycle ends. Its likelihood ratio is the ratio of the
+ * survival functions, exp(-(lambda - lambda0) t). Since the Poisson process
+ * is memoryless, the rest of that interarrival time can then be recorded in
+ * the next cycle with likelihood_ratio_interarrival as if it had been drawn
+ * there.
+ */
+
+void
+likelihood_ratio_no_arrival(Likelihood_Ratio_Ptr lr, double t)
+{
+  int i;
+  double lambda0 = lr->base_arrival_rate, lambda;
+
+  for (i=0; i<lr->number_of_targets; i++) {
+    lambda = lr->targets[i].arrival_rate;
+    if (lambda != lambda0)
+      lr->targets[i].log_weight -= (lambda - lambda0) * t;
+  }
+}
+
+/*
+ * Record an exponential service time drawn at the base mean. Its likelihood
+ * ratio is (theta0/theta) exp(-s (1/theta - 1/theta0)).
+ */
+
+void
+likelihood_ratio_service(Likelihood_Ratio_Ptr lr, double s)
+{
+  int i;
+  double theta0 = lr->base_service_time, theta;
+
+  for (i=0; i<lr->number_of_targets; i++) {
+    theta = lr->targets[i].service_time;
+    if (theta != theta0)
+      lr->targets[i].log_weight +=
+	log(theta0/theta) - s * (1.0/theta - 1.0/theta0);
+  }
+}
+
+/*
+ * Start a new regeneration cycle. Anything drawn before this is discarded.
+ */
+
+void
+likelihood_ratio_start_cycle(Likelihood_Ratio_Ptr lr)
+{
+  int i;
+
+  for (i=0; i<lr->number_of_targets; i++) lr->targets[i].log_weight = 0.0;
+}
+
+/*
+ * Close the current cycle, passing its totals, and start the next one.
+ */
+
+void
+likelihood_ratio_end_cycle(Likelihood_Ratio_Ptr lr, const double * values)
+{
+  int i, j, k;
+  double w;
+  Likelihood_Ratio_Target_Ptr target;
+
+  for (i=0; i<lr->number_of_targets; i++) {
+    target = lr->targets + i;
+    w = exp(target->log_weight);
+    target->sum_w += w;
+    target->sum_w2 += w*w;
+    for (j=0; j<lr->number_of_values; j++) {
+      target->sum_wv[j] += w * values[j];
+      for (k=0; k<lr->number_of_values; k++)
+	target->sum_wv_wv[j][k] += w * values[j] * w * values[k];
+    }
+  }
+  lr->cycles++;
+  likelihood_ratio_start_cycle(lr);
+}
+
+/*
+ * Estimate, at a target, the ratio of the expected cycle totals numerator and
+ * denominator (e.g., total delay over number served gives the mean delay).
+ * The confidence interval uses the usual delta method for ratio estimators.
+ */
+
+void
+likelihood_ratio_estimate(Likelihood_Ratio_Ptr lr, int target_index,
+			  int numerator, int denominator,
+			  Likelihood_Ratio_Estimate_Ptr estimate)
+{
+  double n, r, s2, mean_denominator;
+  Likelihood_Ratio_Target_Ptr target = lr->targets + target_index;
+
+  n = (double) lr->cycles;
+  estimate->mean = 0.0;
+  estimate->half_width = 0.0;
+  estimate->ess = 0.0;
+  estimate->relative_ess = 0.0;
+
+  if (lr->cycles < 2 || target->sum_wv[denominator] == 0.0) return;
+
+  r = target->sum_wv[numerator]/target->sum_wv[denominator];
+  s2 = (target->sum_wv_wv[numerator][numerator]
+	- 2.0 * r * target->sum_wv_wv[numerator][denominator]
+	+ r * r * target->sum_wv_wv[denominator][denominator])/(n - 1.0);
+  if (s2 < 0.0) s2 = 0.0;
+  mean_denominator = target->sum_wv[denominator]/n;
+
+  estimate->mean = r;
+  estimate->half_width = 1.96 * sqrt(s2/n)/mean_denominator;
+  estimate->ess = target->sum_w * target->sum_w/target->sum_w2;
+  estimate->relative_ess = estimate->ess/n;
+}
+
+void
+likelihood_ratio_free(Likelihood_Ratio_Ptr lr)
+{
+  xfree((void *) lr);
+}
+
@@ -32,6 +32,11 @@
 #include "trace.h"
 #include "main.h"
 #include "voice_data_arrival.h"
+#include "packet_transmission.h"
+#include "checkpoint.h"
+#include "branch.h"
+#include "adaptive_grid.h"
+#include "sweep.h"
 
 /******************************************************************************/
 
@@ -49,12 +54,651 @@
 
 /******************************************************************************/
 
-double DATA_ARRIVAL_RATE; /* Global variable */
+/*
+ * The parameters that can be swept from the command line. Without arguments
+ * the program runs the data arrival rate sweep below with the other defaults.
+ */
+
+double DATA_ARRIVAL_RATE = DATA_ARRIVAL_RATE_DEFAULT;
+double VOICE_ARRIVAL_INTERVAL = VOICE_ARRIVAL_INTERVAL_DEFAULT;
+double MEAN_SERVICE_TIME = MEAN_SERVICE_TIME_DEFAULT;
+double RUNLENGTH = RUNLENGTH_DEFAULT;
+
+/* The indices of the sweep outputs. */
+typedef struct _sweep_outputs_
+{
+    int voice_mean_delay;
+    int data_mean_delay;
+    int voice_p99_delay;
+    int data_p99_delay;
+    int voice_exceed;
+    int data_exceed;
+    int link_utilization;
+    int mean_packets_in_system;
+} Sweep_Outputs;
+
+/*
+ * Register a histogram with a checkpoint: its counts and totals.
+ */
+
+static void
+checkpoint_add_histogram(Checkpoint_Ptr checkpoint, Histogram_Ptr histogram)
+{
+    checkpoint_add_values(checkpoint, histogram->counts,
+                          histogram->number_of_buckets * sizeof(long int));
+    CHECKPOINT_ADD_VALUE(checkpoint, histogram->total_count);
+    CHECKPOINT_ADD_VALUE(checkpoint, histogram->overflow_count);
+    CHECKPOINT_ADD_VALUE(checkpoint, histogram->min);
+    CHECKPOINT_ADD_VALUE(checkpoint, histogram->max);
+    CHECKPOINT_ADD_VALUE(checkpoint, histogram->sum);
+}
+
+/*
+ * Register the state of a run with a checkpoint (see checkpoint.h): the
+ * packets, the events, the buffers and the link, and the counters and
+ * statistics in data. The likelihood ratio totals are not included.
+ */
+
+static Checkpoint_Ptr
+checkpoint_model(Simulation_Run_Ptr simulation_run, Simulation_Run_Data_Ptr data)
+{
+    Checkpoint_Ptr checkpoint;
+    int packet_type;
+
+    checkpoint = checkpoint_new(simulation_run);
+    packet_type = checkpoint_add_type(checkpoint, sizeof(Packet));
+
+    checkpoint_add_event(checkpoint, "Voice Packet Arrival",
+                         voice_arrival_event, CHECKPOINT_OBJECT);
+    checkpoint_add_event(checkpoint, "Data Packet Arrival",
+                         data_arrival_event, CHECKPOINT_OBJECT);
+    checkpoint_add_event(checkpoint, "Packet Xmt End",
+                         end_packet_transmission_event, CHECKPOINT_OBJECT);
+
+    checkpoint_add_fifoqueue(checkpoint, data->voice_buffer, packet_type);
+    checkpoint_add_fifoqueue(checkpoint, data->data_buffer, packet_type);
+    checkpoint_add_server(checkpoint, data->link, packet_type);
+    checkpoint_add_stat(checkpoint, data->number_in_system);
+
+    CHECKPOINT_ADD_VALUE(checkpoint, data->blip_counter);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->voice_arrival_count);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->voice_processed_count);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->voice_accumulated_delay);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->data_arrival_count);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->data_processed_count);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->data_accumulated_delay);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->voice_delays);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->data_delays);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->ipa_last_end_d_theta);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->accumulated_d_delay_d_theta);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->cycle_start_time);
+    CHECKPOINT_ADD_VALUE(checkpoint, data->last_data_arrival_time);
+
+    if (data->voice_delay_histogram != NULL)
+        checkpoint_add_histogram(checkpoint, data->voice_delay_histogram);
+    if (data->data_delay_histogram != NULL)
+        checkpoint_add_histogram(checkpoint, data->data_delay_histogram);
+
+    return checkpoint;
+}
+
+/*
+ * The checkpoint file of a run, named after its parameters and seed.
+ */
+
+static void
+checkpoint_filename(char *filename, unsigned random_seed)
+{
+    sprintf(filename, "%s/run_%g_%g_%g_%g_%u.chk", CHECKPOINT_DIRECTORY,
+            DATA_ARRIVAL_RATE, VOICE_ARRIVAL_INTERVAL, MEAN_SERVICE_TIME,
+            RUNLENGTH, random_seed);
+}
+
+/*
+ * Create a run at the current parameters with the given seed, with its
+ * statistics cleared and no events scheduled. If lr is not NULL the
+ * likelihood ratios of the sample path are accumulated in it. The caller
+ * sets the delay histograms (or NULL) beforehand; they are cleared here.
+ */
+
+static Simulation_Run_Ptr
+new_simulation(unsigned random_seed, Likelihood_Ratio_Ptr lr,
+               Simulation_Run_Data_Ptr data)
+{
+    Simulation_Run_Ptr simulation_run;
+
+    /* Create a new simulation run */
+    simulation_run = simulation_run_new();
+    simulation_run_attach_data(simulation_run, (void *)data);
+
+    /* Initialize data structures */
+    data->blip_counter = 0;
+    data->random_seed = random_seed;
+    data->voice_arrival_count = 0;
+    data->voice_processed_count = 0;
+    data->voice_accumulated_delay = 0.0;
+    data->data_arrival_count = 0;
+    data->data_processed_count = 0;
+    data->data_accumulated_delay = 0.0;
+    data->ipa_last_end_d_theta = 0.0;
+    data->accumulated_d_delay_d_theta = 0.0;
+    data->lr = lr;
+    data->cycle_start_time = -1.0;
+    data->last_data_arrival_time = 0.0;
+    running_stat_reset(&data->voice_delays);
+    running_stat_reset(&data->data_delays);
+    if (data->voice_delay_histogram != NULL)
+        histogram_reset(data->voice_delay_histogram);
+    if (data->data_delay_histogram != NULL)
+        histogram_reset(data->data_delay_histogram);
+    output_metrics_start(simulation_run);
+
+    /* Create separate buffers for voice and data, plus link */
+    data->voice_buffer = fifoqueue_new();
+    data->data_buffer = fifoqueue_new();
+    data->link = server_new();
+
+    data->number_in_system = time_weighted_stat_new(simulation_run);
+    fifoqueue_attach_stat(data->voice_buffer, data->number_in_system);
+    fifoqueue_attach_stat(data->data_buffer, data->number_in_system);
+    server_attach_stat(data->link, data->number_in_system);
+
+    /* Set random seed */
+    random_generator_initialize(random_seed);
+
+    return simulation_run;
+}
+
+/*
+ * Clear the statistics of a run, e.g., at the end of a warm-up. Packets
+ * still in the system are counted when they leave.
+ */
+
+static void
+reset_measurements(Simulation_Run_Data_Ptr data)
+{
+    data->blip_counter = 0;
+    data->voice_arrival_count = 0;
+    data->voice_processed_count = 0;
+    data->voice_accumulated_delay = 0.0;
+    data->data_arrival_count = 0;
+    data->data_processed_count = 0;
+    data->data_accumulated_delay = 0.0;
+    data->accumulated_d_delay_d_theta = 0.0;
+    running_stat_reset(&data->voice_delays);
+    running_stat_reset(&data->data_delays);
+    if (data->voice_delay_histogram != NULL)
+        histogram_reset(data->voice_delay_histogram);
+    if (data->data_delay_histogram != NULL)
+        histogram_reset(data->data_delay_histogram);
+    time_weighted_stat_reset(data->number_in_system);
+}
+
+/*
+ * Keep the results of a run in data and free it.
+ */
+
+static void
+finish_simulation(Simulation_Run_Ptr simulation_run, Simulation_Run_Data_Ptr data)
+{
+    data->mean_number_in_system = time_weighted_stat_mean(data->number_in_system);
+    data->link_utilization = time_weighted_stat_tail(data->number_in_system, 1);
+
+    /* Clean up */
+    cleanup_memory_part7(simulation_run);
+}
+
+/*
+ * Do one simulation run at the current DATA_ARRIVAL_RATE with the given seed
+ * (see new_simulation). The statistics are left in data.
+ *
+ * If warm_start is not NULL and names an existing checkpoint, the run
+ * continues from the state saved there (by the previous run with the same
+ * seed, at another rate), with its statistics cleared, and the final state
+ * is saved there in turn.
+ */
+
+static void
+run_simulation(unsigned random_seed, Likelihood_Ratio_Ptr lr,
+               Simulation_Run_Data_Ptr data, const char *warm_start)
+{
+    Simulation_Run_Ptr simulation_run;
+
+    simulation_run = new_simulation(random_seed, lr, data);
+
+    /* Resume from the run's checkpoint if there is one. */
+    Checkpoint_Ptr checkpoint = NULL;
+    char checkpoint_file[512];
+    int resumed = 0;
+
+    if ((CHECKPOINT_INTERVAL > 0 || warm_start != NULL) && lr == NULL)
+        checkpoint = checkpoint_model(simulation_run, data);
+
+    if (CHECKPOINT_INTERVAL > 0 && checkpoint != NULL) {
+        checkpoint_filename(checkpoint_file, random_seed);
+        resumed = checkpoint_restore(checkpoint, checkpoint_file);
+    }
+
+    if (!resumed && warm_start != NULL && checkpoint != NULL &&
+        checkpoint_restore(checkpoint, warm_start)) {
+        reset_measurements(data);
+        resumed = 1;
+    }
+
+    /* Schedule initial arrivals */
+    if (!resumed) {
+        schedule_voice_arrival_event(simulation_run, 0.0);
+        schedule_data_arrival_event(simulation_run, 0.0);
+    }
+
+    /* Run simulation until enough packets processed */
+    long total_processed = data->voice_processed_count + data->data_processed_count;
+    long next_checkpoint = total_processed + CHECKPOINT_INTERVAL;
+    while (total_processed < RUNLENGTH) {
+        simulation_run_execute_event(simulation_run);
+        total_processed = data->voice_processed_count + data->data_processed_count;
+
+        if (CHECKPOINT_INTERVAL > 0 && checkpoint != NULL &&
+            total_processed >= next_checkpoint && total_processed < RUNLENGTH) {
+            checkpoint_save(checkpoint, checkpoint_file);
+            next_checkpoint = total_processed + CHECKPOINT_INTERVAL;
+        }
+    }
+
+    if (checkpoint != NULL) {
+        if (warm_start != NULL)
+            checkpoint_save(checkpoint, warm_start);
+        if (CHECKPOINT_INTERVAL > 0)
+            remove(checkpoint_file);
+        checkpoint_free(checkpoint);
+    }
+
+    finish_simulation(simulation_run, data);
+}
+
+/*
+ * The warm start checkpoint of a seed in the rate sweep below.
+ */
+
+static void
+warm_start_filename(char *filename, unsigned random_seed)
+{
+    sprintf(filename, "%s/warm_start_%u.chk", CHECKPOINT_DIRECTORY, random_seed);
+}
+
+#if BRANCH_MODE
+
+/*
+ * A what-if branch: measure RUNLENGTH packets from the branch point at the
+ * child's overrides.
+ */
 
-int main(void)
+static void
+branch_model(Simulation_Run_Ptr simulation_run, int child, double *values,
+             void *argument)
 {
+    Simulation_Run_Data_Ptr data;
+    long total_processed = 0;
+
+    data = (Simulation_Run_Data_Ptr) simulation_run_data(simulation_run);
+    reset_measurements(data);
+
+    while (total_processed < RUNLENGTH) {
+        simulation_run_execute_event(simulation_run);
+        total_processed = data->voice_processed_count + data->data_processed_count;
+    }
+
+    values[0] = data->voice_delays.mean;
+    values[1] = data->data_delays.mean;
+    values[2] = time_weighted_stat_tail(data->number_in_system, 1);
+    values[3] = time_weighted_stat_mean(data->number_in_system);
+}
+
+/*
+ * Warm each seed up once at the current DATA_ARRIVAL_RATE and branch it into
+ * one child per rate of BRANCH_RATE_LIST. Results go to
+ * data/results_branch.csv.
+ */
+
+static int
+what_if_branches(void)
+{
+    double rates[] = {BRANCH_RATE_LIST};
+    int number_of_rates = sizeof(rates) / sizeof(rates[0]);
+    unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+    unsigned random_seed;
+    Simulation_Run_Data data;
     Simulation_Run_Ptr simulation_run;
+    Branch_Ptr branch;
+    double *values;
+    long total_processed;
+    int i, j = 0;
+
+    FILE *csv = fopen("data/results_branch.csv", "w");
+    if (!csv) {
+        perror("Failed to open results_branch.csv");
+        return 1;
+    }
+    fprintf(csv, "warmup_data_arrival_rate,data_arrival_rate,seed,"
+            "voice_mean_delay,data_mean_delay,link_utilization,"
+            "mean_packets_in_system\n");
+
+    data.voice_delay_histogram = NULL;
+    data.data_delay_histogram = NULL;
+
+    while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
+        simulation_run = new_simulation(random_seed, NULL, &data);
+        schedule_voice_arrival_event(simulation_run, 0.0);
+        schedule_data_arrival_event(simulation_run, 0.0);
+
+        total_processed = 0;
+        while (total_processed < BRANCH_WARMUP) {
+            simulation_run_execute_event(simulation_run);
+            total_processed = data.voice_processed_count + data.data_processed_count;
+        }
+
+        branch = branch_new(number_of_rates, 4);
+        branch->common_random_numbers = BRANCH_COMMON_RANDOM_NUMBERS;
+        for (i = 0; i < number_of_rates; i++)
+            branch_add_override(branch, i, &DATA_ARRIVAL_RATE, rates[i]);
+        branch_run(branch, simulation_run, branch_model, NULL);
+
+        for (i = 0; i < number_of_rates; i++) {
+            values = branch->values + 4 * i;
+            fprintf(csv, "%.1f,%.1f,%d,%.3f,%.3f,%.6f,%.6f\n",
+                    DATA_ARRIVAL_RATE, rates[i], random_seed,
+                    values[0], values[1], values[2], values[3]);
+        }
+        printf("Seed %u: %d branches from %.0f warm-up packets\n",
+               random_seed, number_of_rates, (double) BRANCH_WARMUP);
+
+        branch_free(branch);
+        finish_simulation(simulation_run, &data);
+    }
+
+    fclose(csv);
+    return 0;
+}
+
+#endif /* BRANCH_MODE */
+
+#if ADAPTIVE_GRID_MODE
+
+/*
+ * The seed of replication k of every rate: the seeds of RANDOM_SEED_LIST,
+ * then offsets of them.
+ */
+
+static unsigned
+replication_seed(int k)
+{
+    unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST};
+    int number_of_seeds = sizeof(RANDOM_SEEDS) / sizeof(RANDOM_SEEDS[0]);
+
+    return RANDOM_SEEDS[k % number_of_seeds] + k / number_of_seeds;
+}
+
+/*
+ * One replication of the data mean delay (in ms) at a data arrival rate.
+ */
+
+static double
+adaptive_grid_model(double rate, int replication, void *argument)
+{
+    Simulation_Run_Data data;
+
+    DATA_ARRIVAL_RATE = rate;
+    data.voice_delay_histogram = NULL;
+    data.data_delay_histogram = NULL;
+    run_simulation(replication_seed(replication), NULL, &data, NULL);
+
+    return data.data_delays.mean;
+}
+
+/*
+ * Refine the data mean delay curve over the data arrival rate. Results go to
+ * data/results_adaptive.csv.
+ */
+
+static int
+adaptive_grid_sweep(void)
+{
+    Adaptive_Grid_Ptr grid;
+    Adaptive_Grid_Point_Ptr point;
+    int i;
+
+    FILE *csv = fopen("data/results_adaptive.csv", "w");
+    if (!csv) {
+        perror("Failed to open results_adaptive.csv");
+        return 1;
+    }
+
+    grid = adaptive_grid_new(ADAPTIVE_GRID_LOW, ADAPTIVE_GRID_HIGH,
+                             ADAPTIVE_GRID_INITIAL_POINTS, ADAPTIVE_GRID_BUDGET,
+                             ADAPTIVE_GRID_TOLERANCE);
+    adaptive_grid_run(grid, adaptive_grid_model, NULL);
+
+    fprintf(csv, "data_arrival_rate,replications,data_mean_delay,half_width,"
+            "curvature,interpolation_error\n");
+    for (i = 0; i < grid->number_of_points; i++) {
+        point = grid->points + i;
+        fprintf(csv, "%.4f,%ld,%.3f,%.3f,%.6f,", point->x, point->stat.count,
+                point->stat.mean,
+                running_stat_half_width(&point->stat, grid->confidence),
+                point->curvature);
+        if (i < grid->number_of_points - 1)
+            fprintf(csv, "%.6f", adaptive_grid_interpolation_error(grid, i));
+        fprintf(csv, "\n");
+    }
+
+    printf("Adaptive grid %s: %d rates, %d bisections, %ld runs of %ld\n",
+           grid->status == ADAPTIVE_GRID_CONVERGED ? "converged" : "spent its budget",
+           grid->number_of_points, grid->bisections, grid->replications,
+           grid->budget);
+
+    adaptive_grid_free(grid);
+    fclose(csv);
+    return 0;
+}
+
+#endif /* ADAPTIVE_GRID_MODE */
+
+#if LR_REWEIGHT_MODE
+
+/*
+ * Simulate every third data arrival rate of the sweep and estimate the
+ * rates either side of it by likelihood ratio reweighting of the same
+ * sample path, so that each rate is reported once. The mean delays are
+ * ratios of the reweighted regeneration cycle totals.
+ */
+
+static int
+likelihood_ratio_sweep(void)
+{
+    Simulation_Run_Data data;
+    Likelihood_Ratio_Ptr lr;
+    Likelihood_Ratio_Estimate voice, dat;
+    double base_rate, rate;
+    int n;
+
+    FILE *csv = fopen("data/results_lr.csv", "w");
+    if (!csv) {
+        perror("Failed to open results_lr.csv");
+        return 1;
+    }
+
+    data.voice_delay_histogram = NULL;
+    data.data_delay_histogram = NULL;
+
+    fprintf(csv, "data_arrival_rate,seed,base_data_arrival_rate,source,"
+            "voice_mean_delay,voice_half_width,data_mean_delay,"
+            "data_half_width,relative_ess\n");
+
+    for (base_rate = 1 + LR_DATA_RATE_OFFSET;
+         base_rate - LR_DATA_RATE_OFFSET <= 15;
+         base_rate += 3 * LR_DATA_RATE_OFFSET) {
+
+        unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+        unsigned random_seed;
+        int j = 0;
+
+        while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
+
+            lr = likelihood_ratio_new(base_rate, MEAN_SERVICE_TIME,
+                                      LR_NUMBER_OF_VALUES);
+            if (base_rate <= 15)
+                likelihood_ratio_add_target(lr, base_rate, MEAN_SERVICE_TIME);
+            if (base_rate - LR_DATA_RATE_OFFSET >= 1)
+                likelihood_ratio_add_target(lr, base_rate - LR_DATA_RATE_OFFSET,
+                                            MEAN_SERVICE_TIME);
+            if (base_rate + LR_DATA_RATE_OFFSET <= 15)
+                likelihood_ratio_add_target(lr, base_rate + LR_DATA_RATE_OFFSET,
+                                            MEAN_SERVICE_TIME);
+
+            DATA_ARRIVAL_RATE = base_rate;
+            run_simulation(random_seed, lr, &data, NULL);
+
+            for (n = 0; n < lr->number_of_targets; n++) {
+                rate = lr->targets[n].arrival_rate;
+                likelihood_ratio_estimate(lr, n, LR_VOICE_DELAY, LR_VOICE_COUNT,
+                                          &voice);
+                likelihood_ratio_estimate(lr, n, LR_DATA_DELAY, LR_DATA_COUNT,
+                                          &dat);
+
+                if (dat.relative_ess >= LR_MIN_RELATIVE_ESS) {
+                    fprintf(csv, "%.1f,%d,%.1f,reweighted,%.3f,%.3f,%.3f,%.3f,%.4f\n",
+                        rate, random_seed, base_rate,
+                        1000.0 * voice.mean, 1000.0 * voice.half_width,
+                        1000.0 * dat.mean, 1000.0 * dat.half_width,
+                        dat.relative_ess);
+                } else {
+                    /* The weights have degenerated, so simulate the rate. */
+                    DATA_ARRIVAL_RATE = rate;
+                    run_simulation(random_seed, NULL, &data, NULL);
+                    fprintf(csv, "%.1f,%d,%.1f,simulated,%.3f,,%.3f,,%.4f\n",
+                        rate, random_seed, base_rate,
+                        1000.0 * data.voice_accumulated_delay / data.voice_processed_count,
+                        1000.0 * data.data_accumulated_delay / data.data_processed_count,
+                        dat.relative_ess);
+                }
+            }
+            likelihood_ratio_free(lr);
+        }
+    }
+
+    fclose(csv);
+    return 0;
+}
+
+#endif
+
+/*
+ * Write one row of the pooled delay percentiles (in ms).
+ */
+
+static void
+write_percentiles(FILE *csv, double rate, const char *class_name,
+                  Histogram_Ptr histogram)
+{
+    fprintf(csv, "%.1f,%s,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%.6f\n",
+        rate, class_name, histogram->total_count,
+        1000.0 * histogram_mean(histogram),
+        1000.0 * histogram_quantile(histogram, 0.5),
+        1000.0 * histogram_quantile(histogram, 0.99),
+        1000.0 * histogram_quantile(histogram, 0.999),
+        1000.0 * histogram->max,
+        histogram_exceedance(histogram, DELAY_BOUND));
+}
+
+/*
+ * One job of a sweep: a run at the current parameter values. The delays are
+ * in ms.
+ */
+
+static void
+sweep_model(Sweep_Ptr sweep, unsigned random_seed, void *outputs_ptr)
+{
+    Sweep_Outputs *outputs = (Sweep_Outputs *) outputs_ptr;
+    Simulation_Run_Data data;
+
+    data.voice_delay_histogram = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+                                               DELAY_HISTOGRAM_HIGHEST);
+    data.data_delay_histogram = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+                                              DELAY_HISTOGRAM_HIGHEST);
+
+    run_simulation(random_seed, NULL, &data, NULL);
+
+    sweep_set_output(sweep, outputs->voice_mean_delay, data.voice_delays.mean);
+    sweep_set_output(sweep, outputs->data_mean_delay, data.data_delays.mean);
+    sweep_set_output(sweep, outputs->voice_p99_delay,
+        1000.0 * histogram_quantile(data.voice_delay_histogram, 0.99));
+    sweep_set_output(sweep, outputs->data_p99_delay,
+        1000.0 * histogram_quantile(data.data_delay_histogram, 0.99));
+    sweep_set_output(sweep, outputs->voice_exceed,
+        histogram_exceedance(data.voice_delay_histogram, DELAY_BOUND));
+    sweep_set_output(sweep, outputs->data_exceed,
+        histogram_exceedance(data.data_delay_histogram, DELAY_BOUND));
+    sweep_set_output(sweep, outputs->link_utilization, data.link_utilization);
+    sweep_set_output(sweep, outputs->mean_packets_in_system,
+                     data.mean_number_in_system);
+
+    histogram_free(data.voice_delay_histogram);
+    histogram_free(data.data_delay_histogram);
+}
+
+/*
+ * Run the sweep described by the command line (see sweep.h).
+ */
+
+static int
+sweep_main(int argc, char *argv[])
+{
+    unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+    Sweep_Outputs outputs;
+    Sweep_Ptr sweep;
+    int missing;
+
+    sweep = sweep_new("lab2_voice_data_link", RANDOM_SEEDS);
+    sweep_add_parameter(sweep, "data_arrival_rate", &DATA_ARRIVAL_RATE);
+    sweep_add_parameter(sweep, "voice_arrival_interval", &VOICE_ARRIVAL_INTERVAL);
+    sweep_add_parameter(sweep, "mean_service_time", &MEAN_SERVICE_TIME);
+    sweep_add_parameter(sweep, "runlength", &RUNLENGTH);
+
+    outputs.voice_mean_delay = sweep_add_output(sweep, "voice_mean_delay");
+    outputs.data_mean_delay = sweep_add_output(sweep, "data_mean_delay");
+    outputs.voice_p99_delay = sweep_add_output(sweep, "voice_p99_delay");
+    outputs.data_p99_delay = sweep_add_output(sweep, "data_p99_delay");
+    outputs.voice_exceed = sweep_add_output(sweep, "voice_exceed_20ms");
+    outputs.data_exceed = sweep_add_output(sweep, "data_exceed_20ms");
+    outputs.link_utilization = sweep_add_output(sweep, "link_utilization");
+    outputs.mean_packets_in_system = sweep_add_output(sweep, "mean_packets_in_system");
+
+    sweep_parse_arguments(sweep, argc, argv);
+    missing = sweep_run(sweep, sweep_model, (void *) &outputs);
+    sweep_free(sweep);
+
+    return missing > 0;
+}
+
+int main(int argc, char *argv[])
+{
     Simulation_Run_Data data;
+    Histogram_Ptr voice_delays, data_delays;
+
+    if (argc > 1)
+        return sweep_main(argc, argv);
+
+#if LR_REWEIGHT_MODE
+    return likelihood_ratio_sweep();
+#endif
+
+#if BRANCH_MODE
+    return what_if_branches();
+#endif
+
+#if ADAPTIVE_GRID_MODE
+    return adaptive_grid_sweep();
+#endif
 
     /* Open CSV file for writing results */
     FILE *csv = fopen("data/results.csv", "w");
@@ -63,12 +707,55 @@ int main(void)
         return 1;
     }
     
+    /* The delay percentiles of each rate, over all seeds. */
+    FILE *percentiles_csv = fopen("data/percentiles.csv", "w");
+    if (!percentiles_csv) {
+        perror("Failed to open percentiles.csv");
+        return 1;
+    }
+
+    /* The 95% confidence intervals of each rate, over all seeds. */
+    FILE *summary_csv = fopen("data/summary.csv", "w");
+    if (!summary_csv) {
+        perror("Failed to open summary.csv");
+        return 1;
+    }
+
+    Replication_Aggregator_Ptr agg = replication_aggregator_new();
+    int agg_voice_delay = replication_aggregator_add_output(agg, "voice_delay");
+    int agg_data_delay = replication_aggregator_add_output(agg, "data_delay");
+    int agg_voice_exceed = replication_aggregator_add_output(agg, "voice_exceed_20ms");
+    int agg_data_exceed = replication_aggregator_add_output(agg, "data_exceed_20ms");
+    int agg_utilization = replication_aggregator_add_output(agg, "link_utilization");
+    int agg_number = replication_aggregator_add_output(agg, "mean_packets_in_system");
+    char point[32];
+    char warm_start[512];
+
     /* Write CSV header */
-    fprintf(csv, "data_arrival_rate,seed,voice_mean_delay,data_mean_delay\n");
+    fprintf(csv, "data_arrival_rate,seed,voice_mean_delay,data_mean_delay,"
+            "link_mean_delay,link_d_delay_d_mu,link_d_number_d_mu,"
+            "voice_p99_delay,voice_p999_delay,voice_exceed_20ms,"
+            "data_p99_delay,data_p999_delay,data_exceed_20ms,"
+            "link_utilization,mean_packets_in_system\n");
+    fprintf(percentiles_csv, "data_arrival_rate,class,count,mean_delay,"
+            "p50_delay,p99_delay,p999_delay,max_delay,exceed_20ms\n");
+    replication_aggregator_write_header(summary_csv);
+
+    data.voice_delay_histogram = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+                                               DELAY_HISTOGRAM_HIGHEST);
+    data.data_delay_histogram = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+                                              DELAY_HISTOGRAM_HIGHEST);
+    voice_delays = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+                                 DELAY_HISTOGRAM_HIGHEST);
+    data_delays = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+                                DELAY_HISTOGRAM_HIGHEST);
 
     /* Sweep data arrival rates from 50 to 500 packets/sec */
     for (double rate = 1; rate <= 15; rate += 1) {
         DATA_ARRIVAL_RATE = rate;
+        histogram_reset(voice_delays);
+        histogram_reset(data_delays);
+        replication_aggregator_reset(agg);
         
         /* Run simulation with different random seeds */
         unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
@@ -76,38 +763,18 @@ int main(void)
         int j = 0;
 
         while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
-            /* Create a new simulation run */
-            simulation_run = simulation_run_new();
-            simulation_run_attach_data(simulation_run, (void *)&data);
-
-            /* Initialize data structures */
-            data.blip_counter = 0;
-            data.random_seed = random_seed;
-            data.voice_arrival_count = 0;
-            data.voice_processed_count = 0;
-            data.voice_accumulated_delay = 0.0;
-            data.data_arrival_count = 0;
-            data.data_processed_count = 0;
-            data.data_accumulated_delay = 0.0;
-
-            /* Create separate buffers for voice and data, plus link */
-            data.voice_buffer = fifoqueue_new();
-            data.data_buffer = fifoqueue_new();
-            data.link = server_new();
-
-            /* Set random seed */
-            random_generator_initialize(random_seed);
-
-            /* Schedule initial arrivals */
-            schedule_voice_arrival_event(simulation_run, 0.0);
-            schedule_data_arrival_event(simulation_run, 0.0);
-
-            /* Run simulation until enough packets processed */
-            long total_processed = 0;
-            while (total_processed < RUNLENGTH) {
-                simulation_run_execute_event(simulation_run);
-                total_processed = data.voice_processed_count + data.data_processed_count;
-            }
+            /*
+             * With WARM_START_MODE each seed carries on from its state at
+             * the end of the previous rate, dropping only the first rate's
+             * stale state from an earlier sweep.
+             */
+            warm_start_filename(warm_start, random_seed);
+            if (WARM_START_MODE && rate == 1)
+                remove(warm_start);
+            run_simulation(random_seed, NULL, &data,
+                           WARM_START_MODE ? warm_start : NULL);
+            if (WARM_START_MODE && rate + 1 > 15)
+                remove(warm_start);
 
             /* Calculate mean delays and output to CSV */
             double voice_mean_delay = (data.voice_processed_count > 0) ? 
@@ -115,14 +782,63 @@ int main(void)
             double data_mean_delay = (data.data_processed_count > 0) ? 
                 1000.0 * data.data_accumulated_delay / data.data_processed_count : 0.0;
             
-            fprintf(csv, "%.1f,%d,%.3f,%.3f\n", 
-                DATA_ARRIVAL_RATE, random_seed, voice_mean_delay, data_mean_delay);
+            /*
+             * IPA sensitivity of the mean delay over all packets to the
+             * service rate mu = 1/MEAN_SERVICE_TIME, using
+             * d/dmu = -theta^2 d/dtheta. Only the total is reported: the
+             * priority order of voice and data packets can change under a
+             * perturbation, which biases the per class derivatives even
+             * though the work-conserving total is unaffected. The mean number
+             * of packets in the system follows from Little's law.
+             */
+            long link_processed_count = data.voice_processed_count + data.data_processed_count;
+            double link_mean_delay = 1000.0 * (data.voice_accumulated_delay +
+                data.data_accumulated_delay) / link_processed_count;
+            double link_d_delay_d_mu = -MEAN_SERVICE_TIME * MEAN_SERVICE_TIME *
+                data.accumulated_d_delay_d_theta / link_processed_count;
+            double link_arrival_rate = 1.0/VOICE_ARRIVAL_INTERVAL + DATA_ARRIVAL_RATE;
 
-            /* Clean up */
-            cleanup_memory_part7(simulation_run);
+            fprintf(csv, "%.1f,%d,%.3f,%.3f,%.3f,%.3f,%.6f,%.3f,%.3f,%.6f,%.3f,%.3f,%.6f,%.6f,%.6f\n", 
+                DATA_ARRIVAL_RATE, random_seed, voice_mean_delay, data_mean_delay,
+                link_mean_delay, 1000.0 * link_d_delay_d_mu,
+                link_arrival_rate * link_d_delay_d_mu,
+                1000.0 * histogram_quantile(data.voice_delay_histogram, 0.99),
+                1000.0 * histogram_quantile(data.voice_delay_histogram, 0.999),
+                histogram_exceedance(data.voice_delay_histogram, DELAY_BOUND),
+                1000.0 * histogram_quantile(data.data_delay_histogram, 0.99),
+                1000.0 * histogram_quantile(data.data_delay_histogram, 0.999),
+                histogram_exceedance(data.data_delay_histogram, DELAY_BOUND),
+                data.link_utilization, data.mean_number_in_system);
+
+            histogram_merge(voice_delays, data.voice_delay_histogram);
+            histogram_merge(data_delays, data.data_delay_histogram);
+
+            replication_aggregator_add_run(agg, agg_voice_delay, &data.voice_delays);
+            replication_aggregator_add_run(agg, agg_data_delay, &data.data_delays);
+            replication_aggregator_add(agg, agg_voice_exceed,
+                histogram_exceedance(data.voice_delay_histogram, DELAY_BOUND));
+            replication_aggregator_add(agg, agg_data_exceed,
+                histogram_exceedance(data.data_delay_histogram, DELAY_BOUND));
+            replication_aggregator_add(agg, agg_utilization, data.link_utilization);
+            replication_aggregator_add(agg, agg_number, data.mean_number_in_system);
         }
+
+        sprintf(point, "%.1f", rate);
+        replication_aggregator_write(agg, summary_csv, point, 0.95);
+
+        write_percentiles(percentiles_csv, rate, "voice", voice_delays);
+        write_percentiles(percentiles_csv, rate, "data", data_delays);
     }
 
+    histogram_free(data.voice_delay_histogram);
+    histogram_free(data.data_delay_histogram);
+    histogram_free(voice_delays);
+    histogram_free(data_delays);
+
+    replication_aggregator_free(agg);
+
+    fclose(summary_csv);
+    fclose(percentiles_csv);
     fclose(csv);
     return 0;
 }
\ No newline at end of file
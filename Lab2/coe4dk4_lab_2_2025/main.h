@@ -30,13 +30,24 @@
 
 #include "simlib.h"
 #include "simparameters.h"
+#include "likelihood_ratio.h"
+#include "histogram.h"
+#include "statistics.h"
 
 /******************************************************************************/
 
+/* The parameters that can be swept, defined in main.c. */
 extern double DATA_ARRIVAL_RATE;
+extern double VOICE_ARRIVAL_INTERVAL;
+extern double MEAN_SERVICE_TIME;
+extern double RUNLENGTH;
 
 typedef enum {VOICE_PACKET, DATA_PACKET} Packet_Type;
 
+/* The regeneration cycle totals passed to the likelihood ratio object. */
+typedef enum {LR_VOICE_DELAY, LR_VOICE_COUNT, LR_DATA_DELAY, LR_DATA_COUNT,
+	      LR_NUMBER_OF_VALUES} Likelihood_Ratio_Value;
+
 /******************************************************************************/
 
 typedef struct _simulation_run_data_ 
@@ -56,6 +67,43 @@ typedef struct _simulation_run_data_
   long int data_arrival_count;
   long int data_processed_count;
   double data_accumulated_delay;
+
+  /* Running statistics of the delays per class (ms). */
+  Running_Stat voice_delays;
+  Running_Stat data_delays;
+
+  /* Delay histograms per class (NULL if not wanted). */
+  Histogram_Ptr voice_delay_histogram;
+  Histogram_Ptr data_delay_histogram;
+
+  /*
+   * Time average number of packets in the system, counted by both buffers
+   * and the link together. The link is busy whenever the system is not
+   * empty, so its utilization is P(N >= 1). The results are kept after the
+   * run is cleaned up.
+   */
+  Time_Weighted_Stat_Ptr number_in_system;
+  double mean_number_in_system;
+  double link_utilization;
+
+  /*
+   * Infinitesimal perturbation analysis with respect to MEAN_SERVICE_TIME
+   * (theta): the derivative of the current packet end time and the
+   * accumulated derivatives of all packet delays.
+   */
+  double ipa_last_end_d_theta;
+  double accumulated_d_delay_d_theta;
+
+  /*
+   * Likelihood ratio reweighting to other data arrival rates (NULL when not
+   * used). A regeneration cycle starts at each voice arrival that finds the
+   * link idle. The running totals at the start of the current cycle are kept
+   * to form the cycle totals.
+   */
+  Likelihood_Ratio_Ptr lr;
+  double cycle_start_time;
+  double last_data_arrival_time;
+  double cycle_start_values[LR_NUMBER_OF_VALUES];
   
   unsigned random_seed;
 } Simulation_Run_Data, * Simulation_Run_Data_Ptr;
@@ -74,7 +122,7 @@ typedef struct _packet_
  * Function prototypes
  */
 
-int main(void);
+int main(int, char *[]);
 
 /******************************************************************************/
 
@@ -0,0 +1,116 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _METAMODEL_H_
+#define _METAMODEL_H_
+
+/******************************************************************************/
+
+/*
+ * Stochastic kriging metamodel of a simulation output.
+ *
+ * The replications of the output at the design points (e.g., the runs of a
+ * sweep over a few parameters) are added one at a time; those at the same
+ * point are pooled into its mean and sample variance. The output is then
+ * modelled as
+ *
+ *   Y(x) = beta + M(x) + e(x),
+ *
+ * a constant trend, a zero mean Gaussian process M with variance tau^2 and
+ * correlation exp(-sum_j theta_j (x_j - x'_j)^2), the inputs being scaled
+ * to [0, 1] over the range of the design, and the replication noise e. The
+ * noise of each point mean is its sample variance over its number of
+ * replications (stochastic kriging, Ankenman, Nelson and Staum), so noisy
+ * points are smoothed rather than interpolated. A point with a single
+ * replication takes the pooled variance of the others. tau^2 and the
+ * theta_j are fitted by maximum likelihood (a coordinate search in log
+ * space) and beta by generalized least squares.
+ *
+ * With log_scale set, the logs of the point means are modelled instead,
+ * their noise taken by the delta method, and the predictions are
+ * transformed back. This suits outputs that are positive and span orders of
+ * magnitude, e.g., delays near saturation, which a stationary process on
+ * the linear scale follows poorly.
+ *
+ * A prediction comes with its standard error, which is small near well
+ * replicated points and grows away from the design. The point of the
+ * largest standard error is where a new run tells the most.
+ */
+
+#define METAMODEL_MAX_DIMENSIONS 16
+
+typedef struct _metamodel_
+{
+  int dimensions;
+  int number_of_points;
+  int max_points;         /* allocated */
+  double * x;             /* [point * dimensions + j] */
+  long int * count;       /* replications */
+  double * mean;
+  double * m2;            /* sum of squared deviations */
+  int log_scale;
+
+  /* The fit. */
+  double lower[METAMODEL_MAX_DIMENSIONS];  /* range of the design */
+  double upper[METAMODEL_MAX_DIMENSIONS];
+  double theta[METAMODEL_MAX_DIMENSIONS];
+  double process_variance;   /* tau^2 */
+  double trend;              /* beta */
+  double log_likelihood;
+  double * response;         /* the point means, or their logs */
+  double * noise;            /* and their variances */
+  double * cholesky;         /* of the covariance of the point means */
+  double * weights;          /* its inverse times (means - beta) */
+  double * inverse_ones;     /* its inverse times ones */
+  double ones_sum;           /* ones' inverse_ones */
+  int fitted;
+} Metamodel, * Metamodel_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Metamodel_Ptr
+metamodel_new(int);
+
+void
+metamodel_add(Metamodel_Ptr, const double *, double);
+
+void
+metamodel_fit(Metamodel_Ptr);
+
+void
+metamodel_predict(Metamodel_Ptr, const double *, double *, double *);
+
+void
+metamodel_free(Metamodel_Ptr);
+
+/******************************************************************************/
+
+#endif /* metamodel.h */
+
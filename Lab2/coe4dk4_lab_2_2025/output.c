@@ -0,0 +1,95 @@
+/*
+ * 
+ * Simulation_Run of A Single Server Queueing System
+ * 
+ * Copyright (C) 2014 Terence D. Todd Hamilton, Ontario, CANADA,
+ * todd@mcmaster.ca
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include "simparameters.h"
+#include "main.h"
+#include "output.h"
+
+/******************************************************************************/
+
+/*
+ * Add the live metrics of a run, if it publishes them (see output.h).
+ */
+
+void
+output_metrics_start(Simulation_Run_Ptr simulation_run)
+{
+  char label[128];  /* cut to METRICS_LABEL_SIZE on the page */
+
+  if (simulation_run->metrics == NULL) return;
+
+  sprintf(label, "data rate %g, voice interval %g, service %g",
+	  DATA_ARRIVAL_RATE, VOICE_ARRIVAL_INTERVAL, MEAN_SERVICE_TIME);
+  simulation_run_metrics_label(simulation_run, label);
+  simulation_run_metrics_counter(simulation_run, "voice arrivals");
+  simulation_run_metrics_counter(simulation_run, "data arrivals");
+  simulation_run_metrics_counter(simulation_run, "voice packets processed");
+  simulation_run_metrics_counter(simulation_run, "data packets processed");
+  simulation_run_metrics_estimate(simulation_run, "voice delay (ms)");
+  simulation_run_metrics_estimate(simulation_run, "data delay (ms)");
+}
+
+/*
+ * Publish the live metrics of a run. This is cheap enough to do at every
+ * packet.
+ */
+
+void
+output_metrics(Simulation_Run_Ptr simulation_run)
+{
+  Simulation_Run_Data_Ptr data;
+  Running_Stat_Ptr voice, packets;
+
+  if (simulation_run->metrics == NULL) return;
+
+  data = (Simulation_Run_Data_Ptr) simulation_run_data(simulation_run);
+  voice = &data->voice_delays;
+  packets = &data->data_delays;
+
+  SIMULATION_RUN_METRICS_PROGRESS(simulation_run,
+	  (double) (data->voice_processed_count + data->data_processed_count)
+	  / RUNLENGTH);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, OUTPUT_METRICS_VOICE_ARRIVALS,
+				 data->voice_arrival_count);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, OUTPUT_METRICS_DATA_ARRIVALS,
+				 data->data_arrival_count);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run,
+				 OUTPUT_METRICS_VOICE_PROCESSED,
+				 data->voice_processed_count);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run,
+				 OUTPUT_METRICS_DATA_PROCESSED,
+				 data->data_processed_count);
+
+  /* The running statistics give the sums back from the mean and m2. */
+  SIMULATION_RUN_METRICS_ESTIMATE(simulation_run, OUTPUT_METRICS_VOICE_DELAY,
+				  voice->count, voice->count * voice->mean,
+				  voice->m2 + voice->count * voice->mean *
+				  voice->mean);
+  SIMULATION_RUN_METRICS_ESTIMATE(simulation_run, OUTPUT_METRICS_DATA_DELAY,
+				  packets->count, packets->count * packets->mean,
+				  packets->m2 + packets->count * packets->mean *
+				  packets->mean);
+}
+
@@ -33,10 +33,29 @@
 
 /******************************************************************************/
 
+/*
+ * The live metrics of a run (see metrics.h), added in this order.
+ */
+
+typedef enum {OUTPUT_METRICS_VOICE_ARRIVALS, OUTPUT_METRICS_DATA_ARRIVALS,
+	      OUTPUT_METRICS_VOICE_PROCESSED, OUTPUT_METRICS_DATA_PROCESSED}
+  Output_Metrics_Counter;
+
+typedef enum {OUTPUT_METRICS_VOICE_DELAY, OUTPUT_METRICS_DATA_DELAY}
+  Output_Metrics_Estimate;
+
+/******************************************************************************/
+
 /*
  * Function prototypes
  */
 
+void
+output_metrics_start(Simulation_Run_Ptr);
+
+void
+output_metrics(Simulation_Run_Ptr);
+
 void
 output_progress_msg_to_screen(Simulation_Run_Ptr);
 
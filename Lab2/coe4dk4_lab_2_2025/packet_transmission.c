@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include "trace.h"
 #include "main.h"
+#include "output.h"
 #include "packet_transmission.h"
 
 /******************************************************************************/
@@ -70,14 +71,22 @@ end_packet_transmission_event(Simulation_Run_Ptr simulation_run, void * link)
 
   /* Collect statistics based on packet type */
   double delay = simulation_run_get_time(simulation_run) - this_packet->arrive_time;
+  data->accumulated_d_delay_d_theta += data->ipa_last_end_d_theta;
   
   if (this_packet->packet_type == VOICE_PACKET) {
     data->voice_processed_count++;
     data->voice_accumulated_delay += delay;
+    running_stat_add(&data->voice_delays, 1000.0 * delay);
+    if (data->voice_delay_histogram != NULL)
+      histogram_record(data->voice_delay_histogram, delay);
   } else {
     data->data_processed_count++;
     data->data_accumulated_delay += delay;
+    running_stat_add(&data->data_delays, 1000.0 * delay);
+    if (data->data_delay_histogram != NULL)
+      histogram_record(data->data_delay_histogram, delay);
   }
+  output_metrics(simulation_run);
 
   /* Free the packet */
   xfree((void *) this_packet);
@@ -96,6 +105,11 @@ end_packet_transmission_event(Simulation_Run_Ptr simulation_run, void * link)
  * This function ititiates the transmission of the packet passed to the
  * function. This is done by placing the packet in the server. The packet
  * transmission end event for this packet is then scheduled.
+ *
+ * For perturbation analysis, a packet that waited starts when the previous
+ * packet ends and inherits the derivative of that end time. One that did not
+ * wait starts at its own (unperturbed) arrival time. Service times scale with
+ * MEAN_SERVICE_TIME, so each adds service_time/MEAN_SERVICE_TIME.
  */
 
 void
@@ -103,8 +117,16 @@ start_transmission_on_link(Simulation_Run_Ptr simulation_run,
                Packet_Ptr this_packet,
                Server_Ptr link)
 {
+  Simulation_Run_Data_Ptr data;
+
   TRACE(printf("Start Of Packet.\n");)
 
+  data = (Simulation_Run_Data_Ptr) simulation_run_data(simulation_run);
+
+  if (simulation_run_get_time(simulation_run) == this_packet->arrive_time)
+    data->ipa_last_end_d_theta = 0.0;
+  data->ipa_last_end_d_theta += this_packet->service_time/MEAN_SERVICE_TIME;
+
   server_put(link, (void*) this_packet);
   this_packet->status = XMTTING;
 
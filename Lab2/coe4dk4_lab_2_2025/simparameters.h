@@ -33,17 +33,83 @@
 #define VOICE_PACKET_SIZE 1776 /* bits (160 bytes payload + 62 bytes header) */
 #define DATA_PACKET_SIZE 1000 /* bits - can be adjusted */
 
+/* Defaults of the parameters that can be swept from the command line (see
+   sweep.h). The values in use are the variables of the same names in main.c. */
+#define DATA_ARRIVAL_RATE_DEFAULT 5 /* packets/second */
+
 /* Voice traffic parameters */
-#define VOICE_ARRIVAL_INTERVAL 0.1 /* 20 ms = 0.02 seconds */
-#define MEAN_SERVICE_TIME 0.04 /* 40 ms = 0.04 seconds */
+#define VOICE_ARRIVAL_INTERVAL_DEFAULT 0.1 /* 20 ms = 0.02 seconds */
+#define MEAN_SERVICE_TIME_DEFAULT 0.04 /* 40 ms = 0.04 seconds */
 
 /* Simulation parameters */
-#define RUNLENGTH 10000 /* packets - reduced for faster simulation */
+#define RUNLENGTH_DEFAULT 10000 /* packets - reduced for faster simulation */
 #define STEP 50 /* data arrival rate step */
 
+/* Delay histograms: resolution and highest tracked value (seconds), and the
+   delay bound whose exceedance probability is reported. */
+#define DELAY_HISTOGRAM_RESOLUTION 1e-6
+#define DELAY_HISTOGRAM_HIGHEST 1e3
+#define DELAY_BOUND 0.02 /* 20 ms */
+
 /* Comma separated list of random seeds to run. */
 #define RANDOM_SEED_LIST 400474322, 400430923, 12345678, 987654321, 45671234
 
+/*
+ * Likelihood ratio reweighting. When LR_REWEIGHT_MODE is 1 the sweep only
+ * simulates every third data arrival rate and reweights each sample path to
+ * the rates LR_DATA_RATE_OFFSET either side of it, so every rate from 1 to
+ * 15 in steps of LR_DATA_RATE_OFFSET appears once. Results go to
+ * data/results_lr.csv. A rate whose relative effective sample size falls
+ * below LR_MIN_RELATIVE_ESS is simulated directly instead.
+ */
+#define LR_REWEIGHT_MODE 0
+#define LR_DATA_RATE_OFFSET 1.0
+#define LR_MIN_RELATIVE_ESS 0.1
+
+/*
+ * Checkpoints (see checkpoint.h). With CHECKPOINT_INTERVAL > 0 each run saves
+ * its state to CHECKPOINT_DIRECTORY every CHECKPOINT_INTERVAL packets, and a
+ * run whose checkpoint file is there resumes from it, so a killed program
+ * picks up each run where it stopped. The file is removed when the run
+ * finishes. The likelihood ratio runs are not checkpointed.
+ */
+#define CHECKPOINT_INTERVAL 0 /* packets */
+#define CHECKPOINT_DIRECTORY "data"
+
+/*
+ * Warm starts. With WARM_START_MODE 1 the rate sweep runs each seed on from
+ * its state at the end of the previous rate (saved in CHECKPOINT_DIRECTORY),
+ * with the statistics cleared, instead of from an empty system.
+ */
+#define WARM_START_MODE 0
+
+/*
+ * What-if branches (see branch.h). When BRANCH_MODE is 1 each seed is warmed
+ * up once for BRANCH_WARMUP packets at DATA_ARRIVAL_RATE and then forked into
+ * one branch per rate of BRANCH_RATE_LIST, each measuring RUNLENGTH packets.
+ * With BRANCH_COMMON_RANDOM_NUMBERS 1 the branches share one random number
+ * substream. Results go to data/results_branch.csv.
+ */
+#define BRANCH_MODE 0
+#define BRANCH_WARMUP 10000 /* packets */
+#define BRANCH_RATE_LIST 1, 3, 5, 7, 9, 11, 13, 15
+#define BRANCH_COMMON_RANDOM_NUMBERS 1
+
+/*
+ * Adaptive grid refinement (see adaptive_grid.h). When ADAPTIVE_GRID_MODE is 1
+ * the data mean delay is refined over data arrival rates from
+ * ADAPTIVE_GRID_LOW to ADAPTIVE_GRID_HIGH, starting from
+ * ADAPTIVE_GRID_INITIAL_POINTS rates, until its relative error is within
+ * ADAPTIVE_GRID_TOLERANCE or ADAPTIVE_GRID_BUDGET runs are spent. Results go
+ * to data/results_adaptive.csv.
+ */
+#define ADAPTIVE_GRID_MODE 0
+#define ADAPTIVE_GRID_LOW 1
+#define ADAPTIVE_GRID_HIGH 15
+#define ADAPTIVE_GRID_INITIAL_POINTS 5
+#define ADAPTIVE_GRID_BUDGET 300 /* runs */
+#define ADAPTIVE_GRID_TOLERANCE 0.05
+
 /* Transmission times */
 #define VOICE_XMT_TIME ((double) VOICE_PACKET_SIZE/LINK_BIT_RATE)
 #define DATA_XMT_TIME ((double) DATA_PACKET_SIZE/LINK_BIT_RATE)
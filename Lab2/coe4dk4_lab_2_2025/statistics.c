@@ -0,0 +1,523 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "statistics.h"
+
+/******************************************************************************/
+
+static double
+incomplete_beta_fraction(double, double, double);
+
+static double
+incomplete_beta(double, double, double);
+
+static double
+student_t_cdf(double, int);
+
+static int
+solve_linear_system(int, double [CV_MAX_CONTROLS][CV_MAX_CONTROLS],
+		    const double *, double *);
+
+/******************************************************************************/
+
+/*
+ * Continued fraction for the regularized incomplete beta function, evaluated
+ * with the modified Lentz method.
+ */
+
+static double
+incomplete_beta_fraction(double a, double b, double x)
+{
+  int m;
+  double aa, c, d, del, h;
+  const double tiny = 1.0e-300;
+
+  c = 1.0;
+  d = 1.0 - (a+b) * x/(a+1.0);
+  if (fabs(d) < tiny) d = tiny;
+  d = 1.0/d;
+  h = d;
+
+  for (m=1; m<=300; m++) {
+    aa = m * (b-m) * x/((a+2*m-1) * (a+2*m));
+    d = 1.0 + aa*d;
+    if (fabs(d) < tiny) d = tiny;
+    c = 1.0 + aa/c;
+    if (fabs(c) < tiny) c = tiny;
+    d = 1.0/d;
+    h *= d*c;
+
+    aa = -(a+m) * (a+b+m) * x/((a+2*m) * (a+2*m+1));
+    d = 1.0 + aa*d;
+    if (fabs(d) < tiny) d = tiny;
+    c = 1.0 + aa/c;
+    if (fabs(c) < tiny) c = tiny;
+    d = 1.0/d;
+    del = d*c;
+    h *= del;
+    if (fabs(del-1.0) < 1.0e-14) break;
+  }
+  return h;
+}
+
+/*
+ * Regularized incomplete beta function I_x(a, b).
+ */
+
+static double
+incomplete_beta(double a, double b, double x)
+{
+  double front;
+
+  if (x <= 0.0) return 0.0;
+  if (x >= 1.0) return 1.0;
+
+  front = exp(lgamma(a+b) - lgamma(a) - lgamma(b) +
+	      a*log(x) + b*log(1.0-x));
+
+  if (x < (a+1.0)/(a+b+2.0))
+    return front * incomplete_beta_fraction(a, b, x)/a;
+  else
+    return 1.0 - front * incomplete_beta_fraction(b, a, 1.0-x)/b;
+}
+
+static double
+student_t_cdf(double t, int dof)
+{
+  double tail;
+
+  tail = 0.5 * incomplete_beta(0.5*dof, 0.5, dof/(dof + t*t));
+  return (t >= 0) ? 1.0 - tail : tail;
+}
+
+/*
+ * Return the p quantile of the Student-t distribution with dof degrees of
+ * freedom. It is found by bisection on the cdf, which is plenty fast for the
+ * handful of calls made at the end of a run.
+ */
+
+double
+student_t_quantile(double p, int dof)
+{
+  int i;
+  double low = -1.0e3, high = 1.0e3, mid = 0.0;
+
+  if (dof < 1) {
+    printf("Error: Student-t quantile needs at least one degree of freedom.\n");
+    exit(1);
+  }
+
+  for (i=0; i<200; i++) {
+    mid = 0.5 * (low + high);
+    if (student_t_cdf(mid, dof) < p) low = mid;
+    else high = mid;
+    if (high - low < 1.0e-10) break;
+  }
+  return mid;
+}
+
+/******************************************************************************/
+
+/*
+ * Control variate functions.
+ *
+ * Create a new accumulator. The known means of the controls are copied in.
+ */
+
+Control_Variate_Ptr
+control_variate_new(int number_of_controls, const double * control_means)
+{
+  int i, j;
+  Control_Variate_Ptr cv;
+
+  if (number_of_controls < 1 || number_of_controls > CV_MAX_CONTROLS) {
+    printf("Error: Between 1 and %d control variates are supported.\n",
+	   CV_MAX_CONTROLS);
+    exit(1);
+  }
+
+  cv = (Control_Variate_Ptr) xmalloc(sizeof(Control_Variate));
+  cv->number_of_controls = number_of_controls;
+  cv->count = 0;
+  cv->y_mean = 0.0;
+  cv->m_yy = 0.0;
+
+  for (i=0; i<CV_MAX_CONTROLS; i++) {
+    cv->control_mean[i] = (i < number_of_controls) ? control_means[i] : 0.0;
+    cv->c_mean[i] = 0.0;
+    cv->m_cy[i] = 0.0;
+    for (j=0; j<CV_MAX_CONTROLS; j++) cv->m_cc[i][j] = 0.0;
+  }
+  return cv;
+}
+
+/*
+ * Add one replication: its output y and the sample means of its controls.
+ */
+
+void
+control_variate_add(Control_Variate_Ptr cv, double y, const double * controls)
+{
+  int i, j, q;
+  double n, dy, dc[CV_MAX_CONTROLS];
+
+  q = cv->number_of_controls;
+  cv->count++;
+  n = (double) cv->count;
+
+  dy = y - cv->y_mean;
+  for (i=0; i<q; i++) dc[i] = controls[i] - cv->c_mean[i];
+
+  /* The co-moments use the deviation from the old mean times the deviation
+     from the new mean. */
+  cv->y_mean += dy/n;
+  for (i=0; i<q; i++) cv->c_mean[i] += dc[i]/n;
+
+  cv->m_yy += dy * (y - cv->y_mean);
+  for (i=0; i<q; i++) {
+    cv->m_cy[i] += dc[i] * (y - cv->y_mean);
+    for (j=0; j<q; j++)
+      cv->m_cc[i][j] += dc[i] * (controls[j] - cv->c_mean[j]);
+  }
+}
+
+/*
+ * Solve a * x = b for the small symmetric systems used here. Returns 0 if the
+ * matrix is (numerically) singular.
+ */
+
+static int
+solve_linear_system(int q, double a[CV_MAX_CONTROLS][CV_MAX_CONTROLS],
+		    const double * b, double * x)
+{
+  int i, j, k, pivot;
+  double m[CV_MAX_CONTROLS][CV_MAX_CONTROLS+1], tmp, scale = 0.0;
+
+  for (i=0; i<q; i++) {
+    for (j=0; j<q; j++) {
+      m[i][j] = a[i][j];
+      if (fabs(a[i][j]) > scale) scale = fabs(a[i][j]);
+    }
+    m[i][q] = b[i];
+  }
+
+  for (k=0; k<q; k++) {
+    pivot = k;
+    for (i=k+1; i<q; i++)
+      if (fabs(m[i][k]) > fabs(m[pivot][k])) pivot = i;
+    if (fabs(m[pivot][k]) <= 1.0e-12 * scale) return 0;
+
+    for (j=0; j<=q; j++) {
+      tmp = m[k][j]; m[k][j] = m[pivot][j]; m[pivot][j] = tmp;
+    }
+    for (i=k+1; i<q; i++) {
+      tmp = m[i][k]/m[k][k];
+      for (j=k; j<=q; j++) m[i][j] -= tmp * m[k][j];
+    }
+  }
+
+  for (i=q-1; i>=0; i--) {
+    tmp = m[i][q];
+    for (j=i+1; j<q; j++) tmp -= m[i][j] * x[j];
+    x[i] = tmp/m[i][i];
+  }
+  return 1;
+}
+
+/*
+ * Compute the regression adjusted estimate and its confidence interval at the
+ * given confidence level (e.g., 0.95). With q controls and n replications the
+ * interval uses n-q-1 degrees of freedom. If there are too few replications,
+ * or the controls do not vary, the crude estimate is returned unchanged.
+ */
+
+void
+control_variate_estimate(Control_Variate_Ptr cv, double confidence,
+			 Control_Variate_Estimate_Ptr estimate)
+{
+  int i, q, dof;
+  double n, d[CV_MAX_CONTROLS], z[CV_MAX_CONTROLS], sse, quad, t;
+
+  q = cv->number_of_controls;
+  n = (double) cv->count;
+
+  estimate->count = cv->count;
+  estimate->crude_mean = cv->y_mean;
+  estimate->crude_half_width = 0.0;
+  if (cv->count > 1) {
+    t = student_t_quantile(0.5 + 0.5*confidence, (int) cv->count - 1);
+    estimate->crude_half_width = t * sqrt(cv->m_yy/(n-1.0)/n);
+  }
+
+  estimate->mean = estimate->crude_mean;
+  estimate->half_width = estimate->crude_half_width;
+  for (i=0; i<CV_MAX_CONTROLS; i++) estimate->beta[i] = 0.0;
+
+  dof = (int) cv->count - q - 1;
+  if (dof < 1) return;
+  if (!solve_linear_system(q, cv->m_cc, cv->m_cy, estimate->beta)) return;
+
+  for (i=0; i<CV_MAX_CONTROLS; i++)
+    d[i] = (i < q) ? cv->c_mean[i] - cv->control_mean[i] : 0.0;
+  if (!solve_linear_system(q, cv->m_cc, d, z)) return;
+
+  sse = cv->m_yy;
+  quad = 0.0;
+  for (i=0; i<q; i++) {
+    sse -= estimate->beta[i] * cv->m_cy[i];
+    quad += d[i] * z[i];
+    estimate->mean -= estimate->beta[i] * d[i];
+  }
+  if (sse < 0.0) sse = 0.0;
+
+  t = student_t_quantile(0.5 + 0.5*confidence, dof);
+  estimate->half_width = t * sqrt(sse/dof * (1.0/n + quad));
+}
+
+void
+control_variate_free(Control_Variate_Ptr cv)
+{
+  xfree((void *) cv);
+}
+
+/******************************************************************************/
+
+/*
+ * Running statistic functions.
+ */
+
+void
+running_stat_reset(Running_Stat_Ptr rs)
+{
+  rs->count = 0;
+  rs->mean = 0.0;
+  rs->m2 = 0.0;
+  rs->min = 0.0;
+  rs->max = 0.0;
+}
+
+void
+running_stat_add(Running_Stat_Ptr rs, double x)
+{
+  double delta;
+
+  if (rs->count == 0 || x < rs->min) rs->min = x;
+  if (rs->count == 0 || x > rs->max) rs->max = x;
+
+  rs->count++;
+  delta = x - rs->mean;
+  rs->mean += delta/rs->count;
+  rs->m2 += delta * (x - rs->mean);
+}
+
+/*
+ * Add the observations summarized in source to destination.
+ */
+
+void
+running_stat_merge(Running_Stat_Ptr destination, const Running_Stat * source)
+{
+  long int n;
+  double delta;
+
+  if (source->count == 0) return;
+  if (destination->count == 0) {
+    *destination = *source;
+    return;
+  }
+
+  n = destination->count + source->count;
+  delta = source->mean - destination->mean;
+
+  destination->m2 += source->m2 +
+    delta * delta * ((double) destination->count * source->count)/n;
+  destination->mean += delta * source->count/n;
+  destination->count = n;
+
+  if (source->min < destination->min) destination->min = source->min;
+  if (source->max > destination->max) destination->max = source->max;
+}
+
+double
+running_stat_variance(Running_Stat_Ptr rs)
+{
+  return (rs->count > 1) ? rs->m2/(rs->count - 1) : 0.0;
+}
+
+/*
+ * The half width of the Student-t confidence interval of the mean at the
+ * given confidence level (e.g., 0.95).
+ */
+
+double
+running_stat_half_width(Running_Stat_Ptr rs, double confidence)
+{
+  if (rs->count < 2) return 0.0;
+  return student_t_quantile(0.5 + 0.5*confidence, (int) rs->count - 1) *
+    sqrt(running_stat_variance(rs)/rs->count);
+}
+
+/******************************************************************************/
+
+/*
+ * Replication aggregator functions.
+ */
+
+Replication_Aggregator_Ptr
+replication_aggregator_new(void)
+{
+  return (Replication_Aggregator_Ptr) xcalloc(1, sizeof(Replication_Aggregator));
+}
+
+/*
+ * Add a named output. Returns its index.
+ */
+
+int
+replication_aggregator_add_output(Replication_Aggregator_Ptr agg,
+				  const char * name)
+{
+  int i;
+
+  if (agg->number_of_outputs == AGGREGATOR_MAX_OUTPUTS) {
+    printf("Error: At most %d aggregated outputs are supported.\n",
+	   AGGREGATOR_MAX_OUTPUTS);
+    exit(1);
+  }
+
+  i = agg->number_of_outputs++;
+  strncpy(agg->names[i], name, AGGREGATOR_MAX_NAME - 1);
+  running_stat_reset(agg->replications + i);
+  running_stat_reset(agg->observations + i);
+  return i;
+}
+
+/*
+ * Clear all outputs, e.g., before the next point of a sweep.
+ */
+
+void
+replication_aggregator_reset(Replication_Aggregator_Ptr agg)
+{
+  int i;
+
+  for (i=0; i<agg->number_of_outputs; i++) {
+    running_stat_reset(agg->replications + i);
+    running_stat_reset(agg->observations + i);
+  }
+}
+
+/*
+ * Record the value of an output for one replication.
+ */
+
+void
+replication_aggregator_add(Replication_Aggregator_Ptr agg, int output,
+			   double value)
+{
+  running_stat_add(agg->replications + output, value);
+}
+
+/*
+ * Record a replication from its own running statistics. Its mean is the
+ * value of the output, and its observations are pooled.
+ */
+
+void
+replication_aggregator_add_run(Replication_Aggregator_Ptr agg, int output,
+			       const Running_Stat * run)
+{
+  running_stat_add(agg->replications + output, run->mean);
+  running_stat_merge(agg->observations + output, run);
+}
+
+void
+replication_aggregator_merge(Replication_Aggregator_Ptr destination,
+			     const Replication_Aggregator * source)
+{
+  int i;
+
+  if (destination->number_of_outputs != source->number_of_outputs) {
+    printf("Error: Aggregators with different outputs cannot be merged.\n");
+    exit(1);
+  }
+
+  for (i=0; i<destination->number_of_outputs; i++) {
+    running_stat_merge(destination->replications + i, source->replications + i);
+    running_stat_merge(destination->observations + i, source->observations + i);
+  }
+}
+
+/*
+ * Write one CSV row per output: the replication mean, its confidence
+ * interval at the given level, the range of the replication values and, if
+ * observations were pooled, their count, standard deviation and range. The
+ * point names the experiment point, e.g., "5.0" for an arrival rate.
+ */
+
+void
+replication_aggregator_write_header(FILE * file)
+{
+  fprintf(file, "point,output,replications,mean,half_width,ci_low,ci_high,"
+	  "min,max,observations,observation_sd,observation_min,"
+	  "observation_max\n");
+}
+
+void
+replication_aggregator_write(Replication_Aggregator_Ptr agg, FILE * file,
+			     const char * point, double confidence)
+{
+  int i;
+  double half_width;
+  Running_Stat_Ptr r, o;
+
+  for (i=0; i<agg->number_of_outputs; i++) {
+    r = agg->replications + i;
+    o = agg->observations + i;
+    half_width = running_stat_half_width(r, confidence);
+
+    fprintf(file, "%s,%s,%ld,%.10g,%.10g,%.10g,%.10g,%.10g,%.10g", point,
+	    agg->names[i], r->count, r->mean, half_width, r->mean - half_width,
+	    r->mean + half_width, r->min, r->max);
+    if (o->count > 0)
+      fprintf(file, ",%ld,%.10g,%.10g,%.10g\n", o->count,
+	      sqrt(running_stat_variance(o)), o->min, o->max);
+    else
+      fprintf(file, ",,,,\n");
+  }
+}
+
+void
+replication_aggregator_free(Replication_Aggregator_Ptr agg)
+{
+  xfree((void *) agg);
+}
+
@@ -0,0 +1,179 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _STATISTICS_H_
+#define _STATISTICS_H_
+
+/******************************************************************************/
+
+#include <stdio.h>
+
+/******************************************************************************/
+
+/*
+ * Control variates.
+ *
+ * Each replication produces an output y (e.g., a mean delay) together with the
+ * sample means of some of its random inputs (e.g., the mean of all service
+ * times that were drawn). Since the true means of the inputs are known, the
+ * drift of the sampled inputs away from them can be regressed out of y. The
+ * accumulator keeps running means and co-moments (Welford style) so that
+ * nothing per replication has to be stored.
+ */
+
+#define CV_MAX_CONTROLS 4
+
+typedef struct _control_variate_
+{
+  int number_of_controls;
+  double control_mean[CV_MAX_CONTROLS]; /* The known (true) input means. */
+  long int count;
+  double y_mean;
+  double c_mean[CV_MAX_CONTROLS];
+  double m_yy;
+  double m_cy[CV_MAX_CONTROLS];
+  double m_cc[CV_MAX_CONTROLS][CV_MAX_CONTROLS];
+} Control_Variate, * Control_Variate_Ptr;
+
+typedef struct _control_variate_estimate_
+{
+  long int count;
+  double mean;            /* Regression adjusted estimate. */
+  double half_width;      /* Its confidence interval half width. */
+  double crude_mean;      /* The plain replication average. */
+  double crude_half_width;
+  double beta[CV_MAX_CONTROLS];
+} Control_Variate_Estimate, * Control_Variate_Estimate_Ptr;
+
+/*
+ * Running statistics of a sequence of observations: the count, mean, sum of
+ * squared deviations (Welford), minimum and maximum. Two accumulators, e.g.,
+ * filled by different processes, are combined exactly with Chan's parallel
+ * formula, so nothing per observation has to be kept.
+ */
+
+typedef struct _running_stat_
+{
+  long int count;
+  double mean;
+  double m2;              /* Sum of squared deviations from the mean. */
+  double min;
+  double max;
+} Running_Stat, * Running_Stat_Ptr;
+
+/*
+ * Replication aggregator for one point of an experiment (e.g., one arrival
+ * rate over all seeds). Every named output gets one value per replication,
+ * e.g., the mean delay of a run, and the Student-t confidence interval is
+ * taken over those values. A replication can also pass its own running
+ * statistics of the underlying observations (e.g., the delays of all its
+ * customers), which are pooled so that the overall spread and extremes are
+ * reported as well. Aggregators with the same outputs can be merged, e.g.,
+ * when the replications were run by different processes.
+ */
+
+#define AGGREGATOR_MAX_OUTPUTS 16
+#define AGGREGATOR_MAX_NAME 32
+
+typedef struct _replication_aggregator_
+{
+  int number_of_outputs;
+  char names[AGGREGATOR_MAX_OUTPUTS][AGGREGATOR_MAX_NAME];
+  Running_Stat replications[AGGREGATOR_MAX_OUTPUTS];
+  Running_Stat observations[AGGREGATOR_MAX_OUTPUTS];
+} Replication_Aggregator, * Replication_Aggregator_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+double
+student_t_quantile(double, int);
+
+Control_Variate_Ptr
+control_variate_new(int, const double *);
+
+void
+control_variate_add(Control_Variate_Ptr, double, const double *);
+
+void
+control_variate_estimate(Control_Variate_Ptr, double,
+			 Control_Variate_Estimate_Ptr);
+
+void
+control_variate_free(Control_Variate_Ptr);
+
+void
+running_stat_reset(Running_Stat_Ptr);
+
+void
+running_stat_add(Running_Stat_Ptr, double);
+
+void
+running_stat_merge(Running_Stat_Ptr, const Running_Stat *);
+
+double
+running_stat_variance(Running_Stat_Ptr);
+
+double
+running_stat_half_width(Running_Stat_Ptr, double);
+
+Replication_Aggregator_Ptr
+replication_aggregator_new(void);
+
+int
+replication_aggregator_add_output(Replication_Aggregator_Ptr, const char *);
+
+void
+replication_aggregator_reset(Replication_Aggregator_Ptr);
+
+void
+replication_aggregator_add(Replication_Aggregator_Ptr, int, double);
+
+void
+replication_aggregator_add_run(Replication_Aggregator_Ptr, int,
+			       const Running_Stat *);
+
+void
+replication_aggregator_merge(Replication_Aggregator_Ptr,
+			     const Replication_Aggregator *);
+
+void
+replication_aggregator_write_header(FILE *);
+
+void
+replication_aggregator_write(Replication_Aggregator_Ptr, FILE *, const char *,
+			     double);
+
+void
+replication_aggregator_free(Replication_Aggregator_Ptr);
+
+/******************************************************************************/
+
+#endif /* statistics.h */
+
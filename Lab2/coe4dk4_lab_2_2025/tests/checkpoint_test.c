@@ -0,0 +1,158 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/******************************************************************************/
+
+/*
+ * A check of checkpoint.c: save a run with a long queue, each customer also
+ * attached to a scheduled event, restore it into a new run and compare. The
+ * pointer table grows many times while saving; with a table size that was
+ * not a power of two, probing was confined to blocks of 128 slots and saving
+ * this queue never finished.
+ *
+ *   gcc -Wall -I.. checkpoint_test.c ../checkpoint.c ../simlib.c -lm
+ *
+ * Prints "checkpoint_test: ok" and returns 0, or prints the first mismatch
+ * and returns 1.
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "simlib.h"
+#include "checkpoint.h"
+
+/******************************************************************************/
+
+#define TEST_CUSTOMERS 20000
+#define TEST_FILE "checkpoint_test.chk"
+
+typedef struct _test_customer_
+{
+  long int number;
+  double arrive_time;
+} Test_Customer, * Test_Customer_Ptr;
+
+static Test_Customer_Ptr restored[TEST_CUSTOMERS];
+static long int executed = 0;
+
+/******************************************************************************/
+
+static void
+test_fail(const char * what, long int i)
+{
+  printf("checkpoint_test: %s (customer %ld)\n", what, i);
+  remove(TEST_FILE);
+  exit(1);
+}
+
+/*
+ * The events are executed in the order they were scheduled, each with the
+ * customer that was put in the queue at the same place.
+ */
+
+static void
+test_event(Simulation_Run_Ptr simulation_run, void * attachment)
+{
+  Test_Customer_Ptr customer = (Test_Customer_Ptr) attachment;
+
+  if (executed >= TEST_CUSTOMERS || customer != restored[executed])
+    test_fail("event attachment is not the queued customer", executed);
+  if (customer->number != executed)
+    test_fail("event out of order", executed);
+  executed++;
+}
+
+static Checkpoint_Ptr
+test_checkpoint(Simulation_Run_Ptr simulation_run, Fifoqueue_Ptr queue)
+{
+  Checkpoint_Ptr checkpoint;
+  int type;
+
+  checkpoint = checkpoint_new(simulation_run);
+  type = checkpoint_add_type(checkpoint, sizeof(Test_Customer));
+  checkpoint_add_event(checkpoint, "Test Event", test_event, type);
+  checkpoint_add_fifoqueue(checkpoint, queue, type);
+  return checkpoint;
+}
+
+/******************************************************************************/
+
+int
+main(void)
+{
+  Simulation_Run_Ptr simulation_run;
+  Fifoqueue_Ptr queue;
+  Checkpoint_Ptr checkpoint;
+  Test_Customer_Ptr customer;
+  Event event;
+  long int i;
+
+  /* A run with TEST_CUSTOMERS customers queued and as many events. */
+  simulation_run = simulation_run_new();
+  queue = fifoqueue_new();
+  event.description = "Test Event";
+  event.function = test_event;
+  for (i=0; i<TEST_CUSTOMERS; i++) {
+    customer = (Test_Customer_Ptr) xmalloc(sizeof(Test_Customer));
+    customer->number = i;
+    customer->arrive_time = 0.5 * i;
+    fifoqueue_put(queue, (void *) customer);
+    event.attachment = (void *) customer;
+    simulation_run_schedule_event(simulation_run, event, 1.0 + i);
+  }
+
+  checkpoint = test_checkpoint(simulation_run, queue);
+  checkpoint_save(checkpoint, TEST_FILE);
+  checkpoint_free(checkpoint);
+
+  /* Restore it into a new run. */
+  simulation_run = simulation_run_new();
+  queue = fifoqueue_new();
+  checkpoint = test_checkpoint(simulation_run, queue);
+  if (!checkpoint_restore(checkpoint, TEST_FILE))
+    test_fail("checkpoint not written", 0);
+  checkpoint_free(checkpoint);
+  remove(TEST_FILE);
+
+  if (fifoqueue_size(queue) != TEST_CUSTOMERS)
+    test_fail("queue size", fifoqueue_size(queue));
+  if (simulation_run->eventlist->size != TEST_CUSTOMERS)
+    test_fail("event list size", simulation_run->eventlist->size);
+
+  for (i=0; i<TEST_CUSTOMERS; i++) {
+    restored[i] = (Test_Customer_Ptr) fifoqueue_get(queue);
+    if (restored[i]->number != i || restored[i]->arrive_time != 0.5 * i)
+      test_fail("queued customer", i);
+  }
+
+  while (simulation_run->eventlist->size > 0)
+    simulation_run_execute_event(simulation_run);
+  if (executed != TEST_CUSTOMERS) test_fail("events executed", executed);
+
+  printf("checkpoint_test: ok\n");
+  return 0;
+}
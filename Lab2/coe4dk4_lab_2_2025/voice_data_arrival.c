@@ -6,6 +6,40 @@
 
 extern double DATA_ARRIVAL_RATE;
 
+/*
+ * A voice arrival that finds the link idle is a regeneration point: the next
+ * voice arrival is a fixed interval away and the Poisson data arrivals are
+ * memoryless. Close the likelihood ratio cycle ending here and start the next.
+ * The data interarrival time in progress is split at the cycle boundary.
+ */
+static void
+likelihood_ratio_regeneration(Simulation_Run_Ptr simulation_run,
+			      Simulation_Run_Data_Ptr data)
+{
+  int i;
+  double now = simulation_run_get_time(simulation_run);
+  double values[LR_NUMBER_OF_VALUES];
+
+  values[LR_VOICE_DELAY] = data->voice_accumulated_delay;
+  values[LR_VOICE_COUNT] = (double) data->voice_processed_count;
+  values[LR_DATA_DELAY] = data->data_accumulated_delay;
+  values[LR_DATA_COUNT] = (double) data->data_processed_count;
+
+  /* cycle_start_time is negative until the first cycle starts. */
+  if (data->cycle_start_time >= 0.0) {
+    likelihood_ratio_no_arrival(data->lr, now - data->last_data_arrival_time);
+    for (i=0; i<LR_NUMBER_OF_VALUES; i++)
+      data->cycle_start_values[i] = values[i] - data->cycle_start_values[i];
+    likelihood_ratio_end_cycle(data->lr, data->cycle_start_values);
+  } else {
+    likelihood_ratio_start_cycle(data->lr);
+  }
+
+  for (i=0; i<LR_NUMBER_OF_VALUES; i++) data->cycle_start_values[i] = values[i];
+  data->cycle_start_time = now;
+  data->last_data_arrival_time = now;
+}
+
 /* Schedule voice packet arrival */
 long int schedule_voice_arrival_event(Simulation_Run_Ptr simulation_run, double event_time)
 {
@@ -33,6 +67,10 @@ void voice_arrival_event(Simulation_Run_Ptr simulation_run, void * ptr)
   Packet_Ptr new_packet;
 
   data = (Simulation_Run_Data_Ptr) simulation_run_data(simulation_run);
+
+  if (data->lr != NULL && server_state(data->link) == FREE)
+    likelihood_ratio_regeneration(simulation_run, data);
+
   data->voice_arrival_count++;
 
   new_packet = (Packet_Ptr) xmalloc(sizeof(Packet));
@@ -62,6 +100,13 @@ void data_arrival_event(Simulation_Run_Ptr simulation_run, void * ptr)
   data = (Simulation_Run_Data_Ptr) simulation_run_data(simulation_run);
   data->data_arrival_count++;
 
+  /* The first data arrival at time zero is not drawn. */
+  if (data->lr != NULL && data->data_arrival_count > 1) {
+    likelihood_ratio_interarrival(data->lr,
+      simulation_run_get_time(simulation_run) - data->last_data_arrival_time);
+  }
+  data->last_data_arrival_time = simulation_run_get_time(simulation_run);
+
   new_packet = (Packet_Ptr) xmalloc(sizeof(Packet));
   new_packet->arrive_time = simulation_run_get_time(simulation_run);
   new_packet->service_time = exponential_generator(MEAN_SERVICE_TIME);
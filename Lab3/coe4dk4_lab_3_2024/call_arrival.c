@@ -64,7 +64,7 @@ call_arrival_event(Simulation_Run_Ptr simulation_run, void * ptr)
   Call_Ptr new_call;
   Channel_Ptr free_channel;
   Simulation_Run_Data_Ptr sim_data;
-  double now;
+  double now, interarrival_time;
 
   now = simulation_run_get_time(simulation_run);
 
@@ -81,6 +81,10 @@ call_arrival_event(Simulation_Run_Ptr simulation_run, void * ptr)
 
     /* Yes, we found one. Start the call immediately. */
     new_call->call_duration = get_call_duration();
+    sim_data->accumulated_call_duration += new_call->call_duration;
+    sim_data->call_duration_count++;
+    record_waiting_time(sim_data, free_channel, 0.0);
+    running_stat_add(&sim_data->waiting_times, 0.0);
 
     /* Place the call in the free channel and schedule its
        departure. */
@@ -90,14 +94,42 @@ call_arrival_event(Simulation_Run_Ptr simulation_run, void * ptr)
     schedule_end_call_on_channel_event(simulation_run,
 				       now + new_call->call_duration,
 				       (void *) free_channel);
+  } else if (BLOCKED_CALLS_CLEARED) {
+    /* No free channel was found. The call is blocked and lost. */
+    sim_data->blocked_call_count++;
+    xfree((void *) new_call);
   } else {
     /* No free channel was found. Place the call in queue. */
     fifoqueue_put(sim_data->buffer, (void*) new_call);
   }
 
   /* Schedule the next call arrival. */
-  schedule_call_arrival_event(simulation_run,
-	      now + exponential_generator((double) 1/Call_ARRIVALRATE));
+  interarrival_time = exponential_generator((double) 1/Call_ARRIVALRATE);
+  sim_data->accumulated_interarrival_time += interarrival_time;
+  schedule_call_arrival_event(simulation_run, now + interarrival_time);
+}
+
+/*******************************************************************************/
+
+/*
+ * Record the waiting time of a call that has just been given a channel, in
+ * the histogram of all calls and in that of the channel.
+ */
+
+void
+record_waiting_time(Simulation_Run_Data_Ptr sim_data, Channel_Ptr channel,
+		    double waiting_time)
+{
+  int i;
+
+  histogram_record(sim_data->waiting_time_histogram, waiting_time);
+  for (i=0; i<NUMBER_OF_CHANNELS; i++) {
+    if (*(sim_data->channels+i) == channel) {
+      histogram_record(sim_data->channel_waiting_time_histograms[i],
+		       waiting_time);
+      break;
+    }
+  }
 }
 
 /*******************************************************************************/
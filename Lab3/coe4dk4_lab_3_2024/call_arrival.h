@@ -43,6 +43,9 @@
 Server_Ptr
 get_free_channel(Simulation_Run_Ptr);
 
+void
+record_waiting_time(Simulation_Run_Data_Ptr, Channel_Ptr, double);
+
 void
 call_arrival_event(Simulation_Run_Ptr, void *);
 
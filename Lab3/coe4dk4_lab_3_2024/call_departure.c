@@ -97,9 +97,13 @@ end_call_on_channel_event(Simulation_Run_Ptr simulation_run, void * c_ptr)
     
     /* Generate new call duration and record waiting time */
     next_call->call_duration = get_call_duration();
+    sim_data->accumulated_call_duration += next_call->call_duration;
+    sim_data->call_duration_count++;
     next_call->waiting_time = now - next_call->arrive_time;
     sim_data->accumulated_waiting_time += next_call->waiting_time;
     sim_data->waited_call_count++;
+    record_waiting_time(sim_data, free_channel, next_call->waiting_time);
+    running_stat_add(&sim_data->waiting_times, next_call->waiting_time);
     
     /* Place the call in the free channel and schedule its departure */
     server_put(free_channel, (void*) next_call);
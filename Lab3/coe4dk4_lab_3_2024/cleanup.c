@@ -52,6 +52,13 @@ void cleanup (Simulation_Run_Ptr this_simulation_run)
   }
   xfree(sim_data->channels);
 
+  histogram_free(sim_data->waiting_time_histogram);
+  for (i=0; i<NUMBER_OF_CHANNELS; i++)
+    histogram_free(sim_data->channel_waiting_time_histograms[i]);
+  xfree((void *) sim_data->channel_waiting_time_histograms);
+  time_weighted_stat_free(sim_data->busy_channels);
+  time_weighted_stat_free(sim_data->queue_length);
+
   /* Clean up the simulation_run. */
   simulation_run_free_memory(this_simulation_run);
 }
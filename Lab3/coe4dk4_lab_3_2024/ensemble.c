@@ -0,0 +1,313 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "simlib.h"
+#include "statistics.h"
+#include "ensemble.h"
+
+/******************************************************************************/
+
+static void
+ensemble_sample_event(Simulation_Run_Ptr, void *);
+
+static void
+ensemble_schedule_sample(Ensemble_Ptr, Simulation_Run_Ptr);
+
+static void
+ensemble_run_share(Ensemble_Ptr, long int, int, int, Ensemble_Replication,
+		   void *);
+
+/******************************************************************************/
+
+/*
+ * Create an ensemble sampled at number_of_points equally spaced times from 0
+ * to horizon.
+ */
+
+Ensemble_Ptr
+ensemble_new(double horizon, int number_of_points)
+{
+  Ensemble_Ptr ens;
+
+  if (horizon <= 0.0 || number_of_points < 2) {
+    printf("Error: Bad ensemble grid (horizon = %g, points = %d).\n",
+	   horizon, number_of_points);
+    exit(1);
+  }
+
+  ens = (Ensemble_Ptr) xcalloc(1, sizeof(Ensemble));
+  ens->horizon = horizon;
+  ens->number_of_points = number_of_points;
+  return ens;
+}
+
+/*
+ * Add a state variable, read by calling read(argument). All variables must
+ * be added before the ensemble is run.
+ */
+
+void
+ensemble_add_variable(Ensemble_Ptr ens, const char * name,
+		      Ensemble_Reader read, void * argument)
+{
+  int i;
+
+  if (ens->number_of_variables == ENSEMBLE_MAX_VARIABLES || ens->stats != NULL) {
+    printf("Error: Cannot add ensemble variable %s.\n", name);
+    exit(1);
+  }
+
+  i = ens->number_of_variables++;
+  strncpy(ens->names[i], name, ENSEMBLE_MAX_NAME - 1);
+  ens->read[i] = read;
+  ens->argument[i] = argument;
+}
+
+double
+ensemble_grid_time(Ensemble_Ptr ens, int point)
+{
+  return ens->horizon * point/(ens->number_of_points - 1);
+}
+
+Running_Stat_Ptr
+ensemble_stat(Ensemble_Ptr ens, int point, int variable)
+{
+  return ens->stats + point * ens->number_of_variables + variable;
+}
+
+/******************************************************************************/
+
+/*
+ * Start sampling a replication. The simulation_run clock must be at 0.
+ */
+
+void
+ensemble_start_replication(Ensemble_Ptr ens, Simulation_Run_Ptr simulation_run)
+{
+  ens->next_point = 0;
+  ensemble_schedule_sample(ens, simulation_run);
+}
+
+int
+ensemble_replication_done(Ensemble_Ptr ens)
+{
+  return ens->next_point >= ens->number_of_points;
+}
+
+static void
+ensemble_schedule_sample(Ensemble_Ptr ens, Simulation_Run_Ptr simulation_run)
+{
+  Event new_event;
+
+  new_event.description = "Ensemble Sample";
+  new_event.function = ensemble_sample_event;
+  new_event.attachment = (void *) ens;
+
+  simulation_run_schedule_event(simulation_run, new_event,
+				ensemble_grid_time(ens, ens->next_point));
+}
+
+static void
+ensemble_sample_event(Simulation_Run_Ptr simulation_run, void * ens_ptr)
+{
+  int i;
+  Ensemble_Ptr ens = (Ensemble_Ptr) ens_ptr;
+
+  for (i=0; i<ens->number_of_variables; i++)
+    running_stat_add(ensemble_stat(ens, ens->next_point, i),
+		     ens->read[i](ens->argument[i]));
+
+  if (++ens->next_point < ens->number_of_points)
+    ensemble_schedule_sample(ens, simulation_run);
+}
+
+/******************************************************************************/
+
+/*
+ * Run the replications r = worker, worker + workers, ... below replications
+ * into the ensemble statistics.
+ */
+
+static void
+ensemble_run_share(Ensemble_Ptr ens, long int replications, int worker,
+		   int workers, Ensemble_Replication replicate, void * argument)
+{
+  long int r;
+
+  for (r=worker; r<replications; r+=workers) {
+    replicate(ens, r, argument);
+    if (!ensemble_replication_done(ens)) {
+      printf("Error: Ensemble replication %ld stopped before the horizon.\n", r);
+      exit(1);
+    }
+    ens->replications++;
+  }
+}
+
+/*
+ * Run the given number of replications over the given number of worker
+ * processes and merge their statistics.
+ */
+
+void
+ensemble_run(Ensemble_Ptr ens, long int replications, int workers,
+	     Ensemble_Replication replicate, void * argument)
+{
+  int i, number_of_stats;
+
+  number_of_stats = ens->number_of_points * ens->number_of_variables;
+  if (ens->stats == NULL)
+    ens->stats = (Running_Stat_Ptr) xcalloc(number_of_stats, sizeof(Running_Stat));
+
+#ifdef _WIN32
+  workers = 1;
+#endif
+
+  if (workers <= 1) {
+    ensemble_run_share(ens, replications, 0, 1, replicate, argument);
+    return;
+  }
+
+#ifndef _WIN32
+  {
+    int w, status;
+    int (* pipes)[2];
+    pid_t * pids;
+    long int count;
+    Running_Stat_Ptr own, received;
+    size_t size = number_of_stats * sizeof(Running_Stat), done;
+    ssize_t n;
+    char * p;
+
+    pipes = xcalloc(workers, sizeof(*pipes));
+    pids = (pid_t *) xcalloc(workers, sizeof(pid_t));
+    received = (Running_Stat_Ptr) xcalloc(number_of_stats, sizeof(Running_Stat));
+
+    /* Each worker starts from empty statistics of its own. */
+    own = ens->stats;
+    ens->stats = received;
+
+    fflush(stdout);
+    for (w=0; w<workers; w++) {
+      if (pipe(pipes[w]) != 0 || (pids[w] = fork()) < 0) {
+	printf("Error: Could not start ensemble worker %d.\n", w);
+	exit(1);
+      }
+
+      if (pids[w] == 0) {
+	close(pipes[w][0]);
+	ens->replications = 0;
+	ensemble_run_share(ens, replications, w, workers, replicate, argument);
+
+	count = ens->replications;
+	/* _exit skips the atexit handlers. */
+	simulation_run_metrics_close();
+	simulation_run_trace_close();
+	if (write(pipes[w][1], &count, sizeof(count)) != sizeof(count) ||
+	    write(pipes[w][1], ens->stats, size) != (ssize_t) size) _exit(1);
+	close(pipes[w][1]);
+	fflush(stdout);
+	_exit(0);
+      }
+      close(pipes[w][1]);
+    }
+
+    ens->stats = own;
+    for (w=0; w<workers; w++) {
+      p = (char *) &count;
+      for (done=0; done<sizeof(count); done+=n)
+	if ((n = read(pipes[w][0], p + done, sizeof(count) - done)) <= 0) break;
+      p = (char *) received;
+      if (done == sizeof(count))
+	for (done=0; done<size; done+=n)
+	  if ((n = read(pipes[w][0], p + done, size - done)) <= 0) break;
+      close(pipes[w][0]);
+
+      if (waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) ||
+	  WEXITSTATUS(status) != 0 || done != size) {
+	printf("Error: Ensemble worker %d failed.\n", w);
+	exit(1);
+      }
+
+      for (i=0; i<number_of_stats; i++)
+	running_stat_merge(ens->stats + i, received + i);
+      ens->replications += count;
+    }
+
+    xfree((void *) received);
+    xfree((void *) pids);
+    xfree((void *) pipes);
+  }
+#endif
+}
+
+/******************************************************************************/
+
+/*
+ * Write the mean, confidence interval half width (at the given level), and
+ * range of every variable at every grid point.
+ */
+
+void
+ensemble_write_csv(Ensemble_Ptr ens, const char * filename, double confidence)
+{
+  int k, i;
+  FILE * file;
+  Running_Stat_Ptr rs;
+
+  if ((file = fopen(filename, "w")) == NULL) {
+    printf("Error: Could not open ensemble file %s.\n", filename);
+    exit(1);
+  }
+
+  fprintf(file, "time,variable,replications,mean,half_width,min,max\n");
+  for (k=0; k<ens->number_of_points; k++) {
+    for (i=0; i<ens->number_of_variables; i++) {
+      rs = ensemble_stat(ens, k, i);
+      fprintf(file, "%.6f,%s,%ld,%.8f,%.8f,%g,%g\n", ensemble_grid_time(ens, k),
+	      ens->names[i], rs->count, rs->mean,
+	      running_stat_half_width(rs, confidence), rs->min, rs->max);
+    }
+  }
+  fclose(file);
+}
+
+void
+ensemble_free(Ensemble_Ptr ens)
+{
+  if (ens->stats != NULL) xfree((void *) ens->stats);
+  xfree((void *) ens);
+}
+
@@ -0,0 +1,112 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _ENSEMBLE_H_
+#define _ENSEMBLE_H_
+
+/******************************************************************************/
+
+#include "simlib.h"
+#include "statistics.h"
+
+/******************************************************************************/
+
+/*
+ * Ensemble (transient) analysis over many short independent replications.
+ *
+ * Each replication starts from the same initial state and samples the
+ * registered state variables at the common time grid 0, h, 2h, ..., horizon.
+ * The samples go straight into running statistics per grid point and
+ * variable, so no replication trace is ever stored. The replications are
+ * shared out over a number of worker processes (fork), each of which sends
+ * its statistics back through a pipe to be merged. Without fork (Windows)
+ * they all run in the calling process.
+ *
+ * The model supplies a function that runs replication r, i.e., sets up a
+ * simulation_run seeded for r, calls ensemble_start_replication, executes
+ * events until ensemble_replication_done, and cleans up.
+ */
+
+#define ENSEMBLE_MAX_VARIABLES 8
+#define ENSEMBLE_MAX_NAME 32
+
+struct _ensemble_;
+
+typedef double (* Ensemble_Reader)(void *);
+typedef void (* Ensemble_Replication)(struct _ensemble_ *, long int, void *);
+
+typedef struct _ensemble_
+{
+  double horizon;
+  int number_of_points;    /* grid points, including 0 and the horizon */
+  int number_of_variables;
+  char names[ENSEMBLE_MAX_VARIABLES][ENSEMBLE_MAX_NAME];
+  Ensemble_Reader read[ENSEMBLE_MAX_VARIABLES];
+  void * argument[ENSEMBLE_MAX_VARIABLES];
+
+  int next_point;          /* of the current replication */
+  long int replications;
+
+  Running_Stat_Ptr stats;  /* [point * number_of_variables + variable] */
+} Ensemble, * Ensemble_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Ensemble_Ptr
+ensemble_new(double, int);
+
+void
+ensemble_add_variable(Ensemble_Ptr, const char *, Ensemble_Reader, void *);
+
+double
+ensemble_grid_time(Ensemble_Ptr, int);
+
+void
+ensemble_start_replication(Ensemble_Ptr, Simulation_Run_Ptr);
+
+int
+ensemble_replication_done(Ensemble_Ptr);
+
+void
+ensemble_run(Ensemble_Ptr, long int, int, Ensemble_Replication, void *);
+
+Running_Stat_Ptr
+ensemble_stat(Ensemble_Ptr, int, int);
+
+void
+ensemble_write_csv(Ensemble_Ptr, const char *, double);
+
+void
+ensemble_free(Ensemble_Ptr);
+
+/******************************************************************************/
+
+#endif /* ensemble.h */
+
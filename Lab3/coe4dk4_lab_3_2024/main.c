@@ -33,13 +33,496 @@
 #include "simparameters.h"
 #include "cleanup.h"
 #include "call_arrival.h"
+#include "statistics.h"
+#include "standard_clock.h"
+#include "time_series.h"
+#include "ensemble.h"
+#include "sweep.h"
+#include "root_finder.h"
 #include "main.h"
 
 /*******************************************************************************/
 
-int main(void)
+/*
+ * The parameters that can be swept from the command line. Without arguments
+ * the program runs with these defaults, as before.
+ */
+
+double Call_ARRIVALRATE = Call_ARRIVALRATE_DEFAULT;
+double MEAN_CALL_DURATION = MEAN_CALL_DURATION_DEFAULT;
+double RUNLENGTH = RUNLENGTH_DEFAULT;
+int NUMBER_OF_CHANNELS = NUMBER_OF_CHANNELS_DEFAULT;
+int BLOCKED_CALLS_CLEARED = BLOCKED_CALLS_CLEARED_DEFAULT;
+
+/* The indices of the sweep outputs. */
+typedef struct _sweep_outputs_
+{
+  int blocking_probability;
+  int wait_probability;
+  int mean_waiting_time;
+  int p99_waiting_time;
+  int exceed;
+  int mean_busy_channels;
+  int all_busy;
+  int mean_queue_length;
+} Sweep_Outputs;
+
+/*******************************************************************************/
+
+/*
+ * Create a new simulation_run with an empty system, using the given data
+ * structure, and schedule its first call arrival.
+ */
+
+static Simulation_Run_Ptr
+start_simulation_run(Simulation_Run_Data_Ptr data, unsigned random_seed)
 {
   int i;
+  Simulation_Run_Ptr simulation_run;
+
+  /* Create a new simulation_run. This gives a clock and eventlist. */
+  simulation_run = simulation_run_new();
+
+  /* Add our data definitions to the simulation_run. */
+  simulation_run_set_data(simulation_run, (void *) data);
+
+  /* Initialize our simulation_run data variables. */
+  data->blip_counter = 0;
+  data->quiet = 0;
+  data->call_arrival_count = 0;
+  data->calls_processed = 0;
+  data->blocked_call_count = 0;
+  data->number_of_calls_processed = 0;
+  data->accumulated_call_time = 0.0;
+  data->random_seed = random_seed;
+  data->buffer = fifoqueue_new();
+  data->waited_call_count = 0;
+  data->accumulated_waiting_time = 0.0;
+  data->accumulated_call_duration = 0.0;
+  data->call_duration_count = 0;
+  data->accumulated_interarrival_time = 0.0;
+  data->waiting_time_histogram = histogram_new(WAITING_TIME_RESOLUTION,
+					       WAITING_TIME_HIGHEST);
+  running_stat_reset(&data->waiting_times);
+  output_metrics_start(simulation_run);
+
+  /* Create the channels. */
+  data->channels = (Channel_Ptr *) xcalloc((int) NUMBER_OF_CHANNELS,
+					   sizeof(Channel_Ptr));
+
+  /* Initialize the channels. */
+  for (i=0; i<NUMBER_OF_CHANNELS; i++) {
+    *(data->channels+i) = server_new(); 
+  }
+
+  /* The waiting times of the calls served by each channel. */
+  data->channel_waiting_time_histograms =
+    (Histogram_Ptr *) xcalloc((int) NUMBER_OF_CHANNELS, sizeof(Histogram_Ptr));
+  for (i=0; i<NUMBER_OF_CHANNELS; i++)
+    data->channel_waiting_time_histograms[i] =
+      histogram_new(WAITING_TIME_RESOLUTION, WAITING_TIME_HIGHEST);
+
+  /* Time averages of the number of busy channels and the queue length,
+     updated by the channels and the buffer themselves. */
+  data->busy_channels = time_weighted_stat_new(simulation_run);
+  data->queue_length = time_weighted_stat_new(simulation_run);
+  for (i=0; i<NUMBER_OF_CHANNELS; i++) {
+    server_attach_stat(*(data->channels+i), data->busy_channels);
+  }
+  fifoqueue_attach_stat(data->buffer, data->queue_length);
+
+  /* Set the random number generator seed. */
+  random_generator_initialize((unsigned) random_seed);
+
+  /* Schedule the initial call arrival. */
+  schedule_call_arrival_event(simulation_run,
+		      simulation_run_get_time(simulation_run) +
+		      exponential_generator((double) 1/Call_ARRIVALRATE));
+
+  return simulation_run;
+}
+
+/*******************************************************************************/
+
+#if TIME_SERIES_MODE || ENSEMBLE_MODE
+
+/*
+ * Readers of the state variables recorded in the time series and the
+ * ensemble.
+ */
+
+static double
+read_busy_channels(void * data)
+{
+  return (double) ((Simulation_Run_Data_Ptr) data)->busy_channels->value;
+}
+
+static double
+read_queue_length(void * data)
+{
+  return (double) fifoqueue_size(((Simulation_Run_Data_Ptr) data)->buffer);
+}
+
+static double
+read_all_busy(void * data)
+{
+  return (((Simulation_Run_Data_Ptr) data)->busy_channels->value ==
+	  NUMBER_OF_CHANNELS) ? 1.0 : 0.0;
+}
+
+#endif
+
+/*******************************************************************************/
+
+#if ENSEMBLE_MODE
+
+/*
+ * Run replication r of the ensemble, starting from an empty system at time 0
+ * with its own seed, until the last grid point has been sampled.
+ */
+
+static void
+ensemble_replication(Ensemble_Ptr ens, long int r, void * data)
+{
+  unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+  Simulation_Run_Ptr simulation_run;
+
+  simulation_run = start_simulation_run((Simulation_Run_Data_Ptr) data,
+					RANDOM_SEEDS[0] + (unsigned) r);
+  ensemble_start_replication(ens, simulation_run);
+
+  while (!ensemble_replication_done(ens)) {
+    simulation_run_execute_event(simulation_run);
+  }
+
+  cleanup(simulation_run);
+}
+
+/*
+ * The start-up transient of the busy channels, the queue length and the
+ * probability that all channels are busy, from an empty system.
+ */
+
+static int
+ensemble_analysis(void)
+{
+  Simulation_Run_Data data;
+  Ensemble_Ptr ens;
+  Running_Stat_Ptr rs;
+
+  ens = ensemble_new(ENSEMBLE_HORIZON, ENSEMBLE_POINTS);
+  ensemble_add_variable(ens, "busy_channels", read_busy_channels, &data);
+  ensemble_add_variable(ens, "queue_length", read_queue_length, &data);
+  ensemble_add_variable(ens, "all_busy", read_all_busy, &data);
+
+  ensemble_run(ens, (long int) ENSEMBLE_REPLICATIONS, ENSEMBLE_WORKERS,
+	       ensemble_replication, &data);
+  ensemble_write_csv(ens, "ensemble_results.csv", 0.95);
+
+  rs = ensemble_stat(ens, ENSEMBLE_POINTS - 1, 0);
+  printf("Ensemble: %ld replications over %d workers, written to ensemble_results.csv\n",
+	 ens->replications, ENSEMBLE_WORKERS);
+  printf("Busy channels at %g minutes = %.4f +/- %.4f\n", ENSEMBLE_HORIZON,
+	 rs->mean, running_stat_half_width(rs, 0.95));
+
+  ensemble_free(ens);
+  return 0;
+}
+
+#endif
+
+/*******************************************************************************/
+
+#if STANDARD_CLOCK_MODE
+
+/*
+ * Simulate the dimensioning grid with the standard clock. Every (offered load,
+ * channels) cell is run both as a loss system and with an infinite queue. The
+ * loss results are written in the layout of simulation_sweep_results.csv, so
+ * that compare_erlang_sim.py can plot them against erlangb_results.csv. The
+ * queue cells are only written when they are stable, i.e., A < N.
+ */
+
+static int
+standard_clock_grid(void)
+{
+  int a, n, j = 0;
+  int loss[SC_MAX_OFFERED_LOAD+1][SC_MAX_CHANNELS+1];
+  int queue[SC_MAX_OFFERED_LOAD+1][SC_MAX_CHANNELS+1];
+  double service_rate = 1.0/(double) MEAN_CALL_DURATION;
+  unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+  unsigned random_seed;
+  Standard_Clock_Ptr sc;
+  Standard_Clock_Results results;
+  Standard_Clock_Variant_Ptr v;
+  FILE *loss_csv, *queue_csv;
+
+  loss_csv = fopen("standard_clock_erlangb_results.csv", "w");
+  queue_csv = fopen("standard_clock_erlangc_results.csv", "w");
+  if (loss_csv == NULL || queue_csv == NULL) {
+    printf("Error: Could not open the standard clock output files.\n");
+    exit(1);
+  }
+  fprintf(loss_csv, "A,N,seed,blocked,arrivals,PB\n");
+  fprintf(queue_csv, "A,N,seed,waited,arrivals,Pw,Tw\n");
+
+  while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
+
+    sc = standard_clock_new();
+    for (a=1; a<=SC_MAX_OFFERED_LOAD; a++) {
+      for (n=1; n<=SC_MAX_CHANNELS; n++) {
+	loss[a][n] = standard_clock_add_variant(sc, a * service_rate,
+						service_rate, n, n);
+	queue[a][n] = standard_clock_add_variant(sc, a * service_rate,
+				 service_rate, n, STANDARD_CLOCK_INFINITE);
+      }
+    }
+
+    random_generator_initialize((unsigned) random_seed);
+    standard_clock_run(sc, (long int) SC_EPOCHS);
+
+    for (a=1; a<=SC_MAX_OFFERED_LOAD; a++) {
+      for (n=1; n<=SC_MAX_CHANNELS; n++) {
+	v = sc->variants + loss[a][n];
+	standard_clock_results(sc, loss[a][n], &results);
+	fprintf(loss_csv, "%d,%d,%u,%ld,%ld,%.8f\n", a, n, random_seed,
+		v->blocked, v->arrivals, results.blocking_probability);
+
+	if (a < n) {
+	  v = sc->variants + queue[a][n];
+	  standard_clock_results(sc, queue[a][n], &results);
+	  fprintf(queue_csv, "%d,%d,%u,%ld,%ld,%.8f,%.8f\n", a, n, random_seed,
+		  v->waited, v->arrivals, results.wait_probability,
+		  results.mean_waiting_time_of_waiting);
+	}
+      }
+    }
+
+    printf("Seed %u: %d variants, %ld epochs, simulated time %.1f minutes.\n",
+	   random_seed, sc->number_of_variants, sc->epochs, sc->time);
+    standard_clock_free(sc);
+  }
+
+  fclose(loss_csv);
+  fclose(queue_csv);
+  return 0;
+}
+
+#endif
+
+/*******************************************************************************/
+
+#if THRESHOLD_MODE
+
+/*
+ * The Erlang B blocking probability of offered load a on n channels, and
+ * the offered load where it equals target, for reference.
+ */
+
+static double
+erlang_b(double a, int n)
+{
+  double b = 1.0;
+  int i;
+
+  for (i=1; i<=n; i++) b = a * b/(i + a * b);
+  return b;
+}
+
+static double
+erlang_b_threshold(int n, double target)
+{
+  double low = 0.0, high = n, mid;
+
+  while (high - low > 1e-9) {
+    mid = 0.5 * (low + high);
+    if (erlang_b(mid, n) > target) high = mid; else low = mid;
+  }
+  return 0.5 * (low + high);
+}
+
+/*
+ * One replication of the blocking probability at the given offered load
+ * (Erlangs), counted over THRESHOLD_CALLS call arrivals after a warm-up.
+ */
+
+static double
+blocking_replication(double offered_load, unsigned random_seed,
+		     void * argument)
+{
+  Simulation_Run_Ptr simulation_run;
+  Simulation_Run_Data data;
+  long int arrivals, blocked;
+
+  Call_ARRIVALRATE = offered_load/MEAN_CALL_DURATION;
+  simulation_run = start_simulation_run(&data, random_seed);
+  data.quiet = 1;
+
+  while (data.call_arrival_count < THRESHOLD_WARMUP_CALLS)
+    simulation_run_execute_event(simulation_run);
+  arrivals = data.call_arrival_count;
+  blocked = data.blocked_call_count;
+
+  while (data.call_arrival_count - arrivals < THRESHOLD_CALLS)
+    simulation_run_execute_event(simulation_run);
+  arrivals = data.call_arrival_count - arrivals;
+  blocked = data.blocked_call_count - blocked;
+
+  cleanup(simulation_run);
+  return (double) blocked/arrivals;
+}
+
+/*
+ * Find the capacity threshold of each channel count. The search starts from
+ * [0, N] Erlangs: the Erlang B blocking at A = N is well above 1.5% for any
+ * channel count of interest.
+ */
+
+static int
+threshold_search(void)
+{
+  unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+  unsigned seed = RANDOM_SEEDS[0];
+  Root_Finder_Ptr rf;
+  double calls, grid_calls, total_calls = 0.0, total_grid_calls = 0.0;
+  int n;
+  FILE * csv;
+
+  if ((csv = fopen("threshold_results.csv", "w")) == NULL) {
+    printf("Error: Could not open threshold_results.csv.\n");
+    exit(1);
+  }
+  fprintf(csv, "N_channels,max_offered_load,ci_low,ci_high,erlang_b_load,"
+	  "status,steps,replications,calls\n");
+
+  BLOCKED_CALLS_CLEARED = 1;
+
+  for (n=THRESHOLD_MIN_CHANNELS; n<=THRESHOLD_MAX_CHANNELS; n++) {
+    NUMBER_OF_CHANNELS = n;
+
+    rf = root_finder_new(THRESHOLD_TARGET_PB, 0.0, (double) n,
+			 THRESHOLD_TOLERANCE, THRESHOLD_CONFIDENCE);
+    rf->min_replications = THRESHOLD_MIN_REPLICATIONS;
+    rf->max_replications = THRESHOLD_MAX_REPLICATIONS;
+    rf->seed = seed;
+
+    root_finder_run(rf, blocking_replication, NULL);
+    seed = rf->seed;
+
+    /* A grid at the same spacing, each point run as long as the last one. */
+    calls = rf->replications * (THRESHOLD_CALLS + THRESHOLD_WARMUP_CALLS);
+    grid_calls = (floor(n/THRESHOLD_TOLERANCE) + 1) * rf->point_replications *
+      (THRESHOLD_CALLS + THRESHOLD_WARMUP_CALLS);
+    total_calls += calls;
+    total_grid_calls += grid_calls;
+
+    printf("N = %2d: A = %.3f Erlangs, %.0f%% CI [%.3f, %.3f]%s "
+	   "(Erlang B %.3f), %ld runs\n",
+	   n, rf->estimate, 100 * THRESHOLD_CONFIDENCE, rf->low, rf->high,
+	   (rf->status == ROOT_FINDER_UNDECIDED) ? " undecided" : "",
+	   erlang_b_threshold(n, THRESHOLD_TARGET_PB), rf->replications);
+    fprintf(csv, "%d,%.6f,%.6f,%.6f,%.6f,%s,%d,%ld,%.0f\n", n, rf->estimate,
+	    rf->low, rf->high, erlang_b_threshold(n, THRESHOLD_TARGET_PB),
+	    (rf->status == ROOT_FINDER_UNDECIDED) ? "undecided" : "converged",
+	    rf->steps, rf->replications, calls);
+
+    root_finder_free(rf);
+  }
+
+  printf("Simulated %.3g calls; a grid at %g Erlang spacing run as long would need %.3g.\n",
+	 total_calls, THRESHOLD_TOLERANCE, total_grid_calls);
+  printf("Results written to threshold_results.csv\n");
+
+  fclose(csv);
+  return 0;
+}
+
+#endif
+
+/*******************************************************************************/
+
+/*
+ * One job of a sweep: a run at the current parameter values. The mean
+ * waiting time is over the calls that waited, as in output_results.
+ */
+
+static void
+sweep_model(Sweep_Ptr sweep, unsigned random_seed, void * outputs_ptr)
+{
+  Sweep_Outputs * outputs = (Sweep_Outputs *) outputs_ptr;
+  Simulation_Run_Ptr simulation_run;
+  Simulation_Run_Data data;
+
+  simulation_run = start_simulation_run(&data, random_seed);
+  data.quiet = 1;
+
+  while(data.number_of_calls_processed < RUNLENGTH) {
+    simulation_run_execute_event(simulation_run);
+  }
+
+  sweep_set_output(sweep, outputs->blocking_probability,
+		   (double) data.blocked_call_count/data.call_arrival_count);
+  sweep_set_output(sweep, outputs->wait_probability,
+		   (double) data.waited_call_count/data.call_arrival_count);
+  if (data.waited_call_count > 0)
+    sweep_set_output(sweep, outputs->mean_waiting_time,
+		     data.accumulated_waiting_time/data.waited_call_count);
+  sweep_set_output(sweep, outputs->p99_waiting_time,
+		   histogram_quantile(data.waiting_time_histogram, 0.99));
+  sweep_set_output(sweep, outputs->exceed,
+		   histogram_exceedance(data.waiting_time_histogram,
+					WAITING_TIME_BOUND));
+  sweep_set_output(sweep, outputs->mean_busy_channels,
+		   time_weighted_stat_mean(data.busy_channels));
+  sweep_set_output(sweep, outputs->all_busy,
+		   time_weighted_stat_probability(data.busy_channels,
+						  NUMBER_OF_CHANNELS));
+  sweep_set_output(sweep, outputs->mean_queue_length,
+		   time_weighted_stat_mean(data.queue_length));
+
+  cleanup(simulation_run);
+}
+
+/*
+ * Run the sweep described by the command line (see sweep.h).
+ */
+
+static int
+sweep_main(int argc, char * argv[])
+{
+  unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+  Sweep_Outputs outputs;
+  Sweep_Ptr sweep;
+  int missing;
+
+  sweep = sweep_new("lab3_call_blocking", RANDOM_SEEDS);
+  sweep_add_parameter(sweep, "call_arrival_rate", &Call_ARRIVALRATE);
+  sweep_add_parameter(sweep, "mean_call_duration", &MEAN_CALL_DURATION);
+  sweep_add_integer_parameter(sweep, "number_of_channels", &NUMBER_OF_CHANNELS);
+  sweep_add_integer_parameter(sweep, "blocked_calls_cleared",
+			      &BLOCKED_CALLS_CLEARED);
+  sweep_add_parameter(sweep, "runlength", &RUNLENGTH);
+
+  outputs.blocking_probability = sweep_add_output(sweep, "blocking_probability");
+  outputs.wait_probability = sweep_add_output(sweep, "wait_probability");
+  outputs.mean_waiting_time = sweep_add_output(sweep, "mean_waiting_time");
+  outputs.p99_waiting_time = sweep_add_output(sweep, "p99_waiting_time");
+  outputs.exceed = sweep_add_output(sweep, "exceed_waiting_time_bound");
+  outputs.mean_busy_channels = sweep_add_output(sweep, "mean_busy_channels");
+  outputs.all_busy = sweep_add_output(sweep, "all_busy");
+  outputs.mean_queue_length = sweep_add_output(sweep, "mean_queue_length");
+
+  sweep_parse_arguments(sweep, argc, argv);
+  missing = sweep_run(sweep, sweep_model, (void *) &outputs);
+  sweep_free(sweep);
+
+  return missing > 0;
+}
+
+/*******************************************************************************/
+
+int main(int argc, char * argv[])
+{
   int j=0;
 
   Simulation_Run_Ptr simulation_run;
@@ -52,6 +535,61 @@ int main(void)
   unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
   unsigned random_seed;
 
+#if TIME_SERIES_MODE
+  Time_Series_Ptr time_series;
+  char time_series_file[64];
+#endif
+
+  if (argc > 1) return sweep_main(argc, argv);
+
+#if STANDARD_CLOCK_MODE
+  return standard_clock_grid();
+#endif
+
+#if ENSEMBLE_MODE
+  return ensemble_analysis();
+#endif
+
+#if THRESHOLD_MODE
+  return threshold_search();
+#endif
+
+  /*
+   * The sampled mean call duration and interarrival time of each run are used
+   * as control variates for the waiting time results.
+   */
+
+  double controls[2];
+  double control_means[2] = {(double) MEAN_CALL_DURATION,
+			     1.0/(double) Call_ARRIVALRATE};
+  Control_Variate_Ptr waiting_time_cv, wait_probability_cv;
+
+  /* The waiting times of all runs, merged, also per channel. */
+  Histogram_Ptr all_waiting_times;
+  Histogram_Ptr * all_channel_waiting_times;
+  int i;
+
+  /* Confidence intervals over the seeds. */
+  Replication_Aggregator_Ptr agg;
+  int agg_blocking, agg_wait, agg_waiting_time, agg_busy, agg_queue;
+
+  agg = replication_aggregator_new();
+  agg_blocking = replication_aggregator_add_output(agg, "Blocking probability");
+  agg_wait = replication_aggregator_add_output(agg, "Probability of waiting");
+  agg_waiting_time = replication_aggregator_add_output(agg, "Waiting time");
+  agg_busy = replication_aggregator_add_output(agg, "Mean busy channels");
+  agg_queue = replication_aggregator_add_output(agg, "Mean queue length");
+
+  waiting_time_cv = control_variate_new(2, control_means);
+  wait_probability_cv = control_variate_new(2, control_means);
+  all_waiting_times = histogram_new(WAITING_TIME_RESOLUTION,
+				    WAITING_TIME_HIGHEST);
+  all_channel_waiting_times =
+    (Histogram_Ptr *) xcalloc((int) NUMBER_OF_CHANNELS, sizeof(Histogram_Ptr));
+  for (i=0; i<NUMBER_OF_CHANNELS; i++)
+    all_channel_waiting_times[i] = histogram_new(WAITING_TIME_RESOLUTION,
+						 WAITING_TIME_HIGHEST);
+
   /* 
    * Loop for each random number generator seed, doing a separate
    * simulation_run run for each.
@@ -59,53 +597,90 @@ int main(void)
 
   while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
 
-    /* Create a new simulation_run. This gives a clock and eventlist. */
-    simulation_run = simulation_run_new();
-
-    /* Add our data definitions to the simulation_run. */
-    simulation_run_set_data(simulation_run, (void *) & data);
-
-    /* Initialize our simulation_run data variables. */
-    data.blip_counter = 0;
-    data.call_arrival_count = 0;
-    data.calls_processed = 0;
-    data.blocked_call_count = 0;
-    data.number_of_calls_processed = 0;
-    data.accumulated_call_time = 0.0;
-    data.random_seed = random_seed;
-    data.buffer = fifoqueue_new();
-    data.waited_call_count = 0;
-    data.accumulated_waiting_time = 0.0;
-
-    /* Create the channels. */
-    data.channels = (Channel_Ptr *) xcalloc((int) NUMBER_OF_CHANNELS,
-					    sizeof(Channel_Ptr));
-
-    /* Initialize the channels. */
-    for (i=0; i<NUMBER_OF_CHANNELS; i++) {
-      *(data.channels+i) = server_new(); 
-    }
+    simulation_run = start_simulation_run(&data, random_seed);
 
-    /* Set the random number generator seed. */
-    random_generator_initialize((unsigned) random_seed);
+#if TIME_SERIES_MODE
+    time_series = time_series_new(TIME_SERIES_RESOLUTION);
+    time_series_add_column(time_series, "busy_channels",
+			   read_busy_channels, (void *) &data);
+    time_series_add_column(time_series, "queue_length",
+			   read_queue_length, (void *) &data);
+    if (TIME_SERIES_INTERVAL > 0)
+      time_series_start_sampling(time_series, simulation_run,
+				 TIME_SERIES_INTERVAL);
+#endif
 
-    /* Schedule the initial call arrival. */
-    schedule_call_arrival_event(simulation_run,
-			simulation_run_get_time(simulation_run) +
-			exponential_generator((double) 1/Call_ARRIVALRATE));
-    
     /* Execute events until we are finished. */
     while(data.number_of_calls_processed < RUNLENGTH) {
       simulation_run_execute_event(simulation_run);
+#if TIME_SERIES_MODE
+      if (TIME_SERIES_INTERVAL <= 0)
+	time_series_sample_on_change(time_series,
+				     simulation_run_get_time(simulation_run));
+#endif
     }
     
     /* Print out some results. */
     output_results(simulation_run);
 
+#if TIME_SERIES_MODE
+    sprintf(time_series_file, "time_series_%u.gts", random_seed);
+    time_series_write(time_series, time_series_file);
+    printf("Time series: %ld rows, %ld bytes (%ld bytes uncompressed) in %s\n",
+	   time_series->rows, time_series_compressed_size(time_series),
+	   time_series_raw_size(time_series), time_series_file);
+    time_series_free(time_series);
+#endif
+    histogram_merge(all_waiting_times, data.waiting_time_histogram);
+    for (i=0; i<NUMBER_OF_CHANNELS; i++)
+      histogram_merge(all_channel_waiting_times[i],
+		      data.channel_waiting_time_histograms[i]);
+
+    /* Record this run for the control variate estimates. */
+    controls[0] = data.accumulated_call_duration/data.call_duration_count;
+    controls[1] = data.accumulated_interarrival_time/data.call_arrival_count;
+
+    control_variate_add(waiting_time_cv, (data.waited_call_count > 0) ?
+			data.accumulated_waiting_time/data.waited_call_count : 0.0,
+			controls);
+    control_variate_add(wait_probability_cv,
+			(double) data.waited_call_count/data.call_arrival_count,
+			controls);
+
+    replication_aggregator_add(agg, agg_blocking,
+			       (double) data.blocked_call_count/data.call_arrival_count);
+    replication_aggregator_add(agg, agg_wait,
+			       (double) data.waited_call_count/data.call_arrival_count);
+    replication_aggregator_add_run(agg, agg_waiting_time, &data.waiting_times);
+    replication_aggregator_add(agg, agg_busy,
+			       time_weighted_stat_mean(data.busy_channels));
+    replication_aggregator_add(agg, agg_queue,
+			       time_weighted_stat_mean(data.queue_length));
+
     /* Clean up memory. */
     cleanup(simulation_run);
   }
 
+  output_replication_summary(agg);
+
+  output_control_variate_results("Probability of waiting (Pw)",
+				 wait_probability_cv);
+  output_control_variate_results("Average waiting time (Tw)",
+				 waiting_time_cv);
+  output_histogram("Waiting time of all calls over all runs (minutes)",
+		   all_waiting_times, WAITING_TIME_BOUND);
+  output_channel_histograms("Waiting time by channel over all runs (minutes)",
+			    all_channel_waiting_times, WAITING_TIME_BOUND);
+  printf("\n");
+
+  replication_aggregator_free(agg);
+  control_variate_free(waiting_time_cv);
+  control_variate_free(wait_probability_cv);
+  histogram_free(all_waiting_times);
+  for (i=0; i<NUMBER_OF_CHANNELS; i++)
+    histogram_free(all_channel_waiting_times[i]);
+  xfree((void *) all_channel_waiting_times);
+
   /* Pause before finishing. */
   getchar();
   return 0;
@@ -31,9 +31,18 @@
 /*******************************************************************************/
 
 #include "simlib.h"
+#include "histogram.h"
+#include "statistics.h"
 
 /*******************************************************************************/
 
+/* The parameters that can be swept, defined in main.c. */
+extern double Call_ARRIVALRATE;
+extern double MEAN_CALL_DURATION;
+extern double RUNLENGTH;
+extern int NUMBER_OF_CHANNELS;
+extern int BLOCKED_CALLS_CLEARED;
+
 typedef Server Channel;
 typedef Server_Ptr Channel_Ptr;
 
@@ -52,6 +61,7 @@ typedef struct _simulation_run_data_
   Channel_Ptr * channels;
   Fifoqueue_Ptr buffer;
   long int blip_counter;
+  int quiet;                            /* No progress messages. */
   long int call_arrival_count;
   long int calls_processed;
   long int blocked_call_count;
@@ -59,6 +69,14 @@ typedef struct _simulation_run_data_
   long int number_of_calls_processed;
   double accumulated_call_time;
   double accumulated_waiting_time;
+  double accumulated_call_duration;     /* Sum of all call durations drawn. */
+  long int call_duration_count;
+  double accumulated_interarrival_time; /* Sum of all interarrival times drawn. */
+  Histogram_Ptr waiting_time_histogram; /* Waiting times of all calls served. */
+  Histogram_Ptr * channel_waiting_time_histograms; /* The same, per channel. */
+  Running_Stat waiting_times;           /* The same, as running statistics. */
+  Time_Weighted_Stat_Ptr busy_channels; /* Shared by all the channels. */
+  Time_Weighted_Stat_Ptr queue_length;  /* Calls waiting in the buffer. */
   unsigned random_seed;
 } Simulation_Run_Data, * Simulation_Run_Data_Ptr;
 
@@ -68,7 +86,7 @@ typedef struct _simulation_run_data_
  * Function prototypes
  */
 
-extern int main(void);
+extern int main(int, char *[]);
 
 /*******************************************************************************/
 
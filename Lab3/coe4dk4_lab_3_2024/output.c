@@ -26,12 +26,36 @@
 /*******************************************************************************/
 
 #include <stdio.h>
+#include <math.h>
 #include "simparameters.h"
 #include "main.h"
 #include "output.h"
 
 /*******************************************************************************/
 
+/*
+ * Add the live metrics of a run, if it publishes them (see output.h).
+ */
+
+void output_metrics_start(Simulation_Run_Ptr this_simulation_run)
+{
+  char label[METRICS_LABEL_SIZE];
+
+  if (this_simulation_run->metrics == NULL) return;
+
+  sprintf(label, "channels %d, arrival rate %g", NUMBER_OF_CHANNELS,
+	  Call_ARRIVALRATE);
+  simulation_run_metrics_label(this_simulation_run, label);
+  simulation_run_metrics_counter(this_simulation_run, "call arrivals");
+  simulation_run_metrics_counter(this_simulation_run, "blocked calls");
+  simulation_run_metrics_counter(this_simulation_run, "calls that waited");
+  simulation_run_metrics_counter(this_simulation_run, "calls processed");
+  simulation_run_metrics_estimate(this_simulation_run, "blocking probability");
+  simulation_run_metrics_estimate(this_simulation_run, "wait probability");
+}
+
+/*******************************************************************************/
+
 void output_progress_msg_to_screen(Simulation_Run_Ptr this_simulation_run)
 {
   double percentagedone;
@@ -41,6 +65,31 @@ void output_progress_msg_to_screen(Simulation_Run_Ptr this_simulation_run)
 
   sim_data->blip_counter++;
 
+  /* Publish the live metrics, which is cheap, at every call. */
+  SIMULATION_RUN_METRICS_PROGRESS(this_simulation_run,
+		  (double) sim_data->number_of_calls_processed/RUNLENGTH);
+  SIMULATION_RUN_METRICS_COUNTER(this_simulation_run, OUTPUT_METRICS_ARRIVALS,
+				 sim_data->call_arrival_count);
+  SIMULATION_RUN_METRICS_COUNTER(this_simulation_run, OUTPUT_METRICS_BLOCKED,
+				 sim_data->blocked_call_count);
+  SIMULATION_RUN_METRICS_COUNTER(this_simulation_run, OUTPUT_METRICS_WAITED,
+				 sim_data->waited_call_count);
+  SIMULATION_RUN_METRICS_COUNTER(this_simulation_run,
+				 OUTPUT_METRICS_CALLS_PROCESSED,
+				 sim_data->number_of_calls_processed);
+  SIMULATION_RUN_METRICS_ESTIMATE(this_simulation_run,
+				  OUTPUT_METRICS_BLOCKING,
+				  sim_data->call_arrival_count,
+				  sim_data->blocked_call_count,
+				  sim_data->blocked_call_count);
+  SIMULATION_RUN_METRICS_ESTIMATE(this_simulation_run,
+				  OUTPUT_METRICS_WAITING,
+				  sim_data->call_arrival_count,
+				  sim_data->waited_call_count,
+				  sim_data->waited_call_count);
+
+  if (sim_data->quiet) return;
+
   if((sim_data->blip_counter >= BLIPRATE)
      ||
      (sim_data->number_of_calls_processed >= RUNLENGTH))
@@ -93,9 +142,118 @@ void output_results(Simulation_Run_Ptr this_simulation_run)
   printf("Waited call count = %ld \n", sim_data->waited_call_count);
   printf("Probability of waiting (Pw) = %.4f\n", prob_wait);
   printf("Average waiting time (Tw) = %.4f minutes\n", avg_waiting_time);
+
+  printf("Mean busy channels = %.4f (Utilization = %.4f)\n",
+	 time_weighted_stat_mean(sim_data->busy_channels),
+	 time_weighted_stat_mean(sim_data->busy_channels)/NUMBER_OF_CHANNELS);
+  printf("Time all channels busy = %.4f\n",
+	 time_weighted_stat_probability(sim_data->busy_channels,
+					NUMBER_OF_CHANNELS));
+  printf("Mean queue length = %.4f (max = %d)\n",
+	 time_weighted_stat_mean(sim_data->queue_length),
+	 sim_data->queue_length->max_value);
+
+  output_histogram("Waiting time of all calls (minutes)",
+		   sim_data->waiting_time_histogram, WAITING_TIME_BOUND);
+  output_channel_histograms("Waiting time by channel (minutes)",
+			    sim_data->channel_waiting_time_histograms,
+			    WAITING_TIME_BOUND);
   
    printf("\n");
 }
 
+/*******************************************************************************/
+
+/*
+ * Print a result over all seeds, both as the plain average and adjusted with
+ * the control variates. Both come with 95% confidence intervals.
+ */
+
+void output_control_variate_results(const char * name, Control_Variate_Ptr cv)
+{
+  Control_Variate_Estimate estimate;
+
+  control_variate_estimate(cv, 0.95, &estimate);
+
+  printf("%s over %ld runs:\n", name, estimate.count);
+  printf("  crude estimate            = %.5f +/- %.5f\n",
+	 estimate.crude_mean, estimate.crude_half_width);
+  printf("  control variate estimate  = %.5f +/- %.5f\n",
+	 estimate.mean, estimate.half_width);
+  printf("  (beta: call duration = %.5f, interarrival time = %.5f)\n",
+	 estimate.beta[0], estimate.beta[1]);
+  printf("\n");
+}
+
+/*******************************************************************************/
+
+/*
+ * Print the 95% confidence interval over all seeds of each output, with the
+ * range of the per-seed values. Where the individual observations were
+ * pooled, their spread and range are printed too.
+ */
+
+void output_replication_summary(Replication_Aggregator_Ptr agg)
+{
+  int i;
+  Running_Stat_Ptr r, o;
+
+  for (i=0; i<agg->number_of_outputs; i++) {
+    r = agg->replications + i;
+    o = agg->observations + i;
+
+    printf("%s over %ld runs = %.5f +/- %.5f (range %.5f to %.5f)\n",
+	   agg->names[i], r->count, r->mean, running_stat_half_width(r, 0.95),
+	   r->min, r->max);
+    if (o->count > 0)
+      printf("  over all %ld values: sd = %.5f, range %.5f to %.5f\n",
+	     o->count, sqrt(running_stat_variance(o)), o->min, o->max);
+  }
+  printf("\n");
+}
+
+/*******************************************************************************/
+
+/*
+ * Print the percentiles of a histogram and the fraction of values above the
+ * given bound.
+ */
+
+void output_histogram(const char * name, Histogram_Ptr histogram, double bound)
+{
+  printf("%s, %ld values:\n", name, histogram->total_count);
+  printf("  mean = %.4f, p50 = %.4f, p99 = %.4f, p99.9 = %.4f, max = %.4f\n",
+	 histogram_mean(histogram), histogram_quantile(histogram, 0.5),
+	 histogram_quantile(histogram, 0.99),
+	 histogram_quantile(histogram, 0.999), histogram->max);
+  printf("  P(> %g) = %.6f\n", bound, histogram_exceedance(histogram, bound));
+  if (histogram->overflow_count > 0)
+    printf("  (%ld values above the highest tracked value)\n",
+	   histogram->overflow_count);
+}
+
+/*
+ * Print one line per channel with the percentiles of its histogram and the
+ * fraction of values above the given bound.
+ */
+
+void output_channel_histograms(const char * name, Histogram_Ptr * histograms,
+			       double bound)
+{
+  int i;
+  Histogram_Ptr histogram;
+
+  printf("%s:\n", name);
+  printf("  channel     calls      mean       p99     p99.9  P(> %g)\n", bound);
+  for (i=0; i<NUMBER_OF_CHANNELS; i++) {
+    histogram = histograms[i];
+    printf("  %7d %9ld %9.4f %9.4f %9.4f  %.6f\n", i+1,
+	   histogram->total_count, histogram_mean(histogram),
+	   histogram_quantile(histogram, 0.99),
+	   histogram_quantile(histogram, 0.999),
+	   histogram_exceedance(histogram, bound));
+  }
+}
+
 
 
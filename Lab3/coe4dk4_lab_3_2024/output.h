@@ -32,6 +32,21 @@
 
 #include "trace.h"
 #include "main.h"
+#include "statistics.h"
+#include "histogram.h"
+
+/*******************************************************************************/
+
+/*
+ * The live metrics of a run (see metrics.h), added in this order.
+ */
+
+typedef enum {OUTPUT_METRICS_ARRIVALS, OUTPUT_METRICS_BLOCKED,
+	      OUTPUT_METRICS_WAITED, OUTPUT_METRICS_CALLS_PROCESSED}
+  Output_Metrics_Counter;
+
+typedef enum {OUTPUT_METRICS_BLOCKING, OUTPUT_METRICS_WAITING}
+  Output_Metrics_Estimate;
 
 /*******************************************************************************/
 
@@ -41,12 +56,27 @@
  *
  */
 
+void
+output_metrics_start(Simulation_Run_Ptr);
+
 void
 output_progress_msg_to_screen(Simulation_Run_Ptr);
 
 void
 output_results(Simulation_Run_Ptr);
 
+void
+output_control_variate_results(const char *, Control_Variate_Ptr);
+
+void
+output_histogram(const char *, Histogram_Ptr, double);
+
+void
+output_channel_histograms(const char *, Histogram_Ptr *, double);
+
+void
+output_replication_summary(Replication_Aggregator_Ptr);
+
 /*******************************************************************************/
 
 #endif /* output.h */
@@ -0,0 +1,126 @@
+"""Decode and plot a compressed time series written with TIME_SERIES_MODE.
+
+Usage: python plot_time_series.py time_series_<seed>.gts [output.csv]
+
+The file layout and the compression are described in time_series.c. If a
+CSV file name is given, the decoded rows are also written there.
+"""
+
+import struct
+import sys
+
+import matplotlib.pyplot as plt
+
+
+class BitReader:
+    def __init__(self, data, nbits):
+        self.data = data
+        self.nbits = nbits
+        self.pos = 0
+
+    def read(self, n):
+        if n == 0:
+            return 0
+        if self.pos + n > self.nbits:
+            raise ValueError('read past the end of a stream')
+        first, last = self.pos // 8, (self.pos + n + 7) // 8
+        value = int.from_bytes(self.data[first:last], 'big')
+        shift = 8 * last - self.pos - n
+        self.pos += n
+        return (value >> shift) & ((1 << n) - 1)
+
+
+def signed(value, n):
+    return value - (1 << n) if value >> (n - 1) else value
+
+
+def decode_times(reader, rows):
+    ticks = []
+    tick = delta = 0
+    for row in range(rows):
+        if row == 0:
+            tick = signed(reader.read(64), 64)
+        else:
+            if reader.read(1) == 0:
+                dod = 0
+            elif reader.read(1) == 0:
+                dod = signed(reader.read(7), 7)
+            elif reader.read(1) == 0:
+                dod = signed(reader.read(9), 9)
+            elif reader.read(1) == 0:
+                dod = signed(reader.read(12), 12)
+            else:
+                dod = signed(reader.read(64), 64)
+            delta += dod
+            tick += delta
+        ticks.append(tick)
+    return ticks
+
+
+def decode_values(reader, rows):
+    values = []
+    bits = leading = trailing = 0
+    for row in range(rows):
+        if row == 0:
+            bits = reader.read(64)
+        elif reader.read(1) == 1:
+            if reader.read(1) == 1:
+                leading = reader.read(5)
+                meaningful = reader.read(6) or 64
+                trailing = 64 - leading - meaningful
+            bits ^= reader.read(64 - leading - trailing) << trailing
+        values.append(struct.unpack('>d', bits.to_bytes(8, 'big'))[0])
+    return values
+
+
+def read_time_series(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'GTS1':
+        raise ValueError(f'{filename} is not a time series file')
+    rows, resolution, ncolumns = struct.unpack('>Qdi', data[4:24])
+    pos = 24
+    names = []
+    for _ in range(ncolumns):
+        (length,) = struct.unpack('>i', data[pos:pos + 4])
+        names.append(data[pos + 4:pos + 4 + length].decode())
+        pos += 4 + length
+
+    streams = []
+    for _ in range(ncolumns + 1):
+        (nbits,) = struct.unpack('>Q', data[pos:pos + 8])
+        nbytes = (nbits + 7) // 8
+        streams.append(BitReader(data[pos + 8:pos + 8 + nbytes], nbits))
+        pos += 8 + nbytes
+
+    times = [tick * resolution for tick in decode_times(streams[0], rows)]
+    columns = {name: decode_values(stream, rows)
+               for name, stream in zip(names, streams[1:])}
+    return times, columns
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    times, columns = read_time_series(sys.argv[1])
+    print(f'Decoded {len(times)} rows of {", ".join(columns)}')
+
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'w') as f:
+            f.write(','.join(['time'] + list(columns)) + '\n')
+            for i, t in enumerate(times):
+                f.write(','.join([f'{t:.6f}'] + [f'{columns[name][i]:g}' for name in columns]) + '\n')
+        print(f'Saved {sys.argv[2]}')
+
+    fig, axes = plt.subplots(len(columns), 1, sharex=True, figsize=(10, 3 * len(columns)), squeeze=False)
+    for ax, name in zip(axes[:, 0], columns):
+        ax.step(times, columns[name], where='post')
+        ax.set_ylabel(name)
+        ax.grid(True, linestyle='--', alpha=0.4)
+    axes[-1, 0].set_xlabel('Time (minutes)')
+    plt.tight_layout()
+    output = sys.argv[1].rsplit('.', 1)[0] + '.png'
+    plt.savefig(output, dpi=150, bbox_inches='tight')
+    print(f'Saved {output}')
@@ -0,0 +1,305 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include "simlib.h"
+#include "result_cache.h"
+
+/******************************************************************************/
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*
+ * Continue a 64-bit FNV-1a hash over size bytes of data.
+ */
+
+static unsigned long long
+result_cache_hash(unsigned long long hash, const void * data, size_t size)
+{
+  const unsigned char * p = (const unsigned char *) data;
+
+  while (size-- > 0) {
+    hash ^= *p++;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+/*
+ * Hash the running executable. Where it cannot be read, fall back on the
+ * time this file was compiled; the cache directory should then be cleared by
+ * hand after changing the model.
+ */
+
+static unsigned long long
+result_cache_build_hash(void)
+{
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  unsigned char buffer[65536];
+  size_t n;
+  FILE * file;
+
+  if ((file = fopen("/proc/self/exe", "rb")) != NULL) {
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      hash = result_cache_hash(hash, buffer, n);
+    fclose(file);
+  } else {
+    hash = result_cache_hash(hash, __DATE__ " " __TIME__,
+			     strlen(__DATE__ " " __TIME__));
+  }
+  return hash;
+}
+
+/******************************************************************************/
+
+/*
+ * Open the cache kept in the given directory, creating it if needed, for
+ * the runs of the named model.
+ */
+
+Result_Cache_Ptr
+result_cache_new(const char * directory, const char * model)
+{
+  Result_Cache_Ptr cache;
+  int status;
+
+#ifdef _WIN32
+  status = _mkdir(directory);
+#else
+  status = mkdir(directory, 0777);
+#endif
+  if (status != 0 && errno != EEXIST) {
+    printf("Error: Could not create the result cache directory %s.\n", directory);
+    exit(1);
+  }
+
+  cache = (Result_Cache_Ptr) xcalloc(1, sizeof(Result_Cache));
+  strncpy(cache->directory, directory, sizeof(cache->directory) - 1);
+  strncpy(cache->model, model, sizeof(cache->model) - 1);
+  cache->build_hash = result_cache_build_hash();
+  return cache;
+}
+
+/*
+ * Start the key of a run. Every input of the run is then added by name.
+ */
+
+void
+result_cache_start_key(Result_Cache_Ptr cache)
+{
+  sprintf(cache->key, "model=%s build=%016llx", cache->model,
+	  cache->build_hash);
+}
+
+void
+result_cache_add_key(Result_Cache_Ptr cache, const char * name, double value)
+{
+  size_t length = strlen(cache->key);
+
+  if (length + strlen(name) + 32 >= RESULT_CACHE_MAX_KEY) {
+    printf("Error: Result cache key too long (adding %s).\n", name);
+    exit(1);
+  }
+  sprintf(cache->key + length, " %s=%.17g", name, value);
+}
+
+static void
+result_cache_path(Result_Cache_Ptr cache, char * path)
+{
+  cache->hash = result_cache_hash(FNV_OFFSET_BASIS, cache->key,
+				  strlen(cache->key));
+  sprintf(path, "%s/%016llx.txt", cache->directory, cache->hash);
+}
+
+/*
+ * Load the n results of the current key into values. Returns 1 on a hit
+ * and 0 on a miss, when values is left alone.
+ */
+
+int
+result_cache_load(Result_Cache_Ptr cache, double * values, int n)
+{
+  char path[512], line[RESULT_CACHE_MAX_KEY + 2];
+  double loaded[RESULT_CACHE_MAX_VALUES];
+  int i, count = -1;
+  FILE * file;
+
+  result_cache_path(cache, path);
+
+  if (n <= RESULT_CACHE_MAX_VALUES && (file = fopen(path, "r")) != NULL) {
+    if (fgets(line, sizeof(line), file) != NULL) {
+      line[strcspn(line, "\n")] = '\0';
+      if (strcmp(line, cache->key) == 0 && fscanf(file, "%d", &count) == 1 &&
+	  count == n) {
+	for (i=0; i<n; i++)
+	  if (fscanf(file, "%lf", loaded + i) != 1) break;
+	count = i;
+      }
+    }
+    fclose(file);
+
+    if (count == n) {
+      memcpy(values, loaded, n * sizeof(double));
+      cache->hits++;
+      return 1;
+    }
+  }
+
+  cache->misses++;
+  return 0;
+}
+
+/*
+ * Store the n results of the current key.
+ */
+
+void
+result_cache_store(Result_Cache_Ptr cache, const double * values, int n)
+{
+  char path[512], temporary[512];
+  int i;
+  FILE * file;
+
+  result_cache_path(cache, path);
+  sprintf(temporary, "%s/.%016llx.%d.tmp", cache->directory, cache->hash,
+	  (int) getpid());
+
+  if ((file = fopen(temporary, "w")) == NULL) {
+    printf("Error: Could not write the result cache file %s.\n", temporary);
+    exit(1);
+  }
+  fprintf(file, "%s\n%d\n", cache->key, n);
+  for (i=0; i<n; i++)
+    fprintf(file, "%.17g\n", values[i]);
+
+#ifdef _WIN32
+  remove(path);
+#endif
+  if (fclose(file) != 0 || rename(temporary, path) != 0) {
+    printf("Error: Could not store the result cache file %s.\n", path);
+    exit(1);
+  }
+}
+
+/*
+ * Call function(key, values, n, argument) for every entry of the model and
+ * build in the cache, in no particular order. Returns the number of entries.
+ */
+
+long int
+result_cache_scan(Result_Cache_Ptr cache, Result_Cache_Entry_Function function,
+		  void * argument)
+{
+#ifdef _WIN32
+  printf("Error: Listing the result cache needs dirent.h.\n");
+  exit(1);
+#else
+  char prefix[RESULT_CACHE_MAX_KEY], path[512], line[RESULT_CACHE_MAX_KEY + 2];
+  double values[RESULT_CACHE_MAX_VALUES];
+  struct dirent * entry;
+  size_t length;
+  long int entries = 0;
+  int i, n;
+  DIR * directory;
+  FILE * file;
+
+  if ((directory = opendir(cache->directory)) == NULL) return 0;
+
+  sprintf(prefix, "model=%s build=%016llx ", cache->model, cache->build_hash);
+  length = strlen(prefix);
+
+  while ((entry = readdir(directory)) != NULL) {
+    /* Skip the temporary files, which start with a dot. */
+    if (entry->d_name[0] == '.' || strlen(entry->d_name) != 20 ||
+	strcmp(entry->d_name + 16, ".txt") != 0)
+      continue;
+
+    sprintf(path, "%s/%s", cache->directory, entry->d_name);
+    if ((file = fopen(path, "r")) == NULL) continue;
+
+    n = -1;
+    if (fgets(line, sizeof(line), file) != NULL &&
+	strncmp(line, prefix, length) == 0 && fscanf(file, "%d", &n) == 1 &&
+	n >= 0 && n <= RESULT_CACHE_MAX_VALUES) {
+      for (i=0; i<n; i++)
+	if (fscanf(file, "%lf", values + i) != 1) break;
+      if (i < n) n = -1;
+    } else {
+      n = -1;
+    }
+    fclose(file);
+
+    if (n >= 0) {
+      line[strcspn(line, "\n")] = '\0';
+      (*function)(line, values, n, argument);
+      entries++;
+    }
+  }
+
+  closedir(directory);
+  return entries;
+#endif
+}
+
+/*
+ * Read the named input of a key. Returns 1 if it is there, else 0.
+ */
+
+int
+result_cache_key_value(const char * key, const char * name, double * value)
+{
+  const char * p = key;
+  size_t length = strlen(name);
+
+  while ((p = strchr(p, ' ')) != NULL) {
+    p++;
+    if (strncmp(p, name, length) == 0 && p[length] == '=')
+      return sscanf(p + length + 1, "%lf", value) == 1;
+  }
+  return 0;
+}
+
+void
+result_cache_free(Result_Cache_Ptr cache)
+{
+  xfree((void *) cache);
+}
+
@@ -0,0 +1,201 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "statistics.h"
+#include "root_finder.h"
+
+/******************************************************************************/
+
+/*
+ * Search for the crossing of target in [low, high] to within tolerance,
+ * with the given confidence. The replication limits and the first seed can
+ * be changed before running.
+ */
+
+Root_Finder_Ptr
+root_finder_new(double target, double low, double high, double tolerance,
+		double confidence)
+{
+  Root_Finder_Ptr rf;
+
+  if (!(low < high) || tolerance <= 0.0) {
+    printf("Error: Bad root finder bracket [%g, %g].\n", low, high);
+    exit(1);
+  }
+
+  rf = (Root_Finder_Ptr) xcalloc(1, sizeof(Root_Finder));
+  rf->target = target;
+  rf->low = low;
+  rf->high = high;
+  rf->tolerance = tolerance;
+  rf->confidence = confidence;
+  rf->min_replications = 5;
+  rf->max_replications = 1000;
+  rf->seed = 1;
+  running_stat_reset(&rf->low_stat);
+  running_stat_reset(&rf->high_stat);
+  return rf;
+}
+
+/*
+ * The most bisection steps needed to get below the tolerance, over which
+ * the error probability is split.
+ */
+
+int
+root_finder_max_steps(Root_Finder_Ptr rf)
+{
+  int steps = 0;
+  double width = rf->high - rf->low;
+
+  while (width >= rf->tolerance) {
+    width /= 2;
+    steps++;
+  }
+  return (steps > 0) ? steps : 1;
+}
+
+/*
+ * The most looks at the interval of one point, with the replications
+ * growing by the least allowed each time.
+ */
+
+int
+root_finder_max_looks(Root_Finder_Ptr rf)
+{
+  int looks = 1;
+  long int n = rf->min_replications;
+
+  while (n < rf->max_replications) {
+    n += (n + 1)/2;
+    looks++;
+  }
+  return looks;
+}
+
+static void
+root_finder_replicate(Root_Finder_Ptr rf, Running_Stat_Ptr stat, double x,
+		      long int n, Root_Finder_Function function,
+		      void * argument)
+{
+  while (n-- > 0) {
+    running_stat_add(stat, (*function)(x, rf->seed++, argument));
+    rf->replications++;
+  }
+}
+
+/*
+ * Run the search. function(x, seed, argument) returns one independent
+ * replication of the response at x.
+ */
+
+void
+root_finder_run(Root_Finder_Ptr rf, Root_Finder_Function function,
+		void * argument)
+{
+  Running_Stat stat;
+  double x, level, gap, half_width, ratio;
+  long int more;
+  int max_steps;
+
+  if (rf->min_replications < 2) rf->min_replications = 2;
+
+  max_steps = root_finder_max_steps(rf);
+  level = 1.0 - (1.0 - rf->confidence)/
+    (max_steps * (double) root_finder_max_looks(rf));
+
+  rf->status = ROOT_FINDER_CONVERGED;
+  rf->steps = 0;
+
+  while (rf->high - rf->low >= rf->tolerance && rf->steps < max_steps) {
+    x = 0.5 * (rf->low + rf->high);
+    running_stat_reset(&stat);
+    root_finder_replicate(rf, &stat, x, rf->min_replications, function,
+			  argument);
+
+    for (;;) {
+      gap = fabs(stat.mean - rf->target);
+      half_width = running_stat_half_width(&stat, level);
+      if (gap > half_width || stat.count >= rf->max_replications) break;
+
+      /*
+       * Predict the replications to decide, growing by at least half and at
+       * most doubling each time.
+       */
+      if (gap > 0.0) {
+	ratio = half_width / gap;
+	more = (long int) ceil(1.1 * stat.count * ratio * ratio) - stat.count;
+      } else {
+	more = stat.count;
+      }
+      if (more < (stat.count + 1)/2) more = (stat.count + 1)/2;
+      if (more > stat.count) more = stat.count;
+      if (more > rf->max_replications - stat.count)
+	more = rf->max_replications - stat.count;
+
+      root_finder_replicate(rf, &stat, x, more, function, argument);
+    }
+
+    rf->steps++;
+    rf->point_replications = stat.count;
+
+    if (gap <= half_width) {
+      /* Within the noise of the crossing: stop here. */
+      rf->status = ROOT_FINDER_UNDECIDED;
+      rf->estimate = x;
+      return;
+    }
+
+    if (stat.mean > rf->target) {
+      rf->high = x;
+      rf->high_stat = stat;
+    } else {
+      rf->low = x;
+      rf->low_stat = stat;
+    }
+  }
+
+  /* Interpolate between the ends of the bracket, where both were measured. */
+  if (rf->low_stat.count > 0 && rf->high_stat.count > 0 &&
+      rf->high_stat.mean > rf->low_stat.mean) {
+    rf->estimate = rf->low + (rf->high - rf->low) *
+      (rf->target - rf->low_stat.mean)/(rf->high_stat.mean - rf->low_stat.mean);
+  } else {
+    rf->estimate = 0.5 * (rf->low + rf->high);
+  }
+}
+
+void
+root_finder_free(Root_Finder_Ptr rf)
+{
+  xfree((void *) rf);
+}
+
@@ -0,0 +1,113 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _ROOT_FINDER_H_
+#define _ROOT_FINDER_H_
+
+/******************************************************************************/
+
+#include "statistics.h"
+
+/******************************************************************************/
+
+/*
+ * Stochastic root finding by sequential bisection.
+ *
+ * Find where an increasing function, only seen through noisy replications
+ * (e.g., the blocking probability of a simulation run at a given offered
+ * load), crosses a target. The bracket [low, high] must hold the crossing.
+ * Each step replicates at the midpoint until the confidence interval of the
+ * mean excludes the target, and then drops the half of the bracket on the
+ * wrong side. The number of further replications is predicted from the
+ * current interval: the half width shrinks as 1/sqrt(n), so the gap between
+ * the mean and the target needs about n (half width / gap)^2 replications.
+ * Points far from the crossing are decided after a few replications and the
+ * effort goes into the last steps, close to it.
+ *
+ * The interval at a point is looked at after every batch of replications,
+ * and each look is a chance to decide wrongly, so the error probability is
+ * split (Bonferroni) over all the looks the search can make: the bisection
+ * steps times the looks per point. Each batch grows the replications by at
+ * least half and at most doubles them, which bounds the looks per point at
+ * about log(max_replications/min_replications)/log(1.5). The final bracket
+ * then holds the crossing with at least the requested confidence. A point
+ * still undecided after max_replications is within the noise of the
+ * crossing; the search then stops there. The point estimate is the linear
+ * interpolation of the means at the two ends of the final bracket (the
+ * undecided point, if any).
+ */
+
+typedef double (* Root_Finder_Function)(double, unsigned, void *);
+
+typedef enum {ROOT_FINDER_CONVERGED, ROOT_FINDER_UNDECIDED}
+  Root_Finder_Status;
+
+typedef struct _root_finder_
+{
+  double target;
+  double low;
+  double high;
+  double tolerance;       /* stop when high - low is below this */
+  double confidence;      /* of the final bracket */
+  long int min_replications;  /* at least 2 */
+  long int max_replications;  /* per point */
+  unsigned seed;          /* of the next replication */
+
+  Running_Stat low_stat;  /* the replications at the ends of the bracket */
+  Running_Stat high_stat;
+
+  Root_Finder_Status status;
+  double estimate;
+  int steps;
+  long int replications;  /* in total */
+  long int point_replications;  /* at the last point */
+} Root_Finder, * Root_Finder_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Root_Finder_Ptr
+root_finder_new(double, double, double, double, double);
+
+int
+root_finder_max_steps(Root_Finder_Ptr);
+
+int
+root_finder_max_looks(Root_Finder_Ptr);
+
+void
+root_finder_run(Root_Finder_Ptr, Root_Finder_Function, void *);
+
+void
+root_finder_free(Root_Finder_Ptr);
+
+/******************************************************************************/
+
+#endif /* root_finder.h */
+
@@ -24,7 +24,69 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_TSC
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#define METRICS_SHARED_MEMORY
+#define TRACE_THREADS
+#endif
+
+/*
+ * The trace rings are shared with the thread writing them out: the run
+ * publishes its head after filling the records, and the writer its tail
+ * after writing them.
+ */
+
+#if defined(__GNUC__)
+#define TRACE_PUBLISH(field, value) \
+  __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define TRACE_READ(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#else
+#define TRACE_PUBLISH(field, value) ((field) = (value))
+#define TRACE_READ(field) (field)
+#endif
+
+/*
+ * Profiling, metrics and tracing are off in most runs. Their hooks in the
+ * event loop and the random generators are marked unlikely, so that the
+ * compiler keeps them off the straight path.
+ */
+
+#if defined(__GNUC__)
+#define UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#else
+#define UNLIKELY(condition) (condition)
+#endif
+
+/* Time a random variate, only calling the profiler if a run is profiled. */
+#define PROFILE_RANDOM_BEGIN() \
+  (UNLIKELY(active_profile != NULL) ? profile_random_begin() : 0)
+#define PROFILE_RANDOM_END(start_ticks) \
+  do { \
+    if (UNLIKELY(active_profile != NULL)) profile_random_end(start_ticks); \
+  } while (0)
 
 #include "trace.h"
 #include "simlib.h"
@@ -50,12 +112,138 @@ simulation_run_get_eventlist(Simulation_Run_Ptr);
 static Event_Container_Ptr
 simulation_run_get_event(Simulation_Run_Ptr);
 
+static void
+time_weighted_stat_grow(Time_Weighted_Stat_Ptr, int);
+
+static unsigned long long
+profile_ticks(void);
+
+static unsigned long long
+profile_elapsed(Profile_Ptr, unsigned long long);
+
+static int
+profile_bin(long int);
+
+static void
+profile_event_list_size(Profile_Ptr, int);
+
+static void
+profile_close_counters(Profile_Ptr);
+
+static Profile_Event_Type_Ptr
+profile_event_type(Profile_Ptr, Event_Ptr);
+
+static int
+profile_counters_begin(Profile_Ptr, unsigned long long *);
+
+static void
+profile_counters_end(Profile_Ptr, Profile_Counters_Ptr, unsigned long long *);
+
+static unsigned long long
+profile_random_begin(void);
+
+static void
+profile_random_end(unsigned long long);
+
+static void
+fifoqueue_unregister(Fifoqueue_Ptr);
+
+static void
+profile_note_queue(Profile_Ptr, Fifoqueue_Ptr);
+
+static void
+metrics_start(Simulation_Run_Ptr);
+
+static void
+trace_start(Simulation_Run_Ptr);
+
+static void
+trace_record(Trace_Ptr, int, double, Event_Ptr, long int, double, long int);
+
+static void
+trace_finish(Trace_Ptr);
+
 #ifdef TRACE_ON /* This is only used when tracing is active. */
 static void event_print_type(Event);
 #endif /* TRACE_ON */
 
 /******************************************************************************/
 
+/*
+ * The id given to the next scheduled event, and the state of the generator
+ * behind uniform_generator. Both are kept here so that a checkpoint can save
+ * and restore them.
+ */
+
+static long int next_event_id = 1;
+
+static Random_State random_state;
+
+/* The profile of the run being executed, for the random number generators. */
+
+static Profile_Ptr active_profile = NULL;
+
+/*
+ * The metrics page of the process, if it publishes one, and the run
+ * publishing on it. The seed is the last one given to the random generator.
+ */
+
+static Metrics_Page_Ptr metrics_page = NULL;
+static Simulation_Run_Ptr metrics_run = NULL;
+static long int metrics_pid = 0;
+static char metrics_name[64];
+static unsigned metrics_seed = 1;
+
+/*
+ * The trace file of the process, the traces of its runs, and the event
+ * types named in the file so far. With threads, the lock covers the list,
+ * the types, the states of the traces and the file, and the writer thread
+ * sleeps on trace_wake until a ring has records to write out, while the
+ * runs wait on trace_written.
+ */
+
+static FILE * trace_file = NULL;
+static long int trace_pid = 0;
+static unsigned trace_runs = 0;
+static Trace_Ptr trace_list = NULL;
+
+static int trace_number_of_types = 0;
+static void (* trace_functions[TRACE_MAX_TYPES])(Simulation_Run_Ptr, void *);
+
+#ifdef TRACE_THREADS
+static pthread_t trace_thread;
+static pthread_mutex_t trace_lock;
+static pthread_cond_t trace_wake;
+static pthread_cond_t trace_written;
+static int trace_closing = 0;
+#endif
+
+/*
+ * The names of simlib's own kinds of allocations, and the list of all
+ * live FIFO queues.
+ */
+
+static const char fifoqueue_name[] = "fifoqueue";
+
+static Fifoqueue_Ptr fifoqueue_list = NULL;
+
+static long int number_of_fifoqueues = 0;
+
+/* The counts behind xmalloc, xcalloc and xfree. */
+
+static Allocation_Stats allocation_stats;
+
+/*
+ * Whether blocks carry headers and are counted: -1 until the first
+ * allocation looks at the environment. The headers alone make the labs a
+ * fifth slower, so only profiling turns them on, and only for the whole
+ * process, since xfree has to know whether a block has one.
+ */
+
+static int allocation_counting = -1;
+
+/******************************************************************************/
+
 /*
  * Create a new simulation_run. The simulation_run will include a clock, an
  * event list, and a data pointer to simulation_run data.
@@ -66,10 +254,21 @@ simulation_run_new(void)
 {
   Simulation_Run_Ptr new_simulation_run;
 
-  new_simulation_run = (Simulation_Run_Ptr) xmalloc(sizeof(Simulation_Run));
+  new_simulation_run = (Simulation_Run_Ptr)
+    xmalloc_named(sizeof(Simulation_Run), "simulation run");
   new_simulation_run->eventlist = eventlist_new();
   new_simulation_run->clock = clock_new();
   new_simulation_run->data = NULL;
+  new_simulation_run->profile = NULL;
+  new_simulation_run->metrics = NULL;
+  new_simulation_run->trace = NULL;
+
+  if (getenv("SIMLIB_PROFILE") != NULL || getenv("SIMLIB_PERF") != NULL)
+    simulation_run_start_profile(new_simulation_run);
+  if (getenv("SIMLIB_METRICS") != NULL)
+    metrics_start(new_simulation_run);
+  if (getenv("SIMLIB_TRACE") != NULL)
+    trace_start(new_simulation_run);
   return new_simulation_run;
 }
 
@@ -83,7 +282,7 @@ Clock_Ptr clock_new (void)
 {
   Clock_Ptr new_clock;
 
-  new_clock = (Clock_Ptr) xmalloc(sizeof(Clock));
+  new_clock = (Clock_Ptr) xmalloc_named(sizeof(Clock), "clock");
   new_clock->time = 0.0;
   return new_clock;
 }
@@ -146,7 +345,15 @@ simulation_run_schedule_event(Simulation_Run_Ptr simulation_run,
 
   double current_time;
   Eventlist_Ptr event_list;
-  static long int event_id = 1;
+  Profile_Ptr profile = simulation_run->profile;
+  unsigned long long start_ticks = 0, counters[PROFILE_COUNTERS];
+  int depth = 0, counting = 0;
+
+  if (UNLIKELY(profile != NULL) &&
+      profile->schedules++ % PROFILE_SAMPLE_PERIOD == 0) {
+    counting = profile_counters_begin(profile, counters);
+    start_ticks = profile_ticks();
+  }
 
   current_time = simulation_run_get_time(simulation_run);
   event_list = simulation_run_get_eventlist(simulation_run);
@@ -164,56 +371,83 @@ simulation_run_schedule_event(Simulation_Run_Ptr simulation_run,
     exit(1);
   }
 
-  new_container = (Event_Container_Ptr) xmalloc(sizeof(Event_Container));
+  new_container = (Event_Container_Ptr)
+    xmalloc_named(sizeof(Event_Container), "event container");
   new_container->occurrence_time = new_event_time;
   new_container->event = new_event;
   new_container->next_container = NULL;
   new_container->previous_container = NULL;
-  new_container->event_id = event_id;
+  new_container->event_id = next_event_id;
 
   if (event_list->size == 0) {
     /* The list is empty. */
     event_list->front_ptr = new_container;
     event_list->back_ptr = new_container;
-    event_list->size++;
-    return event_id++;
-  }
-
-  if (event_list->front_ptr->occurrence_time > new_event_time) {
+  } else if (event_list->front_ptr->occurrence_time > new_event_time) {
     /* Add to front of the list. */
     event_list->front_ptr->previous_container = new_container;
     new_container->next_container = event_list->front_ptr;
     event_list->front_ptr = new_container;
-
-    event_list->size++;
-    return event_id++;
-  }
-
-  if (event_list->back_ptr->occurrence_time <= new_event_time) {
+  } else if (event_list->back_ptr->occurrence_time <= new_event_time) {
     /* Add to the back of the list. */
     event_list->back_ptr->next_container = new_container;
     new_container->previous_container = event_list->back_ptr;
     event_list->back_ptr = new_container;
+  } else {
+    /* Add to the middle of the list. */
+    current_container = event_list->front_ptr;
+    next_container = event_list->front_ptr->next_container;
 
-    event_list->size++;
-    return event_id++;
+    while(next_container->occurrence_time <= new_event_time) {
+      current_container = next_container;
+      next_container = current_container->next_container;
+    }
+    current_container->next_container = new_container;
+    new_container->previous_container = current_container;
+    next_container->previous_container = new_container;
+    new_container->next_container = next_container;
   }
+  event_list->size++;
 
-  /* Add to the middle of the list. */
-  current_container = event_list->front_ptr;
-  next_container = event_list->front_ptr->next_container;
-
-  while(next_container->occurrence_time <= new_event_time) {
-    current_container = next_container;
-    next_container = current_container->next_container;
+  if (UNLIKELY(profile != NULL)) {
+    /* Only middle insertions walk the list, so only they have a depth. */
+    if (new_container->previous_container != NULL &&
+	new_container->next_container != NULL)
+      for (current_container = new_container->previous_container;
+	   current_container != NULL;
+	   current_container = current_container->previous_container)
+	depth++;
+    if (event_list->size > profile->max_list_size)
+      profile->max_list_size = event_list->size;
+    profile->insertion_depth[profile_bin(depth)]++;
+    profile->insertion_depth_sum += depth;
+    if (start_ticks != 0) {
+      profile->schedule_ticks += profile_elapsed(profile, start_ticks);
+      profile->schedule_samples++;
+    }
+    if (counting)
+      profile_counters_end(profile, &profile->schedule_counters, counters);
   }
-  current_container->next_container = new_container;
-  new_container->previous_container = current_container;
-  next_container->previous_container = new_container;
-  new_container->next_container = next_container;
+  if (UNLIKELY(simulation_run->trace != NULL) && simulation_run->trace->sampled)
+    trace_record(simulation_run->trace, TRACE_SCHEDULE, current_time,
+		 &new_event, next_event_id, new_event_time, event_list->size);
+  return next_event_id++;
+}
 
-  event_list->size++;
-  return event_id++;
+/*
+ * Get and set the id that the next scheduled event will be given.
+ */
+
+long int
+simulation_run_get_next_event_id(void)
+{
+  return next_event_id;
+}
+
+void
+simulation_run_set_next_event_id(long int event_id)
+{
+  next_event_id = event_id;
 }
 
 /*
@@ -232,6 +466,12 @@ simulation_run_deschedule_event(Simulation_Run_Ptr simulation_run,
   void * content_ptr = NULL;
 
   Eventlist_Ptr event_list;
+  Profile_Ptr profile = simulation_run->profile;
+  unsigned long long start_ticks = 0;
+
+  if (UNLIKELY(profile != NULL) &&
+      profile->deschedules++ % PROFILE_SAMPLE_PERIOD == 0)
+    start_ticks = profile_ticks();
 
   event_list = simulation_run_get_eventlist(simulation_run);
 
@@ -269,13 +509,26 @@ simulation_run_deschedule_event(Simulation_Run_Ptr simulation_run,
       TRACE(event_print_type(found_container->event);)
       TRACE(printf("descheduled\n");)
 
-      free((void*) found_container);
       event_list->size--;
+      if (simulation_run->trace != NULL && simulation_run->trace->sampled)
+	trace_record(simulation_run->trace, TRACE_DESCHEDULE,
+		     simulation_run_get_time(simulation_run),
+		     &found_container->event, event_id,
+		     found_container->occurrence_time, event_list->size);
+      xfree((void*) found_container);
       break;
     }
     current_container = current_container->next_container;
 
   }
+
+  if (UNLIKELY(profile != NULL)) {
+    profile->deschedule_depth_sum += i;
+    if (start_ticks != 0) {
+      profile->deschedule_ticks += profile_elapsed(profile, start_ticks);
+      profile->deschedule_samples++;
+    }
+  }
   return content_ptr;
 }
 
@@ -322,17 +575,70 @@ void
 simulation_run_execute_event(Simulation_Run_Ptr simulation_run)
 {
   Event_Container_Ptr current_container;
+  Profile_Ptr profile = simulation_run->profile;
+  Profile_Event_Type_Ptr type;
+  unsigned long long start_ticks = 0, counters[PROFILE_COUNTERS];
+  int counting = 0;
+
+  active_profile = profile;
+  if (UNLIKELY(profile != NULL)) {
+    profile_event_list_size(profile, simulation_run->eventlist->size);
+    if ((profile->events - 1) % PROFILE_SAMPLE_PERIOD == 0) {
+      counting = profile_counters_begin(profile, counters);
+      start_ticks = profile_ticks();
+    }
+  }
 
   current_container = simulation_run_get_event(simulation_run);
   simulation_run_set_time(simulation_run, 
 			  current_container->occurrence_time);
 
+  if (UNLIKELY(simulation_run->trace != NULL)) {
+    Trace_Ptr trace = simulation_run->trace;
+
+    if ((trace->sampled = (--trace->countdown <= 0)))
+      trace->countdown = trace->sample;
+    if (trace->state == TRACE_ARMED &&
+	current_container->occurrence_time >= trace->trigger_time)
+      simulation_run_trace_trigger(simulation_run);
+    if (trace->sampled)
+      trace_record(trace, TRACE_EXECUTE, current_container->occurrence_time,
+		   &current_container->event, current_container->event_id,
+		   current_container->occurrence_time,
+		   simulation_run->eventlist->size);
+  }
+
+  if (UNLIKELY(simulation_run->metrics != NULL)) {
+    METRICS_STORE(simulation_run->metrics->events,
+		  simulation_run->metrics->events + 1);
+    METRICS_STORE(simulation_run->metrics->simulation_time,
+		  current_container->occurrence_time);
+  }
+
+  if (UNLIKELY(start_ticks != 0)) {
+    profile->pop_ticks += profile_elapsed(profile, start_ticks);
+    profile->pop_samples++;
+  }
+  if (counting) profile_counters_end(profile, &profile->pop_counters, counters);
+
   TRACE(printf("\n");)
   TRACE(event_print_type(current_container->event);)
   TRACE(printf("occurring at %.3f\n", simulation_run_get_time(simulation_run));)
 
-  (*(current_container->event.function))(simulation_run,
-			current_container->event.attachment);
+  if (UNLIKELY(profile != NULL) &&
+      (type = profile_event_type(profile, &current_container->event))->count++
+      % PROFILE_SAMPLE_PERIOD == 0) {
+    counting = profile_counters_begin(profile, counters);
+    start_ticks = profile_ticks();
+    (*(current_container->event.function))(simulation_run,
+			  current_container->event.attachment);
+    type->ticks += profile_elapsed(profile, start_ticks);
+    type->samples++;
+    if (counting) profile_counters_end(profile, &type->counters, counters);
+  } else {
+    (*(current_container->event.function))(simulation_run,
+			  current_container->event.attachment);
+  }
   xfree(current_container);
 }
 
@@ -352,6 +658,20 @@ simulation_run_free_memory(Simulation_Run_Ptr this_simulation_run)
     xfree((void*) simulation_run_get_event(this_simulation_run));
   }
 
+  if (this_simulation_run->profile != NULL) {
+    simulation_run_print_profile(this_simulation_run);
+    if (active_profile == this_simulation_run->profile) active_profile = NULL;
+    profile_close_counters(this_simulation_run->profile);
+    xfree(this_simulation_run->profile);
+  }
+
+  if (this_simulation_run->metrics != NULL) {
+    METRICS_STORE(this_simulation_run->metrics->state, METRICS_FINISHED);
+    metrics_run = NULL;
+  }
+
+  if (this_simulation_run->trace != NULL) trace_finish(this_simulation_run->trace);
+
   /* Clean up the simulation_run. */
   xfree(this_simulation_run->eventlist);
   xfree(this_simulation_run->clock);
@@ -370,7 +690,8 @@ eventlist_new(void)
 {
   Eventlist_Ptr new_event_list;
 
-  new_event_list = (Eventlist_Ptr) xmalloc(sizeof(Eventlist));
+  new_event_list = (Eventlist_Ptr) xmalloc_named(sizeof(Eventlist),
+						  "event list");
 
   new_event_list->front_ptr = NULL;
   new_event_list->back_ptr = NULL;
@@ -402,169 +723,1615 @@ event_print_type(Event event)
 
 #endif /* TRACE_ON */
 
+/******************************************************************************/
+
 /*
- * FIFO queue functions
+ * Profiling functions.
  *
- * Make a new (empty) FIFO queue. This will return a pointer to the created
- * Fifoqueue. The FIFO queue is a singly linked list.
+ * Read the CPU time stamp counter, or the monotonic clock in ns where there
+ * is none.
  */
 
-Fifoqueue_Ptr
-fifoqueue_new(void)
+static double
+profile_seconds(void)
 {
-  Fifoqueue_Ptr queue_id;
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+#endif
+}
 
-  queue_id = (Fifoqueue_Ptr) xmalloc(sizeof(Fifoqueue));
-  queue_id->size = 0;
-  queue_id->front_ptr = NULL;
-  queue_id->back_ptr  = NULL;
-  return queue_id;
+static unsigned long long
+profile_ticks(void)
+{
+#ifdef PROFILE_TSC
+  return (unsigned long long) __rdtsc();
+#else
+  return (unsigned long long) (1e9 * profile_seconds());
+#endif
 }
 
 /*
- * Put something into a FIFO queue. Whatever it is should be cast to a void
- * pointer.
+ * The ticks since start_ticks, less the cost of reading the counter.
  */
 
-void
-fifoqueue_put(Fifoqueue_Ptr queue_ptr, void * content_ptr)
+static unsigned long long
+profile_elapsed(Profile_Ptr profile, unsigned long long start_ticks)
 {
-  Queue_Container_Ptr queue_container_ptr;
+  unsigned long long ticks = profile_ticks() - start_ticks;
 
-  queue_container_ptr = (Queue_Container_Ptr) xmalloc(sizeof(Queue_Container));
-  queue_container_ptr->content_ptr = content_ptr;
-  queue_container_ptr->next_ptr = NULL;
+  return (ticks > profile->tick_overhead) ? ticks - profile->tick_overhead : 0;
+}
 
-  if (queue_ptr->size == 0) {
-    queue_ptr->front_ptr = queue_container_ptr;
-    queue_ptr->back_ptr =  queue_container_ptr;
-  }
-  else {
-    queue_ptr->back_ptr->next_ptr = queue_container_ptr;
-    queue_ptr->back_ptr = queue_container_ptr;
+static int
+profile_bin(long int n)
+{
+  int bin = 0;
+
+  while (n > 0 && bin < PROFILE_BINS - 1) {
+    n >>= 1;
+    bin++;
   }
-  queue_ptr->size++;
+  return bin;
+}
+
+static void
+profile_event_list_size(Profile_Ptr profile, int size)
+{
+  profile->events++;
+  profile->list_size[profile_bin(size)]++;
+  profile->list_size_sum += size;
+  if (size > profile->max_list_size) profile->max_list_size = size;
 }
 
 /*
- * Take something out of a FIFO queue. Whatever it is should be cast to a void
- * pointer.
+ * Find the entry of an event type by its function. There are only a few, so
+ * a linear search of the table is the fastest.
  */
 
-void *
-fifoqueue_get(Fifoqueue_Ptr queue_ptr)
+static Profile_Event_Type_Ptr
+profile_event_type(Profile_Ptr profile, Event_Ptr event)
 {
-  Queue_Container_Ptr removed_container_ptr;
-  void* content_ptr;
+  Profile_Event_Type_Ptr type;
+  int i;
 
-  if (queue_ptr->size > 0) {
-    removed_container_ptr = queue_ptr->front_ptr;
-    queue_ptr->front_ptr = removed_container_ptr->next_ptr;
-    content_ptr = removed_container_ptr->content_ptr;
-    free((char*) removed_container_ptr);
+  for (i=0; i<profile->number_of_event_types; i++)
+    if (profile->event_types[i].function == event->function)
+      return profile->event_types + i;
 
-    if(queue_ptr->size == 1) queue_ptr->back_ptr = NULL;
-    queue_ptr->size--;
-  }
-  else {
-    content_ptr = NULL;
-  }
-  return content_ptr;
+  if (i == PROFILE_MAX_EVENT_TYPES) i--;  /* lump the rest together */
+  else profile->number_of_event_types++;
+
+  type = profile->event_types + i;
+  type->function = event->function;
+  type->description = (i == PROFILE_MAX_EVENT_TYPES - 1) ?
+    "(other event types)" : event->description;
+  return type;
 }
 
 /*
- * Get the number of objects currently in the Fifoqueue.
+ * Time every PROFILE_SAMPLE_PERIOD-th draw of the generators, counting only
+ * the outermost of nested calls (e.g., uniform_generator in
+ * exponential_generator).
  */
 
-int
-fifoqueue_size(Fifoqueue_Ptr queue_ptr)
+static unsigned long long
+profile_random_begin(void)
 {
-  return queue_ptr->size;
-}
+  Profile_Ptr profile = active_profile;
 
-/*
- * Get a pointer to the object at the front of the Fifoqueue.
- */
+  if (profile == NULL || profile->random_depth++ > 0) return 0;
+  if (profile->random_draws++ % PROFILE_SAMPLE_PERIOD != 0) return 0;
+  return profile_ticks();
+}
 
-void*
-fifoqueue_see_front(Fifoqueue_Ptr queue_ptr)
+static void
+profile_random_end(unsigned long long start_ticks)
 {
-  return queue_ptr->front_ptr->content_ptr;
+  Profile_Ptr profile = active_profile;
+
+  if (profile == NULL) return;
+  profile->random_depth--;
+  if (start_ticks != 0) {
+    profile->random_ticks += profile_elapsed(profile, start_ticks);
+    profile->random_samples++;
+  }
 }
 
 /*
- * Server functions.
- *
- * Create and return a pointer to an empty server. The server is marked FREE.
+ * The hardware performance counters, opened as one perf_event_open group so
+ * that a single read gives them all.
  */
 
-Server_Ptr
-server_new(void)
+#ifdef __linux__
+
+static const struct
 {
-  Server_Ptr server_ptr;
+  const char * name;
+  unsigned type;
+  unsigned long long config;
+} profile_counter_events[PROFILE_COUNTERS] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"L1d misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+   (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+static int
+profile_read_counters(Profile_Ptr profile, unsigned long long * values)
+{
+  unsigned long long buffer[PROFILE_COUNTERS + 1];
+  ssize_t size = (profile->number_of_counters + 1) * sizeof(buffer[0]);
+  int i;
 
-  server_ptr = (Server_Ptr) xmalloc(sizeof(Server));
-  server_ptr->customer_in_service = NULL;
-  server_ptr->state = FREE;
-  return server_ptr;
+  if (read(profile->counter_fd, buffer, size) != size) return 0;
+  for (i=0; i<PROFILE_COUNTERS; i++)
+    values[i] = (profile->counter_slot[i] < 0) ? 0 :
+      buffer[1 + profile->counter_slot[i]];
+  return 1;
 }
 
-/*
- * Pass a server pointer and an object pointer to place the object in the
- * server. The server is marked BUSY.
- */
+#endif /* __linux__ */
 
-void
-server_put(Server_Ptr server, void* content_ptr)
+static void
+profile_open_counters(Profile_Ptr profile)
 {
-  if (server_state(server) == BUSY) {
-      printf("Error: Cannot put into busy server.\n");
-      exit(1);
+  int i;
+
+  profile->counter_fd = -1;
+  for (i=0; i<PROFILE_COUNTERS; i++) {
+    profile->counter_fds[i] = -1;
+    profile->counter_slot[i] = -1;
+  }
+
+#ifdef __linux__
+  {
+    struct perf_event_attr attributes;
+    unsigned long long before[PROFILE_COUNTERS], after[PROFILE_COUNTERS];
+    int fd, error = 0, k;
+
+    for (i=0; i<PROFILE_COUNTERS; i++) {
+      memset(&attributes, 0, sizeof(attributes));
+      attributes.size = sizeof(attributes);
+      attributes.type = profile_counter_events[i].type;
+      attributes.config = profile_counter_events[i].config;
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv = 1;
+      attributes.read_format = PERF_FORMAT_GROUP;
+
+      fd = (int) syscall(SYS_perf_event_open, &attributes, 0, -1,
+			 profile->counter_fd, 0);
+      if (fd < 0) {
+	error = errno;
+	continue;
+      }
+      if (profile->counter_fd < 0) profile->counter_fd = fd;
+      profile->counter_fds[i] = fd;
+      profile->counter_slot[i] = profile->number_of_counters++;
     }
 
-  server->customer_in_service = content_ptr;
-  server->state = BUSY;
+    if (profile->counter_fd < 0) {
+      fprintf(stderr, "Profile: no hardware counters (perf_event_open: %s)\n",
+	      strerror(error));
+      return;
+    }
+
+    /* What reading the counters itself adds to them. */
+    for (i=0; i<PROFILE_COUNTERS; i++) profile->counter_overhead[i] = ~0ULL;
+    for (k=0; k<16; k++) {
+      if (!profile_read_counters(profile, before) ||
+	  !profile_read_counters(profile, after))
+	break;
+      for (i=0; i<PROFILE_COUNTERS; i++)
+	if (after[i] - before[i] < profile->counter_overhead[i])
+	  profile->counter_overhead[i] = after[i] - before[i];
+    }
+    if (k < 16) {
+      fprintf(stderr, "Profile: could not read the hardware counters\n");
+      profile_close_counters(profile);
+    }
+  }
+#else
+  fprintf(stderr, "Profile: the hardware counters need Linux (perf_event_open)\n");
+#endif
+}
+
+static void
+profile_close_counters(Profile_Ptr profile)
+{
+#ifdef __linux__
+  int i;
+
+  /* The group leader goes last. */
+  for (i=PROFILE_COUNTERS-1; i>=0; i--)
+    if (profile->counter_fds[i] >= 0) close(profile->counter_fds[i]);
+#endif
+  profile->counter_fd = -1;
+  profile->number_of_counters = 0;
 }
 
 /*
- * Remove whatever is in the server. The simulation_run will exit if this is
- * called when the server is FREE. So the server state should be tested first to
- * be sure.
+ * Start counting a phase, unless the counters are off or already counting an
+ * enclosing one. Returns whether it did.
  */
 
-void *
-server_get(Server_Ptr server)
+static int
+profile_counters_begin(Profile_Ptr profile, unsigned long long * values)
 {
-  void *entry;
+#ifdef __linux__
+  if (profile->counter_fd < 0 || profile->measuring) return 0;
+  if (!profile_read_counters(profile, values)) return 0;
+  profile->measuring = 1;
+  return 1;
+#else
+  return 0;
+#endif
+}
 
-  if (server_state(server) == FREE) {
-      printf("Error: Cannot get from free server.\n");
-      exit(1);
-    }
+static void
+profile_counters_end(Profile_Ptr profile, Profile_Counters_Ptr counters,
+		     unsigned long long * before)
+{
+#ifdef __linux__
+  unsigned long long after[PROFILE_COUNTERS], delta;
+  int i;
 
-  entry = server->customer_in_service;
-  server->customer_in_service = NULL;
-  server->state = FREE;
-  return entry;
+  profile->measuring = 0;
+  if (!profile_read_counters(profile, after)) return;
+  for (i=0; i<PROFILE_COUNTERS; i++) {
+    delta = after[i] - before[i];
+    counters->values[i] += (delta > profile->counter_overhead[i]) ?
+      delta - profile->counter_overhead[i] : 0;
+  }
+  counters->samples++;
+#endif
 }
 
 /*
- * Test if the server is FREE or BUSY.
+ * The metrics page of the process, created on first use. A forked child
+ * creates its own, leaving the mapping of its parent's alone.
  */
 
-Server_State
-server_state(Server_Ptr a_server)
+static Metrics_Page_Ptr
+metrics_open(void)
 {
-  return(a_server->state);
+#ifdef METRICS_SHARED_MEMORY
+  static int registered = 0;
+  void * page;
+  int fd;
+
+  if (metrics_page != NULL && metrics_pid == (long int) getpid())
+    return metrics_page;
+  metrics_page = NULL;
+  metrics_run = NULL;
+
+  sprintf(metrics_name, "%s%ld", METRICS_PREFIX, (long int) getpid());
+  fd = shm_open(metrics_name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Warning: Could not create metrics page %s.\n",
+	    metrics_name);
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(Metrics_Page)) != 0 ||
+      (page = mmap(NULL, sizeof(Metrics_Page), PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    fprintf(stderr, "Warning: Could not map metrics page %s.\n",
+	    metrics_name);
+    close(fd);
+    shm_unlink(metrics_name);
+    return NULL;
+  }
+  close(fd);
+
+  metrics_page = (Metrics_Page_Ptr) page;
+  metrics_pid = (long int) getpid();
+  metrics_page->version = METRICS_VERSION;
+  metrics_page->pid = metrics_pid;
+  METRICS_STORE(metrics_page->magic, METRICS_MAGIC);
+
+  if (!registered) {
+    atexit(simulation_run_metrics_close);
+    registered = 1;
+  }
+  return metrics_page;
+#else
+  fprintf(stderr, "Warning: Live metrics need POSIX shared memory.\n");
+  return NULL;
+#endif
 }
 
 /*
- * Random number generator functions.
+ * Publish the metrics of a new run on the page of the process, in place of
+ * those of the run before it.
  */
 
+static void
+metrics_start(Simulation_Run_Ptr simulation_run)
+{
+  Metrics_Page_Ptr page;
+  int i;
+
+  if ((page = metrics_open()) == NULL) return;
+  if (metrics_run != NULL) metrics_run->metrics = NULL;
+
+  METRICS_STORE(page->state, METRICS_IDLE);
+  METRICS_STORE(page->number_of_counters, 0);
+  METRICS_STORE(page->number_of_estimates, 0);
+  for (i=0; i<METRICS_LABEL_SIZE; i++) METRICS_STORE(page->label[i], '\0');
+  METRICS_STORE(page->runs, page->runs + 1);
+  METRICS_STORE(page->seed, metrics_seed);
+  METRICS_STORE(page->start_time, (double) time(NULL));
+  METRICS_STORE(page->events, 0);
+  METRICS_STORE(page->simulation_time, 0.0);
+  METRICS_STORE(page->progress, 0.0);
+  METRICS_STORE(page->state, METRICS_RUNNING);
+
+  simulation_run->metrics = page;
+  metrics_run = simulation_run;
+}
+
 /*
- * Functions for random streams, which permit multiple overlapping random number
- * generator streams (and seeds) at once.
+ * Copy a name into the page, a byte at a time.
+ */
+
+static void
+metrics_copy_name(char * to, const char * name, int size)
+{
+  int i;
+
+  for (i=0; i<size-1 && name[i] != '\0'; i++) METRICS_STORE(to[i], name[i]);
+  for (; i<size; i++) METRICS_STORE(to[i], '\0');
+}
+
+/*
+ * Add a counter or an estimate to the metrics of the run, returning its
+ * index, or -1 if the run is not publishing.
+ */
+
+int
+simulation_run_metrics_counter(Simulation_Run_Ptr simulation_run,
+			       const char * name)
+{
+  Metrics_Page_Ptr page = simulation_run->metrics;
+  int index;
+
+  if (page == NULL) return -1;
+  if ((index = page->number_of_counters) >= METRICS_MAX_COUNTERS) {
+    printf("Error: Too many metrics counters.\n");
+    exit(1);
+  }
+  metrics_copy_name(page->counters[index].name, name, METRICS_NAME_SIZE);
+  METRICS_STORE(page->counters[index].value, 0);
+  METRICS_STORE(page->number_of_counters, index + 1);
+  return index;
+}
+
+int
+simulation_run_metrics_estimate(Simulation_Run_Ptr simulation_run,
+				const char * name)
+{
+  Metrics_Page_Ptr page = simulation_run->metrics;
+  int index;
+
+  if (page == NULL) return -1;
+  if ((index = page->number_of_estimates) >= METRICS_MAX_ESTIMATES) {
+    printf("Error: Too many metrics estimates.\n");
+    exit(1);
+  }
+  metrics_copy_name(page->estimates[index].name, name, METRICS_NAME_SIZE);
+  METRICS_STORE(page->estimates[index].count, 0);
+  METRICS_STORE(page->estimates[index].sum, 0.0);
+  METRICS_STORE(page->estimates[index].sum_squares, 0.0);
+  METRICS_STORE(page->number_of_estimates, index + 1);
+  return index;
+}
+
+/*
+ * Describe the run on its metrics page, e.g., with its parameters.
+ */
+
+void
+simulation_run_metrics_label(Simulation_Run_Ptr simulation_run,
+			     const char * label)
+{
+  if (simulation_run->metrics != NULL)
+    metrics_copy_name(simulation_run->metrics->label, label,
+		      METRICS_LABEL_SIZE);
+}
+
+/*
+ * Remove the metrics page of the process. This is done at exit, and should
+ * be done before a forked child leaves with _exit.
+ */
+
+void
+simulation_run_metrics_close(void)
+{
+#ifdef METRICS_SHARED_MEMORY
+  if (metrics_page == NULL || metrics_pid != (long int) getpid()) return;
+  if (metrics_run != NULL) metrics_run->metrics = NULL;
+  munmap((void *) metrics_page, sizeof(Metrics_Page));
+  shm_unlink(metrics_name);
+  metrics_page = NULL;
+  metrics_run = NULL;
+#endif
+}
+
+/******************************************************************************/
+
+/*
+ * Binary event tracing (see simlib.h).
+ */
+
+#ifdef TRACE_THREADS
+#define TRACE_LOCK() pthread_mutex_lock(&trace_lock)
+#define TRACE_UNLOCK() pthread_mutex_unlock(&trace_lock)
+#else
+#define TRACE_LOCK()
+#define TRACE_UNLOCK()
+#endif
+
+/*
+ * Write a chunk to the trace file in one piece, its bytes in up to two
+ * parts.
+ */
+
+static void
+trace_write_chunk(unsigned kind, unsigned run, const void * first,
+		  size_t first_length, const void * second,
+		  size_t second_length)
+{
+  Trace_Chunk_Header header;
+
+  header.kind = kind;
+  header.run = run;
+  header.length = (uint32_t) (first_length + second_length);
+  header.reserved = 0;
+
+#ifdef TRACE_THREADS
+  flockfile(trace_file);
+#endif
+  fwrite(&header, sizeof(header), 1, trace_file);
+  if (first_length > 0) fwrite(first, 1, first_length, trace_file);
+  if (second_length > 0) fwrite(second, 1, second_length, trace_file);
+  fflush(trace_file);
+#ifdef TRACE_THREADS
+  funlockfile(trace_file);
+#endif
+}
+
+/*
+ * Write out the records of a trace from tail up to head, a segment at most
+ * per chunk.
+ */
+
+static void
+trace_write_records(Trace_Ptr trace, unsigned long long tail,
+		    unsigned long long head)
+{
+  size_t start, count, first;
+
+  while (tail < head) {
+    count = (head - tail > TRACE_SEGMENT) ? TRACE_SEGMENT : head - tail;
+    start = tail & (TRACE_RING_SIZE - 1);
+    first = (start + count > TRACE_RING_SIZE) ? TRACE_RING_SIZE - start : count;
+    trace_write_chunk(TRACE_CHUNK_RECORDS, trace->run, trace->records + start,
+		      first * sizeof(Trace_Record), trace->records,
+		      (count - first) * sizeof(Trace_Record));
+    tail += count;
+  }
+}
+
+#ifdef TRACE_THREADS
+
+/*
+ * The thread writing out the rings of the process, until it is closed.
+ */
+
+static void *
+trace_writer(void * unused)
+{
+  Trace_Ptr trace;
+  unsigned long long tail, head;
+
+  (void) unused;
+  pthread_mutex_lock(&trace_lock);
+  for (;;) {
+    for (trace = trace_list; trace != NULL; trace = trace->next)
+      if (trace->state != TRACE_ARMED && TRACE_READ(trace->head) != trace->tail)
+	break;
+
+    if (trace == NULL) {
+      if (trace_closing) break;
+      pthread_cond_wait(&trace_wake, &trace_lock);
+      continue;
+    }
+
+    trace->busy = 1;
+    tail = trace->tail;
+    head = TRACE_READ(trace->head);
+    pthread_mutex_unlock(&trace_lock);
+    trace_write_records(trace, tail, head);
+    pthread_mutex_lock(&trace_lock);
+    TRACE_PUBLISH(trace->tail, head);
+    trace->busy = 0;
+    pthread_cond_broadcast(&trace_written);
+  }
+  pthread_mutex_unlock(&trace_lock);
+  return NULL;
+}
+
+#endif /* TRACE_THREADS */
+
+/*
+ * Have the records of a trace written out, or write them out here without
+ * threads. With wait set, return only once they are all out.
+ */
+
+static void
+trace_write_out(Trace_Ptr trace, int wait)
+{
+#ifdef TRACE_THREADS
+  pthread_mutex_lock(&trace_lock);
+  pthread_cond_signal(&trace_wake);
+  while (wait && trace->state != TRACE_ARMED &&
+	 (trace->busy || TRACE_READ(trace->head) != trace->tail)) {
+    pthread_cond_signal(&trace_wake);
+    pthread_cond_wait(&trace_written, &trace_lock);
+  }
+  pthread_mutex_unlock(&trace_lock);
+#else
+  if (trace->state != TRACE_ARMED) {
+    trace_write_records(trace, trace->tail, trace->head);
+    trace->tail = trace->head;
+  }
+#endif
+}
+
+/*
+ * Wait for room in the ring of a trace.
+ */
+
+static void
+trace_wait(Trace_Ptr trace)
+{
+#ifdef TRACE_THREADS
+  pthread_mutex_lock(&trace_lock);
+  while (trace->head - TRACE_READ(trace->tail) >= TRACE_RING_SIZE) {
+    pthread_cond_signal(&trace_wake);
+    pthread_cond_wait(&trace_written, &trace_lock);
+  }
+  pthread_mutex_unlock(&trace_lock);
+#else
+  trace_write_out(trace, 1);
+#endif
+}
+
+/*
+ * Write out what the traces of the process have left, and close its trace
+ * file. This is done at exit, and should be done before a forked child
+ * leaves with _exit.
+ */
+
+void
+simulation_run_trace_close(void)
+{
+  Trace_Ptr trace;
+
+  if (trace_file == NULL || trace_pid != (long int) getpid()) return;
+
+  for (trace = trace_list; trace != NULL; trace = trace->next)
+    trace_write_out(trace, 1);
+
+#ifdef TRACE_THREADS
+  pthread_mutex_lock(&trace_lock);
+  trace_closing = 1;
+  pthread_cond_signal(&trace_wake);
+  pthread_mutex_unlock(&trace_lock);
+  pthread_join(trace_thread, NULL);
+#endif
+
+  fclose(trace_file);
+  trace_file = NULL;
+}
+
+/*
+ * Open the trace file of the process, unless it is open, and start its
+ * writer thread. A forked child leaves its parent's file and starts its
+ * own. Returns 0 if the file cannot be opened.
+ */
+
+static int
+trace_open(void)
+{
+  static int registered = 0;
+  Trace_File_Header header;
+  const char * path = getenv("SIMLIB_TRACE");
+  char name[FILENAME_MAX];
+  size_t length = 0;
+  long int pid = (long int) getpid();
+#ifdef TRACE_THREADS
+  int fd;
+#endif
+
+  if (trace_file != NULL && trace_pid == pid) return 1;
+  trace_file = NULL;
+  trace_list = NULL;
+  trace_runs = 0;
+  trace_number_of_types = 0;
+
+  /* The name, with each %p replaced by the process id. */
+  for (; *path != '\0' && length < FILENAME_MAX - 24; path++) {
+    if (path[0] == '%' && path[1] == 'p') {
+      length += sprintf(name + length, "%ld", pid);
+      path++;
+    } else {
+      name[length++] = *path;
+    }
+  }
+  name[length] = '\0';
+
+#ifdef TRACE_THREADS
+  /*
+   * Another process still writing the file keeps it locked, and then this
+   * one adds its id to the name.
+   */
+  if ((fd = open(name, O_WRONLY | O_CREAT, 0644)) >= 0 &&
+      lockf(fd, F_TLOCK, 0) != 0) {
+    close(fd);
+    sprintf(name + length, ".%ld", pid);
+    if ((fd = open(name, O_WRONLY | O_CREAT, 0644)) >= 0 &&
+	lockf(fd, F_TLOCK, 0) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd < 0 || ftruncate(fd, 0) != 0 ||
+      (trace_file = fdopen(fd, "wb")) == NULL) {
+    if (fd >= 0) close(fd);
+    fprintf(stderr, "Warning: Could not open trace file %s.\n", name);
+    return 0;
+  }
+#else
+  if ((trace_file = fopen(name, "wb")) == NULL) {
+    fprintf(stderr, "Warning: Could not open trace file %s.\n", name);
+    return 0;
+  }
+#endif
+  trace_pid = pid;
+
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(Trace_Record);
+  fwrite(&header, sizeof(header), 1, trace_file);
+  fflush(trace_file);
+
+#ifdef TRACE_THREADS
+  trace_closing = 0;
+  pthread_mutex_init(&trace_lock, NULL);
+  pthread_cond_init(&trace_wake, NULL);
+  pthread_cond_init(&trace_written, NULL);
+  if (pthread_create(&trace_thread, NULL, trace_writer, NULL) != 0) {
+    printf("Error: Could not start the trace writer.\n");
+    exit(1);
+  }
+#endif
+
+  if (!registered) {
+    atexit(simulation_run_trace_close);
+    registered = 1;
+  }
+  return 1;
+}
+
+/*
+ * Trace a new run, as set in the environment.
+ */
+
+static void
+trace_start(Simulation_Run_Ptr simulation_run)
+{
+  Trace_Ptr trace;
+  const char * value;
+
+  if (!trace_open()) return;
+
+  trace = (Trace_Ptr) xmalloc_named(sizeof(Trace), "trace");
+  memset(trace, 0, sizeof(Trace));
+  trace->records = (Trace_Record_Ptr)
+    xmalloc_named(TRACE_RING_SIZE * sizeof(Trace_Record), "trace ring");
+  trace->run = ++trace_runs;
+
+  trace->sample = 1;
+  if ((value = getenv("SIMLIB_TRACE_SAMPLE")) != NULL &&
+      (trace->sample = atol(value)) < 1)
+    trace->sample = 1;
+  trace->countdown = 1;
+  trace->sampled = 1;
+
+  if ((value = getenv("SIMLIB_TRACE_WINDOW")) != NULL &&
+      (trace->window = atol(value)) > 0) {
+    if (trace->window > TRACE_RING_SIZE/2 - 1)
+      trace->window = TRACE_RING_SIZE/2 - 1;
+    trace->state = TRACE_ARMED;
+  } else {
+    trace->window = 0;
+    trace->state = TRACE_STREAMING;
+  }
+  trace->trigger_time = HUGE_VAL;
+  if ((value = getenv("SIMLIB_TRACE_TRIGGER")) != NULL)
+    trace->trigger_time = atof(value);
+
+  TRACE_LOCK();
+  trace->next = trace_list;
+  trace_list = trace;
+  TRACE_UNLOCK();
+
+  simulation_run->trace = trace;
+}
+
+/*
+ * The id of the type of an event in the trace file (from 1), naming it in
+ * the file when it is new. Past TRACE_MAX_TYPES types it is 0.
+ */
+
+static unsigned
+trace_type(Trace_Ptr trace, Event_Ptr event)
+{
+  uint32_t id;
+  int i;
+
+  for (i=0; i<trace->number_of_cached_types; i++)
+    if (trace->cached_functions[i] == event->function)
+      return trace->cached_types[i];
+
+  TRACE_LOCK();
+  for (i=0; i<trace_number_of_types; i++)
+    if (trace_functions[i] == event->function) break;
+  if (i == trace_number_of_types && i < TRACE_MAX_TYPES) {
+    trace_functions[trace_number_of_types++] = event->function;
+    id = i + 1;
+    trace_write_chunk(TRACE_CHUNK_TYPE, 0, &id, sizeof(id),
+		      event->description != NULL ? event->description : "",
+		      event->description != NULL ? strlen(event->description) : 0);
+  }
+  TRACE_UNLOCK();
+
+  id = (i < TRACE_MAX_TYPES) ? i + 1 : 0;
+  if (trace->number_of_cached_types < TRACE_CACHED_TYPES) {
+    trace->cached_functions[trace->number_of_cached_types] = event->function;
+    trace->cached_types[trace->number_of_cached_types++] = id;
+  }
+  return id;
+}
+
+/*
+ * Add a record to the ring of a trace. The event is NULL for a trigger.
+ */
+
+static void
+trace_record(Trace_Ptr trace, int operation, double time, Event_Ptr event,
+	     long int event_id, double event_time, long int list_size)
+{
+  Trace_Record_Ptr record;
+
+  if (trace->state == TRACE_STOPPED) return;
+  if (trace->state != TRACE_ARMED &&
+      trace->head - TRACE_READ(trace->tail) >= TRACE_RING_SIZE)
+    trace_wait(trace);
+
+  record = trace->records + (trace->head & (TRACE_RING_SIZE - 1));
+  record->time = time;
+  record->event_time = event_time;
+  record->event_id = event_id;
+  record->attachment = (event != NULL) ? (uint64_t) (size_t) event->attachment : 0;
+  record->event_type = (event != NULL) ? trace_type(trace, event) : 0;
+  record->list_size = (uint32_t) list_size;
+  record->operation = (uint32_t) operation;
+  record->reserved = 0;
+  TRACE_PUBLISH(trace->head, trace->head + 1);
+
+  if (trace->state == TRACE_CAPTURING && trace->head >= trace->stop) {
+    TRACE_LOCK();
+    trace->state = TRACE_STOPPED;
+    TRACE_UNLOCK();
+    trace_write_out(trace, 0);
+  } else if (trace->state != TRACE_ARMED &&
+	     (trace->head & (TRACE_SEGMENT - 1)) == 0) {
+    trace_write_out(trace, 0);
+  }
+}
+
+/*
+ * Mark the trigger in the trace of a run. A trace waiting for it starts
+ * capturing its window: the records before the trigger are kept and as
+ * many after it are made.
+ */
+
+void
+simulation_run_trace_trigger(Simulation_Run_Ptr simulation_run)
+{
+  Trace_Ptr trace = simulation_run->trace;
+
+  if (trace == NULL ||
+      (trace->state != TRACE_ARMED && trace->state != TRACE_STREAMING))
+    return;
+
+  if (trace->state == TRACE_ARMED) {
+    TRACE_LOCK();
+    trace->tail = (trace->head > (unsigned long long) trace->window) ?
+      trace->head - trace->window : 0;
+    trace->stop = trace->head + trace->window + 1;
+    trace->state = TRACE_CAPTURING;
+    TRACE_UNLOCK();
+  }
+  trace_record(trace, TRACE_TRIGGER, simulation_run_get_time(simulation_run),
+	       NULL, 0, simulation_run_get_time(simulation_run),
+	       simulation_run->eventlist->size);
+}
+
+/*
+ * Write out the rest of a run's trace and free it.
+ */
+
+static void
+trace_finish(Trace_Ptr trace)
+{
+  Trace_Ptr * link;
+
+  trace_write_out(trace, 1);
+
+  TRACE_LOCK();
+  for (link = &trace_list; *link != NULL; link = &(*link)->next) {
+    if (*link == trace) {
+      *link = trace->next;
+      break;
+    }
+  }
+  TRACE_UNLOCK();
+
+  xfree((void *) trace->records);
+  xfree((void *) trace);
+}
+
+/*
+ * Turn profiling on for a simulation_run, starting from zero.
+ */
+
+void
+simulation_run_start_profile(Simulation_Run_Ptr simulation_run)
+{
+  Profile_Ptr profile;
+  Allocation_Kind_Ptr kind;
+  unsigned long long ticks, overhead = ~0ULL;
+  int i;
+
+  if (simulation_run->profile == NULL)
+    simulation_run->profile =
+      (Profile_Ptr) xmalloc_named(sizeof(Profile), "profile");
+  else
+    profile_close_counters(simulation_run->profile);
+  profile = simulation_run->profile;
+  memset(profile, 0, sizeof(Profile));
+
+  if (getenv("SIMLIB_PERF") != NULL) {
+    profile_open_counters(profile);
+  } else {
+    profile->counter_fd = -1;
+    for (i=0; i<PROFILE_COUNTERS; i++) profile->counter_fds[i] = -1;
+  }
+
+  for (i=0; i<64; i++) {
+    ticks = profile_ticks();
+    ticks = profile_ticks() - ticks;
+    if (ticks < overhead) overhead = ticks;
+  }
+  profile->tick_overhead = overhead;
+  /* Count the allocations and the peaks from here. */
+  for (i=0; i<ALLOCATION_MAX_KINDS; i++) {
+    kind = allocation_stats.kinds + i;
+    profile->allocations[i] = kind->allocations;
+    profile->frees[i] = kind->frees;
+    kind->peak_bytes = kind->live_bytes;
+  }
+  allocation_stats.peak_bytes = allocation_stats.live_bytes;
+  profile->first_queue = number_of_fifoqueues + 1;
+
+  profile->start_seconds = profile_seconds();
+  profile->start_ticks = profile_ticks();
+  active_profile = profile;
+}
+
+/*
+ * The estimated seconds of count calls, of which samples took ticks.
+ */
+
+static double
+profile_estimate(unsigned long long ticks, long int samples, long int count,
+		 double ticks_per_second)
+{
+  if (samples == 0) return 0.0;
+  return (double) ticks / samples * count / ticks_per_second;
+}
+
+static void
+profile_print_histogram(long int * bins, long int total)
+{
+  int bin;
+
+  for (bin=0; bin<PROFILE_BINS; bin++) {
+    if (bins[bin] == 0) continue;
+    if (bin <= 1)
+      fprintf(stderr, " %d:", bin);
+    else
+      fprintf(stderr, " %ld-%ld:", 1L << (bin - 1), (1L << bin) - 1);
+    fprintf(stderr, "%.1f%%", 100.0 * bins[bin] / total);
+  }
+  fprintf(stderr, "\n");
+}
+
+/*
+ * Count a queue of the run, keeping the longest peak lengths.
+ */
+
+static void
+profile_note_queue(Profile_Ptr profile, Fifoqueue_Ptr queue)
+{
+  int k;
+
+  if (queue->number < profile->first_queue) return;
+  profile->number_of_queues++;
+
+  for (k=profile->number_of_top_queues;
+       k>0 && profile->top_queue_sizes[k-1] < queue->max_size; k--) {
+    if (k < PROFILE_TOP_QUEUES) {
+      profile->top_queues[k] = profile->top_queues[k-1];
+      profile->top_queue_sizes[k] = profile->top_queue_sizes[k-1];
+    }
+  }
+  if (k < PROFILE_TOP_QUEUES) {
+    profile->top_queues[k] = queue->number;
+    profile->top_queue_sizes[k] = queue->max_size;
+    if (profile->number_of_top_queues < PROFILE_TOP_QUEUES)
+      profile->number_of_top_queues++;
+  }
+}
+
+/*
+ * The allocations of the run by kind, and the peak lengths of its queues.
+ */
+
+static void
+profile_print_memory(Profile_Ptr profile)
+{
+  Allocation_Kind_Ptr kind;
+  Fifoqueue_Ptr queue;
+  Profile queues;
+  long int allocations = 0, frees = 0;
+  int i, k;
+  char name[40];
+
+  if (!allocation_counting) {
+    fprintf(stderr, "  Memory: not counted, as profiling was not on from "
+	    "the first allocation\n");
+    return;
+  }
+
+  for (i=0; i<ALLOCATION_MAX_KINDS; i++) {
+    allocations += allocation_stats.kinds[i].allocations - profile->allocations[i];
+    frees += allocation_stats.kinds[i].frees - profile->frees[i];
+  }
+  fprintf(stderr, "  Memory: %ld allocations, %ld frees, %.1f kB live, "
+	  "peak %.1f kB\n", allocations, frees,
+	  allocation_stats.live_bytes / 1024.0,
+	  allocation_stats.peak_bytes / 1024.0);
+
+  fprintf(stderr, "  %-36s %12s %12s %10s %10s\n", "Kind", "Allocations",
+	  "Frees", "Live kB", "Peak kB");
+  for (i=0; i<ALLOCATION_MAX_KINDS; i++) {
+    kind = allocation_stats.kinds + i;
+    if (kind->allocations == profile->allocations[i] && kind->live_bytes == 0)
+      continue;
+    if (kind->name != NULL)
+      sprintf(name, "%.39s", kind->name);
+    else
+      sprintf(name, "%u-byte blocks", kind->size);
+    fprintf(stderr, "  %-36s %12ld %12ld %10.1f %10.1f\n", name,
+	    kind->allocations - profile->allocations[i],
+	    kind->frees - profile->frees[i], kind->live_bytes / 1024.0,
+	    kind->peak_bytes / 1024.0);
+  }
+
+  /*
+   * The queues freed during the run are already noted; add the live ones to
+   * a copy, so that the report can be printed again.
+   */
+  queues = *profile;
+  profile = &queues;
+  for (queue = fifoqueue_list; queue != NULL; queue = queue->next_queue)
+    profile_note_queue(profile, queue);
+
+  if (profile->number_of_queues > 0) {
+    fprintf(stderr, "  FIFO queues: %ld, peak lengths", profile->number_of_queues);
+    for (k=0; k<profile->number_of_top_queues; k++)
+      fprintf(stderr, "%s #%ld %d", (k == 0) ? "" : ",",
+	      profile->top_queues[k] - profile->first_queue + 1,
+	      profile->top_queue_sizes[k]);
+    fprintf(stderr, "%s\n", (profile->number_of_queues >
+			     profile->number_of_top_queues) ? ", ..." : "");
+  }
+}
+
+#ifdef __linux__
+
+static void
+profile_print_counters(Profile_Ptr profile, const char * phase,
+		       Profile_Counters_Ptr counters)
+{
+  int i;
+
+  if (counters->samples == 0) return;
+  fprintf(stderr, "  %-36.36s", phase);
+  for (i=0; i<PROFILE_COUNTERS; i++)
+    if (profile->counter_slot[i] >= 0)
+      fprintf(stderr, " %13.1f", (double) counters->values[i] / counters->samples);
+  if (profile->counter_slot[0] >= 0 && profile->counter_slot[1] >= 0)
+    fprintf(stderr, " %6.2f", (counters->values[0] > 0) ?
+	    (double) counters->values[1] / counters->values[0] : 0.0);
+  fprintf(stderr, "\n");
+}
+
+#endif /* __linux__ */
+
+/*
+ * Print the profile of a simulation_run so far to stderr.
+ */
+
+void
+simulation_run_print_profile(Simulation_Run_Ptr simulation_run)
+{
+  Profile_Ptr profile = simulation_run->profile;
+  Profile_Event_Type_Ptr type;
+  double seconds, ticks_per_second, handlers = 0.0, schedule, random, self;
+  double share, pop, list, other, biggest;
+  const char * bound;
+  int i;
+#ifdef __linux__
+  Profile_Counters dispatch;
+  char name[40];
+  int k;
+#endif
+
+  if (profile == NULL) return;
+
+  seconds = profile_seconds() - profile->start_seconds;
+  if (seconds <= 0.0) seconds = 1e-9;
+  ticks_per_second = (profile_ticks() - profile->start_ticks) / seconds;
+  if (ticks_per_second <= 0.0) ticks_per_second = 1e9;
+
+  fprintf(stderr, "Profile: %ld events in %.3f s (%.0f events/s), "
+	  "%.0f events per unit of simulated time\n", profile->events, seconds,
+	  profile->events / seconds,
+	  (simulation_run_get_time(simulation_run) > 0.0) ?
+	  profile->events / simulation_run_get_time(simulation_run) : 0.0);
+
+  fprintf(stderr, "  %-36s %12s %7s %10s %7s\n", "Event type", "Events",
+	  "Share", "ns/event", "Time");
+  for (i=0; i<profile->number_of_event_types; i++) {
+    type = profile->event_types + i;
+    share = profile_estimate(type->ticks, type->samples, type->count,
+			     ticks_per_second);
+    handlers += share;
+    fprintf(stderr, "  %-36.36s %12ld %6.1f%% %10.1f %6.1f%%\n",
+	    type->description, type->count, 100.0 * type->count / profile->events,
+	    (type->samples > 0) ? 1e9 * share / type->count : 0.0,
+	    100.0 * share / seconds);
+  }
+
+  /*
+   * Split the time. Most scheduling and random numbers happen inside the
+   * handlers, so they are taken out of the handlers' time. Taking events off
+   * the list is not, and the rest (the model's own loop) is other.
+   */
+  schedule = profile_estimate(profile->schedule_ticks, profile->schedule_samples,
+			      profile->schedules, ticks_per_second);
+  pop = profile_estimate(profile->pop_ticks, profile->pop_samples,
+			 profile->events, ticks_per_second);
+  list = schedule + pop + profile_estimate(profile->deschedule_ticks,
+					   profile->deschedule_samples,
+					   profile->deschedules, ticks_per_second);
+  random = profile_estimate(profile->random_ticks, profile->random_samples,
+			    profile->random_draws, ticks_per_second);
+  self = handlers - (list - pop) - random;
+  if (self < 0.0) self = 0.0;
+  other = seconds - self - list - random;
+  if (other < 0.0) other = 0.0;
+
+  fprintf(stderr, "  Time: handlers %.1f%%, event list %.1f%%, random numbers "
+	  "%.1f%%, other %.1f%%\n", 100.0 * self / seconds,
+	  100.0 * list / seconds, 100.0 * random / seconds,
+	  100.0 * other / seconds);
+
+  biggest = self;
+  bound = "handler";
+  if (list > biggest) {
+    biggest = list;
+    bound = "list";
+  }
+  if (random > biggest) bound = "RNG";
+  fprintf(stderr, "  Looks %s-bound: %ld schedules (%.1f ns each), "
+	  "%ld deschedules, %ld random variates (%.1f ns each)\n", bound,
+	  profile->schedules,
+	  (profile->schedules > 0) ? 1e9 * schedule / profile->schedules : 0.0,
+	  profile->deschedules, profile->random_draws,
+	  (profile->random_draws > 0) ? 1e9 * random / profile->random_draws : 0.0);
+
+  if (profile->events > 0) {
+    fprintf(stderr, "  Event list size: mean %.2f, max %d, distribution",
+	    profile->list_size_sum / profile->events, profile->max_list_size);
+    profile_print_histogram(profile->list_size, profile->events);
+  }
+  if (profile->schedules > 0) {
+    fprintf(stderr, "  Insertion depth: mean %.2f, distribution",
+	    profile->insertion_depth_sum / profile->schedules);
+    profile_print_histogram(profile->insertion_depth, profile->schedules);
+  }
+  if (profile->deschedules > 0)
+    fprintf(stderr, "  Deschedule search: mean %.2f containers\n",
+	    profile->deschedule_depth_sum / profile->deschedules);
+
+  profile_print_memory(profile);
+
+#ifdef __linux__
+  if (profile->number_of_counters > 0) {
+    fprintf(stderr, "  Hardware counters per call (1 in %d sampled):\n",
+	    PROFILE_SAMPLE_PERIOD);
+    fprintf(stderr, "  %-36s", "Phase");
+    for (i=0; i<PROFILE_COUNTERS; i++)
+      if (profile->counter_slot[i] >= 0)
+	fprintf(stderr, " %13s", profile_counter_events[i].name);
+    if (profile->counter_slot[0] >= 0 && profile->counter_slot[1] >= 0)
+      fprintf(stderr, " %6s", "IPC");
+    fprintf(stderr, "\n");
+
+    profile_print_counters(profile, "schedule", &profile->schedule_counters);
+    profile_print_counters(profile, "pop", &profile->pop_counters);
+    memset(&dispatch, 0, sizeof(dispatch));
+    for (i=0; i<profile->number_of_event_types; i++) {
+      type = profile->event_types + i;
+      dispatch.samples += type->counters.samples;
+      for (k=0; k<PROFILE_COUNTERS; k++)
+	dispatch.values[k] += type->counters.values[k];
+    }
+    profile_print_counters(profile, "dispatch", &dispatch);
+    for (i=0; i<profile->number_of_event_types; i++) {
+      type = profile->event_types + i;
+      sprintf(name, "  %.34s", type->description);
+      profile_print_counters(profile, name, &type->counters);
+    }
+  }
+#endif
+}
+
+/******************************************************************************/
+
+/*
+ * FIFO queue functions
+ *
+ * Make a new (empty) FIFO queue. This will return a pointer to the created
+ * Fifoqueue. The FIFO queue is a singly linked list.
+ */
+
+Fifoqueue_Ptr
+fifoqueue_new(void)
+{
+  Fifoqueue_Ptr queue_id;
+
+  queue_id = (Fifoqueue_Ptr) xmalloc_named(sizeof(Fifoqueue), fifoqueue_name);
+  queue_id->size = 0;
+  queue_id->front_ptr = NULL;
+  queue_id->back_ptr  = NULL;
+  queue_id->stat = NULL;
+  queue_id->max_size = 0;
+
+  /*
+   * Keep it on the list of live queues until it is freed, which xfree can
+   * only tell while the blocks are counted.
+   */
+  queue_id->number = ++number_of_fifoqueues;
+  queue_id->previous_queue = NULL;
+  queue_id->next_queue = NULL;
+  if (!allocation_counting) return queue_id;
+  queue_id->next_queue = fifoqueue_list;
+  if (fifoqueue_list != NULL) fifoqueue_list->previous_queue = queue_id;
+  fifoqueue_list = queue_id;
+  return queue_id;
+}
+
+/*
+ * Take a queue being freed off the list of live queues.
+ */
+
+static void
+fifoqueue_unregister(Fifoqueue_Ptr queue_ptr)
+{
+  if (active_profile != NULL) profile_note_queue(active_profile, queue_ptr);
+
+  if (queue_ptr->previous_queue != NULL)
+    queue_ptr->previous_queue->next_queue = queue_ptr->next_queue;
+  else
+    fifoqueue_list = queue_ptr->next_queue;
+  if (queue_ptr->next_queue != NULL)
+    queue_ptr->next_queue->previous_queue = queue_ptr->previous_queue;
+}
+
+/*
+ * Put something into a FIFO queue. Whatever it is should be cast to a void
+ * pointer.
+ */
+
+void
+fifoqueue_put(Fifoqueue_Ptr queue_ptr, void * content_ptr)
+{
+  Queue_Container_Ptr queue_container_ptr;
+
+  queue_container_ptr = (Queue_Container_Ptr)
+    xmalloc_named(sizeof(Queue_Container), "queue container");
+  queue_container_ptr->content_ptr = content_ptr;
+  queue_container_ptr->next_ptr = NULL;
+
+  if (queue_ptr->size == 0) {
+    queue_ptr->front_ptr = queue_container_ptr;
+    queue_ptr->back_ptr =  queue_container_ptr;
+  }
+  else {
+    queue_ptr->back_ptr->next_ptr = queue_container_ptr;
+    queue_ptr->back_ptr = queue_container_ptr;
+  }
+  queue_ptr->size++;
+  if (queue_ptr->size > queue_ptr->max_size) queue_ptr->max_size = queue_ptr->size;
+
+  if (queue_ptr->stat != NULL) time_weighted_stat_change(queue_ptr->stat, 1);
+}
+
+/*
+ * Take something out of a FIFO queue. Whatever it is should be cast to a void
+ * pointer.
+ */
+
+void *
+fifoqueue_get(Fifoqueue_Ptr queue_ptr)
+{
+  Queue_Container_Ptr removed_container_ptr;
+  void* content_ptr;
+
+  if (queue_ptr->size > 0) {
+    removed_container_ptr = queue_ptr->front_ptr;
+    queue_ptr->front_ptr = removed_container_ptr->next_ptr;
+    content_ptr = removed_container_ptr->content_ptr;
+    xfree((void*) removed_container_ptr);
+
+    if(queue_ptr->size == 1) queue_ptr->back_ptr = NULL;
+    queue_ptr->size--;
+
+    if (queue_ptr->stat != NULL) time_weighted_stat_change(queue_ptr->stat, -1);
+  }
+  else {
+    content_ptr = NULL;
+  }
+  return content_ptr;
+}
+
+/*
+ * Get the number of objects currently in the Fifoqueue.
+ */
+
+int
+fifoqueue_size(Fifoqueue_Ptr queue_ptr)
+{
+  return queue_ptr->size;
+}
+
+/*
+ * Get the largest number of objects that have been in the Fifoqueue.
+ */
+
+int
+fifoqueue_max_size(Fifoqueue_Ptr queue_ptr)
+{
+  return queue_ptr->max_size;
+}
+
+/*
+ * Get a pointer to the object at the front of the Fifoqueue.
+ */
+
+void*
+fifoqueue_see_front(Fifoqueue_Ptr queue_ptr)
+{
+  return queue_ptr->front_ptr->content_ptr;
+}
+
+/*
+ * Server functions.
+ *
+ * Create and return a pointer to an empty server. The server is marked FREE.
+ */
+
+Server_Ptr
+server_new(void)
+{
+  Server_Ptr server_ptr;
+
+  server_ptr = (Server_Ptr) xmalloc_named(sizeof(Server), "server");
+  server_ptr->customer_in_service = NULL;
+  server_ptr->state = FREE;
+  server_ptr->stat = NULL;
+  return server_ptr;
+}
+
+/*
+ * Pass a server pointer and an object pointer to place the object in the
+ * server. The server is marked BUSY.
+ */
+
+void
+server_put(Server_Ptr server, void* content_ptr)
+{
+  if (server_state(server) == BUSY) {
+      printf("Error: Cannot put into busy server.\n");
+      exit(1);
+    }
+
+  server->customer_in_service = content_ptr;
+  server->state = BUSY;
+
+  if (server->stat != NULL) time_weighted_stat_change(server->stat, 1);
+}
+
+/*
+ * Remove whatever is in the server. The simulation_run will exit if this is
+ * called when the server is FREE. So the server state should be tested first to
+ * be sure.
+ */
+
+void *
+server_get(Server_Ptr server)
+{
+  void *entry;
+
+  if (server_state(server) == FREE) {
+      printf("Error: Cannot get from free server.\n");
+      exit(1);
+    }
+
+  entry = server->customer_in_service;
+  server->customer_in_service = NULL;
+  server->state = FREE;
+
+  if (server->stat != NULL) time_weighted_stat_change(server->stat, -1);
+  return entry;
+}
+
+/*
+ * Test if the server is FREE or BUSY.
+ */
+
+Server_State
+server_state(Server_Ptr a_server)
+{
+  return(a_server->state);
+}
+
+/*
+ * Attach a time weighted statistic to a FIFO queue or a server. The queue
+ * size or number of busy servers is added to its current value.
+ */
+
+void
+fifoqueue_attach_stat(Fifoqueue_Ptr queue_ptr, Time_Weighted_Stat_Ptr stat)
+{
+  queue_ptr->stat = stat;
+  time_weighted_stat_change(stat, queue_ptr->size);
+}
+
+void
+server_attach_stat(Server_Ptr server, Time_Weighted_Stat_Ptr stat)
+{
+  server->stat = stat;
+  if (server_state(server) == BUSY) time_weighted_stat_change(stat, 1);
+}
+
+/*
+ * Time weighted statistic functions.
+ *
+ * Create a new statistic at level 0, starting at the current time.
+ */
+
+Time_Weighted_Stat_Ptr
+time_weighted_stat_new(Simulation_Run_Ptr simulation_run)
+{
+  Time_Weighted_Stat_Ptr stat;
+
+  stat = (Time_Weighted_Stat_Ptr)
+    xmalloc_named(sizeof(Time_Weighted_Stat), "time weighted stat");
+  stat->clock = (simulation_run != NULL) ? simulation_run->clock : NULL;
+  stat->start_time = (stat->clock != NULL) ? stat->clock->time : 0.0;
+  stat->last_time = stat->start_time;
+  stat->value = 0;
+  stat->max_value = 0;
+  stat->integral = 0.0;
+  stat->number_of_levels = 16;
+  stat->time_at_level = (double *) xcalloc(stat->number_of_levels,
+					   sizeof(double));
+  return stat;
+}
+
+/*
+ * Make room in the level array for the given level.
+ */
+
+static void
+time_weighted_stat_grow(Time_Weighted_Stat_Ptr stat, int level)
+{
+  int i, number_of_levels;
+  double * time_at_level;
+
+  if (level < stat->number_of_levels) return;
+
+  number_of_levels = stat->number_of_levels;
+  while (number_of_levels <= level) number_of_levels *= 2;
+
+  time_at_level = (double *) xcalloc(number_of_levels, sizeof(double));
+  for (i=0; i<stat->number_of_levels; i++)
+    time_at_level[i] = stat->time_at_level[i];
+  xfree(stat->time_at_level);
+
+  stat->time_at_level = time_at_level;
+  stat->number_of_levels = number_of_levels;
+}
+
+/*
+ * Account for the time from the last change up to the given time at the
+ * current level.
+ */
+
+void
+time_weighted_stat_advance(Time_Weighted_Stat_Ptr stat, double time)
+{
+  double elapsed = time - stat->last_time;
+
+  if (elapsed > 0.0) {
+    stat->integral += stat->value * elapsed;
+    stat->time_at_level[stat->value] += elapsed;
+    stat->last_time = time;
+  }
+}
+
+/*
+ * Change the level at the given time.
+ */
+
+void
+time_weighted_stat_set_at(Time_Weighted_Stat_Ptr stat, double time, int value)
+{
+  if (value < 0) {
+    printf("Error: Time weighted statistic set below zero.\n");
+    exit(1);
+  }
+
+  time_weighted_stat_advance(stat, time);
+  time_weighted_stat_grow(stat, value);
+  stat->value = value;
+  if (value > stat->max_value) stat->max_value = value;
+}
+
+/*
+ * Change the level at the current clock time.
+ */
+
+void
+time_weighted_stat_set(Time_Weighted_Stat_Ptr stat, int value)
+{
+  if (stat->clock == NULL) {
+    printf("Error: Time weighted statistic has no clock. Use time_weighted_stat_set_at.\n");
+    exit(1);
+  }
+  time_weighted_stat_set_at(stat, stat->clock->time, value);
+}
+
+void
+time_weighted_stat_change(Time_Weighted_Stat_Ptr stat, int delta)
+{
+  time_weighted_stat_set(stat, stat->value + delta);
+}
+
+/*
+ * Throw away everything collected so far, e.g., at the end of a warm up
+ * period. The current level is kept.
+ */
+
+void
+time_weighted_stat_reset(Time_Weighted_Stat_Ptr stat)
+{
+  int i;
+
+  if (stat->clock != NULL) stat->last_time = stat->clock->time;
+  stat->start_time = stat->last_time;
+  stat->integral = 0.0;
+  stat->max_value = stat->value;
+  for (i=0; i<stat->number_of_levels; i++) stat->time_at_level[i] = 0.0;
+}
+
+/*
+ * The results below cover the time up to the current clock time or, without
+ * a clock, up to the last time given.
+ */
+
+double
+time_weighted_stat_elapsed(Time_Weighted_Stat_Ptr stat)
+{
+  if (stat->clock != NULL) time_weighted_stat_advance(stat, stat->clock->time);
+  return stat->last_time - stat->start_time;
+}
+
+double
+time_weighted_stat_mean(Time_Weighted_Stat_Ptr stat)
+{
+  double elapsed = time_weighted_stat_elapsed(stat);
+
+  return (elapsed > 0.0) ? stat->integral/elapsed : (double) stat->value;
+}
+
+/*
+ * The fraction of time spent at level n, i.e., P(N = n).
+ */
+
+double
+time_weighted_stat_probability(Time_Weighted_Stat_Ptr stat, int n)
+{
+  double elapsed = time_weighted_stat_elapsed(stat);
+
+  if (n < 0 || n >= stat->number_of_levels || elapsed <= 0.0) return 0.0;
+  return stat->time_at_level[n]/elapsed;
+}
+
+/*
+ * The fraction of time spent at level n or above, i.e., P(N >= n).
+ */
+
+double
+time_weighted_stat_tail(Time_Weighted_Stat_Ptr stat, int n)
+{
+  int i;
+  double elapsed = time_weighted_stat_elapsed(stat), time = 0.0;
+
+  if (elapsed <= 0.0) return 0.0;
+  if (n < 0) n = 0;
+  for (i=n; i<stat->number_of_levels; i++) time += stat->time_at_level[i];
+  return time/elapsed;
+}
+
+void
+time_weighted_stat_free(Time_Weighted_Stat_Ptr stat)
+{
+  xfree(stat->time_at_level);
+  xfree(stat);
+}
+
+/*
+ * Random number generator functions.
+ */
+
+/*
+ * Functions for random streams, which permit multiple overlapping random number
+ * generator streams (and seeds) at once.
  */
 
 Rand_Stream_Ptr
@@ -572,7 +2339,8 @@ rand_stream_new(unsigned seed)
 {
   Rand_Stream_Ptr new_stream;
 
-  new_stream = (Rand_Stream_Ptr) xmalloc(sizeof(Rand_Stream));
+  new_stream = (Rand_Stream_Ptr) xmalloc_named(sizeof(Rand_Stream),
+					       "rand stream");
   rand_stream_initialize(new_stream, seed);
   return new_stream;
 }
@@ -601,10 +2369,12 @@ double
 rand_stream_uniform_generator(Rand_Stream_Ptr rand_stream)
 {
   double r;
+  unsigned long long start_ticks = PROFILE_RANDOM_BEGIN();
 
   do {
     r = (double) rand_stream_get(rand_stream)/(double)rand_stream->rand_max;
   } while (r == 1 || r == 0);
+  PROFILE_RANDOM_END(start_ticks);
 
 if (r > 1.0) {
   printf ("***** ERROR: Random() out of bounds! ***** \n");
@@ -615,16 +2385,82 @@ if (r > 1.0) {
 double
 rand_stream_exponential_generator(Rand_Stream_Ptr rand_stream, double mean)
 {
-  double u = 0.0;
+  double u = 0.0, x;
+  unsigned long long start_ticks = PROFILE_RANDOM_BEGIN();
 
   while (u == 0.0 || u == 1) u = rand_stream_uniform_generator(rand_stream);
-  return -1.0 * log(u) * mean;
+  x = -1.0 * log(u) * mean;
+  PROFILE_RANDOM_END(start_ticks);
+  return x;
 }
 
+/*
+ * The generator behind uniform_generator is the additive feedback generator
+ * of the C library's random(), x[n] = x[n-3] + x[n-31] (mod 2^32), returning
+ * the top 31 bits. It is seeded the same way, so it gives the same numbers as
+ * rand() on glibc, but its state is ours to save and restore.
+ */
+
 void
 random_generator_initialize(unsigned iseed)
 {
-  srand(iseed);
+  int i, word;
+  long int hi, lo;
+
+  metrics_seed = iseed;
+#ifdef METRICS_SHARED_MEMORY
+  if (metrics_run != NULL && metrics_run->metrics != NULL &&
+      metrics_pid == (long int) getpid())
+    METRICS_STORE(metrics_run->metrics->seed, iseed);
+#endif
+  word = (int) (iseed == 0 ? 1 : iseed);
+  random_state.table[0] = (unsigned) word;
+
+  for (i=1; i<RANDOM_STATE_DEGREE; i++) {
+    /* word = 16807 * word % 2147483647, without overflow. */
+    hi = word / 127773;
+    lo = word % 127773;
+    word = (int) (16807 * lo - 2836 * hi);
+    if (word < 0) word += 2147483647;
+    random_state.table[i] = (unsigned) word;
+  }
+
+  random_state.front = RANDOM_STATE_SEPARATION;
+  random_state.rear = 0;
+
+  for (i=0; i<10*RANDOM_STATE_DEGREE; i++)
+    (void) random_generator_get();
+}
+
+/*
+ * Return the next number of the generator, in the range 0 to
+ * RANDOM_GENERATOR_MAX.
+ */
+
+unsigned
+random_generator_get(void)
+{
+  unsigned value;
+
+  value = (random_state.table[random_state.front] +=
+	   random_state.table[random_state.rear]);
+
+  if (++random_state.front >= RANDOM_STATE_DEGREE) random_state.front = 0;
+  if (++random_state.rear >= RANDOM_STATE_DEGREE) random_state.rear = 0;
+
+  return (value & 0xffffffffU) >> 1;
+}
+
+void
+random_generator_get_state(Random_State_Ptr state)
+{
+  *state = random_state;
+}
+
+void
+random_generator_set_state(Random_State_Ptr state)
+{
+  random_state = *state;
 }
 
 /*
@@ -635,10 +2471,12 @@ double
 uniform_generator(void)
 {
   double r;
+  unsigned long long start_ticks = PROFILE_RANDOM_BEGIN();
 
   do {
-    r = (double) rand()/(double) RAND_MAX;
+    r = (double) random_generator_get()/(double) RANDOM_GENERATOR_MAX;
   } while (r == 1 || r == 0);
+  PROFILE_RANDOM_END(start_ticks);
 
 if (r > 1.0) {
   printf ("***** ERROR: Random() out of bounds! ***** \n");
@@ -653,10 +2491,165 @@ if (r > 1.0) {
 double
 exponential_generator(double mean)
 {
-  double u = 0.0;
+  double u = 0.0, x;
+  unsigned long long start_ticks = PROFILE_RANDOM_BEGIN();
 
   while (u == 0.0 || u == 1) u = uniform_generator();
-  return -1.0 * log(u) * mean;
+  x = -1.0 * log(u) * mean;
+  PROFILE_RANDOM_END(start_ticks);
+  return x;
+}
+
+/*
+ * A hash table from the size of a block to its kinds (the index + 1, 0 for
+ * an empty slot).
+ */
+
+#define ALLOCATION_TABLE_SIZE (2 * ALLOCATION_MAX_KINDS)
+#define ALLOCATION_MAGIC 0x51b1a110U
+
+static short allocation_table[ALLOCATION_TABLE_SIZE];
+
+/*
+ * The header in front of each block, padded so that the block stays
+ * aligned for any type.
+ */
+
+typedef union _allocation_header_
+{
+  struct
+  {
+    size_t size;
+    int kind;
+    unsigned magic;
+  } block;
+  long double align_long_double;
+  void * align_pointer;
+} Allocation_Header;
+
+static int
+allocation_kind(unsigned size, const char * name)
+{
+  Allocation_Kind_Ptr kind;
+  unsigned slot = (size * 2654435761U) % ALLOCATION_TABLE_SIZE;
+  int k;
+
+  while ((k = allocation_table[slot]) != 0) {
+    kind = allocation_stats.kinds + k - 1;
+    if (kind->size == size && (kind->name == name ||
+	(kind->name != NULL && name != NULL && strcmp(kind->name, name) == 0)))
+      return k - 1;
+    slot = (slot + 1) % ALLOCATION_TABLE_SIZE;
+  }
+
+  if (allocation_stats.number_of_kinds == ALLOCATION_MAX_KINDS - 1) {
+    /* The table is full: lump the rest together. */
+    kind = allocation_stats.kinds + ALLOCATION_MAX_KINDS - 1;
+    kind->name = "(other kinds)";
+    return ALLOCATION_MAX_KINDS - 1;
+  }
+
+  k = allocation_stats.number_of_kinds++;
+  allocation_table[slot] = (short) (k + 1);
+  kind = allocation_stats.kinds + k;
+  kind->name = name;
+  kind->size = size;
+  return k;
+}
+
+static void *
+allocation_new_counted(size_t bytes, unsigned size, const char * name,
+		       int zero)
+{
+  Allocation_Header * header;
+  Allocation_Kind_Ptr kind;
+  int k;
+
+  header = (Allocation_Header *) (zero ?
+				  calloc(1, sizeof(Allocation_Header) + bytes) :
+				  malloc(sizeof(Allocation_Header) + bytes));
+  if (header == NULL) {
+    printf("***** ERROR: Out of memory ***** \n");
+    printf("(%lu bytes live in %ld blocks)\n",
+	   (unsigned long) allocation_stats.live_bytes,
+	   allocation_stats.allocations - allocation_stats.frees);
+    exit(1);
+  }
+
+  k = allocation_kind(size, name);
+  header->block.size = bytes;
+  header->block.kind = k;
+  header->block.magic = ALLOCATION_MAGIC;
+
+  kind = allocation_stats.kinds + k;
+  kind->allocations++;
+  kind->live_bytes += bytes;
+  if (kind->live_bytes > kind->peak_bytes) kind->peak_bytes = kind->live_bytes;
+
+  allocation_stats.allocations++;
+  allocation_stats.live_bytes += bytes;
+  if (allocation_stats.live_bytes > allocation_stats.peak_bytes)
+    allocation_stats.peak_bytes = allocation_stats.live_bytes;
+
+  return (void *) (header + 1);
+}
+
+static void
+allocation_free_counted(void * ptr)
+{
+  Allocation_Header * header;
+  Allocation_Kind_Ptr kind;
+
+  if(ptr == NULL) {
+    printf("Warning: Attempting to free a NULL pointer.\n");
+    return;
+  }
+
+  header = (Allocation_Header *) ptr - 1;
+  if (header->block.magic != ALLOCATION_MAGIC) {
+    printf("Error: xfree of a block that was not allocated by xmalloc, "
+	   "or was already freed.\n");
+    exit(1);
+  }
+  header->block.magic = 0;
+
+  kind = allocation_stats.kinds + header->block.kind;
+  if (kind->name == fifoqueue_name) fifoqueue_unregister((Fifoqueue_Ptr) ptr);
+  kind->frees++;
+  kind->live_bytes -= header->block.size;
+  allocation_stats.frees++;
+  allocation_stats.live_bytes -= header->block.size;
+
+  free((void *) header);
+}
+
+static void
+allocation_out_of_memory(void)
+{
+  printf("***** ERROR: Out of memory ***** \n");
+  exit(1);
+}
+
+/*
+ * The slow path of xmalloc, xcalloc and xmalloc_named: the first
+ * allocation, which decides whether blocks are counted, and all of them if
+ * they are.
+ */
+
+static void *
+allocation_new(size_t bytes, unsigned size, const char * name, int zero)
+{
+  void * block;
+
+  if (allocation_counting < 0)
+    allocation_counting = (getenv("SIMLIB_PROFILE") != NULL ||
+			   getenv("SIMLIB_PERF") != NULL);
+  if (allocation_counting)
+    return allocation_new_counted(bytes, size, name, zero);
+
+  block = zero ? calloc(1, bytes) : malloc(bytes);
+  if (block == NULL) allocation_out_of_memory();
+  return block;
 }
 
 /*
@@ -668,11 +2661,10 @@ xmalloc(unsigned size)
 {
   void * a_ptr;
 
-  if((a_ptr = (void *) malloc(size)) != NULL) return a_ptr;
-  else {
-    printf("***** ERROR: Out of memory ***** \n");
-    exit(1);
-  }
+  if (UNLIKELY(allocation_counting != 0))
+    return allocation_new(size, size, NULL, 0);
+  if ((a_ptr = malloc(size)) == NULL) allocation_out_of_memory();
+  return a_ptr;
 }
 
 /*
@@ -684,11 +2676,25 @@ xcalloc(unsigned num, unsigned size)
 {
   void * a_ptr;
 
-  if((a_ptr = (void *) calloc(num, size)) != NULL) return a_ptr;
-  else {
-    printf(" ***** WARNING: Out of memory ***** \n");
-    exit(1);
-  }
+  if (UNLIKELY(allocation_counting != 0))
+    return allocation_new((size_t) num * size, size, NULL, 1);
+  if ((a_ptr = calloc(num, size)) == NULL) allocation_out_of_memory();
+  return a_ptr;
+}
+
+/*
+ * xmalloc, counting the block as a kind of its own.
+ */
+
+void *
+xmalloc_named(unsigned size, const char * name)
+{
+  void * a_ptr;
+
+  if (UNLIKELY(allocation_counting != 0))
+    return allocation_new(size, size, name, 0);
+  if ((a_ptr = malloc(size)) == NULL) allocation_out_of_memory();
+  return a_ptr;
 }
 
 /*
@@ -698,12 +2704,17 @@ xcalloc(unsigned num, unsigned size)
 void
 xfree(void * ptr)
 {
-  if(ptr == NULL) {
+  if (UNLIKELY(allocation_counting > 0))
+    allocation_free_counted(ptr);
+  else if(ptr == NULL)
     printf("Warning: Attempting to free a NULL pointer.\n");
-  }
-  else free(ptr);
+  else
+    free(ptr);
 }
 
-
-
+Allocation_Stats_Ptr
+xmalloc_stats(void)
+{
+  return &allocation_stats;
+}
 
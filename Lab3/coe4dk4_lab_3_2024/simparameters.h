@@ -30,15 +30,75 @@
 
 /*******************************************************************************/
 
-#define Call_ARRIVALRATE 5   /* calls/minute */
-#define MEAN_CALL_DURATION 2 /* minutes */
-#define RUNLENGTH 5e6 /* number of successful calls */
+/* Defaults of the parameters that can be swept from the command line (see
+   sweep.h). The values in use are the variables of the same names in main.c. */
+#define Call_ARRIVALRATE_DEFAULT 5   /* calls/minute */
+#define MEAN_CALL_DURATION_DEFAULT 2 /* minutes */
+#define RUNLENGTH_DEFAULT 5e6 /* number of successful calls */
+#define NUMBER_OF_CHANNELS_DEFAULT 15
+#define BLOCKED_CALLS_CLEARED_DEFAULT 0 /* 1: blocked calls are lost, not queued */
+
 #define BLIPRATE 1e3
-#define NUMBER_OF_CHANNELS 15
+
+/* Waiting time histogram: resolution, highest tracked value and the bound
+   whose exceedance probability is reported (all in minutes). */
+#define WAITING_TIME_RESOLUTION 1e-4
+#define WAITING_TIME_HIGHEST 1e4
+#define WAITING_TIME_BOUND 0.5
+
+/* Compressed time series of the number of busy channels and the queue
+   length, written to time_series_<seed>.gts for plot_time_series.py. Rows are
+   sampled every TIME_SERIES_INTERVAL minutes or, if it is 0, whenever the
+   state changes. Sample times are kept to TIME_SERIES_RESOLUTION minutes. */
+#define TIME_SERIES_MODE 0
+#define TIME_SERIES_INTERVAL 0.01
+#define TIME_SERIES_RESOLUTION 1e-6
+
+/* Ensemble analysis of the start-up transient: ENSEMBLE_REPLICATIONS short
+   runs, each from an empty system with its own seed, sampled at
+   ENSEMBLE_POINTS times from 0 to ENSEMBLE_HORIZON minutes and spread over
+   ENSEMBLE_WORKERS processes. Written to ensemble_results.csv. */
+#define ENSEMBLE_MODE 0
+#define ENSEMBLE_REPLICATIONS 2000
+#define ENSEMBLE_WORKERS 4
+#define ENSEMBLE_HORIZON 10.0
+#define ENSEMBLE_POINTS 101
 
 /* Comma separated list of random seeds to run. */
 #define RANDOM_SEED_LIST 400474322, 400430923, 12345678, 987654321, 45671234
 
+/*
+ * Standard clock mode. When STANDARD_CLOCK_MODE is 1 the whole dimensioning
+ * grid, 1 to SC_MAX_CHANNELS channels by 1 to SC_MAX_OFFERED_LOAD Erlangs, is
+ * simulated in one pass per seed for both blocked calls cleared (Erlang B)
+ * and blocked calls delayed (Erlang C), instead of the runs above.
+ */
+#define STANDARD_CLOCK_MODE 0
+#define SC_MAX_CHANNELS 20
+#define SC_MAX_OFFERED_LOAD 20
+#define SC_EPOCHS 2e6
+
+/*
+ * Capacity thresholds. When THRESHOLD_MODE is 1 the largest offered load
+ * (Erlangs) with a blocking probability of THRESHOLD_TARGET_PB, blocked calls
+ * cleared, is searched for each channel count from THRESHOLD_MIN_CHANNELS to
+ * THRESHOLD_MAX_CHANNELS by sequential bisection (see root_finder.h), to
+ * within THRESHOLD_TOLERANCE Erlangs with THRESHOLD_CONFIDENCE. Each
+ * replication offers THRESHOLD_CALLS calls after THRESHOLD_WARMUP_CALLS from
+ * an empty system. Results, with the Erlang B values, go to
+ * threshold_results.csv.
+ */
+#define THRESHOLD_MODE 0
+#define THRESHOLD_TARGET_PB 0.015
+#define THRESHOLD_MIN_CHANNELS 1
+#define THRESHOLD_MAX_CHANNELS 20
+#define THRESHOLD_TOLERANCE 0.1
+#define THRESHOLD_CONFIDENCE 0.95
+#define THRESHOLD_CALLS 2e4
+#define THRESHOLD_WARMUP_CALLS 1e3
+#define THRESHOLD_MIN_REPLICATIONS 5
+#define THRESHOLD_MAX_REPLICATIONS 2000
+
 /*******************************************************************************/
 
 #endif /* simparameters.h */
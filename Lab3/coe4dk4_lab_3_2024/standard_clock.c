@@ -0,0 +1,173 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "simlib.h"
+#include "standard_clock.h"
+
+/******************************************************************************/
+
+Standard_Clock_Ptr
+standard_clock_new(void)
+{
+  Standard_Clock_Ptr sc;
+
+  sc = (Standard_Clock_Ptr) xcalloc(1, sizeof(Standard_Clock));
+  sc->allocated_variants = 16;
+  sc->variants = (Standard_Clock_Variant_Ptr)
+    xcalloc(sc->allocated_variants, sizeof(Standard_Clock_Variant));
+  return sc;
+}
+
+/*
+ * Add a variant, starting empty. Returns its index.
+ */
+
+int
+standard_clock_add_variant(Standard_Clock_Ptr sc, double arrival_rate,
+			   double service_rate, int servers, int capacity)
+{
+  Standard_Clock_Variant_Ptr variant, variants;
+
+  if (servers < 1 || arrival_rate <= 0.0 || service_rate <= 0.0 ||
+      (capacity != STANDARD_CLOCK_INFINITE && capacity < servers)) {
+    printf("Error: Bad standard clock variant (servers = %d, capacity = %d).\n",
+	   servers, capacity);
+    exit(1);
+  }
+
+  if (sc->number_of_variants == sc->allocated_variants) {
+    variants = (Standard_Clock_Variant_Ptr)
+      xcalloc(2 * sc->allocated_variants, sizeof(Standard_Clock_Variant));
+    memcpy(variants, sc->variants,
+	   sc->allocated_variants * sizeof(Standard_Clock_Variant));
+    xfree((void *) sc->variants);
+    sc->variants = variants;
+    sc->allocated_variants *= 2;
+  }
+
+  variant = sc->variants + sc->number_of_variants;
+  memset(variant, 0, sizeof(Standard_Clock_Variant));
+  variant->arrival_rate = arrival_rate;
+  variant->service_rate = service_rate;
+  variant->servers = servers;
+  variant->capacity = capacity;
+
+  return sc->number_of_variants++;
+}
+
+/******************************************************************************/
+
+/*
+ * Advance all variants through the given number of epochs. This can be called
+ * repeatedly to extend a run.
+ */
+
+void
+standard_clock_run(Standard_Clock_Ptr sc, long int epochs)
+{
+  int i, n, busy;
+  long int k;
+  double rate, dt, mark;
+  Standard_Clock_Variant_Ptr v;
+
+  sc->uniformization_rate = 0.0;
+  for (i=0; i<sc->number_of_variants; i++) {
+    v = sc->variants + i;
+    rate = v->arrival_rate + v->servers * v->service_rate;
+    if (rate > sc->uniformization_rate) sc->uniformization_rate = rate;
+  }
+  if (sc->uniformization_rate == 0.0) return;
+
+  for (k=0; k<epochs; k++) {
+
+    dt = exponential_generator(1.0/sc->uniformization_rate);
+    mark = uniform_generator() * sc->uniformization_rate;
+    sc->time += dt;
+
+    for (i=0, v=sc->variants; i<sc->number_of_variants; i++, v++) {
+      n = v->number_in_system;
+      busy = (n < v->servers) ? n : v->servers;
+
+      v->integral_of_n += n * dt;
+      v->integral_of_queue += (n - busy) * dt;
+      v->integral_of_busy += busy * dt;
+
+      if (mark < v->arrival_rate) {
+	v->arrivals++;
+	if (v->capacity != STANDARD_CLOCK_INFINITE && n >= v->capacity) {
+	  v->blocked++;
+	} else {
+	  if (n >= v->servers) v->waited++;
+	  v->number_in_system++;
+	}
+      } else if (mark < v->arrival_rate + busy * v->service_rate) {
+	v->number_in_system--;
+      }
+    }
+  }
+  sc->epochs += epochs;
+}
+
+/******************************************************************************/
+
+void
+standard_clock_results(Standard_Clock_Ptr sc, int index,
+		       Standard_Clock_Results_Ptr results)
+{
+  Standard_Clock_Variant_Ptr v = sc->variants + index;
+  long int admitted = v->arrivals - v->blocked;
+
+  memset(results, 0, sizeof(Standard_Clock_Results));
+
+  if (v->arrivals > 0) {
+    results->blocking_probability = (double) v->blocked/v->arrivals;
+    results->wait_probability = (double) v->waited/v->arrivals;
+  }
+
+  if (admitted > 0) {
+    results->mean_delay = v->integral_of_n/admitted;
+    results->mean_waiting_time = v->integral_of_queue/admitted;
+  }
+
+  if (v->waited > 0)
+    results->mean_waiting_time_of_waiting = v->integral_of_queue/v->waited;
+
+  if (sc->time > 0.0) {
+    results->mean_number_in_system = v->integral_of_n/sc->time;
+    results->utilization = v->integral_of_busy/(v->servers * sc->time);
+  }
+}
+
+void
+standard_clock_free(Standard_Clock_Ptr sc)
+{
+  xfree((void *) sc->variants);
+  xfree((void *) sc);
+}
+
@@ -0,0 +1,206 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include "result_cache.h"
+
+/******************************************************************************/
+
+/*
+ * Parameter sweeps.
+ *
+ * The model registers the variables holding its parameters and the names of
+ * its outputs. The parameter space is then described on the command line or
+ * in a file, one axis per argument or line:
+ *
+ *   name=0.5               a single value
+ *   name=1,2,5,10          a list
+ *   name=1:15:0.5          a grid from 1 to 15 in steps of 0.5 (a:b means
+ *                          steps of 1); lists and grids can be mixed
+ *   a=1,2,3 b=0.1,0.2,0.3  a zipped axis: the parameters take their k-th
+ *                          values together
+ *   seed=1:10              the random seeds, as another axis
+ *   lhs=50 a=0.1:0.9 b=5:20
+ *                          a 50 point Latin hypercube design over the
+ *                          ranges of a and b (lhs=50:SEED for another one)
+ *   sobol=64 a=0.1:0.9 b=5:20
+ *                          the first 64 points of the Sobol sequence
+ *
+ * A design (design.h) is a zipped axis whose points cover the box of its
+ * parameter ranges evenly, so that several interacting parameters are
+ * studied with a fixed number of runs instead of a full factorial grid.
+ * Integer parameters take the whole values of their range equally often.
+ *
+ * The jobs are all combinations of the axis values, the last axis varying
+ * fastest. Without a seed axis the model's default seeds are run for every
+ * point, innermost. Parameters that are not swept keep their values. Each job
+ * sets the parameters, calls the model function, and writes one CSV row of
+ * the job number, all parameters, the seed, and the outputs the model set.
+ *
+ * The jobs are handed out one at a time to a pool of worker processes (fork)
+ * and their rows are written as they finish, so the row order can differ from
+ * the job order. The workers' own output is discarded. Without fork
+ * (Windows), or with one worker, the jobs run in the calling process.
+ *
+ * The outputs of every job are kept in a result cache (result_cache.h),
+ * keyed by the model name, the build, all parameter values and the seed.
+ * Jobs found in it are written straight away and only the others are run,
+ * so an interrupted sweep resumes where it stopped and a widened one only
+ * runs its new points.
+ *
+ * With -m OUTPUT nothing is run. Instead a stochastic kriging metamodel
+ * (metamodel.h) of the output is fitted to all the runs of the model in the
+ * cache, over the parameters that vary among them, and each point described
+ * by the axes is written with the predicted output, its standard error and
+ * the number of runs there. An output that is positive in every run is
+ * modelled on a log scale. The point with the largest standard error is
+ * proposed as the next one to simulate if that is above the -t tolerance.
+ *
+ * With -s ADDRESS the jobs are handed out over a socket to workers started
+ * with -w ADDRESS, on this host or others (sweep_service.h).
+ */
+
+#define SWEEP_MAX_PARAMETERS 16
+#define SWEEP_MAX_OUTPUTS 32
+#define SWEEP_MAX_AXES 16
+#define SWEEP_MAX_NAME 32
+#define SWEEP_MAX_ROW 4096
+
+/* The parameter index of the seed in an axis. */
+#define SWEEP_SEED (-1)
+
+struct _sweep_;
+
+typedef void (* Sweep_Model)(struct _sweep_ *, unsigned, void *);
+
+typedef struct _sweep_parameter_
+{
+  char name[SWEEP_MAX_NAME];
+  double * value;   /* Exactly one of these is set. */
+  int * integer;
+} Sweep_Parameter, * Sweep_Parameter_Ptr;
+
+typedef struct _sweep_axis_
+{
+  int number_of_parameters;
+  int parameters[SWEEP_MAX_PARAMETERS];  /* indices, or SWEEP_SEED */
+  int number_of_values;
+  double * values;  /* [value * number_of_parameters + parameter] */
+} Sweep_Axis, * Sweep_Axis_Ptr;
+
+typedef struct _sweep_
+{
+  char model[SWEEP_MAX_NAME];
+
+  int number_of_parameters;
+  Sweep_Parameter parameters[SWEEP_MAX_PARAMETERS];
+
+  int number_of_outputs;
+  char outputs[SWEEP_MAX_OUTPUTS][SWEEP_MAX_NAME];
+  double output_values[SWEEP_MAX_OUTPUTS];  /* of the current job */
+
+  int number_of_axes;
+  Sweep_Axis axes[SWEEP_MAX_AXES];
+
+  unsigned * default_seeds;  /* zero terminated */
+  unsigned seed;             /* of the current job */
+
+  int workers;
+  int list_only;
+  char metamodel_output[SWEEP_MAX_NAME];  /* "" to run the jobs */
+  double metamodel_tolerance;
+  char output_file[256];     /* "-" for stdout */
+  char cache_directory[256]; /* "-" for no cache */
+  char service_address[256]; /* "" to run the jobs here */
+  int service_worker;        /* work for the service instead of serving */
+  Result_Cache_Ptr cache;
+
+  long int number_of_jobs;
+  long int completed_jobs;
+  long int * pending_jobs;   /* those not in the cache */
+  long int number_of_pending_jobs;
+} Sweep, * Sweep_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Sweep_Ptr
+sweep_new(const char *, unsigned *);
+
+void
+sweep_add_parameter(Sweep_Ptr, const char *, double *);
+
+void
+sweep_add_integer_parameter(Sweep_Ptr, const char *, int *);
+
+int
+sweep_add_output(Sweep_Ptr, const char *);
+
+void
+sweep_set_output(Sweep_Ptr, int, double);
+
+void
+sweep_add_axis(Sweep_Ptr, const char *);
+
+void
+sweep_read_file(Sweep_Ptr, const char *);
+
+void
+sweep_parse_arguments(Sweep_Ptr, int, char *[]);
+
+void
+sweep_usage(Sweep_Ptr, const char *);
+
+long int
+sweep_count_jobs(Sweep_Ptr);
+
+void
+sweep_set_job(Sweep_Ptr, long int);
+
+void
+sweep_format_row(Sweep_Ptr, long int, char *);
+
+void
+sweep_job_key(Sweep_Ptr);
+
+int
+sweep_run(Sweep_Ptr, Sweep_Model, void *);
+
+void
+sweep_free(Sweep_Ptr);
+
+/******************************************************************************/
+
+#endif /* sweep.h */
+
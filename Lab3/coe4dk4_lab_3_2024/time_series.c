@@ -0,0 +1,362 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "time_series.h"
+
+/******************************************************************************/
+
+static void
+bit_stream_write(Bit_Stream_Ptr, unsigned long long, int);
+
+static void
+write_integer(FILE *, unsigned long long, int);
+
+static void
+time_series_sample_event(Simulation_Run_Ptr, void *);
+
+/******************************************************************************/
+
+/*
+ * Append the low nbits of value to a bit stream, most significant bit first.
+ */
+
+static void
+bit_stream_write(Bit_Stream_Ptr stream, unsigned long long value, int nbits)
+{
+  int bit;
+  long int allocated;
+  unsigned char * bytes;
+
+  if ((stream->bits + nbits + 7)/8 > stream->allocated) {
+    allocated = (stream->allocated > 0) ? 2 * stream->allocated : 1024;
+    bytes = (unsigned char *) xcalloc(allocated, 1);
+    if (stream->bytes != NULL) {
+      memcpy(bytes, stream->bytes, stream->allocated);
+      xfree((void *) stream->bytes);
+    }
+    stream->bytes = bytes;
+    stream->allocated = allocated;
+  }
+
+  for (bit=nbits-1; bit>=0; bit--) {
+    if ((value >> bit) & 1ULL)
+      stream->bytes[stream->bits/8] |= (unsigned char) (0x80 >> (stream->bits % 8));
+    stream->bits++;
+  }
+}
+
+/*
+ * Write an integer of nbytes bytes, most significant byte first.
+ */
+
+static void
+write_integer(FILE * file, unsigned long long value, int nbytes)
+{
+  int i;
+
+  for (i=nbytes-1; i>=0; i--) fputc((int) ((value >> (8*i)) & 0xff), file);
+}
+
+/******************************************************************************/
+
+Time_Series_Ptr
+time_series_new(double resolution)
+{
+  Time_Series_Ptr ts;
+
+  if (resolution <= 0.0) {
+    printf("Error: The time series resolution must be positive.\n");
+    exit(1);
+  }
+
+  ts = (Time_Series_Ptr) xcalloc(1, sizeof(Time_Series));
+  ts->resolution = resolution;
+  return ts;
+}
+
+/*
+ * Add a column, read by calling read(argument). All columns must be added
+ * before the first row is recorded.
+ */
+
+void
+time_series_add_column(Time_Series_Ptr ts, const char * name,
+		       Time_Series_Reader read, void * argument)
+{
+  Time_Series_Column_Ptr column;
+
+  if (ts->number_of_columns == TIME_SERIES_MAX_COLUMNS || ts->rows > 0) {
+    printf("Error: Cannot add time series column %s.\n", name);
+    exit(1);
+  }
+
+  column = ts->columns + ts->number_of_columns++;
+  strncpy(column->name, name, TIME_SERIES_MAX_NAME - 1);
+  column->read = read;
+  column->argument = argument;
+  column->last_leading = -1;
+  column->last_trailing = -1;
+}
+
+/******************************************************************************/
+
+/*
+ * Record a row of all columns at the given time.
+ */
+
+void
+time_series_sample(Time_Series_Ptr ts, double time)
+{
+  int i, leading, trailing, meaningful;
+  long long tick, delta, dod;
+  double value;
+  unsigned long long bits, xor;
+  Time_Series_Column_Ptr column;
+
+  /* The time, as the delta of deltas of the ticks. */
+  tick = (long long) floor(time/ts->resolution + 0.5);
+
+  if (ts->rows == 0) {
+    bit_stream_write(&ts->time_stream, (unsigned long long) tick, 64);
+  } else {
+    delta = tick - ts->last_tick;
+    dod = delta - ts->last_delta;
+
+    if (dod == 0) {
+      bit_stream_write(&ts->time_stream, 0x0, 1);
+    } else if (dod >= -64 && dod < 64) {
+      bit_stream_write(&ts->time_stream, 0x2, 2);
+      bit_stream_write(&ts->time_stream, (unsigned long long) dod, 7);
+    } else if (dod >= -256 && dod < 256) {
+      bit_stream_write(&ts->time_stream, 0x6, 3);
+      bit_stream_write(&ts->time_stream, (unsigned long long) dod, 9);
+    } else if (dod >= -2048 && dod < 2048) {
+      bit_stream_write(&ts->time_stream, 0xe, 4);
+      bit_stream_write(&ts->time_stream, (unsigned long long) dod, 12);
+    } else {
+      bit_stream_write(&ts->time_stream, 0xf, 4);
+      bit_stream_write(&ts->time_stream, (unsigned long long) dod, 64);
+    }
+    ts->last_delta = delta;
+  }
+  ts->last_tick = tick;
+
+  /* The values, as the XOR with the previous value of the column. */
+  for (i=0, column=ts->columns; i<ts->number_of_columns; i++, column++) {
+    value = column->read(column->argument);
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (ts->rows == 0) {
+      bit_stream_write(&column->stream, bits, 64);
+      column->last_bits = bits;
+      continue;
+    }
+
+    xor = bits ^ column->last_bits;
+    column->last_bits = bits;
+
+    if (xor == 0) {
+      bit_stream_write(&column->stream, 0x0, 1);
+      continue;
+    }
+
+    for (leading=0; !((xor >> (63-leading)) & 1ULL); leading++);
+    for (trailing=0; !((xor >> trailing) & 1ULL); trailing++);
+    if (leading > 31) leading = 31;
+
+    if (column->last_leading >= 0 && leading >= column->last_leading &&
+	trailing >= column->last_trailing) {
+      /* The meaningful bits fit in those of the previous XOR. */
+      meaningful = 64 - column->last_leading - column->last_trailing;
+      bit_stream_write(&column->stream, 0x2, 2);
+      bit_stream_write(&column->stream, xor >> column->last_trailing,
+		       meaningful);
+    } else {
+      meaningful = 64 - leading - trailing;
+      bit_stream_write(&column->stream, 0x3, 2);
+      bit_stream_write(&column->stream, (unsigned long long) leading, 5);
+      bit_stream_write(&column->stream, (unsigned long long) (meaningful & 63), 6);
+      bit_stream_write(&column->stream, xor >> trailing, meaningful);
+      column->last_leading = leading;
+      column->last_trailing = trailing;
+    }
+  }
+
+  ts->rows++;
+}
+
+/*
+ * Record a row only if some column has changed since the last row. Calling
+ * this after every event gives the exact sample path.
+ */
+
+void
+time_series_sample_on_change(Time_Series_Ptr ts, double time)
+{
+  int i;
+  double value;
+  unsigned long long bits;
+  Time_Series_Column_Ptr column;
+
+  if (ts->rows > 0) {
+    for (i=0, column=ts->columns; i<ts->number_of_columns; i++, column++) {
+      value = column->read(column->argument);
+      memcpy(&bits, &value, sizeof(bits));
+      if (bits != column->last_bits) break;
+    }
+    if (i == ts->number_of_columns) return;
+  }
+  time_series_sample(ts, time);
+}
+
+/******************************************************************************/
+
+/*
+ * Record a row every interval of simulated time, starting now. The sample
+ * times are computed from the start time, so that they do not drift.
+ */
+
+void
+time_series_start_sampling(Time_Series_Ptr ts, Simulation_Run_Ptr simulation_run,
+			   double interval)
+{
+  Event new_event;
+
+  if (interval <= 0.0) {
+    printf("Error: The time series sampling interval must be positive.\n");
+    exit(1);
+  }
+
+  ts->start_time = simulation_run_get_time(simulation_run);
+  ts->interval = interval;
+  ts->samples_scheduled = 0;
+
+  new_event.description = "Time Series Sample";
+  new_event.function = time_series_sample_event;
+  new_event.attachment = (void *) ts;
+
+  simulation_run_schedule_event(simulation_run, new_event, ts->start_time);
+}
+
+static void
+time_series_sample_event(Simulation_Run_Ptr simulation_run, void * ts_ptr)
+{
+  Time_Series_Ptr ts = (Time_Series_Ptr) ts_ptr;
+  Event new_event;
+
+  time_series_sample(ts, simulation_run_get_time(simulation_run));
+
+  new_event.description = "Time Series Sample";
+  new_event.function = time_series_sample_event;
+  new_event.attachment = ts_ptr;
+
+  ts->samples_scheduled++;
+  simulation_run_schedule_event(simulation_run, new_event,
+				ts->start_time + ts->samples_scheduled * ts->interval);
+}
+
+/******************************************************************************/
+
+/*
+ * The size in bytes of the compressed streams and of the same rows stored
+ * as plain doubles.
+ */
+
+long int
+time_series_compressed_size(Time_Series_Ptr ts)
+{
+  int i;
+  long int bits = ts->time_stream.bits;
+
+  for (i=0; i<ts->number_of_columns; i++) bits += ts->columns[i].stream.bits;
+  return (bits + 7)/8;
+}
+
+long int
+time_series_raw_size(Time_Series_Ptr ts)
+{
+  return ts->rows * (ts->number_of_columns + 1) * (long int) sizeof(double);
+}
+
+/*
+ * Write the time series to a file. All integers are big endian:
+ *
+ *   "GTS1", rows (8 bytes), resolution (8 byte IEEE double),
+ *   number of columns (4 bytes), then for each column its name length
+ *   (4 bytes) and name, then the time stream and each column stream, as
+ *   the number of bits (8 bytes) followed by the bytes.
+ */
+
+void
+time_series_write(Time_Series_Ptr ts, const char * filename)
+{
+  int i;
+  FILE * file;
+  unsigned long long bits;
+  Bit_Stream_Ptr stream;
+
+  if ((file = fopen(filename, "wb")) == NULL) {
+    printf("Error: Could not open time series file %s.\n", filename);
+    exit(1);
+  }
+
+  fwrite("GTS1", 1, 4, file);
+  write_integer(file, (unsigned long long) ts->rows, 8);
+  memcpy(&bits, &ts->resolution, sizeof(bits));
+  write_integer(file, bits, 8);
+  write_integer(file, (unsigned long long) ts->number_of_columns, 4);
+
+  for (i=0; i<ts->number_of_columns; i++) {
+    write_integer(file, (unsigned long long) strlen(ts->columns[i].name), 4);
+    fwrite(ts->columns[i].name, 1, strlen(ts->columns[i].name), file);
+  }
+
+  for (i=-1; i<ts->number_of_columns; i++) {
+    stream = (i < 0) ? &ts->time_stream : &ts->columns[i].stream;
+    write_integer(file, (unsigned long long) stream->bits, 8);
+    if (stream->bits > 0) fwrite(stream->bytes, 1, (stream->bits + 7)/8, file);
+  }
+
+  fclose(file);
+}
+
+void
+time_series_free(Time_Series_Ptr ts)
+{
+  int i;
+
+  for (i=0; i<ts->number_of_columns; i++)
+    if (ts->columns[i].stream.bytes != NULL)
+      xfree((void *) ts->columns[i].stream.bytes);
+  if (ts->time_stream.bytes != NULL) xfree((void *) ts->time_stream.bytes);
+  xfree((void *) ts);
+}
+
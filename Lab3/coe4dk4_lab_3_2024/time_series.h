@@ -0,0 +1,125 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _TIME_SERIES_H_
+#define _TIME_SERIES_H_
+
+/******************************************************************************/
+
+/*
+ * Compressed time series of model state, for transient analysis.
+ *
+ * A time series has a set of columns, each read through a function that
+ * returns the current value of some state variable (e.g., a queue length). A
+ * row of all columns is recorded either every interval of simulated time, by
+ * a sampling event, or whenever a value has changed.
+ *
+ * The rows are compressed as in Facebook's Gorilla. The sample times are
+ * counted in ticks of the given resolution and stored as delta of deltas,
+ * which costs one bit per row when the sampling is periodic. Each column is
+ * stored as the XOR of a value with the previous one, which costs one bit
+ * when the value did not change and otherwise only the bits between the
+ * leading and trailing zeros. Every column has its own bit stream.
+ *
+ * time_series_write saves the streams to a file, which plot_time_series.py
+ * decodes.
+ */
+
+#define TIME_SERIES_MAX_COLUMNS 16
+#define TIME_SERIES_MAX_NAME 32
+
+typedef double (* Time_Series_Reader)(void *);
+
+typedef struct _bit_stream_
+{
+  unsigned char * bytes;
+  long int allocated;      /* bytes */
+  long int bits;           /* bits written */
+} Bit_Stream, * Bit_Stream_Ptr;
+
+typedef struct _time_series_column_
+{
+  char name[TIME_SERIES_MAX_NAME];
+  Time_Series_Reader read;
+  void * argument;
+  Bit_Stream stream;
+  unsigned long long last_bits;
+  int last_leading;        /* zeros around the last stored XOR, */
+  int last_trailing;       /* -1 before the first one */
+} Time_Series_Column, * Time_Series_Column_Ptr;
+
+typedef struct _time_series_
+{
+  double resolution;       /* simulated time per tick */
+  double start_time;       /* of periodic sampling */
+  double interval;
+  long int samples_scheduled;
+  long int rows;
+  long long last_tick;
+  long long last_delta;
+  Bit_Stream time_stream;
+  int number_of_columns;
+  Time_Series_Column columns[TIME_SERIES_MAX_COLUMNS];
+} Time_Series, * Time_Series_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Time_Series_Ptr
+time_series_new(double);
+
+void
+time_series_add_column(Time_Series_Ptr, const char *, Time_Series_Reader,
+		       void *);
+
+void
+time_series_sample(Time_Series_Ptr, double);
+
+void
+time_series_sample_on_change(Time_Series_Ptr, double);
+
+void
+time_series_start_sampling(Time_Series_Ptr, Simulation_Run_Ptr, double);
+
+long int
+time_series_compressed_size(Time_Series_Ptr);
+
+long int
+time_series_raw_size(Time_Series_Ptr);
+
+void
+time_series_write(Time_Series_Ptr, const char *);
+
+void
+time_series_free(Time_Series_Ptr);
+
+/******************************************************************************/
+
+#endif /* time_series.h */
+
@@ -42,7 +42,9 @@ cleanup (Simulation_Run_Ptr simulation_run)
     while (fifoqueue_size((data->stations+i)->buffer) > 0) {
       xfree(fifoqueue_get((data->stations+i)->buffer));
     }
+    histogram_free((data->stations+i)->delay_histogram);
   }
+  histogram_free(data->delay_histogram);
   xfree(data->stations);
 
   /* Clean out the data channel queue. */
@@ -51,6 +53,9 @@ cleanup (Simulation_Run_Ptr simulation_run)
   }
   xfree(data->data_channel_queue);
   xfree(data->data_channel);
+
+  time_weighted_stat_free(data->station_backlog);
+  time_weighted_stat_free(data->data_queue_length);
   
   /* Clean out the channel. */
   xfree(data->channel);
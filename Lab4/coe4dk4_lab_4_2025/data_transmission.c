@@ -105,6 +105,12 @@ data_transmission_end_event(Simulation_Run_Ptr simulation_run, void * packet)
 
   data->number_of_collisions += this_packet->collision_count;
   data->accumulated_delay += now - this_packet->arrive_time;
+  data->accumulated_squared_delay +=
+    (now - this_packet->arrive_time) * (now - this_packet->arrive_time);
+
+  histogram_record((data->stations + this_packet->station_id)->delay_histogram,
+		   now - this_packet->arrive_time);
+  histogram_record(data->delay_histogram, now - this_packet->arrive_time);
   output_blip_to_screen(simulation_run);
 
   /* This packet is done. */
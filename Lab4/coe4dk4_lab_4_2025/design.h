@@ -0,0 +1,70 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _DESIGN_H_
+#define _DESIGN_H_
+
+/******************************************************************************/
+
+/*
+ * Space-filling designs of experiments in the unit cube.
+ *
+ * A full factorial grid over d factors grows as (levels)^d. These designs
+ * place a fixed number n of points so that they cover the cube evenly, each
+ * point being a row of d coordinates in [0, 1), to be mapped onto the
+ * factor ranges by the caller.
+ *
+ * Latin hypercube: each factor's range is cut into n equal strata and each
+ * stratum is used by exactly one point, at a uniform random position in it;
+ * the strata are matched up across factors by independent random
+ * permutations. Every one-dimensional projection is thus evenly covered
+ * whatever n is. The design is fixed by its seed.
+ *
+ * Sobol: the low-discrepancy sequence of Sobol, with the primitive
+ * polynomials and direction numbers of Joe and Kuo, starting from the
+ * origin. The points fill the cube more evenly than random ones in every
+ * projection, best when n is a power of two. The design is deterministic
+ * and extends: the first n points of a larger design are the smaller one.
+ */
+
+#define DESIGN_MAX_DIMENSIONS 16
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+void
+design_latin_hypercube(int, int, unsigned, double *);
+
+void
+design_sobol(int, int, double *);
+
+/******************************************************************************/
+
+#endif /* design.h */
+
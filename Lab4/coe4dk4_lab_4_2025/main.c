@@ -32,11 +32,271 @@
 #include "packet_arrival.h"
 #include "packet_transmission.h"
 #include "main.h"
+#include "sweep.h"
+#include "selection.h"
+
+/*******************************************************************************/
+
+/*
+ * The parameters that can be swept from the command line. Without arguments
+ * the program runs with these defaults, as before.
+ */
+
+int NUMBER_OF_STATIONS = NUMBER_OF_STATIONS_DEFAULT;
+double MEAN_PACKET_DURATION = MEAN_PACKET_DURATION_DEFAULT;
+double PACKET_ARRIVAL_RATE = PACKET_ARRIVAL_RATE_DEFAULT;
+double MEAN_DATA_PACKET_DURATION = MEAN_DATA_PACKET_DURATION_DEFAULT;
+double SLOT_DURATION_XR = SLOT_DURATION_XR_DEFAULT;
+double RUNLENGTH = RUNLENGTH_DEFAULT;
+
+/* The indices of the sweep outputs. */
+typedef struct _sweep_outputs_
+{
+  int mean_delay;
+  int p99_delay;
+  int exceed;
+  int collisions_per_packet;
+  int service_fraction;
+  int mean_station_backlog;
+  int mean_data_queue_length;
+} Sweep_Outputs;
+
+/*******************************************************************************/
+
+/*
+ * Create a new simulation_run with the given seed and execute events until
+ * RUNLENGTH packets have been processed. The caller sets data->quiet and
+ * cleans up.
+ */
+
+static Simulation_Run_Ptr
+run_simulation(Simulation_Run_Data_Ptr data, unsigned random_seed)
+{
+  Simulation_Run_Ptr simulation_run;
+  int i;
+
+  /* Set the random generator seed. */
+  random_generator_initialize(random_seed);
+
+  /* Create a new simulation_run. This gives a clock and
+     eventlist. Clock time is set to zero. */
+  simulation_run = (Simulation_Run_Ptr) simulation_run_new();
+
+  /* Add our data definitions to the simulation_run. */
+  simulation_run_set_data(simulation_run, (void *) data);
+
+  /* Create and initalize the stations. */
+  data->stations = (Station_Ptr) xcalloc((unsigned int) NUMBER_OF_STATIONS,
+					 sizeof(Station));
+
+  /* Initialize various simulation_run variables. */
+  data->blip_counter = 0;
+  data->arrival_count = 0;
+  data->number_of_packets_processed = 0;
+  data->number_of_collisions = 0;
+  data->accumulated_delay = 0.0;
+  data->accumulated_squared_delay = 0.0;
+  data->delay_histogram = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+					DELAY_HISTOGRAM_HIGHEST);
+  data->random_seed = random_seed;
+  output_metrics_start(simulation_run);
+    
+  /* Initialize the stations. */
+  for(i=0; i<NUMBER_OF_STATIONS; i++) {
+    (data->stations+i)->id = i;
+    (data->stations+i)->buffer = fifoqueue_new();
+    (data->stations+i)->packet_count = 0;
+    (data->stations+i)->accumulated_delay = 0.0;
+    (data->stations+i)->mean_delay = 0;
+    (data->stations+i)->delay_histogram =
+      histogram_new(DELAY_HISTOGRAM_RESOLUTION, DELAY_HISTOGRAM_HIGHEST);
+  }
+
+  /* Create and initialize the channel. */
+  data->channel = channel_new();
+  data->data_channel = channel_new();
+  data->data_channel_queue = fifoqueue_new();
+
+  /* Time averages of the packets held at the stations and of those
+     waiting for the data channel. */
+  data->station_backlog = time_weighted_stat_new(simulation_run);
+  for(i=0; i<NUMBER_OF_STATIONS; i++)
+    fifoqueue_attach_stat((data->stations+i)->buffer, data->station_backlog);
+  data->data_queue_length = time_weighted_stat_new(simulation_run);
+  fifoqueue_attach_stat(data->data_channel_queue, data->data_queue_length);
+
+  /* Schedule initial packet arrival. */
+  schedule_packet_arrival_event(simulation_run, 
+		  simulation_run_get_time(simulation_run) +
+		  exponential_generator((double) 1.0/PACKET_ARRIVAL_RATE));
+
+  /* Execute events until we are finished. */
+  while(data->number_of_packets_processed < RUNLENGTH) {
+    simulation_run_execute_event(simulation_run);
+  }
+
+  return simulation_run;
+}
+
+/*******************************************************************************/
+
+/*
+ * One job of a sweep: a run at the current parameter values.
+ */
+
+static void
+sweep_model(Sweep_Ptr sweep, unsigned random_seed, void * outputs_ptr)
+{
+  Sweep_Outputs * outputs = (Sweep_Outputs *) outputs_ptr;
+  Simulation_Run_Ptr simulation_run;
+  Simulation_Run_Data data;
+
+  data.quiet = 1;
+  simulation_run = run_simulation(&data, random_seed);
+
+  sweep_set_output(sweep, outputs->mean_delay,
+		   data.accumulated_delay/data.number_of_packets_processed);
+  sweep_set_output(sweep, outputs->p99_delay,
+		   histogram_quantile(data.delay_histogram, 0.99));
+  sweep_set_output(sweep, outputs->exceed,
+		   histogram_exceedance(data.delay_histogram, DELAY_BOUND));
+  sweep_set_output(sweep, outputs->collisions_per_packet,
+		   (double) data.number_of_collisions/
+		   data.number_of_packets_processed);
+  sweep_set_output(sweep, outputs->service_fraction,
+		   (double) data.number_of_packets_processed/data.arrival_count);
+  sweep_set_output(sweep, outputs->mean_station_backlog,
+		   time_weighted_stat_mean(data.station_backlog));
+  sweep_set_output(sweep, outputs->mean_data_queue_length,
+		   time_weighted_stat_mean(data.data_queue_length));
+
+  cleanup(simulation_run);
+}
+
+/*
+ * Run the sweep described by the command line (see sweep.h).
+ */
+
+static int
+sweep_main(int argc, char * argv[])
+{
+  unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST, 0};
+  Sweep_Outputs outputs;
+  Sweep_Ptr sweep;
+  int missing;
+
+  sweep = sweep_new("lab4_aloha_reservation", RANDOM_SEEDS);
+  sweep_add_integer_parameter(sweep, "number_of_stations", &NUMBER_OF_STATIONS);
+  sweep_add_parameter(sweep, "mean_packet_duration", &MEAN_PACKET_DURATION);
+  sweep_add_parameter(sweep, "packet_arrival_rate", &PACKET_ARRIVAL_RATE);
+  sweep_add_parameter(sweep, "mean_data_packet_duration",
+		      &MEAN_DATA_PACKET_DURATION);
+  sweep_add_parameter(sweep, "slot_duration_xr", &SLOT_DURATION_XR);
+  sweep_add_parameter(sweep, "runlength", &RUNLENGTH);
+
+  outputs.mean_delay = sweep_add_output(sweep, "mean_delay");
+  outputs.p99_delay = sweep_add_output(sweep, "p99_delay");
+  outputs.exceed = sweep_add_output(sweep, "exceed_delay_bound");
+  outputs.collisions_per_packet = sweep_add_output(sweep, "collisions_per_packet");
+  outputs.service_fraction = sweep_add_output(sweep, "service_fraction");
+  outputs.mean_station_backlog = sweep_add_output(sweep, "mean_station_backlog");
+  outputs.mean_data_queue_length = sweep_add_output(sweep, "mean_data_queue_length");
+
+  sweep_parse_arguments(sweep, argc, argv);
+  missing = sweep_run(sweep, sweep_model, (void *) &outputs);
+  sweep_free(sweep);
+
+  return missing > 0;
+}
+
+/*******************************************************************************/
+
+#if SELECTION_MODE
+
+static double SLOT_DURATIONS[] = {SELECTION_SLOT_DURATION_XR_LIST};
+
+/*
+ * The seed of replication r of every system: the seeds of RANDOM_SEED_LIST,
+ * then offsets of them.
+ */
+
+static unsigned
+replication_seed(int r)
+{
+  unsigned RANDOM_SEEDS[] = {RANDOM_SEED_LIST};
+  int number_of_seeds = sizeof(RANDOM_SEEDS)/sizeof(RANDOM_SEEDS[0]);
+
+  return RANDOM_SEEDS[r % number_of_seeds] + r/number_of_seeds;
+}
+
+/*
+ * One replication of the mean delay with the given slot duration.
+ */
+
+static double
+selection_model(int system, int replication, void * argument)
+{
+  Simulation_Run_Ptr simulation_run;
+  Simulation_Run_Data data;
+  double mean_delay;
+
+  SLOT_DURATION_XR = SLOT_DURATIONS[system];
+  data.quiet = 1;
+  simulation_run = run_simulation(&data, replication_seed(replication));
+  mean_delay = data.accumulated_delay/data.number_of_packets_processed;
+  cleanup(simulation_run);
+
+  return mean_delay;
+}
+
+/*
+ * Choose the slot duration with the smallest mean delay. Results go to
+ * selection_results.csv.
+ */
+
+static int
+slot_duration_selection(void)
+{
+  int number_of_systems = sizeof(SLOT_DURATIONS)/sizeof(SLOT_DURATIONS[0]);
+  Selection_Ptr selection;
+  FILE * csv;
+  int i;
+
+  if ((csv = fopen("selection_results.csv", "w")) == NULL) {
+    perror("Failed to open selection_results.csv");
+    return 1;
+  }
+
+  RUNLENGTH = SELECTION_RUNLENGTH;
+  selection = selection_new(number_of_systems, SELECTION_INDIFFERENCE_ZONE,
+			    SELECTION_CONFIDENCE);
+  selection->first_stage = SELECTION_FIRST_STAGE;
+  selection->max_replications = SELECTION_MAX_REPLICATIONS;
+  selection_run(selection, selection_model, NULL);
+
+  fprintf(csv, "slot_duration_xr,replications,mean_delay,eliminated_at,selected\n");
+  for (i=0; i<number_of_systems; i++)
+    fprintf(csv, "%.4f,%ld,%.6f,%ld,%d\n", SLOT_DURATIONS[i],
+	    selection->replications[i], selection_mean(selection, i),
+	    selection->eliminated_at[i], i == selection->best);
+  fclose(csv);
+
+  printf("Slot duration Xr = %.4f %s: mean delay %.4f, %ld replications "
+	 "in %ld stages\n", SLOT_DURATIONS[selection->best],
+	 selection->status == SELECTION_SELECTED ? "selected" :
+	 "best at the replication limit", selection_mean(selection,
+	 selection->best), selection->total_replications, selection->stages);
+
+  selection_free(selection);
+  return 0;
+}
+
+#endif /* SELECTION_MODE */
 
 /*******************************************************************************/
 
 int
-main(void)
+main(int argc, char * argv[])
 {
   /* Get the list of random number generator seeds defined in simparameters.h */
   unsigned random_seed;
@@ -46,62 +306,49 @@ main(void)
   Simulation_Run_Data data;
   int i, j=0;
 
-  /* Do a new simulation_run for each random number generator seed. */
-  while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
+  /* The delays of all runs, merged, over all stations and per station. */
+  Histogram_Ptr all_delays, * station_delays;
 
-    /* Set the random generator seed. */
-    random_generator_initialize(random_seed);
+  if (argc > 1) return sweep_main(argc, argv);
 
-    /* Create a new simulation_run. This gives a clock and
-       eventlist. Clock time is set to zero. */
-    simulation_run = (Simulation_Run_Ptr) simulation_run_new();
+#if SELECTION_MODE
+  return slot_duration_selection();
+#endif
 
-    /* Add our data definitions to the simulation_run. */
-    simulation_run_set_data(simulation_run, (void *) & data);
+  all_delays = histogram_new(DELAY_HISTOGRAM_RESOLUTION, DELAY_HISTOGRAM_HIGHEST);
+  station_delays = (Histogram_Ptr *) xcalloc(NUMBER_OF_STATIONS,
+					     sizeof(Histogram_Ptr));
+  for(i=0; i<NUMBER_OF_STATIONS; i++)
+    station_delays[i] = histogram_new(DELAY_HISTOGRAM_RESOLUTION,
+				      DELAY_HISTOGRAM_HIGHEST);
 
-    /* Create and initalize the stations. */
-    data.stations = (Station_Ptr) xcalloc((unsigned int) NUMBER_OF_STATIONS,
-					  sizeof(Station));
+  /* Do a new simulation_run for each random number generator seed. */
+  while ((random_seed = RANDOM_SEEDS[j++]) != 0) {
 
-    /* Initialize various simulation_run variables. */
-    data.blip_counter = 0;
-    data.arrival_count = 0;
-    data.number_of_packets_processed = 0;
-    data.number_of_collisions = 0;
-    data.accumulated_delay = 0.0;
-    data.random_seed = random_seed;
-    
-    /* Initialize the stations. */
-    for(i=0; i<NUMBER_OF_STATIONS; i++) {
-      (data.stations+i)->id = i;
-      (data.stations+i)->buffer = fifoqueue_new();
-      (data.stations+i)->packet_count = 0;
-      (data.stations+i)->accumulated_delay = 0.0;
-      (data.stations+i)->mean_delay = 0;
-    }
-
-    /* Create and initialize the channel. */
-    data.channel = channel_new();
-    data.data_channel = channel_new();
-    data.data_channel_queue = fifoqueue_new();
-
-    /* Schedule initial packet arrival. */
-    schedule_packet_arrival_event(simulation_run, 
-		    simulation_run_get_time(simulation_run) +
-		    exponential_generator((double) 1.0/PACKET_ARRIVAL_RATE));
-
-    /* Execute events until we are finished. */
-    while(data.number_of_packets_processed < RUNLENGTH) {
-      simulation_run_execute_event(simulation_run);
-    }
+    data.quiet = 0;
+    simulation_run = run_simulation(&data, random_seed);
 
     /* Print out some results. */
     output_results(simulation_run);
 
+    histogram_merge(all_delays, data.delay_histogram);
+    for(i=0; i<NUMBER_OF_STATIONS; i++)
+      histogram_merge(station_delays[i], (data.stations+i)->delay_histogram);
+
     /* Clean up memory. */
     cleanup(simulation_run);
   }
 
+  printf("Over all runs:\n");
+  output_histogram("All stations ", all_delays);
+  for(i=0; i<NUMBER_OF_STATIONS; i++) {
+    printf("Station %2i ", i);
+    output_histogram("", station_delays[i]);
+  }
+  histogram_free(all_delays);
+  for(i=0; i<NUMBER_OF_STATIONS; i++) histogram_free(station_delays[i]);
+  xfree((void *) station_delays);
+
   /* Pause before finishing. */
   getchar();
 
@@ -33,9 +33,18 @@
 #include "simlib.h"
 #include "simparameters.h"
 #include "channel.h"
+#include "histogram.h"
 
 /**********************************************************************/
 
+/* The parameters that can be swept, defined in main.c. */
+extern int NUMBER_OF_STATIONS;
+extern double MEAN_PACKET_DURATION;
+extern double PACKET_ARRIVAL_RATE;
+extern double MEAN_DATA_PACKET_DURATION;
+extern double SLOT_DURATION_XR;
+extern double RUNLENGTH;
+
 typedef double Time;
 typedef Fifoqueue_Ptr Buffer_Ptr;
 
@@ -48,6 +57,7 @@ typedef struct _station_
   long int packet_count;
   double accumulated_delay;
   double mean_delay;
+  Histogram_Ptr delay_histogram;
 } Station, * Station_Ptr;
 
 /**********************************************************************/
@@ -75,7 +85,12 @@ typedef struct _simulation_run_data_
   long int number_of_packets_processed;
   long int number_of_collisions;
   double accumulated_delay;
+  double accumulated_squared_delay;
+  Histogram_Ptr delay_histogram; /* over all stations */
+  Time_Weighted_Stat_Ptr station_backlog; /* packets in all station buffers */
+  Time_Weighted_Stat_Ptr data_queue_length;
   unsigned random_seed;
+  int quiet; /* No progress messages. */
 } Simulation_Run_Data, * Simulation_Run_Data_Ptr;
 
 /**********************************************************************/
@@ -85,7 +100,7 @@ typedef struct _simulation_run_data_
  */
 
 int
-main(void);
+main(int, char *[]);
 
 /**********************************************************************/
 
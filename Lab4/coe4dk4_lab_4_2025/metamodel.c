@@ -0,0 +1,417 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "metamodel.h"
+
+/******************************************************************************/
+
+/*
+ * Create a metamodel of an output depending on the given number of inputs.
+ */
+
+Metamodel_Ptr
+metamodel_new(int dimensions)
+{
+  Metamodel_Ptr metamodel;
+
+  if (dimensions < 1 || dimensions > METAMODEL_MAX_DIMENSIONS) {
+    printf("Error: A metamodel cannot have %d inputs.\n", dimensions);
+    exit(1);
+  }
+
+  metamodel = (Metamodel_Ptr) xcalloc(1, sizeof(Metamodel));
+  metamodel->dimensions = dimensions;
+  return metamodel;
+}
+
+static void
+metamodel_free_fit(Metamodel_Ptr metamodel)
+{
+  if (metamodel->response != NULL) xfree((void *) metamodel->response);
+  if (metamodel->noise != NULL) xfree((void *) metamodel->noise);
+  if (metamodel->cholesky != NULL) xfree((void *) metamodel->cholesky);
+  if (metamodel->weights != NULL) xfree((void *) metamodel->weights);
+  if (metamodel->inverse_ones != NULL) xfree((void *) metamodel->inverse_ones);
+  metamodel->response = metamodel->noise = metamodel->cholesky = NULL;
+  metamodel->weights = metamodel->inverse_ones = NULL;
+  metamodel->fitted = 0;
+}
+
+/*
+ * Make room for one more point, doubling the arrays when they are full.
+ */
+
+static void
+metamodel_grow(Metamodel_Ptr metamodel)
+{
+  int d = metamodel->dimensions, n = metamodel->number_of_points;
+  int max_points = (metamodel->max_points > 0) ? 2 * metamodel->max_points : 64;
+  double * x, * mean, * m2;
+  long int * count;
+
+  x = (double *) xcalloc(max_points * d, sizeof(double));
+  count = (long int *) xcalloc(max_points, sizeof(long int));
+  mean = (double *) xcalloc(max_points, sizeof(double));
+  m2 = (double *) xcalloc(max_points, sizeof(double));
+
+  if (metamodel->max_points > 0) {
+    memcpy(x, metamodel->x, n * d * sizeof(double));
+    memcpy(count, metamodel->count, n * sizeof(long int));
+    memcpy(mean, metamodel->mean, n * sizeof(double));
+    memcpy(m2, metamodel->m2, n * sizeof(double));
+    xfree((void *) metamodel->x);
+    xfree((void *) metamodel->count);
+    xfree((void *) metamodel->mean);
+    xfree((void *) metamodel->m2);
+  }
+
+  metamodel->x = x;
+  metamodel->count = count;
+  metamodel->mean = mean;
+  metamodel->m2 = m2;
+  metamodel->max_points = max_points;
+}
+
+/*
+ * Add one replication y of the output at x.
+ */
+
+void
+metamodel_add(Metamodel_Ptr metamodel, const double * x, double y)
+{
+  int d = metamodel->dimensions, i;
+  double delta;
+
+  for (i=0; i<metamodel->number_of_points; i++)
+    if (memcmp(metamodel->x + i * d, x, d * sizeof(double)) == 0) break;
+
+  if (i == metamodel->number_of_points) {
+    if (i == metamodel->max_points) metamodel_grow(metamodel);
+    memcpy(metamodel->x + i * d, x, d * sizeof(double));
+    metamodel->count[i] = 0;
+    metamodel->mean[i] = 0.0;
+    metamodel->m2[i] = 0.0;
+    metamodel->number_of_points++;
+  }
+
+  /* Welford's update. */
+  metamodel->count[i]++;
+  delta = y - metamodel->mean[i];
+  metamodel->mean[i] += delta / metamodel->count[i];
+  metamodel->m2[i] += delta * (y - metamodel->mean[i]);
+
+  metamodel_free_fit(metamodel);
+}
+
+/******************************************************************************/
+
+static double
+metamodel_correlation(Metamodel_Ptr metamodel, const double * theta,
+		      const double * a, const double * b)
+{
+  double sum = 0.0, d, range;
+  int j;
+
+  for (j=0; j<metamodel->dimensions; j++) {
+    range = metamodel->upper[j] - metamodel->lower[j];
+    d = (a[j] - b[j]) / (range > 0.0 ? range : 1.0);
+    sum += theta[j] * d * d;
+  }
+  return exp(-sum);
+}
+
+/*
+ * Cholesky decomposition of the n by n matrix a, in place (lower triangle).
+ * Returns 0 if it is not positive definite.
+ */
+
+static int
+metamodel_cholesky(double * a, int n)
+{
+  double sum;
+  int i, j, k;
+
+  for (j=0; j<n; j++) {
+    sum = a[j*n + j];
+    for (k=0; k<j; k++) sum -= a[j*n + k] * a[j*n + k];
+    if (sum <= 0.0) return 0;
+    a[j*n + j] = sqrt(sum);
+    for (i=j+1; i<n; i++) {
+      sum = a[i*n + j];
+      for (k=0; k<j; k++) sum -= a[i*n + k] * a[j*n + k];
+      a[i*n + j] = sum / a[j*n + j];
+    }
+  }
+  return 1;
+}
+
+/*
+ * Solve L L' x = b for x, given the Cholesky factor L.
+ */
+
+static void
+metamodel_solve(const double * l, int n, const double * b, double * x)
+{
+  double sum;
+  int i, k;
+
+  for (i=0; i<n; i++) {
+    sum = b[i];
+    for (k=0; k<i; k++) sum -= l[i*n + k] * x[k];
+    x[i] = sum / l[i*n + i];
+  }
+  for (i=n-1; i>=0; i--) {
+    sum = x[i];
+    for (k=i+1; k<n; k++) sum -= l[k*n + i] * x[k];
+    x[i] = sum / l[i*n + i];
+  }
+}
+
+/*
+ * Set up the fit for the given theta and tau^2 and return its log
+ * likelihood.
+ */
+
+static double
+metamodel_decompose(Metamodel_Ptr metamodel, const double * theta,
+		    double process_variance)
+{
+  int n = metamodel->number_of_points, d = metamodel->dimensions, i, j;
+  double * c = metamodel->cholesky, * ones, * residual;
+  double jitter = 1e-10 * process_variance, log_determinant, sum;
+
+  /* Add a little to the diagonal until the covariance factors. */
+  for (;;) {
+    for (i=0; i<n; i++) {
+      for (j=0; j<=i; j++)
+	c[i*n + j] = c[j*n + i] = process_variance *
+	  metamodel_correlation(metamodel, theta, metamodel->x + i * d,
+				metamodel->x + j * d);
+      c[i*n + i] += metamodel->noise[i] + jitter;
+    }
+    if (metamodel_cholesky(c, n)) break;
+    jitter = (jitter > 0.0) ? 10 * jitter : 1e-10;
+  }
+
+  ones = (double *) xcalloc(n, sizeof(double));
+  residual = (double *) xcalloc(n, sizeof(double));
+
+  for (i=0; i<n; i++) ones[i] = 1.0;
+  metamodel_solve(c, n, ones, metamodel->inverse_ones);
+
+  metamodel->ones_sum = 0.0;
+  sum = 0.0;
+  for (i=0; i<n; i++) {
+    metamodel->ones_sum += metamodel->inverse_ones[i];
+    sum += metamodel->inverse_ones[i] * metamodel->response[i];
+  }
+  metamodel->trend = sum / metamodel->ones_sum;
+
+  for (i=0; i<n; i++) residual[i] = metamodel->response[i] - metamodel->trend;
+  metamodel_solve(c, n, residual, metamodel->weights);
+
+  log_determinant = 0.0;
+  sum = 0.0;
+  for (i=0; i<n; i++) {
+    log_determinant += 2 * log(c[i*n + i]);
+    sum += residual[i] * metamodel->weights[i];
+  }
+
+  xfree((void *) ones);
+  xfree((void *) residual);
+
+  return -0.5 * (log_determinant + sum);
+}
+
+/*
+ * Fit the metamodel to the points added so far.
+ */
+
+void
+metamodel_fit(Metamodel_Ptr metamodel)
+{
+  int n = metamodel->number_of_points, d = metamodel->dimensions;
+  int i, j, k, improved;
+  double parameters[METAMODEL_MAX_DIMENSIONS + 1];
+  double best[METAMODEL_MAX_DIMENSIONS + 1];
+  double theta[METAMODEL_MAX_DIMENSIONS];
+  double pooled = 0.0, spread = 0.0, overall = 0.0, likelihood, best_likelihood;
+  double step, low, high;
+  long int pooled_points = 0;
+
+  if (n == 0) {
+    printf("Error: The metamodel has no points to fit.\n");
+    exit(1);
+  }
+
+  metamodel_free_fit(metamodel);
+  metamodel->response = (double *) xcalloc(n, sizeof(double));
+  metamodel->noise = (double *) xcalloc(n, sizeof(double));
+  metamodel->cholesky = (double *) xcalloc(n * n, sizeof(double));
+  metamodel->weights = (double *) xcalloc(n, sizeof(double));
+  metamodel->inverse_ones = (double *) xcalloc(n, sizeof(double));
+
+  /* The range of the design. */
+  for (j=0; j<d; j++) {
+    metamodel->lower[j] = metamodel->upper[j] = metamodel->x[j];
+    for (i=1; i<n; i++) {
+      metamodel->lower[j] = fmin(metamodel->lower[j], metamodel->x[i*d + j]);
+      metamodel->upper[j] = fmax(metamodel->upper[j], metamodel->x[i*d + j]);
+    }
+  }
+
+  /* The noise of the point means, pooled where there is one replication. */
+  for (i=0; i<n; i++) {
+    if (metamodel->count[i] >= 2) {
+      pooled += metamodel->m2[i] / (metamodel->count[i] - 1);
+      pooled_points++;
+    }
+  }
+  if (pooled_points > 0) pooled /= pooled_points;
+  for (i=0; i<n; i++)
+    metamodel->noise[i] = (metamodel->count[i] >= 2) ?
+      metamodel->m2[i] / (metamodel->count[i] - 1) / metamodel->count[i] :
+      pooled;
+
+  /* On the log scale, var(log m) is about var(m) / m^2. */
+  for (i=0; i<n; i++) {
+    metamodel->response[i] = metamodel->mean[i];
+    if (metamodel->log_scale) {
+      if (metamodel->mean[i] <= 0.0) {
+	printf("Error: A log scale metamodel needs positive outputs.\n");
+	exit(1);
+      }
+      metamodel->response[i] = log(metamodel->mean[i]);
+      metamodel->noise[i] /= metamodel->mean[i] * metamodel->mean[i];
+    }
+  }
+
+  /* Start tau^2 at the spread of the means and theta at 1. */
+  for (i=0; i<n; i++) overall += metamodel->response[i] / n;
+  for (i=0; i<n; i++)
+    spread += (metamodel->response[i] - overall) *
+      (metamodel->response[i] - overall);
+  spread = (n > 1 && spread > 0.0) ? spread / (n - 1) : 1.0;
+
+  parameters[0] = log(spread);
+  for (j=0; j<d; j++) parameters[j+1] = 0.0;
+
+  /* Coordinate search of the log likelihood over log tau^2 and log theta. */
+  for (j=0; j<d; j++) theta[j] = exp(parameters[j+1]);
+  best_likelihood = metamodel_decompose(metamodel, theta, exp(parameters[0]));
+  memcpy(best, parameters, (d + 1) * sizeof(double));
+
+  for (step=2.0; step>0.05; ) {
+    improved = 0;
+    for (k=0; k<=d; k++) {
+      low = (k == 0) ? log(spread) - 10 : log(1e-3);
+      high = (k == 0) ? log(spread) + 10 : log(1e4);
+      for (i=-1; i<=1; i+=2) {
+	memcpy(parameters, best, (d + 1) * sizeof(double));
+	parameters[k] += i * step;
+	if (parameters[k] < low || parameters[k] > high) continue;
+	for (j=0; j<d; j++) theta[j] = exp(parameters[j+1]);
+	likelihood = metamodel_decompose(metamodel, theta, exp(parameters[0]));
+	if (likelihood > best_likelihood) {
+	  best_likelihood = likelihood;
+	  memcpy(best, parameters, (d + 1) * sizeof(double));
+	  improved = 1;
+	  break;
+	}
+      }
+    }
+    if (!improved) step /= 2;
+  }
+
+  for (j=0; j<d; j++) metamodel->theta[j] = exp(best[j+1]);
+  metamodel->process_variance = exp(best[0]);
+  metamodel->log_likelihood =
+    metamodel_decompose(metamodel, metamodel->theta, metamodel->process_variance);
+  metamodel->fitted = 1;
+}
+
+/*
+ * Predict the mean output at x, with its standard error. The metamodel is
+ * fitted first if needed.
+ */
+
+void
+metamodel_predict(Metamodel_Ptr metamodel, const double * x, double * mean,
+		  double * standard_error)
+{
+  int n = metamodel->number_of_points, d = metamodel->dimensions, i;
+  double * r, * v, mse, sum;
+
+  if (!metamodel->fitted) metamodel_fit(metamodel);
+
+  r = (double *) xcalloc(n, sizeof(double));
+  v = (double *) xcalloc(n, sizeof(double));
+
+  for (i=0; i<n; i++)
+    r[i] = metamodel->process_variance *
+      metamodel_correlation(metamodel, metamodel->theta, x, metamodel->x + i * d);
+  metamodel_solve(metamodel->cholesky, n, r, v);
+
+  *mean = metamodel->trend;
+  mse = metamodel->process_variance;
+  sum = 0.0;
+  for (i=0; i<n; i++) {
+    *mean += r[i] * metamodel->weights[i];
+    mse -= r[i] * v[i];
+    sum += v[i];
+  }
+  /* The uncertainty of the estimated trend. */
+  mse += (1.0 - sum) * (1.0 - sum) / metamodel->ones_sum;
+  *standard_error = (mse > 0.0) ? sqrt(mse) : 0.0;
+
+  if (metamodel->log_scale) {
+    *mean = exp(*mean);
+    *standard_error *= *mean;
+  }
+
+  xfree((void *) r);
+  xfree((void *) v);
+}
+
+void
+metamodel_free(Metamodel_Ptr metamodel)
+{
+  metamodel_free_fit(metamodel);
+  if (metamodel->max_points > 0) {
+    xfree((void *) metamodel->x);
+    xfree((void *) metamodel->count);
+    xfree((void *) metamodel->mean);
+    xfree((void *) metamodel->m2);
+  }
+  xfree((void *) metamodel);
+}
+
@@ -29,6 +29,28 @@
 
 /*******************************************************************************/
 
+/*
+ * Add the live metrics of a run, if it publishes them (see output.h).
+ */
+
+void
+output_metrics_start(Simulation_Run_Ptr simulation_run)
+{
+  char label[METRICS_LABEL_SIZE];
+
+  if (simulation_run->metrics == NULL) return;
+
+  sprintf(label, "stations %d, arrival rate %g", NUMBER_OF_STATIONS,
+	  PACKET_ARRIVAL_RATE);
+  simulation_run_metrics_label(simulation_run, label);
+  simulation_run_metrics_counter(simulation_run, "arrivals");
+  simulation_run_metrics_counter(simulation_run, "packets processed");
+  simulation_run_metrics_counter(simulation_run, "collisions");
+  simulation_run_metrics_estimate(simulation_run, "mean delay");
+}
+
+/*******************************************************************************/
+
 void
 output_blip_to_screen(Simulation_Run_Ptr simulation_run)
 {
@@ -39,6 +61,23 @@ output_blip_to_screen(Simulation_Run_Ptr simulation_run)
 
   data->blip_counter++;
 
+  /* Publish the live metrics, which is cheap, at every packet. */
+  SIMULATION_RUN_METRICS_PROGRESS(simulation_run,
+		  (double) data->number_of_packets_processed/RUNLENGTH);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, OUTPUT_METRICS_ARRIVALS,
+				 data->arrival_count);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run,
+				 OUTPUT_METRICS_PACKETS_PROCESSED,
+				 data->number_of_packets_processed);
+  SIMULATION_RUN_METRICS_COUNTER(simulation_run, OUTPUT_METRICS_COLLISIONS,
+				 data->number_of_collisions);
+  SIMULATION_RUN_METRICS_ESTIMATE(simulation_run, OUTPUT_METRICS_DELAY,
+				  data->number_of_packets_processed,
+				  data->accumulated_delay,
+				  data->accumulated_squared_delay);
+
+  if (data->quiet) return;
+
   if((data->blip_counter >= BLIPRATE)
      ||
      (data->number_of_packets_processed >= RUNLENGTH)) {
@@ -85,14 +124,46 @@ void output_results(Simulation_Run_Ptr this_simulation_run)
 	 (double) sim_data->number_of_collisions / 
 	 sim_data->number_of_packets_processed);
 
+  printf("Mean station backlog = %.3f (max = %d)\n",
+	 time_weighted_stat_mean(sim_data->station_backlog),
+	 sim_data->station_backlog->max_value);
+  printf("Mean data channel queue = %.3f (P(empty) = %.4f, max = %d)\n",
+	 time_weighted_stat_mean(sim_data->data_queue_length),
+	 time_weighted_stat_probability(sim_data->data_queue_length, 0),
+	 sim_data->data_queue_length->max_value);
+
   for(i=0; i<NUMBER_OF_STATIONS; i++) {
 
     printf("Station %2i Mean Delay = %8.1f \n", i,
 	   (sim_data->stations+i)->accumulated_delay / 
 	   (sim_data->stations+i)->packet_count);
   }
+
+  output_histogram("All stations ", sim_data->delay_histogram);
+  for(i=0; i<NUMBER_OF_STATIONS; i++) {
+    printf("Station %2i ", i);
+    output_histogram("", (sim_data->stations+i)->delay_histogram);
+  }
   printf("\n\n");
 }
 
+/**********************************************************************/
+
+/*
+ * Print one line of delay percentiles and the fraction of packets whose
+ * delay exceeded DELAY_BOUND.
+ */
+
+void output_histogram(const char * name, Histogram_Ptr histogram)
+{
+  printf("%sDelay p50 = %8.2f p99 = %8.2f p99.9 = %8.2f max = %8.2f "
+	 "P(> %g) = %.5f\n", name,
+	 histogram_quantile(histogram, 0.5),
+	 histogram_quantile(histogram, 0.99),
+	 histogram_quantile(histogram, 0.999),
+	 histogram->max, DELAY_BOUND,
+	 histogram_exceedance(histogram, DELAY_BOUND));
+}
+
 
 
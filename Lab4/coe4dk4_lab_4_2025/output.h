@@ -32,16 +32,33 @@
 
 /*******************************************************************************/
 
+/*
+ * The live metrics of a run (see metrics.h), added in this order.
+ */
+
+typedef enum {OUTPUT_METRICS_ARRIVALS, OUTPUT_METRICS_PACKETS_PROCESSED,
+	      OUTPUT_METRICS_COLLISIONS} Output_Metrics_Counter;
+
+typedef enum {OUTPUT_METRICS_DELAY} Output_Metrics_Estimate;
+
+/*******************************************************************************/
+
 /*
  * Function prototypes
  */
 
+void
+output_metrics_start(Simulation_Run_Ptr);
+
 void
 output_blip_to_screen(Simulation_Run_Ptr);
 
 void
 output_results(Simulation_Run_Ptr);
 
+void
+output_histogram(const char *, Histogram_Ptr);
+
 /*******************************************************************************/
 
 #endif /* output.h */
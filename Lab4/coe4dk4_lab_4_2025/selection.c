@@ -0,0 +1,240 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "simlib.h"
+#include "selection.h"
+
+/******************************************************************************/
+
+/*
+ * Select the best of number_of_systems systems, correctly with the given
+ * confidence when it is better than the others by at least
+ * indifference_zone. The other settings can be changed before running.
+ */
+
+Selection_Ptr
+selection_new(int number_of_systems, double indifference_zone,
+	      double confidence)
+{
+  Selection_Ptr selection;
+
+  if (number_of_systems < 1 || indifference_zone <= 0.0 ||
+      !(confidence > 0.0 && confidence < 1.0)) {
+    printf("Error: Bad selection of %d systems.\n", number_of_systems);
+    exit(1);
+  }
+
+  selection = (Selection_Ptr) xcalloc(1, sizeof(Selection));
+  selection->number_of_systems = number_of_systems;
+  selection->indifference_zone = indifference_zone;
+  selection->confidence = confidence;
+  selection->first_stage = 10;
+  selection->max_replications = 1000;
+  selection->sums = (double *) xcalloc(number_of_systems, sizeof(double));
+  selection->variances = (double *)
+    xcalloc(number_of_systems * number_of_systems, sizeof(double));
+  selection->replications = (long int *)
+    xcalloc(number_of_systems, sizeof(long int));
+  selection->eliminated_at = (long int *)
+    xcalloc(number_of_systems, sizeof(long int));
+  return selection;
+}
+
+/*
+ * The mean output of system i so far.
+ */
+
+double
+selection_mean(Selection_Ptr selection, int i)
+{
+  return (selection->replications[i] > 0) ?
+    selection->sums[i] / selection->replications[i] : NAN;
+}
+
+static void
+selection_replicate(Selection_Ptr selection, int i, int replication,
+		    Selection_Function function, void * argument)
+{
+  double x = (*function)(i, replication, argument);
+
+  if (replication < selection->first_stage)
+    selection->first_stage_values[i * selection->first_stage + replication] = x;
+  selection->sums[i] += x;
+  selection->replications[i]++;
+  selection->total_replications++;
+}
+
+/*
+ * The variances of the pairwise differences over the first stage.
+ */
+
+static void
+selection_first_stage_variances(Selection_Ptr selection)
+{
+  int k = selection->number_of_systems, n0 = selection->first_stage;
+  double * x = selection->first_stage_values;
+  double mean, sum, d;
+  int i, l, r;
+
+  for (i=0; i<k; i++) {
+    for (l=i+1; l<k; l++) {
+      mean = 0.0;
+      for (r=0; r<n0; r++) mean += x[i*n0 + r] - x[l*n0 + r];
+      mean /= n0;
+      sum = 0.0;
+      for (r=0; r<n0; r++) {
+	d = x[i*n0 + r] - x[l*n0 + r] - mean;
+	sum += d * d;
+      }
+      selection->variances[i*k + l] = selection->variances[l*k + i] =
+	sum / (n0 - 1);
+    }
+  }
+}
+
+/*
+ * Whether system i, after r replications, is behind a survivor by more than
+ * the continuation region.
+ */
+
+static int
+selection_is_inferior(Selection_Ptr selection, int i, long int r)
+{
+  int k = selection->number_of_systems, l;
+  double delta = selection->indifference_zone;
+  double sign = selection->maximize ? 1.0 : -1.0;
+  double w;
+
+  for (l=0; l<k; l++) {
+    if (l == i || selection->eliminated_at[l] != 0) continue;
+    w = delta / (2 * r) *
+      (selection->h2 * selection->variances[i*k + l] / (delta * delta) - r);
+    if (w < 0.0) w = 0.0;
+    if (sign * (selection_mean(selection, i) - selection_mean(selection, l)) < -w)
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Run the procedure. function(system, replication, argument) returns one
+ * replication of a system's output.
+ */
+
+void
+selection_run(Selection_Ptr selection, Selection_Function function,
+	      void * argument)
+{
+  int k = selection->number_of_systems, i, n0;
+  int * inferior;
+  double alpha, eta, best_mean, sign;
+  long int r;
+
+  if (selection->first_stage < 2) selection->first_stage = 2;
+  if (selection->max_replications < selection->first_stage)
+    selection->max_replications = selection->first_stage;
+  n0 = selection->first_stage;
+
+  alpha = 1.0 - selection->confidence;
+  eta = (k > 1) ? 0.5 * (pow(2 * alpha / (k - 1), -2.0 / (n0 - 1)) - 1) : 0.0;
+  selection->h2 = 2 * eta * (n0 - 1);
+
+  if (selection->first_stage_values != NULL)
+    xfree((void *) selection->first_stage_values);
+  selection->first_stage_values = (double *) xcalloc(k * n0, sizeof(double));
+  inferior = (int *) xcalloc(k, sizeof(int));
+
+  for (i=0; i<k; i++) {
+    selection->sums[i] = 0.0;
+    selection->replications[i] = 0;
+    selection->eliminated_at[i] = 0;
+  }
+  selection->total_replications = 0;
+  selection->survivors = k;
+
+  for (r=0; r<n0; r++)
+    for (i=0; i<k; i++)
+      selection_replicate(selection, i, r, function, argument);
+  selection_first_stage_variances(selection);
+
+  for (r=n0; ; r++) {
+    /* Screen every survivor against the survivors of the previous stage. */
+    for (i=0; i<k; i++)
+      inferior[i] = selection->eliminated_at[i] == 0 &&
+	selection_is_inferior(selection, i, r);
+    for (i=0; i<k; i++) {
+      if (inferior[i]) {
+	selection->eliminated_at[i] = r;
+	selection->survivors--;
+      }
+    }
+
+    if (selection->survivors <= 1) {
+      selection->status = SELECTION_SELECTED;
+      break;
+    }
+    if (r >= selection->max_replications) {
+      selection->status = SELECTION_TRUNCATED;
+      break;
+    }
+
+    for (i=0; i<k; i++)
+      if (selection->eliminated_at[i] == 0)
+	selection_replicate(selection, i, r, function, argument);
+  }
+  selection->stages = r;
+
+  /* The best survivor (the only one unless truncated). */
+  sign = selection->maximize ? 1.0 : -1.0;
+  selection->best = -1;
+  best_mean = 0.0;
+  for (i=0; i<k; i++) {
+    if (selection->eliminated_at[i] != 0) continue;
+    if (selection->best < 0 || sign * selection_mean(selection, i) > best_mean) {
+      selection->best = i;
+      best_mean = sign * selection_mean(selection, i);
+    }
+  }
+
+  xfree((void *) inferior);
+}
+
+void
+selection_free(Selection_Ptr selection)
+{
+  if (selection->first_stage_values != NULL)
+    xfree((void *) selection->first_stage_values);
+  xfree((void *) selection->eliminated_at);
+  xfree((void *) selection->replications);
+  xfree((void *) selection->variances);
+  xfree((void *) selection->sums);
+  xfree((void *) selection);
+}
+
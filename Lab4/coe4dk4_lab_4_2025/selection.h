@@ -0,0 +1,112 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#ifndef _SELECTION_H_
+#define _SELECTION_H_
+
+/******************************************************************************/
+
+/*
+ * Ranking and selection of the best of a number of systems (configurations)
+ * by the fully sequential procedure of Kim and Nelson (KN).
+ *
+ * Every system first gets first_stage replications, from which the variance
+ * of the difference between each pair of systems is estimated. From then on
+ * each surviving system gets one more replication per stage, and a system is
+ * dropped as soon as its mean falls behind that of another survivor by more
+ * than a continuation region that narrows as the stages go on,
+ *
+ *   W = max(0, (delta / 2r) (h^2 S^2 / delta^2 - r)),
+ *
+ * after r replications, S^2 being the variance of the pair's differences
+ * and h^2 = 2 eta (first_stage - 1) with
+ *
+ *   eta = ((2 alpha / (k - 1))^(-2 / (first_stage - 1)) - 1) / 2.
+ *
+ * Clearly inferior systems go after a few stages and the replications are
+ * spent on the contenders. The last survivor is the best with probability
+ * at least confidence = 1 - alpha, provided its mean is better than all the
+ * others by at least the indifference zone delta (otherwise one within
+ * delta of the best is chosen with that probability). The outputs of a
+ * replication are taken to be normal, e.g., run means.
+ *
+ * function(system, replication, argument) returns one replication of the
+ * output of a system, to be minimized (or maximized, see below). The
+ * procedure allows, and gains from, common random numbers: replication r
+ * of every system should use the same random seed, so that the variances of
+ * the differences are small. If max_replications is reached first, the
+ * survivor with the best mean is chosen without the guarantee.
+ */
+
+typedef double (* Selection_Function)(int, int, void *);
+
+typedef enum {SELECTION_SELECTED, SELECTION_TRUNCATED} Selection_Status;
+
+typedef struct _selection_
+{
+  int number_of_systems;
+  double indifference_zone;   /* delta, in the units of the output */
+  double confidence;          /* of a correct selection */
+  int first_stage;            /* replications, at least 2 */
+  long int max_replications;  /* per system */
+  int maximize;               /* 0: the smallest output is best */
+
+  double * first_stage_values;  /* [system * first_stage + replication] */
+  double * variances;         /* of the differences, [i * systems + l] */
+  double * sums;              /* of the outputs */
+  long int * replications;    /* per system */
+  long int * eliminated_at;   /* stage that dropped each system, 0 if none */
+
+  Selection_Status status;
+  int survivors;
+  int best;
+  long int stages;
+  long int total_replications;
+  double h2;
+} Selection, * Selection_Ptr;
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+Selection_Ptr
+selection_new(int, double, double);
+
+void
+selection_run(Selection_Ptr, Selection_Function, void *);
+
+double
+selection_mean(Selection_Ptr, int);
+
+void
+selection_free(Selection_Ptr);
+
+/******************************************************************************/
+
+#endif /* selection.h */
+
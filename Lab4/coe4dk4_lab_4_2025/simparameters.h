@@ -27,20 +27,47 @@
 
 /*******************************************************************************/
 
-#define NUMBER_OF_STATIONS 10
-#define MEAN_PACKET_DURATION 1      /* normalized packet Tx time */
-#define PACKET_ARRIVAL_RATE 0.5     /* packets per Tx time */
+/* Defaults of the parameters that can be swept from the command line (see
+   sweep.h). The values in use are the variables of the same names in main.c. */
+#define NUMBER_OF_STATIONS_DEFAULT 10
+#define MEAN_PACKET_DURATION_DEFAULT 1      /* normalized packet Tx time */
+#define PACKET_ARRIVAL_RATE_DEFAULT 0.5     /* packets per Tx time */
+#define MEAN_DATA_PACKET_DURATION_DEFAULT 1.6   /* mean data packet duration X in seconds */
+#define SLOT_DURATION_XR_DEFAULT 0.1            /* reservation mini-slot duration Xr in seconds */
+#define RUNLENGTH_DEFAULT 500000
+
 #define MEAN_BACKOFF_DURATION 10    /* in units of packet transmit time, Tx */
 #define SLOT_DURATION 1.02         /* slot duration in Tx time units */
 #define EPSILON 0.01                /* guard time in Tx time units */
-#define MEAN_DATA_PACKET_DURATION 1.6   /* mean data packet duration X in seconds */
-#define SLOT_DURATION_XR 0.1            /* reservation mini-slot duration Xr in seconds */
-#define RUNLENGTH 500000
 #define BLIPRATE 50000
 
+/* Delay histograms: resolution and highest tracked value, and the delay bound
+   whose exceedance probability is reported (in the same time units). */
+#define DELAY_HISTOGRAM_RESOLUTION 1e-3
+#define DELAY_HISTOGRAM_HIGHEST 1e6
+#define DELAY_BOUND 20.0
+
 /* Comma separated list of random seeds to run. */
 #define RANDOM_SEED_LIST 400474322, 400430923, 12345678, 987654321, 45671234
 
+/*
+ * Selection of the best reservation mini-slot duration. When SELECTION_MODE is
+ * 1 the durations Xr of SELECTION_SLOT_DURATION_XR_LIST are compared by their
+ * mean delay over runs of SELECTION_RUNLENGTH packets with the KN procedure
+ * (see selection.h), which drops the clearly worse ones early. The one chosen
+ * is the best with SELECTION_CONFIDENCE unless another is within
+ * SELECTION_INDIFFERENCE_ZONE of it. Results go to selection_results.csv.
+ * Leave out durations that make the system unstable: the variance of their
+ * delays is so large that they are only dropped very late.
+ */
+#define SELECTION_MODE 0
+#define SELECTION_SLOT_DURATION_XR_LIST 0.02, 0.05, 0.1, 0.15, 0.2
+#define SELECTION_INDIFFERENCE_ZONE 0.1 /* of the mean delay */
+#define SELECTION_CONFIDENCE 0.95
+#define SELECTION_FIRST_STAGE 10
+#define SELECTION_MAX_REPLICATIONS 500
+#define SELECTION_RUNLENGTH 5e4
+
 /*******************************************************************************/
 
 #endif /* simparameters.h */
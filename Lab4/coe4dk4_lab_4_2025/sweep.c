@@ -0,0 +1,1162 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "simlib.h"
+#include "design.h"
+#include "metamodel.h"
+#include "sweep.h"
+#include "sweep_service.h"
+
+/******************************************************************************/
+
+static int
+sweep_find_parameter(Sweep_Ptr, const char *);
+
+static int
+sweep_parse_values(const char *, const char *, double *);
+
+static void
+sweep_run_job(Sweep_Ptr, long int, Sweep_Model, void *, char *);
+
+static int
+sweep_metamodel(Sweep_Ptr);
+
+#ifndef _WIN32
+static long int
+sweep_run_workers(Sweep_Ptr, FILE *, Sweep_Model, void *);
+#endif
+
+/******************************************************************************/
+
+/*
+ * Create a sweep of the named model. default_seeds is the zero terminated
+ * list of seeds run when no seed axis is given.
+ */
+
+Sweep_Ptr
+sweep_new(const char * model, unsigned * default_seeds)
+{
+  Sweep_Ptr sweep;
+
+  sweep = (Sweep_Ptr) xcalloc(1, sizeof(Sweep));
+  strncpy(sweep->model, model, SWEEP_MAX_NAME - 1);
+  sweep->default_seeds = default_seeds;
+  strcpy(sweep->output_file, "sweep_results.csv");
+  strcpy(sweep->cache_directory, "result_cache");
+
+#ifdef _WIN32
+  sweep->workers = 1;
+#else
+  sweep->workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (sweep->workers < 1) sweep->workers = 1;
+#endif
+
+  return sweep;
+}
+
+/*
+ * Register a model parameter held in a double or int variable. Its value
+ * when the sweep is run is the default for jobs that do not sweep it.
+ */
+
+static Sweep_Parameter_Ptr
+sweep_new_parameter(Sweep_Ptr sweep, const char * name)
+{
+  Sweep_Parameter_Ptr parameter;
+
+  if (sweep->number_of_parameters == SWEEP_MAX_PARAMETERS) {
+    printf("Error: Too many sweep parameters (adding %s).\n", name);
+    exit(1);
+  }
+
+  parameter = sweep->parameters + sweep->number_of_parameters++;
+  strncpy(parameter->name, name, SWEEP_MAX_NAME - 1);
+  return parameter;
+}
+
+void
+sweep_add_parameter(Sweep_Ptr sweep, const char * name, double * value)
+{
+  sweep_new_parameter(sweep, name)->value = value;
+}
+
+void
+sweep_add_integer_parameter(Sweep_Ptr sweep, const char * name, int * value)
+{
+  sweep_new_parameter(sweep, name)->integer = value;
+}
+
+/*
+ * Register a model output. The returned index is passed to sweep_set_output
+ * by the model function. Outputs that a job does not set are left empty.
+ */
+
+int
+sweep_add_output(Sweep_Ptr sweep, const char * name)
+{
+  if (sweep->number_of_outputs == SWEEP_MAX_OUTPUTS) {
+    printf("Error: Too many sweep outputs (adding %s).\n", name);
+    exit(1);
+  }
+
+  strncpy(sweep->outputs[sweep->number_of_outputs], name, SWEEP_MAX_NAME - 1);
+  return sweep->number_of_outputs++;
+}
+
+void
+sweep_set_output(Sweep_Ptr sweep, int output, double value)
+{
+  if (output < 0 || output >= sweep->number_of_outputs) {
+    printf("Error: Bad sweep output index %d.\n", output);
+    exit(1);
+  }
+
+  sweep->output_values[output] = value;
+}
+
+/******************************************************************************/
+
+/*
+ * Look up a parameter by name, ignoring case. "seed" gives SWEEP_SEED.
+ */
+
+static int
+sweep_names_equal(const char * a, const char * b)
+{
+  while (*a != '\0' && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+    a++;
+    b++;
+  }
+  return *a == '\0' && *b == '\0';
+}
+
+static int
+sweep_find_parameter(Sweep_Ptr sweep, const char * name)
+{
+  int i;
+
+  if (sweep_names_equal(name, "seed")) return SWEEP_SEED;
+
+  for (i=0; i<sweep->number_of_parameters; i++)
+    if (sweep_names_equal(name, sweep->parameters[i].name)) return i;
+
+  printf("Error: Unknown sweep parameter %s (-h lists them).\n", name);
+  exit(1);
+}
+
+/*
+ * Parse a comma separated list of values and a:b:step grids into values, or
+ * only count them if values is NULL. Returns the number of values.
+ */
+
+static int
+sweep_parse_values(const char * name, const char * spec, double * values)
+{
+  int i, count = 0, steps;
+  double first, last, step;
+  const char * p = spec;
+  char * end;
+
+  for (;;) {
+    first = last = strtod(p, &end);
+    step = 1.0;
+    if (end == p) break;
+
+    if (*end == ':') {
+      p = end + 1;
+      last = strtod(p, &end);
+      if (end == p) break;
+      if (*end == ':') {
+	p = end + 1;
+	step = strtod(p, &end);
+	if (end == p) break;
+      }
+      if (step == 0.0 || (last - first)/step < 0.0) break;
+    }
+
+    /* Allow for rounding in the number of steps, and end exactly on last. */
+    steps = (int) ((last - first)/step + 1e-6) + 1;
+    if (values != NULL) {
+      for (i=0; i<steps; i++)
+	values[count + i] = first + i * step;
+      if (fabs(values[count + steps - 1] - last) < 1e-6 * fabs(step))
+	values[count + steps - 1] = last;
+    }
+    count += steps;
+
+    if (*end == '\0') return count;
+    if (*end != ',') break;
+    p = end + 1;
+  }
+
+  printf("Error: Bad sweep values %s=%s.\n", name, spec);
+  exit(1);
+}
+
+/*
+ * Whether an assignment starts a design axis: lhs=... or sobol=...
+ */
+
+static int
+sweep_is_design(const char * assignment)
+{
+  char name[SWEEP_MAX_NAME];
+
+  if (sscanf(assignment, "%31[^=]=", name) != 1) return 0;
+  return sweep_names_equal(name, "lhs") || sweep_names_equal(name, "sobol");
+}
+
+/*
+ * Fill a design axis (see sweep.h). assignments[0] is lhs=N[:SEED] or
+ * sobol=N, the others name=low:high.
+ */
+
+static void
+sweep_add_design(Sweep_Ptr sweep, Sweep_Axis_Ptr axis, char ** assignments,
+		 int n)
+{
+  int d = n - 1, i, j, count, p;
+  unsigned seed = 1;
+  double low[SWEEP_MAX_PARAMETERS], high[SWEEP_MAX_PARAMETERS], * points;
+  char * end, * token;
+  int latin_hypercube = tolower((unsigned char) assignments[0][0]) == 'l';
+
+  token = strchr(assignments[0], '=') + 1;
+  count = (int) strtol(token, &end, 10);
+  if (*end == ':' && latin_hypercube) seed = (unsigned) strtoul(end + 1, &end, 10);
+  if (count < 1 || *end != '\0' || d < 1) {
+    printf("Error: Bad sweep design %s (expected lhs=N[:seed] or sobol=N "
+	   "and name=low:high ranges).\n", assignments[0]);
+    exit(1);
+  }
+
+  /* The axis holds the design's parameters, without the design itself. */
+  axis->number_of_parameters = d;
+  for (j=0; j<d; j++) {
+    axis->parameters[j] = axis->parameters[j+1];
+    p = axis->parameters[j];
+    token = strchr(assignments[j+1], '\0') + 1;
+    if (p == SWEEP_SEED || sscanf(token, "%lf:%lf", low + j, high + j) != 2 ||
+	high[j] < low[j] || (sweep->parameters[p].integer != NULL &&
+			     (low[j] != floor(low[j]) || high[j] != floor(high[j])))) {
+      printf("Error: Bad sweep design range %s=%s.\n", assignments[j+1], token);
+      exit(1);
+    }
+  }
+
+  points = (double *) xcalloc(count * d, sizeof(double));
+  if (latin_hypercube)
+    design_latin_hypercube(count, d, seed, points);
+  else
+    design_sobol(count, d, points);
+
+  /* Integer parameters take each whole value in the range equally often. */
+  axis->number_of_values = count;
+  axis->values = (double *) xcalloc(count * d, sizeof(double));
+  for (i=0; i<count; i++) {
+    for (j=0; j<d; j++) {
+      p = axis->parameters[j];
+      if (sweep->parameters[p].integer != NULL)
+	axis->values[i * d + j] =
+	  fmin(floor(low[j] + points[i * d + j] * (high[j] - low[j] + 1)), high[j]);
+      else
+	axis->values[i * d + j] = low[j] + points[i * d + j] * (high[j] - low[j]);
+    }
+  }
+  xfree((void *) points);
+}
+
+/*
+ * Add an axis from a description of one or more whitespace separated
+ * name=values assignments. Several assignments make a zipped axis.
+ */
+
+void
+sweep_add_axis(Sweep_Ptr sweep, const char * spec)
+{
+  int a, k, n = 0, v, p, count, design;
+  char buffer[SWEEP_MAX_ROW], * assignments[SWEEP_MAX_PARAMETERS + 1], * token;
+  double * values, value;
+  Sweep_Axis_Ptr axis;
+
+  if (strlen(spec) >= sizeof(buffer)) {
+    printf("Error: Sweep axis description too long.\n");
+    exit(1);
+  }
+  strcpy(buffer, spec);
+
+  for (token = strtok(buffer, " \t\r\n"); token != NULL;
+       token = strtok(NULL, " \t\r\n")) {
+    if (n == SWEEP_MAX_PARAMETERS + 1) {
+      printf("Error: Too many parameters in sweep axis %s\n", spec);
+      exit(1);
+    }
+    assignments[n++] = token;
+  }
+  if (n == 0) return;
+
+  if (sweep->number_of_axes == SWEEP_MAX_AXES) {
+    printf("Error: Too many sweep axes.\n");
+    exit(1);
+  }
+  axis = sweep->axes + sweep->number_of_axes;
+  axis->number_of_parameters = n;
+
+  /* A design: lhs=N or sobol=N, then the ranges. */
+  design = sweep_is_design(assignments[0]);
+
+  for (k=design; k<n; k++) {
+    if ((token = strchr(assignments[k], '=')) == NULL) {
+      printf("Error: Bad sweep axis %s (expected name=values).\n", spec);
+      exit(1);
+    }
+    *token++ = '\0';
+    p = axis->parameters[k] = sweep_find_parameter(sweep, assignments[k]);
+
+    for (a=0; a<=sweep->number_of_axes; a++) {
+      for (v=(a == sweep->number_of_axes ? design : 0);
+	   v<(a == sweep->number_of_axes ? k : sweep->axes[a].number_of_parameters); v++) {
+	if (sweep->axes[a].parameters[v] == p) {
+	  printf("Error: Sweep parameter %s is given twice.\n", assignments[k]);
+	  exit(1);
+	}
+      }
+    }
+
+    if (design) continue;
+
+    count = sweep_parse_values(assignments[k], token, NULL);
+    if (k == 0) {
+      axis->number_of_values = count;
+      axis->values = (double *) xcalloc(count * n, sizeof(double));
+    } else if (count != axis->number_of_values) {
+      printf("Error: Zipped sweep parameters %s and %s have %d and %d values.\n",
+	     assignments[0], assignments[k], axis->number_of_values, count);
+      exit(1);
+    }
+
+    values = (double *) xcalloc(count, sizeof(double));
+    sweep_parse_values(assignments[k], token, values);
+    for (v=0; v<count; v++) {
+      value = values[v];
+      if ((p == SWEEP_SEED || sweep->parameters[p].integer != NULL) &&
+	  (value != floor(value) || (p == SWEEP_SEED && value < 0.0))) {
+	printf("Error: Sweep parameter %s needs whole values, not %g.\n",
+	       assignments[k], value);
+	exit(1);
+      }
+      axis->values[v * n + k] = value;
+    }
+    xfree((void *) values);
+  }
+
+  if (design) sweep_add_design(sweep, axis, assignments, n);
+
+  sweep->number_of_axes++;
+}
+
+/*
+ * Read a sweep description: one axis per line, plus the options
+ * "workers N", "output FILE", "cache DIRECTORY", "metamodel OUTPUT",
+ * "tolerance VALUE" and "serve ADDRESS". Anything after a # is a comment.
+ */
+
+void
+sweep_read_file(Sweep_Ptr sweep, const char * filename)
+{
+  FILE * file;
+  char line[SWEEP_MAX_ROW], keyword[SWEEP_MAX_NAME], value[256];
+
+  if ((file = fopen(filename, "r")) == NULL) {
+    printf("Error: Could not open sweep file %s.\n", filename);
+    exit(1);
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (strchr(line, '#') != NULL) *strchr(line, '#') = '\0';
+
+    if (sscanf(line, "%31s %255s", keyword, value) == 2 &&
+	strchr(keyword, '=') == NULL) {
+      if (strcmp(keyword, "workers") == 0) {
+	sweep->workers = atoi(value);
+      } else if (strcmp(keyword, "output") == 0) {
+	strcpy(sweep->output_file, value);
+      } else if (strcmp(keyword, "cache") == 0) {
+	strcpy(sweep->cache_directory, value);
+      } else if (strcmp(keyword, "metamodel") == 0) {
+	sscanf(value, "%31s", sweep->metamodel_output);
+      } else if (strcmp(keyword, "tolerance") == 0) {
+	sweep->metamodel_tolerance = atof(value);
+      } else if (strcmp(keyword, "serve") == 0) {
+	strcpy(sweep->service_address, value);
+      } else {
+	printf("Error: Unknown option %s in sweep file %s.\n", keyword, filename);
+	exit(1);
+      }
+    } else {
+      sweep_add_axis(sweep, line);
+    }
+  }
+
+  fclose(file);
+}
+
+/*
+ * Parse the command line: -f FILE reads a sweep file, -j N sets the number
+ * of workers, -o FILE the results file ("-" for stdout), -c DIRECTORY the
+ * result cache ("-" for none), -n lists the jobs without running them, -m
+ * OUTPUT and -t TOLERANCE query a metamodel of the output instead, -s
+ * ADDRESS serves the jobs to workers and -w ADDRESS works for such a sweep,
+ * and every other argument is an axis.
+ */
+
+void
+sweep_parse_arguments(Sweep_Ptr sweep, int argc, char * argv[])
+{
+  int i;
+
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      sweep_usage(sweep, argv[0]);
+      exit(0);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      sweep->list_only = 1;
+    } else if (argv[i][0] == '-' && strchr("fjocmtsw", argv[i][1]) != NULL &&
+	       argv[i][1] != '\0' && argv[i][2] == '\0' && i + 1 < argc) {
+      if (argv[i][1] == 'f') {
+	sweep_read_file(sweep, argv[++i]);
+      } else if (argv[i][1] == 'j') {
+	sweep->workers = atoi(argv[++i]);
+      } else if (argv[i][1] == 'c') {
+	strncpy(sweep->cache_directory, argv[++i],
+		sizeof(sweep->cache_directory) - 1);
+      } else if (argv[i][1] == 'm') {
+	strncpy(sweep->metamodel_output, argv[++i], SWEEP_MAX_NAME - 1);
+      } else if (argv[i][1] == 't') {
+	sweep->metamodel_tolerance = atof(argv[++i]);
+      } else if (argv[i][1] == 's' || argv[i][1] == 'w') {
+	sweep->service_worker = (argv[i][1] == 'w');
+	strncpy(sweep->service_address, argv[++i],
+		sizeof(sweep->service_address) - 1);
+      } else {
+	strncpy(sweep->output_file, argv[++i], sizeof(sweep->output_file) - 1);
+      }
+    } else if (argv[i][0] == '-') {
+      sweep_usage(sweep, argv[0]);
+      exit(1);
+    } else {
+      sweep_add_axis(sweep, argv[i]);
+    }
+  }
+}
+
+void
+sweep_usage(Sweep_Ptr sweep, const char * program)
+{
+  int i;
+  Sweep_Parameter_Ptr parameter;
+
+  fprintf(stderr, "Usage: %s [-f file] [-j workers] [-o results.csv] "
+	  "[-c cache_dir] [-n] [-m output [-t tolerance]] [-s address] "
+	  "name=values ...\n"
+	  "       %s -w address\n\n", program, program);
+  fprintf(stderr, "  name=1,2,5 (list), name=1:15:0.5 (grid), "
+	  "\"a=1,2 b=3,4\" (zipped), seed=1:10\n");
+  fprintf(stderr, "  \"lhs=50 a=0:1 b=5:20\" (Latin hypercube), "
+	  "\"sobol=64 a=0:1 b=5:20\" (Sobol design)\n");
+  fprintf(stderr, "  address: unix:/path, host:port or port (localhost)\n\n");
+  fprintf(stderr, "Parameters (default):\n");
+  for (i=0; i<sweep->number_of_parameters; i++) {
+    parameter = sweep->parameters + i;
+    if (parameter->value != NULL)
+      fprintf(stderr, "  %-28s %g\n", parameter->name, *parameter->value);
+    else
+      fprintf(stderr, "  %-28s %d\n", parameter->name, *parameter->integer);
+  }
+  fprintf(stderr, "Outputs:\n");
+  for (i=0; i<sweep->number_of_outputs; i++)
+    fprintf(stderr, "  %s\n", sweep->outputs[i]);
+}
+
+/******************************************************************************/
+
+/*
+ * Count the jobs, adding the default seeds as the innermost axis if no seeds
+ * were given.
+ */
+
+long int
+sweep_count_jobs(Sweep_Ptr sweep)
+{
+  int a, k, n, seeded = 0;
+  Sweep_Axis_Ptr axis;
+
+  for (a=0; a<sweep->number_of_axes; a++)
+    for (k=0; k<sweep->axes[a].number_of_parameters; k++)
+      if (sweep->axes[a].parameters[k] == SWEEP_SEED) seeded = 1;
+
+  if (!seeded) {
+    for (n=0; sweep->default_seeds[n] != 0; n++);
+    if (n == 0 || a == SWEEP_MAX_AXES) {
+      printf("Error: No seeds to sweep.\n");
+      exit(1);
+    }
+    axis = sweep->axes + sweep->number_of_axes++;
+    axis->number_of_parameters = 1;
+    axis->parameters[0] = SWEEP_SEED;
+    axis->number_of_values = n;
+    axis->values = (double *) xcalloc(n, sizeof(double));
+    for (k=0; k<n; k++) axis->values[k] = sweep->default_seeds[k];
+  }
+
+  sweep->number_of_jobs = 1;
+  for (a=0; a<sweep->number_of_axes; a++) {
+    sweep->number_of_jobs *= sweep->axes[a].number_of_values;
+    if (sweep->number_of_jobs > 1000000000L) {
+      printf("Error: The sweep has too many jobs.\n");
+      exit(1);
+    }
+  }
+  return sweep->number_of_jobs;
+}
+
+/*
+ * Set the parameters and the seed of a job, and clear the outputs.
+ */
+
+void
+sweep_set_job(Sweep_Ptr sweep, long int job)
+{
+  int a, k, v, p;
+  Sweep_Axis_Ptr axis;
+  double value;
+
+  for (a=sweep->number_of_axes-1; a>=0; a--) {
+    axis = sweep->axes + a;
+    v = job % axis->number_of_values;
+    job /= axis->number_of_values;
+
+    for (k=0; k<axis->number_of_parameters; k++) {
+      value = axis->values[v * axis->number_of_parameters + k];
+      p = axis->parameters[k];
+      if (p == SWEEP_SEED)
+	sweep->seed = (unsigned) value;
+      else if (sweep->parameters[p].value != NULL)
+	*sweep->parameters[p].value = value;
+      else
+	*sweep->parameters[p].integer = (int) value;
+    }
+  }
+
+  for (k=0; k<sweep->number_of_outputs; k++)
+    sweep->output_values[k] = NAN;
+}
+
+static void
+sweep_write_header(Sweep_Ptr sweep, FILE * file)
+{
+  int i;
+
+  fprintf(file, "job");
+  for (i=0; i<sweep->number_of_parameters; i++)
+    fprintf(file, ",%s", sweep->parameters[i].name);
+  fprintf(file, ",seed");
+  for (i=0; i<sweep->number_of_outputs; i++)
+    fprintf(file, ",%s", sweep->outputs[i]);
+  fprintf(file, "\n");
+}
+
+/*
+ * Format the CSV row of the current job, ending in a newline.
+ */
+
+void
+sweep_format_row(Sweep_Ptr sweep, long int job, char * row)
+{
+  int i, n;
+  Sweep_Parameter_Ptr parameter;
+
+  n = sprintf(row, "%ld", job);
+  for (i=0; i<sweep->number_of_parameters; i++) {
+    parameter = sweep->parameters + i;
+    if (parameter->value != NULL)
+      n += sprintf(row + n, ",%.10g", *parameter->value);
+    else
+      n += sprintf(row + n, ",%d", *parameter->integer);
+  }
+  n += sprintf(row + n, ",%u", sweep->seed);
+  for (i=0; i<sweep->number_of_outputs; i++) {
+    if (isnan(sweep->output_values[i]))
+      n += sprintf(row + n, ",");
+    else
+      n += sprintf(row + n, ",%.10g", sweep->output_values[i]);
+  }
+  sprintf(row + n, "\n");
+}
+
+/*
+ * Make the result cache key of the job that has been set.
+ */
+
+void
+sweep_job_key(Sweep_Ptr sweep)
+{
+  int i;
+  Sweep_Parameter_Ptr parameter;
+
+  result_cache_start_key(sweep->cache);
+  for (i=0; i<sweep->number_of_parameters; i++) {
+    parameter = sweep->parameters + i;
+    result_cache_add_key(sweep->cache, parameter->name, parameter->value != NULL ?
+			 *parameter->value : (double) *parameter->integer);
+  }
+  result_cache_add_key(sweep->cache, "seed", (double) sweep->seed);
+}
+
+static void
+sweep_run_job(Sweep_Ptr sweep, long int job, Sweep_Model model,
+	      void * argument, char * row)
+{
+  sweep_set_job(sweep, job);
+  model(sweep, sweep->seed, argument);
+  sweep_format_row(sweep, job, row);
+
+  if (sweep->cache != NULL) {
+    sweep_job_key(sweep);
+    result_cache_store(sweep->cache, sweep->output_values,
+		       sweep->number_of_outputs);
+  }
+}
+
+/******************************************************************************/
+
+/*
+ * Run all the jobs of the sweep and write their rows to the results file.
+ * Returns the number of jobs that did not complete.
+ */
+
+int
+sweep_run(Sweep_Ptr sweep, Sweep_Model model, void * argument)
+{
+  long int job, missing;
+  char row[SWEEP_MAX_ROW];
+  FILE * file;
+
+  if (sweep->metamodel_output[0] != '\0') return sweep_metamodel(sweep);
+  if (sweep->service_address[0] != '\0' && sweep->service_worker)
+    return sweep_work(sweep, model, argument);
+
+  sweep_count_jobs(sweep);
+
+  if (sweep->list_only) {
+    sweep_write_header(sweep, stdout);
+    for (job=0; job<sweep->number_of_jobs; job++) {
+      sweep_set_job(sweep, job);
+      sweep_format_row(sweep, job, row);
+      fputs(row, stdout);
+    }
+    return 0;
+  }
+
+  if (strcmp(sweep->output_file, "-") == 0) {
+    file = stdout;
+  } else if ((file = fopen(sweep->output_file, "w")) == NULL) {
+    printf("Error: Could not open sweep results file %s.\n", sweep->output_file);
+    exit(1);
+  }
+  sweep_write_header(sweep, file);
+
+  /* Write the jobs found in the cache and queue the others. */
+  if (strcmp(sweep->cache_directory, "-") != 0)
+    sweep->cache = result_cache_new(sweep->cache_directory, sweep->model);
+
+  sweep->completed_jobs = 0;
+  sweep->number_of_pending_jobs = 0;
+  sweep->pending_jobs = (long int *) xcalloc(sweep->number_of_jobs,
+					     sizeof(long int));
+  for (job=0; job<sweep->number_of_jobs; job++) {
+    sweep_set_job(sweep, job);
+    if (sweep->cache != NULL) {
+      sweep_job_key(sweep);
+      if (result_cache_load(sweep->cache, sweep->output_values,
+			    sweep->number_of_outputs)) {
+	sweep_format_row(sweep, job, row);
+	fputs(row, file);
+	sweep->completed_jobs++;
+	continue;
+      }
+    }
+    sweep->pending_jobs[sweep->number_of_pending_jobs++] = job;
+  }
+  fflush(file);
+
+#ifdef _WIN32
+  sweep->workers = 1;
+#endif
+
+  if (sweep->service_address[0] != '\0') {
+    fprintf(stderr, "Sweep: %ld jobs, %ld from the cache, %ld to serve\n",
+	    sweep->number_of_jobs, sweep->completed_jobs,
+	    sweep->number_of_pending_jobs);
+    if (sweep->number_of_pending_jobs > 0) sweep_serve(sweep, file);
+  } else {
+    fprintf(stderr, "Sweep: %ld jobs, %ld from the cache, %ld to run over %d workers\n",
+	    sweep->number_of_jobs, sweep->completed_jobs,
+	    sweep->number_of_pending_jobs, sweep->workers);
+
+    if (sweep->workers <= 1 || sweep->number_of_pending_jobs <= 1) {
+      for (job=0; job<sweep->number_of_pending_jobs; job++) {
+	sweep_run_job(sweep, sweep->pending_jobs[job], model, argument, row);
+	fputs(row, file);
+	fflush(file);
+	sweep->completed_jobs++;
+      }
+    }
+#ifndef _WIN32
+    else {
+      sweep_run_workers(sweep, file, model, argument);
+    }
+#endif
+  }
+
+  if (file != stdout) fclose(file);
+  xfree((void *) sweep->pending_jobs);
+  if (sweep->cache != NULL) result_cache_free(sweep->cache);
+  sweep->cache = NULL;
+
+  missing = sweep->number_of_jobs - sweep->completed_jobs;
+  if (missing > 0)
+    fprintf(stderr, "Error: %ld of %ld sweep jobs did not complete.\n",
+	    missing, sweep->number_of_jobs);
+  else
+    fprintf(stderr, "Sweep: %ld jobs done, results in %s\n",
+	    sweep->completed_jobs, sweep->output_file);
+
+  return (int) missing;
+}
+
+/******************************************************************************/
+
+#ifndef _WIN32
+
+static int
+sweep_read_fully(int fd, void * buffer, size_t size)
+{
+  size_t done;
+  ssize_t n;
+
+  for (done=0; done<size; done+=n)
+    if ((n = read(fd, (char *) buffer + done, size - done)) <= 0) return 0;
+  return 1;
+}
+
+static int
+sweep_write_fully(int fd, const void * buffer, size_t size)
+{
+  size_t done;
+  ssize_t n;
+
+  for (done=0; done<size; done+=n)
+    if ((n = write(fd, (const char *) buffer + done, size - done)) <= 0) return 0;
+  return 1;
+}
+
+/*
+ * Hand worker w its next job, or close its job pipe when there are none left
+ * so that it exits.
+ */
+
+static void
+sweep_send_job(Sweep_Ptr sweep, int * job_fd, long int * current, long int * next)
+{
+  if (*next < sweep->number_of_pending_jobs) {
+    *current = sweep->pending_jobs[(*next)++];
+    sweep_write_fully(*job_fd, current, sizeof(*current));
+  } else {
+    close(*job_fd);
+    *job_fd = -1;
+    *current = -1;
+  }
+}
+
+/*
+ * Run the jobs over the worker processes. Each worker reads job numbers from
+ * its job pipe and writes a row per job to its result pipe. A worker gets
+ * its next job when its row arrives, so slow and fast jobs balance out.
+ */
+
+static long int
+sweep_run_workers(Sweep_Ptr sweep, FILE * file, Sweep_Model model,
+		  void * argument)
+{
+  int w, v, workers, active, status;
+  int (* job_pipes)[2], (* result_pipes)[2];
+  long int job, next = 0, * current;
+  size_t * length, size;
+  ssize_t n;
+  char (* lines)[SWEEP_MAX_ROW], * end;
+  struct pollfd * fds;
+  pid_t * pids;
+
+  workers = sweep->workers;
+  if (workers > sweep->number_of_pending_jobs)
+    workers = (int) sweep->number_of_pending_jobs;
+
+  job_pipes = xcalloc(workers, sizeof(*job_pipes));
+  result_pipes = xcalloc(workers, sizeof(*result_pipes));
+  lines = xcalloc(workers, sizeof(*lines));
+  length = (size_t *) xcalloc(workers, sizeof(size_t));
+  current = (long int *) xcalloc(workers, sizeof(long int));
+  fds = (struct pollfd *) xcalloc(workers, sizeof(struct pollfd));
+  pids = (pid_t *) xcalloc(workers, sizeof(pid_t));
+
+  /* A worker that dies is noticed on its result pipe instead. */
+  signal(SIGPIPE, SIG_IGN);
+
+  fflush(stdout);
+  fflush(file);
+  for (w=0; w<workers; w++) {
+    if (pipe(job_pipes[w]) != 0 || pipe(result_pipes[w]) != 0 ||
+	(pids[w] = fork()) < 0) {
+      printf("Error: Could not start sweep worker %d.\n", w);
+      exit(1);
+    }
+
+    if (pids[w] == 0) {
+      char row[SWEEP_MAX_ROW];
+      int failed = 0;
+
+      /* Hold no other pipe open, so that every worker sees its end. */
+      for (v=0; v<w; v++) {
+	close(job_pipes[v][1]);
+	close(result_pipes[v][0]);
+      }
+      close(job_pipes[w][1]);
+      close(result_pipes[w][0]);
+      if (freopen("/dev/null", "w", stdout) == NULL) _exit(1);
+
+      while (!failed && sweep_read_fully(job_pipes[w][0], &job, sizeof(job))) {
+	sweep_run_job(sweep, job, model, argument, row);
+	failed = !sweep_write_fully(result_pipes[w][1], row, strlen(row));
+      }
+      /* _exit skips the atexit handlers. */
+      simulation_run_metrics_close();
+      simulation_run_trace_close();
+      _exit(failed);
+    }
+    close(job_pipes[w][0]);
+    close(result_pipes[w][1]);
+  }
+
+  for (w=0; w<workers; w++)
+    sweep_send_job(sweep, &job_pipes[w][1], current + w, &next);
+
+  for (active=workers; active>0; ) {
+    for (w=0; w<workers; w++) {
+      fds[w].fd = result_pipes[w][0];
+      fds[w].events = POLLIN;
+      fds[w].revents = 0;
+    }
+    if (poll(fds, workers, -1) < 0) {
+      if (errno == EINTR) continue;
+      printf("Error: Lost the sweep workers.\n");
+      exit(1);
+    }
+
+    for (w=0; w<workers; w++) {
+      if (fds[w].fd < 0 || fds[w].revents == 0) continue;
+
+      n = read(result_pipes[w][0], lines[w] + length[w],
+	       SWEEP_MAX_ROW - length[w]);
+      if (n <= 0) {
+	/* The worker has finished, or died in the middle of a job. */
+	close(result_pipes[w][0]);
+	result_pipes[w][0] = -1;
+	if (job_pipes[w][1] >= 0) close(job_pipes[w][1]);
+	job_pipes[w][1] = -1;
+	waitpid(pids[w], &status, 0);
+	if (current[w] >= 0)
+	  fprintf(stderr, "Error: Sweep job %ld failed (run it with -j 1 to see why).\n",
+		  current[w]);
+	active--;
+	continue;
+      }
+      length[w] += n;
+
+      while ((end = memchr(lines[w], '\n', length[w])) != NULL) {
+	size = end - lines[w] + 1;
+	fwrite(lines[w], 1, size, file);
+	fflush(file);
+	memmove(lines[w], end + 1, length[w] - size);
+	length[w] -= size;
+
+	sweep->completed_jobs++;
+	fprintf(stderr, "Sweep: %ld of %ld jobs done\r", sweep->completed_jobs,
+		sweep->number_of_jobs);
+	sweep_send_job(sweep, &job_pipes[w][1], current + w, &next);
+      }
+    }
+  }
+  fprintf(stderr, "\n");
+
+  xfree((void *) pids);
+  xfree((void *) fds);
+  xfree((void *) current);
+  xfree((void *) length);
+  xfree((void *) lines);
+  xfree((void *) result_pipes);
+  xfree((void *) job_pipes);
+
+  return sweep->number_of_jobs - sweep->completed_jobs;
+}
+
+#endif
+
+/******************************************************************************/
+
+/*
+ * The cached runs of a metamodel query: all parameter values and the output
+ * of each.
+ */
+
+typedef struct _sweep_runs_
+{
+  Sweep_Ptr sweep;
+  int output;
+  long int number_of_runs;
+  long int max_runs;
+  double * values;  /* [run * (parameters + 1) + parameter], output last */
+} Sweep_Runs;
+
+static void
+sweep_collect_run(const char * key, const double * outputs, int n,
+		  void * argument)
+{
+  Sweep_Runs * runs = (Sweep_Runs *) argument;
+  Sweep_Ptr sweep = runs->sweep;
+  int p = sweep->number_of_parameters, i;
+  double * row, * values;
+
+  if (n != sweep->number_of_outputs || isnan(outputs[runs->output])) return;
+
+  if (runs->number_of_runs == runs->max_runs) {
+    runs->max_runs = (runs->max_runs > 0) ? 2 * runs->max_runs : 256;
+    values = (double *) xcalloc(runs->max_runs * (p + 1), sizeof(double));
+    if (runs->values != NULL) {
+      memcpy(values, runs->values,
+	     runs->number_of_runs * (p + 1) * sizeof(double));
+      xfree((void *) runs->values);
+    }
+    runs->values = values;
+  }
+
+  row = runs->values + runs->number_of_runs * (p + 1);
+  for (i=0; i<p; i++)
+    if (!result_cache_key_value(key, sweep->parameters[i].name, row + i))
+      return;
+  row[p] = outputs[runs->output];
+  runs->number_of_runs++;
+}
+
+static double
+sweep_parameter_value(Sweep_Ptr sweep, int i)
+{
+  return (sweep->parameters[i].value != NULL) ?
+    *sweep->parameters[i].value : (double) *sweep->parameters[i].integer;
+}
+
+/*
+ * Fit a metamodel of the output to the cached runs and predict it at the
+ * points of the axes (see sweep.h). Returns 0, or 1 if there was nothing to
+ * fit.
+ */
+
+static int
+sweep_metamodel(Sweep_Ptr sweep)
+{
+  Sweep_Runs runs;
+  Metamodel_Ptr metamodel;
+  Result_Cache_Ptr cache;
+  FILE * file;
+  int p = sweep->number_of_parameters, inputs[SWEEP_MAX_PARAMETERS];
+  int number_of_inputs = 0, a, i, j, k;
+  long int job, r, replications, worst_job = 0;
+  double x[SWEEP_MAX_PARAMETERS], mean, standard_error, worst = -1.0;
+
+  for (k=0; k<sweep->number_of_outputs; k++)
+    if (sweep_names_equal(sweep->outputs[k], sweep->metamodel_output)) break;
+  if (k == sweep->number_of_outputs) {
+    printf("Error: Unknown sweep output %s.\n", sweep->metamodel_output);
+    exit(1);
+  }
+  if (strcmp(sweep->cache_directory, "-") == 0) {
+    printf("Error: A metamodel is fitted to the result cache.\n");
+    exit(1);
+  }
+  for (a=0; a<sweep->number_of_axes; a++)
+    for (i=0; i<sweep->axes[a].number_of_parameters; i++)
+      if (sweep->axes[a].parameters[i] == SWEEP_SEED) {
+	printf("Error: A metamodel query has no seeds.\n");
+	exit(1);
+      }
+
+  /* Gather the runs. */
+  memset(&runs, 0, sizeof(runs));
+  runs.sweep = sweep;
+  runs.output = k;
+  cache = result_cache_new(sweep->cache_directory, sweep->model);
+  result_cache_scan(cache, sweep_collect_run, (void *) &runs);
+  result_cache_free(cache);
+
+  /* The inputs are the parameters that vary among the runs. */
+  for (i=0; i<p; i++)
+    for (r=1; r<runs.number_of_runs; r++)
+      if (runs.values[r * (p + 1) + i] != runs.values[i]) {
+	inputs[number_of_inputs++] = i;
+	break;
+      }
+
+  if (number_of_inputs == 0) {
+    fprintf(stderr, "Error: The result cache has %ld runs of %s with %s; "
+	    "a metamodel needs runs at two or more points.\n",
+	    runs.number_of_runs, sweep->model, sweep->outputs[k]);
+    if (runs.values != NULL) xfree((void *) runs.values);
+    return 1;
+  }
+
+  metamodel = metamodel_new(number_of_inputs);
+  metamodel->log_scale = 1;
+  for (r=0; r<runs.number_of_runs; r++)
+    if (!(runs.values[r * (p + 1) + p] > 0.0)) metamodel->log_scale = 0;
+  for (r=0; r<runs.number_of_runs; r++) {
+    for (j=0; j<number_of_inputs; j++)
+      x[j] = runs.values[r * (p + 1) + inputs[j]];
+    metamodel_add(metamodel, x, runs.values[r * (p + 1) + p]);
+  }
+  metamodel_fit(metamodel);
+
+  fprintf(stderr, "Metamodel of %s%s: %ld runs at %d points, inputs",
+	  metamodel->log_scale ? "log " : "", sweep->outputs[k],
+	  runs.number_of_runs, metamodel->number_of_points);
+  for (j=0; j<number_of_inputs; j++)
+    fprintf(stderr, " %s", sweep->parameters[inputs[j]].name);
+  fprintf(stderr, "\n");
+
+  /* Every combination of the axis values is a query point. */
+  sweep->number_of_jobs = 1;
+  for (a=0; a<sweep->number_of_axes; a++)
+    sweep->number_of_jobs *= sweep->axes[a].number_of_values;
+
+  /* The others are taken at their values in the runs. */
+  sweep_set_job(sweep, 0);
+  for (i=0; i<p; i++) {
+    for (j=0; j<number_of_inputs && inputs[j] != i; j++);
+    if (j == number_of_inputs && sweep_parameter_value(sweep, i) != runs.values[i])
+      fprintf(stderr, "Warning: %s is %g in all the cached runs.\n",
+	      sweep->parameters[i].name, runs.values[i]);
+  }
+
+  if (strcmp(sweep->output_file, "-") == 0) {
+    file = stdout;
+  } else if ((file = fopen(sweep->output_file, "w")) == NULL) {
+    printf("Error: Could not open sweep results file %s.\n", sweep->output_file);
+    exit(1);
+  }
+
+  fprintf(file, "point");
+  for (j=0; j<number_of_inputs; j++)
+    fprintf(file, ",%s", sweep->parameters[inputs[j]].name);
+  fprintf(file, ",%s,%s_standard_error,runs\n", sweep->outputs[k],
+	  sweep->outputs[k]);
+
+  for (job=0; job<sweep->number_of_jobs; job++) {
+    sweep_set_job(sweep, job);
+    for (j=0; j<number_of_inputs; j++)
+      x[j] = sweep_parameter_value(sweep, inputs[j]);
+    metamodel_predict(metamodel, x, &mean, &standard_error);
+
+    replications = 0;
+    for (i=0; i<metamodel->number_of_points; i++)
+      if (memcmp(metamodel->x + i * number_of_inputs, x,
+		 number_of_inputs * sizeof(double)) == 0)
+	replications = metamodel->count[i];
+
+    fprintf(file, "%ld", job);
+    for (j=0; j<number_of_inputs; j++) fprintf(file, ",%.10g", x[j]);
+    fprintf(file, ",%.10g,%.10g,%ld\n", mean, standard_error, replications);
+
+    if (standard_error > worst) {
+      worst = standard_error;
+      worst_job = job;
+    }
+  }
+  if (file != stdout) fclose(file);
+
+  if (worst > sweep->metamodel_tolerance) {
+    sweep_set_job(sweep, worst_job);
+    fprintf(stderr, "Metamodel: the largest standard error, %g, is at point "
+	    "%ld; to simulate it next:", worst, worst_job);
+    for (j=0; j<number_of_inputs; j++)
+      fprintf(stderr, " %s=%.10g", sweep->parameters[inputs[j]].name,
+	      sweep_parameter_value(sweep, inputs[j]));
+    fprintf(stderr, "\n");
+  } else {
+    fprintf(stderr, "Metamodel: all standard errors are within %g\n",
+	    sweep->metamodel_tolerance);
+  }
+
+  metamodel_free(metamodel);
+  xfree((void *) runs.values);
+  return 0;
+}
+
+/******************************************************************************/
+
+void
+sweep_free(Sweep_Ptr sweep)
+{
+  int a;
+
+  for (a=0; a<sweep->number_of_axes; a++)
+    xfree((void *) sweep->axes[a].values);
+  xfree((void *) sweep);
+}
+
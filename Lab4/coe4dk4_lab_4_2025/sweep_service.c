@@ -0,0 +1,793 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#include "simlib.h"
+#include "result_cache.h"
+#include "sweep.h"
+#include "sweep_service.h"
+
+/******************************************************************************/
+
+#ifdef _WIN32
+
+long int
+sweep_serve(Sweep_Ptr sweep, FILE * file)
+{
+  printf("Error: Serving a sweep needs sockets and fork().\n");
+  exit(1);
+}
+
+int
+sweep_work(Sweep_Ptr sweep, Sweep_Model model, void * argument)
+{
+  printf("Error: Sweep workers need sockets and fork().\n");
+  exit(1);
+}
+
+#else
+
+/*
+ * The state of a job in the coordinator.
+ */
+
+typedef enum {SWEEP_QUEUED, SWEEP_LEASED, SWEEP_DONE, SWEEP_FAILED}
+  Sweep_Job_State;
+
+typedef struct _sweep_connection_
+{
+  int fd;
+  int greeted;            /* sent a matching HELLO */
+  int waiting;            /* sent READY and has no job yet */
+  long int lease;         /* pending job index, or -1 */
+  time_t deadline;        /* of the lease */
+  size_t length;
+  char buffer[SWEEP_MAX_ROW];
+} Sweep_Connection, * Sweep_Connection_Ptr;
+
+typedef struct _sweep_service_
+{
+  Sweep_Ptr sweep;
+  FILE * file;
+  unsigned signature;
+
+  int number_of_connections;
+  Sweep_Connection connections[SWEEP_MAX_CONNECTIONS];
+
+  Sweep_Job_State * state;  /* [pending job index] */
+  int * attempts;
+  long int * queue;         /* ring of pending job indices */
+  long int head;
+  long int queued;
+  long int remaining;       /* neither done nor failed */
+  long int failed;
+} Sweep_Service, * Sweep_Service_Ptr;
+
+/******************************************************************************/
+
+static int
+sweep_service_write(int fd, const char * line)
+{
+  size_t done, size = strlen(line);
+  ssize_t n;
+
+  for (done=0; done<size; done+=n) {
+    n = write(fd, line + done, size - done);
+    if (n < 0 && errno == EINTR) n = 0;
+    else if (n <= 0) return 0;
+  }
+  return 1;
+}
+
+/*
+ * Take the next complete line out of the buffer, without its newline.
+ */
+
+static int
+sweep_take_line(char * buffer, size_t * length, char * line)
+{
+  char * end;
+  size_t size;
+
+  if ((end = memchr(buffer, '\n', *length)) == NULL) return 0;
+  size = end - buffer;
+  memcpy(line, buffer, size);
+  line[size] = '\0';
+  if (size > 0 && line[size - 1] == '\r') line[size - 1] = '\0';
+  memmove(buffer, end + 1, *length - size - 1);
+  *length -= size + 1;
+  return 1;
+}
+
+/*
+ * A 32-bit FNV-1a hash of the model name and its parameter and output names,
+ * so that a worker built from another model, or another version of it, is
+ * refused.
+ */
+
+static unsigned
+sweep_signature(Sweep_Ptr sweep)
+{
+  unsigned hash = 2166136261U;
+  const char * p;
+  int i;
+
+  for (p=sweep->model; *p; p++) hash = (hash ^ (unsigned char) *p) * 16777619U;
+  for (i=0; i<sweep->number_of_parameters; i++) {
+    hash = (hash ^ (sweep->parameters[i].value != NULL ? 'd' : 'i')) * 16777619U;
+    for (p=sweep->parameters[i].name; *p; p++)
+      hash = (hash ^ (unsigned char) *p) * 16777619U;
+  }
+  for (i=0; i<sweep->number_of_outputs; i++) {
+    hash = (hash ^ ',') * 16777619U;
+    for (p=sweep->outputs[i]; *p; p++)
+      hash = (hash ^ (unsigned char) *p) * 16777619U;
+  }
+  return hash;
+}
+
+/*
+ * Open a socket on the address, listening on it or connected to it.
+ * Returns -1 on failure.
+ */
+
+static int
+sweep_service_socket(const char * address, int listening)
+{
+  struct sockaddr_un local;
+  struct addrinfo hints, * addresses, * a;
+  char host[256], * port;
+  int fd = -1, on = 1;
+
+  if (strncmp(address, "unix:", 5) == 0) {
+    if (strlen(address + 5) >= sizeof(local.sun_path)) {
+      printf("Error: Socket path %s is too long.\n", address + 5);
+      exit(1);
+    }
+    memset(&local, 0, sizeof(local));
+    local.sun_family = AF_UNIX;
+    strcpy(local.sun_path, address + 5);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+    if (listening) {
+      unlink(local.sun_path);
+      if (bind(fd, (struct sockaddr *) &local, sizeof(local)) == 0 &&
+	  listen(fd, SWEEP_MAX_CONNECTIONS) == 0)
+	return fd;
+    } else if (connect(fd, (struct sockaddr *) &local, sizeof(local)) == 0) {
+      return fd;
+    }
+    close(fd);
+    return -1;
+  }
+
+  strncpy(host, address, sizeof(host) - 1);
+  host[sizeof(host) - 1] = '\0';
+  if ((port = strrchr(host, ':')) != NULL) {
+    *port++ = '\0';
+  } else {
+    memmove(host + 10, host, strlen(host) + 1);
+    memcpy(host, "127.0.0.1", 10);
+    port = host + 10;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &addresses) != 0) return -1;
+
+  for (a=addresses; a!=NULL; a=a->ai_next) {
+    if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) < 0)
+      continue;
+    if (listening) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (bind(fd, a->ai_addr, a->ai_addrlen) == 0 &&
+	  listen(fd, SWEEP_MAX_CONNECTIONS) == 0)
+	break;
+    } else if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+  return fd;
+}
+
+/******************************************************************************/
+
+/*
+ * The coordinator.
+ */
+
+/*
+ * The index of a job in the pending jobs, which are in job order, or -1.
+ */
+
+static long int
+sweep_find_pending(Sweep_Ptr sweep, long int job)
+{
+  long int low = 0, high = sweep->number_of_pending_jobs - 1, middle;
+
+  while (low <= high) {
+    middle = (low + high)/2;
+    if (sweep->pending_jobs[middle] == job) return middle;
+    if (sweep->pending_jobs[middle] < job) low = middle + 1;
+    else high = middle - 1;
+  }
+  return -1;
+}
+
+static void
+sweep_enqueue(Sweep_Service_Ptr service, long int i)
+{
+  long int n = service->sweep->number_of_pending_jobs;
+
+  service->queue[(service->head + service->queued++) % n] = i;
+  service->state[i] = SWEEP_QUEUED;
+}
+
+/*
+ * Give a job back after its lease was lost, or fail it after too many
+ * attempts.
+ */
+
+static void
+sweep_release(Sweep_Service_Ptr service, long int i, const char * reason)
+{
+  Sweep_Ptr sweep = service->sweep;
+
+  if (service->state[i] != SWEEP_LEASED) return;
+
+  if (service->attempts[i] < SWEEP_MAX_ATTEMPTS) {
+    fprintf(stderr, "Sweep: job %ld %s, retrying\n", sweep->pending_jobs[i],
+	    reason);
+    sweep_enqueue(service, i);
+  } else {
+    fprintf(stderr, "Error: Sweep job %ld %s after %d attempts.\n",
+	    sweep->pending_jobs[i], reason, service->attempts[i]);
+    service->state[i] = SWEEP_FAILED;
+    service->remaining--;
+    service->failed++;
+  }
+}
+
+static void
+sweep_close_connection(Sweep_Service_Ptr service, Sweep_Connection_Ptr c)
+{
+  if (c->lease >= 0) sweep_release(service, c->lease, "lost its worker");
+  close(c->fd);
+  *c = service->connections[--service->number_of_connections];
+}
+
+/*
+ * Lease the next queued job to a waiting worker, or tell it that there are
+ * none left. Returns 0 if the worker could not be written to.
+ */
+
+static int
+sweep_lease(Sweep_Service_Ptr service, Sweep_Connection_Ptr c)
+{
+  Sweep_Ptr sweep = service->sweep;
+  Sweep_Parameter_Ptr parameter;
+  char line[SWEEP_MAX_ROW];
+  long int i = -1;
+  int k, n;
+
+  if (service->remaining == 0) return sweep_service_write(c->fd, "DONE\n");
+
+  /* Skip the jobs whose late result came in while they were queued again. */
+  while (service->queued > 0) {
+    i = service->queue[service->head];
+    service->head = (service->head + 1) % sweep->number_of_pending_jobs;
+    service->queued--;
+    if (service->state[i] == SWEEP_QUEUED) break;
+    i = -1;
+  }
+  if (i < 0) return 1;
+
+  service->state[i] = SWEEP_LEASED;
+  service->attempts[i]++;
+  c->waiting = 0;
+  c->lease = i;
+  c->deadline = time(NULL) + SWEEP_LEASE;
+
+  sweep_set_job(sweep, sweep->pending_jobs[i]);
+  n = sprintf(line, "JOB %ld %u", sweep->pending_jobs[i], sweep->seed);
+  for (k=0; k<sweep->number_of_parameters; k++) {
+    parameter = sweep->parameters + k;
+    if (parameter->value != NULL)
+      n += sprintf(line + n, " %s=%.17g", parameter->name, *parameter->value);
+    else
+      n += sprintf(line + n, " %s=%d", parameter->name, *parameter->integer);
+  }
+  sprintf(line + n, "\n");
+  return sweep_service_write(c->fd, line);
+}
+
+/*
+ * Write the row of a finished job and keep it in the cache.
+ */
+
+static int
+sweep_complete(Sweep_Service_Ptr service, long int i, const char * values)
+{
+  Sweep_Ptr sweep = service->sweep;
+  char row[SWEEP_MAX_ROW], * end;
+  int k;
+
+  sweep_set_job(sweep, sweep->pending_jobs[i]);
+  for (k=0; k<sweep->number_of_outputs; k++) {
+    sweep->output_values[k] = strtod(values, &end);
+    if (end == values) {
+      fprintf(stderr, "Error: Sweep job %ld came back with %d of %d outputs.\n",
+	      sweep->pending_jobs[i], k, sweep->number_of_outputs);
+      return 0;
+    }
+    values = end;
+  }
+
+  sweep_format_row(sweep, sweep->pending_jobs[i], row);
+  fputs(row, service->file);
+  fflush(service->file);
+
+  if (sweep->cache != NULL) {
+    sweep_job_key(sweep);
+    result_cache_store(sweep->cache, sweep->output_values,
+		       sweep->number_of_outputs);
+  }
+
+  service->state[i] = SWEEP_DONE;
+  service->remaining--;
+  sweep->completed_jobs++;
+  fprintf(stderr, "Sweep: %ld of %ld jobs done\r", sweep->completed_jobs,
+	  sweep->number_of_jobs);
+  return 1;
+}
+
+/*
+ * Act on a line from a worker. Returns 0 to drop the worker.
+ */
+
+static int
+sweep_handle_line(Sweep_Service_Ptr service, Sweep_Connection_Ptr c,
+		  char * line)
+{
+  Sweep_Ptr sweep = service->sweep;
+  char command[16], model[SWEEP_MAX_NAME], error[SWEEP_MAX_ROW];
+  long int job, i;
+  unsigned signature;
+  int start = 0, offset = 0;
+
+  if (sscanf(line, "%15s %n", command, &start) != 1) return 1;
+
+  if (strcmp(command, "HELLO") == 0) {
+    if (sscanf(line + start, "%31s %x", model, &signature) != 2 ||
+	strcmp(model, sweep->model) != 0 || signature != service->signature) {
+      sprintf(error, "ERROR this sweep needs the %s model, signature %08x\n",
+	      sweep->model, service->signature);
+      sweep_service_write(c->fd, error);
+      return 0;
+    }
+    c->greeted = 1;
+    return 1;
+  }
+  if (!c->greeted) return 0;
+
+  if (strcmp(command, "READY") == 0) {
+    c->waiting = 1;
+    return sweep_lease(service, c);
+  }
+
+  if (sscanf(line + start, "%ld %n", &job, &offset) < 1) return 0;
+  i = sweep_find_pending(sweep, job);
+  if (i < 0) return 0;
+
+  if (strcmp(command, "HEARTBEAT") == 0) {
+    if (c->lease == i) c->deadline = time(NULL) + SWEEP_LEASE;
+  } else if (strcmp(command, "RESULT") == 0) {
+    if (c->lease == i) c->lease = -1;
+    if ((service->state[i] == SWEEP_QUEUED || service->state[i] == SWEEP_LEASED)
+	&& !sweep_complete(service, i, line + start + offset))
+      sweep_release(service, i, "sent a bad result");
+  } else if (strcmp(command, "FAIL") == 0) {
+    if (c->lease == i) {
+      c->lease = -1;
+      sweep_release(service, i, "failed");
+    }
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * Hand the pending jobs out to the workers that connect to the service
+ * address, writing their rows to the file as they come in. Returns the
+ * number of jobs that failed.
+ */
+
+long int
+sweep_serve(Sweep_Ptr sweep, FILE * file)
+{
+  Sweep_Service_Ptr service;
+  Sweep_Connection_Ptr c;
+  struct pollfd fds[SWEEP_MAX_CONNECTIONS + 1];
+  char line[SWEEP_MAX_ROW];
+  long int i, failed;
+  time_t now;
+  ssize_t count;
+  int listener, k, n, fd, drop;
+
+  if ((listener = sweep_service_socket(sweep->service_address, 1)) < 0) {
+    printf("Error: Could not listen on %s.\n", sweep->service_address);
+    exit(1);
+  }
+
+  service = (Sweep_Service_Ptr) xcalloc(1, sizeof(Sweep_Service));
+  service->sweep = sweep;
+  service->file = file;
+  service->signature = sweep_signature(sweep);
+  i = sweep->number_of_pending_jobs;
+  service->state = (Sweep_Job_State *) xcalloc(i, sizeof(Sweep_Job_State));
+  service->attempts = (int *) xcalloc(i, sizeof(int));
+  service->queue = (long int *) xcalloc(i, sizeof(long int));
+  for (i=0; i<sweep->number_of_pending_jobs; i++) sweep_enqueue(service, i);
+  service->remaining = sweep->number_of_pending_jobs;
+
+  /* A worker that dies is noticed on its socket instead. */
+  signal(SIGPIPE, SIG_IGN);
+
+  fprintf(stderr, "Sweep: serving %ld jobs on %s (model %s, signature %08x)\n",
+	  sweep->number_of_pending_jobs, sweep->service_address, sweep->model,
+	  service->signature);
+
+  while (service->remaining > 0) {
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    for (k=0; k<service->number_of_connections; k++) {
+      fds[k + 1].fd = service->connections[k].fd;
+      fds[k + 1].events = POLLIN;
+    }
+    n = service->number_of_connections;
+    if (poll(fds, n + 1, 1000) < 0) {
+      if (errno == EINTR) continue;
+      printf("Error: Lost the sweep service socket.\n");
+      exit(1);
+    }
+
+    /* Walk down, as closing a connection moves the last one into its place. */
+    for (k=n-1; k>=0; k--) {
+      if (fds[k + 1].revents == 0) continue;
+      c = service->connections + k;
+      count = read(c->fd, c->buffer + c->length, SWEEP_MAX_ROW - c->length);
+      if (count < 0 && errno == EINTR) continue;
+      drop = (count <= 0);
+      if (!drop) c->length += count;
+      while (!drop && sweep_take_line(c->buffer, &c->length, line))
+	drop = !sweep_handle_line(service, c, line);
+      /* A line too long for the buffer is not from a worker either. */
+      if (drop || c->length == SWEEP_MAX_ROW) sweep_close_connection(service, c);
+    }
+
+    if (fds[0].revents & POLLIN) {
+      if ((fd = accept(listener, NULL, NULL)) >= 0) {
+	if (service->number_of_connections == SWEEP_MAX_CONNECTIONS) {
+	  sweep_service_write(fd, "ERROR too many workers\n");
+	  close(fd);
+	} else {
+	  c = service->connections + service->number_of_connections++;
+	  memset(c, 0, sizeof(*c));
+	  c->fd = fd;
+	  c->lease = -1;
+	}
+      }
+    }
+
+    /* Take back the expired leases, then serve the waiting workers. */
+    now = time(NULL);
+    for (k=0; k<service->number_of_connections; k++) {
+      c = service->connections + k;
+      if (c->lease >= 0 && now > c->deadline) {
+	i = c->lease;
+	c->lease = -1;
+	sweep_release(service, i, "lease expired");
+      }
+    }
+    for (k=service->number_of_connections-1; k>=0; k--) {
+      c = service->connections + k;
+      if (c->waiting && !sweep_lease(service, c))
+	sweep_close_connection(service, c);
+    }
+  }
+  fprintf(stderr, "\n");
+
+  /*
+   * Tell the connected workers to stop, and wait for them to hang up, so
+   * that closing with their last READY unread does not reset the
+   * connection before they see the DONE.
+   */
+  for (k=0; k<service->number_of_connections; k++) {
+    c = service->connections + k;
+    sweep_service_write(c->fd, "DONE\n");
+    shutdown(c->fd, SHUT_WR);
+  }
+  for (now=time(NULL); service->number_of_connections > 0 &&
+	 time(NULL) - now < SWEEP_HEARTBEAT; ) {
+    n = service->number_of_connections;
+    for (k=0; k<n; k++) {
+      fds[k].fd = service->connections[k].fd;
+      fds[k].events = POLLIN;
+    }
+    if (poll(fds, n, 1000) < 0 && errno != EINTR) break;
+    for (k=n-1; k>=0; k--) {
+      c = service->connections + k;
+      if (fds[k].revents != 0 && read(c->fd, line, sizeof(line)) <= 0)
+	sweep_close_connection(service, c);
+    }
+  }
+  while (service->number_of_connections > 0)
+    sweep_close_connection(service,
+			   service->connections + service->number_of_connections - 1);
+  close(listener);
+  if (strncmp(sweep->service_address, "unix:", 5) == 0)
+    unlink(sweep->service_address + 5);
+
+  failed = service->failed;
+  xfree((void *) service->queue);
+  xfree((void *) service->attempts);
+  xfree((void *) service->state);
+  xfree((void *) service);
+
+  return failed;
+}
+
+/******************************************************************************/
+
+/*
+ * The worker.
+ */
+
+static int
+sweep_read_line(int fd, char * buffer, size_t * length, char * line)
+{
+  ssize_t n;
+
+  while (!sweep_take_line(buffer, length, line)) {
+    if (*length == SWEEP_MAX_ROW) return 0;
+    n = read(fd, buffer + *length, SWEEP_MAX_ROW - *length);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    *length += n;
+  }
+  return 1;
+}
+
+/*
+ * Connect to the coordinator, retrying while it is not up, and introduce
+ * the model. Returns -1 if it could not be reached.
+ */
+
+static int
+sweep_connect(Sweep_Ptr sweep)
+{
+  char line[SWEEP_MAX_ROW];
+  int fd, attempt;
+
+  for (attempt=0; attempt<SWEEP_CONNECT_ATTEMPTS; attempt++) {
+    if (attempt > 0) sleep(1);
+    if ((fd = sweep_service_socket(sweep->service_address, 0)) < 0) continue;
+
+    sprintf(line, "HELLO %s %08x\n", sweep->model, sweep_signature(sweep));
+    if (sweep_service_write(fd, line)) return fd;
+    close(fd);
+  }
+  return -1;
+}
+
+/*
+ * Set the parameters of a JOB line. Returns 0 if one is unknown.
+ */
+
+static int
+sweep_set_assignments(Sweep_Ptr sweep, char * assignments)
+{
+  char * name, * value;
+  int i;
+
+  for (name=strtok(assignments, " "); name!=NULL; name=strtok(NULL, " ")) {
+    if ((value = strchr(name, '=')) == NULL) return 0;
+    *value++ = '\0';
+    for (i=0; i<sweep->number_of_parameters; i++)
+      if (strcmp(sweep->parameters[i].name, name) == 0) break;
+    if (i == sweep->number_of_parameters) return 0;
+    if (sweep->parameters[i].value != NULL)
+      *sweep->parameters[i].value = strtod(value, NULL);
+    else
+      *sweep->parameters[i].integer = atoi(value);
+  }
+  return 1;
+}
+
+/*
+ * Run a job in a child, sending heartbeats while it runs and then its result.
+ * Returns 0 if the coordinator was lost.
+ */
+
+static int
+sweep_work_job(Sweep_Ptr sweep, int fd, long int job, Sweep_Model model,
+	       void * argument)
+{
+  struct pollfd child;
+  char line[SWEEP_MAX_ROW];
+  int pipe_fds[2], status, ok, k, n;
+  size_t done, size;
+  ssize_t count;
+  pid_t pid;
+
+  for (k=0; k<sweep->number_of_outputs; k++) sweep->output_values[k] = NAN;
+
+  fflush(NULL);
+  if (pipe(pipe_fds) != 0 || (pid = fork()) < 0) {
+    printf("Error: Could not start sweep job %ld.\n", job);
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fd);
+    close(pipe_fds[0]);
+    if (freopen("/dev/null", "w", stdout) == NULL) _exit(1);
+    model(sweep, sweep->seed, argument);
+    /* _exit skips the atexit handlers. */
+    simulation_run_metrics_close();
+    simulation_run_trace_close();
+    size = sweep->number_of_outputs * sizeof(double);
+    for (done=0; done<size; done+=count)
+      if ((count = write(pipe_fds[1], (char *) sweep->output_values + done,
+			 size - done)) <= 0)
+	_exit(1);
+    _exit(0);
+  }
+  close(pipe_fds[1]);
+
+  /* Wait for the run, renewing the lease meanwhile. */
+  child.fd = pipe_fds[0];
+  child.events = POLLIN;
+  sprintf(line, "HEARTBEAT %ld\n", job);
+  for (;;) {
+    n = poll(&child, 1, SWEEP_HEARTBEAT * 1000);
+    if (n > 0) break;
+    if (n < 0 && errno != EINTR) break;
+    if (n == 0 && !sweep_service_write(fd, line)) {
+      kill(pid, SIGKILL);
+      close(pipe_fds[0]);
+      waitpid(pid, &status, 0);
+      return 0;
+    }
+  }
+
+  size = sweep->number_of_outputs * sizeof(double);
+  for (done=0; done<size; done+=count) {
+    count = read(pipe_fds[0], (char *) sweep->output_values + done, size - done);
+    if (count < 0 && errno == EINTR) count = 0;
+    else if (count <= 0) break;
+  }
+  ok = (done == size);
+  close(pipe_fds[0]);
+  waitpid(pid, &status, 0);
+
+  if (!ok) {
+    fprintf(stderr, "Error: Sweep job %ld failed.\n", job);
+    sprintf(line, "FAIL %ld\n", job);
+  } else {
+    n = sprintf(line, "RESULT %ld", job);
+    for (k=0; k<sweep->number_of_outputs; k++)
+      n += sprintf(line + n, " %.17g", sweep->output_values[k]);
+    sprintf(line + n, "\n");
+  }
+  return sweep_service_write(fd, line);
+}
+
+/*
+ * Run the jobs handed out by the coordinator at the service address until
+ * it has none left.
+ */
+
+int
+sweep_work(Sweep_Ptr sweep, Sweep_Model model, void * argument)
+{
+  char buffer[SWEEP_MAX_ROW], line[SWEEP_MAX_ROW], command[16];
+  size_t length = 0;
+  long int job, jobs = 0;
+  int fd, start, offset, ok;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if ((fd = sweep_connect(sweep)) < 0) {
+    printf("Error: Could not reach the sweep coordinator at %s.\n",
+	   sweep->service_address);
+    exit(1);
+  }
+  fprintf(stderr, "Sweep: working for %s\n", sweep->service_address);
+
+  for (;;) {
+    /* The answer can already be waiting even if the coordinator hung up. */
+    sweep_service_write(fd, "READY\n");
+    ok = sweep_read_line(fd, buffer, &length, line);
+
+    if (ok && sscanf(line, "%15s %n", command, &start) == 1) {
+      if (strcmp(command, "DONE") == 0) break;
+      if (strcmp(command, "ERROR") == 0) {
+	printf("Error: The sweep coordinator refused this worker: %s\n",
+	       line + start);
+	exit(1);
+      }
+      if (strcmp(command, "JOB") != 0 ||
+	  sscanf(line + start, "%ld %u %n", &job, &sweep->seed, &offset) < 2 ||
+	  !sweep_set_assignments(sweep, line + start + offset)) {
+	printf("Error: Bad line from the sweep coordinator: %s\n", line);
+	exit(1);
+      }
+      ok = sweep_work_job(sweep, fd, job, model, argument);
+      jobs++;
+    }
+
+    if (!ok) {
+      fprintf(stderr, "Sweep: lost the coordinator, reconnecting\n");
+      close(fd);
+      length = 0;
+      if ((fd = sweep_connect(sweep)) < 0) {
+	printf("Error: Lost the sweep coordinator at %s.\n",
+	       sweep->service_address);
+	exit(1);
+      }
+    }
+  }
+  close(fd);
+
+  fprintf(stderr, "Sweep: worker done after %ld jobs\n", jobs);
+  return 0;
+}
+
+#endif /* _WIN32 */
+
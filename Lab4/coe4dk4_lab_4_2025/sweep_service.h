@@ -0,0 +1,100 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/******************************************************************************/
+
+#ifndef _SWEEP_SERVICE_H_
+#define _SWEEP_SERVICE_H_
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include "sweep.h"
+
+/******************************************************************************/
+
+/*
+ * Sweeps distributed over processes and hosts.
+ *
+ * With -s ADDRESS a sweep is run by a coordinator. Instead of forking its own
+ * workers it listens on ADDRESS and hands the jobs that are not in its cache
+ * to the worker processes that connect, writing each row to the results file
+ * and the cache as it arrives. With -w ADDRESS the same lab binary is a
+ * worker: it connects to the coordinator and runs the jobs it is given with
+ * its own model function until there are none left. Workers can be started
+ * before the coordinator, and join or leave at any time.
+ *
+ * ADDRESS is unix:PATH for a Unix socket, HOST:PORT for TCP, or PORT alone
+ * for TCP on the loopback interface (0.0.0.0:PORT listens on every one).
+ * There is no authentication, so only listen where the peers are trusted.
+ *
+ * The protocol is lines of text, worker first:
+ *
+ *   HELLO model signature     the model name and a hash of its parameter
+ *                             and output names, which must match
+ *   READY                     asks for a job
+ *   JOB job seed name=value ...
+ *                             the job number, its seed and every parameter
+ *   HEARTBEAT job             every SWEEP_HEARTBEAT seconds while running
+ *   RESULT job value ...      all the outputs, "nan" for unset ones
+ *   FAIL job                  the run died
+ *   DONE                      no jobs are left: the worker exits
+ *   ERROR message             the worker was refused
+ *
+ * A READY is answered once a job can be leased, so workers wait while the
+ * last jobs run elsewhere. A job is leased to one worker for SWEEP_LEASE
+ * seconds, renewed by each heartbeat. A job whose lease runs out, whose run
+ * fails or whose worker disconnects goes back to the queue, up to
+ * SWEEP_MAX_ATTEMPTS leases; a result that comes in late is still taken if
+ * the job is not done yet. Each job runs in a child of the worker (fork),
+ * with its output discarded, so a crashing run costs only that attempt.
+ * A worker that loses the coordinator reconnects, and gives up after
+ * SWEEP_CONNECT_ATTEMPTS seconds.
+ *
+ * POSIX only: without fork and sockets (Windows) both modes are errors.
+ */
+
+#define SWEEP_LEASE 30
+#define SWEEP_HEARTBEAT 5
+#define SWEEP_MAX_ATTEMPTS 3
+#define SWEEP_MAX_CONNECTIONS 256
+#define SWEEP_CONNECT_ATTEMPTS 30
+
+/******************************************************************************/
+
+/*
+ * Function prototypes
+ */
+
+long int
+sweep_serve(Sweep_Ptr, FILE *);
+
+int
+sweep_work(Sweep_Ptr, Sweep_Model, void *);
+
+/******************************************************************************/
+
+#endif /* sweep_service.h */
+
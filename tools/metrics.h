@@ -0,0 +1,122 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/******************************************************************************/
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+/******************************************************************************/
+
+/*
+ * Live metrics of a running simulation.
+ *
+ * With SIMLIB_METRICS set in the environment, each process running
+ * simulations publishes a page of fixed layout in the POSIX shared memory
+ * segment METRICS_PREFIX<pid> (e.g., /dev/shm/simlib-1234 on Linux), for
+ * tools/simtop to attach to and display. The page holds the run being
+ * executed: the seed it was started with, the events executed so far and
+ * the simulation time, and the progress, counters and estimates that the
+ * model publishes (see simulation_run_metrics_counter in simlib.h). A
+ * process starting another run reuses its page; the segment is removed
+ * when the process exits normally.
+ *
+ * The simulation only does relaxed atomic stores to the page, one field at
+ * a time and without a lock, so a reader sees each field whole but may see
+ * them from slightly different moments. Everything derived is left to the
+ * reader: the event rate from two readings, and the mean and confidence
+ * interval of an estimate from its count, sum and sum of squares (which
+ * treats the observations as independent).
+ */
+
+#define METRICS_MAGIC 0x4d4d4953U  /* "SIMM" */
+#define METRICS_VERSION 1
+#define METRICS_PREFIX "/simlib-"
+#define METRICS_NAME_SIZE 32
+#define METRICS_LABEL_SIZE 64
+#define METRICS_MAX_COUNTERS 16
+#define METRICS_MAX_ESTIMATES 8
+
+typedef enum {METRICS_IDLE, METRICS_RUNNING, METRICS_FINISHED} Metrics_State;
+
+typedef struct _metrics_counter_
+{
+  char name[METRICS_NAME_SIZE];
+  long long value;
+} Metrics_Counter, * Metrics_Counter_Ptr;
+
+typedef struct _metrics_estimate_
+{
+  char name[METRICS_NAME_SIZE];
+  long long count;
+  double sum;
+  double sum_squares;
+} Metrics_Estimate, * Metrics_Estimate_Ptr;
+
+typedef struct _metrics_page_
+{
+  unsigned magic;
+  unsigned version;
+  long long pid;
+  char label[METRICS_LABEL_SIZE];  /* set by the model, or empty */
+
+  int state;              /* a Metrics_State */
+  long long runs;         /* started by the process, this one included */
+  unsigned seed;          /* of the random generator at the start */
+  double start_time;      /* wall clock, in seconds since the epoch */
+
+  long long events;
+  double simulation_time;
+  double progress;        /* fraction of the run done, if published */
+
+  int number_of_counters;
+  int number_of_estimates;
+  Metrics_Counter counters[METRICS_MAX_COUNTERS];
+  Metrics_Estimate estimates[METRICS_MAX_ESTIMATES];
+} Metrics_Page, * Metrics_Page_Ptr;
+
+/*
+ * Relaxed atomic stores and loads of single fields of the page. Without
+ * the GCC atomic builtins they are plain ones, which are whole on the
+ * usual platforms for aligned fields of up to 8 bytes.
+ */
+
+#if defined(__GNUC__)
+#define METRICS_STORE(field, value) \
+  do { \
+    __typeof__(field) metrics_value_ = (value); \
+    __atomic_store(&(field), &metrics_value_, __ATOMIC_RELAXED); \
+  } while (0)
+#define METRICS_LOAD(field, result) \
+  __atomic_load(&(field), &(result), __ATOMIC_RELAXED)
+#else
+#define METRICS_STORE(field, value) ((field) = (value))
+#define METRICS_LOAD(field, result) ((result) = (field))
+#endif
+
+/******************************************************************************/
+
+#endif /* metrics.h */
+
@@ -0,0 +1,320 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/******************************************************************************/
+
+/*
+ * simtop: display the live metrics of the simulations running on this
+ * machine (see metrics.h). Run the simulations with SIMLIB_METRICS set.
+ *
+ *   simtop [-i SECONDS] [-n COUNT] [-c] [PID ...]
+ *
+ * Without PIDs it shows every page in /dev/shm (Linux). The display is
+ * refreshed every -i seconds (1 by default), -n times (forever by default;
+ * -n 1 prints once, e.g., for a batch job's log). The event rate is taken
+ * between two refreshes, so the first display has none. The confidence
+ * intervals are at 95%. With -c the pages left by processes that have gone
+ * (e.g., killed ones) are removed.
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metrics.h"
+
+/******************************************************************************/
+
+#define SIMTOP_MAX_PAGES 256
+#define SIMTOP_Z 1.96
+
+/* An attached page and what was seen on it at the last refresh. */
+typedef struct _simtop_page_
+{
+  long int pid;
+  Metrics_Page_Ptr page;
+  int seen;               /* still there at this refresh */
+  long long runs;
+  long long events;
+  double time;
+} Simtop_Page, * Simtop_Page_Ptr;
+
+static Simtop_Page pages[SIMTOP_MAX_PAGES];
+static int number_of_pages = 0;
+
+/******************************************************************************/
+
+static double
+simtop_seconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+/*
+ * Attach to the page of a process, read-only, unless it already is.
+ */
+
+static Simtop_Page_Ptr
+simtop_attach(long int pid)
+{
+  Simtop_Page_Ptr entry;
+  char name[64];
+  void * page;
+  unsigned magic;
+  int i, fd;
+
+  for (i=0; i<number_of_pages; i++)
+    if (pages[i].pid == pid) return pages + i;
+  if (number_of_pages >= SIMTOP_MAX_PAGES) return NULL;
+
+  sprintf(name, "%s%ld", METRICS_PREFIX, pid);
+  if ((fd = shm_open(name, O_RDONLY, 0)) < 0) return NULL;
+  page = mmap(NULL, sizeof(Metrics_Page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) return NULL;
+
+  METRICS_LOAD(((Metrics_Page_Ptr) page)->magic, magic);
+  if (magic != METRICS_MAGIC ||
+      ((Metrics_Page_Ptr) page)->version != METRICS_VERSION) {
+    munmap(page, sizeof(Metrics_Page));
+    return NULL;
+  }
+
+  entry = pages + number_of_pages++;
+  memset(entry, 0, sizeof(Simtop_Page));
+  entry->pid = pid;
+  entry->page = (Metrics_Page_Ptr) page;
+  entry->runs = -1;
+  return entry;
+}
+
+static void
+simtop_detach(Simtop_Page_Ptr entry)
+{
+  munmap((void *) entry->page, sizeof(Metrics_Page));
+  *entry = pages[--number_of_pages];
+}
+
+/*
+ * Attach to the pages of all the processes publishing, as found in
+ * /dev/shm.
+ */
+
+static void
+simtop_find_pages(void)
+{
+  Simtop_Page_Ptr entry;
+  struct dirent * file;
+  DIR * directory;
+  char * end;
+  long int pid;
+  size_t prefix = strlen(METRICS_PREFIX) - 1;
+
+  if ((directory = opendir("/dev/shm")) == NULL) return;
+  while ((file = readdir(directory)) != NULL) {
+    if (strncmp(file->d_name, METRICS_PREFIX + 1, prefix) != 0) continue;
+    pid = strtol(file->d_name + prefix, &end, 10);
+    if (*end != '\0' || pid <= 0) continue;
+    if ((entry = simtop_attach(pid)) != NULL) entry->seen = 1;
+  }
+  closedir(directory);
+}
+
+/******************************************************************************/
+
+static const char *
+simtop_state(int state, int alive)
+{
+  if (!alive) return "exited";
+  switch (state) {
+  case METRICS_RUNNING: return "running";
+  case METRICS_FINISHED: return "finished";
+  default: return "idle";
+  }
+}
+
+/*
+ * Copy a name off the page, a byte at a time as it is written.
+ */
+
+static void
+simtop_copy_name(char * to, char * name, int size)
+{
+  int i;
+
+  for (i=0; i<size; i++) METRICS_LOAD(name[i], to[i]);
+  to[size-1] = '\0';
+}
+
+/*
+ * Print one page. The rate is over the time since the last refresh, if the
+ * same run was there then.
+ */
+
+static void
+simtop_print_page(Simtop_Page_Ptr entry, double now)
+{
+  Metrics_Page_Ptr page = entry->page;
+  Metrics_Estimate estimate;
+  char label[METRICS_LABEL_SIZE], name[METRICS_NAME_SIZE];
+  long long runs, events, value;
+  double simulation_time, progress, start_time, mean, half_width;
+  unsigned seed;
+  int i, state, alive, number;
+
+  METRICS_LOAD(page->state, state);
+  METRICS_LOAD(page->runs, runs);
+  METRICS_LOAD(page->seed, seed);
+  METRICS_LOAD(page->start_time, start_time);
+  METRICS_LOAD(page->events, events);
+  METRICS_LOAD(page->simulation_time, simulation_time);
+  METRICS_LOAD(page->progress, progress);
+  simtop_copy_name(label, page->label, METRICS_LABEL_SIZE);
+  alive = kill((pid_t) entry->pid, 0) == 0 || errno != ESRCH;
+
+  printf("%s%ld  %s  run %lld  seed %u  %s\n", METRICS_PREFIX + 1,
+	 entry->pid, simtop_state(state, alive), runs, seed, label);
+  printf("  progress %5.1f%%  events %lld", 100.0 * progress, events);
+  if (runs == entry->runs && now > entry->time && state == METRICS_RUNNING)
+    printf(" (%.0f/s)", (events - entry->events)/(now - entry->time));
+  printf("  simulation time %.6g", simulation_time);
+  if (state == METRICS_RUNNING && alive)
+    printf("  elapsed %.0f s", difftime(time(NULL), (time_t) start_time));
+  printf("\n");
+
+  METRICS_LOAD(page->number_of_counters, number);
+  for (i=0; i<number && i<METRICS_MAX_COUNTERS; i++) {
+    simtop_copy_name(name, page->counters[i].name, METRICS_NAME_SIZE);
+    METRICS_LOAD(page->counters[i].value, value);
+    printf("  %-32s %lld\n", name, value);
+  }
+
+  METRICS_LOAD(page->number_of_estimates, number);
+  for (i=0; i<number && i<METRICS_MAX_ESTIMATES; i++) {
+    simtop_copy_name(name, page->estimates[i].name, METRICS_NAME_SIZE);
+    METRICS_LOAD(page->estimates[i].count, estimate.count);
+    METRICS_LOAD(page->estimates[i].sum, estimate.sum);
+    METRICS_LOAD(page->estimates[i].sum_squares, estimate.sum_squares);
+    if (estimate.count < 2) {
+      printf("  %-32s -\n", name);
+      continue;
+    }
+    mean = estimate.sum / estimate.count;
+    half_width = SIMTOP_Z *
+      sqrt(fmax(0.0, (estimate.sum_squares - estimate.count * mean * mean)
+		/ (estimate.count - 1)) / estimate.count);
+    printf("  %-32s %.6g +/- %.3g (n = %lld)\n", name, mean, half_width,
+	   estimate.count);
+  }
+
+  entry->runs = runs;
+  entry->events = events;
+  entry->time = now;
+}
+
+/******************************************************************************/
+
+static void
+simtop_usage(void)
+{
+  printf("Usage: simtop [-i SECONDS] [-n COUNT] [-c] [PID ...]\n");
+  exit(1);
+}
+
+int
+main(int argc, char * argv[])
+{
+  Simtop_Page_Ptr entry;
+  char name[64];
+  double interval = 1.0, now;
+  long int count = 0, refresh, pid;
+  int i, clean = 0, first_pid, screen;
+
+  for (i=1; i<argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-i") == 0 && i+1 < argc) {
+      interval = atof(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+      count = atol(argv[++i]);
+    } else if (strcmp(argv[i], "-c") == 0) {
+      clean = 1;
+    } else {
+      simtop_usage();
+    }
+  }
+  first_pid = i;
+  if (interval <= 0.0) simtop_usage();
+  screen = isatty(STDOUT_FILENO) && count != 1;
+
+  for (refresh=0; count == 0 || refresh < count; refresh++) {
+    if (refresh > 0) usleep((useconds_t) (interval * 1e6));
+
+    for (i=0; i<number_of_pages; i++) pages[i].seen = 0;
+    if (first_pid < argc) {
+      for (i=first_pid; i<argc; i++)
+	if ((pid = atol(argv[i])) > 0 && (entry = simtop_attach(pid)) != NULL)
+	  entry->seen = 1;
+    } else {
+      simtop_find_pages();
+    }
+
+    /* Let go of the pages that have been removed. */
+    for (i=number_of_pages-1; i>=0; i--)
+      if (!pages[i].seen) simtop_detach(pages + i);
+
+    if (screen) printf("\033[H\033[J");
+    now = simtop_seconds();
+    if (number_of_pages == 0) printf("No simulations are publishing metrics.\n");
+    for (i=0; i<number_of_pages; i++) {
+      if (i > 0) printf("\n");
+      simtop_print_page(pages + i, now);
+    }
+
+    if (clean) {
+      for (i=number_of_pages-1; i>=0; i--) {
+	if (kill((pid_t) pages[i].pid, 0) == 0 || errno != ESRCH) continue;
+	sprintf(name, "%s%ld", METRICS_PREFIX, pages[i].pid);
+	shm_unlink(name);
+	simtop_detach(pages + i);
+      }
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
+
@@ -0,0 +1,256 @@
+/*
+ *
+ * Simlib Simulation Library
+ *
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+/******************************************************************************/
+
+/*
+ * simtrace: decode a binary event trace written with SIMLIB_TRACE set (see
+ * trace.h and simlib.h).
+ *
+ *   simtrace [-c] [-s SCALE] FILE
+ *
+ * By default each record is printed as a line of text. With -c the trace
+ * is exported as Chrome trace event JSON instead, for chrome://tracing or
+ * ui.perfetto.dev: each run is a thread, each event an async slice from
+ * its schedule to its execution (ended as cancelled by a deschedule), with
+ * an instant at its execution, the event list size as a counter, and the
+ * trigger as a global instant. -s sets the microseconds shown per unit of
+ * simulation time (1 by default).
+ */
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+/******************************************************************************/
+
+#define SIMTRACE_MAX_TYPES 256
+#define SIMTRACE_MAX_RUNS 4096
+
+static char * type_names[SIMTRACE_MAX_TYPES + 1];
+static char named_runs[SIMTRACE_MAX_RUNS];
+
+/******************************************************************************/
+
+static const char *
+simtrace_type_name(unsigned type)
+{
+  if (type <= SIMTRACE_MAX_TYPES && type_names[type] != NULL)
+    return type_names[type];
+  return (type == 0) ? "-" : "?";
+}
+
+static const char *
+simtrace_operation_name(unsigned operation)
+{
+  switch (operation) {
+  case TRACE_SCHEDULE: return "schedule";
+  case TRACE_EXECUTE: return "execute";
+  case TRACE_DESCHEDULE: return "deschedule";
+  case TRACE_TRIGGER: return "trigger";
+  default: return "?";
+  }
+}
+
+/*
+ * Print a string as a JSON string.
+ */
+
+static void
+simtrace_json_string(const char * string)
+{
+  putchar('"');
+  for (; *string != '\0'; string++) {
+    if (*string == '"' || *string == '\\') {
+      printf("\\%c", *string);
+    } else if ((unsigned char) *string < ' ') {
+      printf("\\u%04x", (unsigned char) *string);
+    } else {
+      putchar(*string);
+    }
+  }
+  putchar('"');
+}
+
+/******************************************************************************/
+
+static void
+simtrace_print_text(unsigned run, Trace_Record_Ptr record)
+{
+  printf("%4u %-10s %14.6f %-28s %10lld %14.6f %#14llx %6u\n", run,
+	 simtrace_operation_name(record->operation), record->time,
+	 simtrace_type_name(record->event_type),
+	 (long long) record->event_id, record->event_time,
+	 (unsigned long long) record->attachment,
+	 (unsigned) record->list_size);
+}
+
+/*
+ * Print the Chrome trace events of a record, each starting with a comma
+ * but the very first.
+ */
+
+static void
+simtrace_print_chrome(unsigned run, Trace_Record_Ptr record, double scale,
+		      int * first)
+{
+  double ts = record->time * scale;
+
+  if (record->operation == TRACE_TRIGGER) {
+    printf("%s\n{\"name\":\"trigger\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,"
+	   "\"tid\":%u,\"ts\":%.3f}", *first ? "" : ",", run, ts);
+    *first = 0;
+    return;
+  }
+
+  printf("%s\n{\"name\":", *first ? "" : ",");
+  *first = 0;
+  simtrace_json_string(simtrace_type_name(record->event_type));
+  printf(",\"cat\":\"event\",\"id\":\"%u.%lld\",\"pid\":1,\"tid\":%u,"
+	 "\"ts\":%.3f,", run, (long long) record->event_id, run, ts);
+  switch (record->operation) {
+  case TRACE_SCHEDULE:
+    printf("\"ph\":\"b\",\"args\":{\"event_time\":%.6f,\"attachment\":"
+	   "\"%#llx\"}}", record->event_time,
+	   (unsigned long long) record->attachment);
+    break;
+  case TRACE_DESCHEDULE:
+    printf("\"ph\":\"e\",\"args\":{\"cancelled\":true}}");
+    break;
+  default:
+    printf("\"ph\":\"e\"}");
+    printf(",\n{\"name\":");
+    simtrace_json_string(simtrace_type_name(record->event_type));
+    printf(",\"cat\":\"event\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+	   "\"tid\":%u,\"ts\":%.3f,\"args\":{\"id\":%lld}}", run, ts,
+	   (long long) record->event_id);
+    break;
+  }
+  printf(",\n{\"name\":\"event list %u\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,"
+	 "\"ts\":%.3f,\"args\":{\"size\":%u}}", run, run, ts,
+	 (unsigned) record->list_size);
+}
+
+/******************************************************************************/
+
+static void
+simtrace_usage(void)
+{
+  printf("Usage: simtrace [-c] [-s SCALE] FILE\n");
+  exit(1);
+}
+
+int
+main(int argc, char * argv[])
+{
+  FILE * file;
+  Trace_File_Header header;
+  Trace_Chunk_Header chunk;
+  Trace_Record record;
+  uint32_t type;
+  double scale = 1.0;
+  unsigned long i, count;
+  int chrome = 0, first = 1;
+
+  for (i=1; i<(unsigned long) argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-c") == 0) {
+      chrome = 1;
+    } else if (strcmp(argv[i], "-s") == 0 && i+1 < (unsigned long) argc) {
+      scale = atof(argv[++i]);
+    } else {
+      simtrace_usage();
+    }
+  }
+  if (i+1 != (unsigned long) argc || scale <= 0.0) simtrace_usage();
+
+  if ((file = fopen(argv[i], "rb")) == NULL) {
+    printf("Error: Could not open %s.\n", argv[i]);
+    exit(1);
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+    printf("Error: %s is not a simlib trace.\n", argv[i]);
+    exit(1);
+  }
+  if (header.version != TRACE_VERSION ||
+      header.record_size != sizeof(Trace_Record)) {
+    printf("Error: %s is trace version %u, with %u byte records.\n", argv[i],
+	   (unsigned) header.version, (unsigned) header.record_size);
+    exit(1);
+  }
+
+  if (chrome) {
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  } else {
+    printf("%4s %-10s %14s %-28s %10s %14s %14s %6s\n", "run", "operation",
+	   "time", "type", "event", "event time", "attachment", "list");
+  }
+
+  while (fread(&chunk, sizeof(chunk), 1, file) == 1) {
+    if (chunk.kind == TRACE_CHUNK_TYPE && chunk.length >= sizeof(type)) {
+      if (fread(&type, sizeof(type), 1, file) != 1) break;
+      count = chunk.length - sizeof(type);
+      if (type > SIMTRACE_MAX_TYPES) {
+	fseek(file, (long) count, SEEK_CUR);
+	continue;
+      }
+      free(type_names[type]);
+      type_names[type] = (char *) malloc(count + 1);
+      if (fread(type_names[type], 1, count, file) != count) break;
+      type_names[type][count] = '\0';
+
+    } else if (chunk.kind == TRACE_CHUNK_RECORDS) {
+      if (chrome && chunk.run < SIMTRACE_MAX_RUNS && !named_runs[chunk.run]) {
+	named_runs[chunk.run] = 1;
+	printf("%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+	       "\"tid\":%u,\"args\":{\"name\":\"run %u\"}}",
+	       first ? "" : ",", (unsigned) chunk.run, (unsigned) chunk.run);
+	first = 0;
+      }
+      count = chunk.length / sizeof(Trace_Record);
+      for (i=0; i<count; i++) {
+	if (fread(&record, sizeof(record), 1, file) != 1) break;
+	if (chrome) {
+	  simtrace_print_chrome(chunk.run, &record, scale, &first);
+	} else {
+	  simtrace_print_text(chunk.run, &record);
+	}
+      }
+      if (i < count) break;
+
+    } else {
+      fseek(file, (long) chunk.length, SEEK_CUR);
+    }
+  }
+
+  if (chrome) printf("\n]}\n");
+  fclose(file);
+  return 0;
+}
@@ -0,0 +1,107 @@
+
+/*
+ * 
+ * Simlib Simulation Library
+ * 
+ * Copyright (C) 2014 Terence D. Todd
+ * Hamilton, Ontario, CANADA
+ * todd@mcmaster.ca
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**********************************************************************/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/**********************************************************************/
+
+#define DO(x) x
+#define IGNORE(x)
+
+/* Uncomment the next statement to activate trace. */
+/* #define TRACE_ON */
+
+#ifdef TRACE_ON
+#define TRACE DO
+#else
+#define TRACE IGNORE
+#endif
+
+#define TRACEF(a) { printf("%s @ line %u\n", __FILE__, __LINE__); \
+    a;								  \
+    fflush(stdout); }
+
+/**********************************************************************/
+
+/*
+ * The binary event trace of simlib (see simlib.h), as written to the trace
+ * file and read back by tools/simtrace. Text tracing with TRACE_ON prints
+ * at every event, which makes runs far too slow to trace for long; the
+ * binary trace only copies a fixed-size record into memory.
+ *
+ * The file starts with a Trace_File_Header, followed by chunks, each a
+ * Trace_Chunk_Header and its length in bytes. A TRACE_CHUNK_TYPE chunk
+ * names an event type: a 32-bit type id, then the event description
+ * without its '\0'. A TRACE_CHUNK_RECORDS chunk holds Trace_Records of one
+ * run, in the order they were made. A type is named before any record of
+ * it. Numbers are in the byte order of the machine that wrote the file.
+ */
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "SIMTRACE"
+#define TRACE_VERSION 1
+
+typedef enum {TRACE_CHUNK_TYPE = 1, TRACE_CHUNK_RECORDS = 2} Trace_Chunk_Kind;
+
+typedef enum {TRACE_SCHEDULE = 1, TRACE_EXECUTE, TRACE_DESCHEDULE,
+	      TRACE_TRIGGER} Trace_Operation;
+
+typedef struct _trace_file_header_
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+} Trace_File_Header;
+
+typedef struct _trace_chunk_header_
+{
+  uint32_t kind;
+  uint32_t run;           /* of the records: the number of the run in the
+			     process, from 1 */
+  uint32_t length;        /* bytes that follow */
+  uint32_t reserved;
+} Trace_Chunk_Header;
+
+typedef struct _trace_record_
+{
+  double time;            /* simulation time of the operation */
+  double event_time;      /* when the event occurs */
+  int64_t event_id;       /* as given by simulation_run_schedule_event */
+  uint64_t attachment;    /* the attachment pointer, as an id */
+  uint32_t event_type;    /* named by a TRACE_CHUNK_TYPE chunk */
+  uint32_t list_size;     /* of the event list after the operation */
+  uint32_t operation;     /* a Trace_Operation */
+  uint32_t reserved;
+} Trace_Record, * Trace_Record_Ptr;
+
+/**********************************************************************/
+
+#endif /* trace.h */
+
+